@@ -0,0 +1,118 @@
+// Register allocation microbenchmark: times both allocators on a synthetic
+// function of about 100k machine instructions.
+//
+//   yac_ra_bench [statements] [runs] [linear|color]
+
+#include "yac/Basic/Diagnostic.h"
+#include "yac/CodeGen/GraphColoringAllocator.h"
+#include "yac/CodeGen/IRBuilder.h"
+#include "yac/CodeGen/IRUtils.h"
+#include "yac/CodeGen/Pass.h"
+#include "yac/CodeGen/RegisterAllocator.h"
+#include "yac/CodeGen/Transforms.h"
+#include "yac/CodeGen/X86ISel.h"
+#include "yac/Parse/Lexer.h"
+#include "yac/Parse/Parser.h"
+#include "yac/Sema/Sema.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+using namespace yac;
+
+namespace {
+
+/// A function of straight-line arithmetic over NumVars locals, broken into
+/// loops and branches every few statements
+std::string generateSource(unsigned NumStmts, unsigned NumVars,
+                           unsigned Seed) {
+  std::mt19937 Rng(Seed);
+  auto var = [&]() { return "v" + std::to_string(Rng() % NumVars); };
+  const char* Ops[] = {"+", "-", "*", "^", "&", "|"};
+
+  std::ostringstream OS;
+  OS << "int f(int n, int z) {\n";
+  for (unsigned i = 0; i < NumVars; ++i)
+    OS << "  int v" << i << " = z * " << i + 1 << " + " << i << ";\n";
+  for (unsigned i = 0; i < NumStmts; ++i) {
+    if (i % 64 == 0) {
+      if (i) OS << "  }\n";
+      OS << "  for (int i" << i << " = 0; i" << i << " < n; i" << i
+         << " = i" << i << " + 1) {\n";
+    }
+    if (i % 16 == 8) OS << "    if (" << var() << " < " << var() << ")";
+    OS << "    " << var() << " = " << var() << " " << Ops[Rng() % 6] << " "
+       << var() << " " << Ops[Rng() % 3] << " " << Rng() % 100 << ";\n";
+  }
+  OS << "  }\n  return v0";
+  for (unsigned i = 1; i < NumVars; ++i) OS << " + v" << i;
+  OS << ";\n}\n";
+  return OS.str();
+}
+
+size_t countInstrs(const MachineFunction& MF) {
+  size_t N = 0;
+  for (const auto& MBB : MF.getBlocks()) N += MBB->size();
+  return N;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  unsigned NumStmts = argc > 1 ? std::atoi(argv[1]) : 25000;
+  unsigned Runs = argc > 2 ? std::atoi(argv[2]) : 5;
+  std::string Only = argc > 3 ? argv[3] : "";
+
+  DiagnosticEngine Diag;
+  TypeContext TyCtx;
+  std::string Source = generateSource(NumStmts, 24, 1);
+  Lexer Lex(Source, "bench.c", Diag);
+  Parser P(Lex.tokenize(), Diag, TyCtx);
+  auto TU = P.parseTranslationUnit();
+  Sema S(Diag, TyCtx);
+  S.analyze(TU.get());
+  if (Diag.hasErrors()) {
+    Diag.printAll(std::cerr);
+    return 1;
+  }
+  IRBuilder Builder(TyCtx);
+  auto M = Builder.generateIR(TU.get());
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<SimplifyCFGPass>());
+  PM.run(M.get());
+  IRFunction* F = M->getFunctions().back().get();
+  splitCriticalEdges(F);
+
+  // Selection runs again for each allocation, which rewrites the function
+  auto time = [&](auto Allocate) {
+    std::vector<double> Times;
+    size_t Instrs = 0;
+    for (unsigned i = 0; i < Runs; ++i) {
+      X86InstrSelector ISel;
+      auto MF = ISel.select(F);
+      Instrs = countInstrs(*MF);
+      auto Start = std::chrono::steady_clock::now();
+      Allocate(*MF);
+      std::chrono::duration<double, std::milli> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+      Times.push_back(Elapsed.count());
+    }
+    std::sort(Times.begin(), Times.end());
+    std::cout << "  " << Instrs << " instructions, median " << Times[Runs / 2]
+              << " ms, best " << Times.front() << " ms\n";
+  };
+
+  if (Only.empty() || Only == "linear") {
+    std::cout << "Linear scan:\n";
+    time([](MachineFunction& MF) { RegisterAllocator().allocate(MF); });
+  }
+  if (Only.empty() || Only == "color") {
+    std::cout << "Graph coloring:\n";
+    time([](MachineFunction& MF) { GraphColoringAllocator().allocate(MF); });
+  }
+  return 0;
+}
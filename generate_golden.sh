@@ -17,6 +17,7 @@ test_files=(
     "two_vars.c"
     "simple_loop.c"
     "loop_test.c"
+    "switch.c"
 )
 
 # Optimization levels
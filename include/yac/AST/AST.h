@@ -52,6 +52,9 @@ public:
     NK_DoStmt,
     NK_BreakStmt,
     NK_ContinueStmt,
+    NK_SwitchStmt,
+    NK_CaseStmt,
+    NK_DefaultStmt,
     // Declarations
     NK_VarDecl,
     NK_ParmVarDecl,
@@ -302,7 +305,7 @@ protected:
 public:
   static bool classof(const ASTNode* N) {
     return N->getKind() >= NK_CompoundStmt &&
-           N->getKind() <= NK_ContinueStmt;
+           N->getKind() <= NK_DefaultStmt;
   }
 };
 
@@ -470,6 +473,64 @@ public:
   }
 };
 
+class SwitchStmt : public Stmt {
+  std::unique_ptr<Expr> Condition;
+  std::unique_ptr<Stmt> Body;
+
+public:
+  SwitchStmt(SourceRange Loc, std::unique_ptr<Expr> Cond,
+             std::unique_ptr<Stmt> Body)
+      : Stmt(Loc), Condition(std::move(Cond)), Body(std::move(Body)) {}
+
+  Expr* getCondition() const { return Condition.get(); }
+  Stmt* getBody() const { return Body.get(); }
+
+  NodeKind getKind() const override { return NK_SwitchStmt; }
+  static bool classof(const ASTNode* N) {
+    return N->getKind() == NK_SwitchStmt;
+  }
+};
+
+/// CaseStmt - 'case' label inside a switch body. The value is folded by
+/// Sema since the label must be an integer constant expression.
+class CaseStmt : public Stmt {
+  std::unique_ptr<Expr> ValueExpr;
+  std::unique_ptr<Stmt> SubStmt;
+  int64_t Value = 0;
+
+public:
+  CaseStmt(SourceRange Loc, std::unique_ptr<Expr> ValueExpr,
+           std::unique_ptr<Stmt> SubStmt)
+      : Stmt(Loc), ValueExpr(std::move(ValueExpr)),
+        SubStmt(std::move(SubStmt)) {}
+
+  Expr* getValueExpr() const { return ValueExpr.get(); }
+  Stmt* getSubStmt() const { return SubStmt.get(); }
+
+  int64_t getValue() const { return Value; }
+  void setValue(int64_t V) { Value = V; }
+
+  NodeKind getKind() const override { return NK_CaseStmt; }
+  static bool classof(const ASTNode* N) {
+    return N->getKind() == NK_CaseStmt;
+  }
+};
+
+class DefaultStmt : public Stmt {
+  std::unique_ptr<Stmt> SubStmt;
+
+public:
+  DefaultStmt(SourceRange Loc, std::unique_ptr<Stmt> SubStmt)
+      : Stmt(Loc), SubStmt(std::move(SubStmt)) {}
+
+  Stmt* getSubStmt() const { return SubStmt.get(); }
+
+  NodeKind getKind() const override { return NK_DefaultStmt; }
+  static bool classof(const ASTNode* N) {
+    return N->getKind() == NK_DefaultStmt;
+  }
+};
+
 // ===----------------------------------------------------------------------===
 // Declarations
 // ===----------------------------------------------------------------------===
@@ -491,6 +552,8 @@ class VarDecl : public Decl {
   std::unique_ptr<Expr> Init;
   bool IsArray = false;
   int ArraySize = 0;
+  bool IsStatic = false;
+  int64_t InitValue = 0;  // Folded initializer of a global, set by Sema
 
 public:
   VarDecl(SourceRange Loc, std::string Name, Type* DeclType,
@@ -512,6 +575,13 @@ public:
   bool isArray() const { return IsArray; }
   int getArraySize() const { return ArraySize; }
 
+  // 'static' at file scope gives the variable internal linkage
+  bool isStatic() const { return IsStatic; }
+  void setStatic(bool S) { IsStatic = S; }
+
+  int64_t getInitValue() const { return InitValue; }
+  void setInitValue(int64_t V) { InitValue = V; }
+
   NodeKind getKind() const override { return NK_VarDecl; }
   static bool classof(const ASTNode* N) {
     return N->getKind() == NK_VarDecl || N->getKind() == NK_ParmVarDecl;
@@ -535,6 +605,7 @@ class FunctionDecl : public Decl {
   std::vector<ParmVarDecl*> Params;
   std::unique_ptr<CompoundStmt> Body;
   bool IsDefined = false;
+  bool IsStatic = false;
 
 public:
   FunctionDecl(SourceRange Loc, std::string Name, Type* ReturnType,
@@ -556,6 +627,10 @@ public:
   bool hasBody() const { return Body != nullptr; }
   bool isDefined() const { return IsDefined; }
 
+  // 'static' gives the function internal linkage
+  bool isStatic() const { return IsStatic; }
+  void setStatic(bool S) { IsStatic = S; }
+
   void setBody(std::unique_ptr<CompoundStmt> B) {
     Body = std::move(B);
     IsDefined = true;
@@ -33,6 +33,9 @@ public:
   virtual void visitDoStmt(DoStmt* S) {}
   virtual void visitBreakStmt(BreakStmt* S) {}
   virtual void visitContinueStmt(ContinueStmt* S) {}
+  virtual void visitSwitchStmt(SwitchStmt* S) {}
+  virtual void visitCaseStmt(CaseStmt* S) {}
+  virtual void visitDefaultStmt(DefaultStmt* S) {}
 
   // Visit declarations
   virtual void visitVarDecl(VarDecl* D) {}
@@ -82,6 +85,9 @@ public:
   void visitDoStmt(DoStmt* S) override;
   void visitBreakStmt(BreakStmt* S) override;
   void visitContinueStmt(ContinueStmt* S) override;
+  void visitSwitchStmt(SwitchStmt* S) override;
+  void visitCaseStmt(CaseStmt* S) override;
+  void visitDefaultStmt(DefaultStmt* S) override;
 
   // Declarations
   void visitVarDecl(VarDecl* D) override;
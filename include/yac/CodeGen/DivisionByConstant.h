@@ -0,0 +1,29 @@
+#ifndef YAC_CODEGEN_DIVISIONBYCONSTANT_H
+#define YAC_CODEGEN_DIVISIONBYCONSTANT_H
+
+#include <cstdint>
+
+namespace yac {
+
+/// SignedDivMagic - multiplier and shift that replace signed division by a
+/// constant (Hacker's Delight, chapter 10):
+///   q = mulhs(X, Multiplier)
+///   q += X   if D > 0 and Multiplier < 0
+///   q -= X   if D < 0 and Multiplier > 0
+///   q >>= Shift (arithmetic)
+///   q += 1   if q < 0
+struct SignedDivMagic {
+  int64_t Multiplier;
+  unsigned Shift;
+};
+
+/// Compute the magic numbers for dividing by D. D must not be -1, 0 or 1.
+SignedDivMagic computeSignedDivMagic(int64_t D);
+
+/// Check if |D| is a power of two greater than one and return its log2.
+/// Handles INT64_MIN, whose magnitude is 2^63.
+bool isPowerOf2Divisor(int64_t D, unsigned& Log2);
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_DIVISIONBYCONSTANT_H
@@ -0,0 +1,107 @@
+#ifndef YAC_CODEGEN_GRAPHCOLORINGALLOCATOR_H
+#define YAC_CODEGEN_GRAPHCOLORINGALLOCATOR_H
+
+#include "yac/CodeGen/MachineIR.h"
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace yac {
+
+/// Graph coloring register allocator over machine IR: iterated register
+/// coalescing after George and Appel. Interference comes from the block
+/// liveness shared with the linear scan allocator; copies are coalesced
+/// conservatively (Briggs between virtual registers, George against
+/// physical ones) as nodes are simplified, colors are assigned
+/// optimistically, and the nodes left uncolored are spilled, cheapest
+/// first by loop-weighted uses per neighbour, before starting over. On
+/// return the function refers to physical registers only and parallel
+/// copies have been expanded.
+class GraphColoringAllocator {
+public:
+  GraphColoringAllocator() {
+    // Same pool and preference order as the linear scan allocator
+    AvailableRegs = {
+      X86::R8, X86::R9, X86::RAX, X86::RCX, X86::RDI, X86::RDX, X86::RSI,
+      X86::RBX, X86::R12, X86::R13, X86::R14, X86::R15
+    };
+  }
+
+  /// Allocate registers for a function
+  void allocate(MachineFunction& MF);
+
+  /// Number of virtual registers given a stack slot
+  unsigned getNumSpilled() const { return NumSpilled; }
+  /// Number of copies removed by coalescing
+  unsigned getNumCoalesced() const { return NumCoalesced; }
+
+private:
+  /// Move - a copy between two graph nodes, a candidate for coalescing
+  struct Move {
+    unsigned Dst;
+    unsigned Src;
+  };
+
+  std::vector<unsigned> AvailableRegs;
+  std::set<unsigned> Precolored;              // Allocatable physregs
+  std::map<unsigned, int> VRegToStackSlot;    // Spilled virtual registers
+  std::set<unsigned> NoSpill;                 // Reload and store temporaries
+  unsigned NumSpilled = 0;
+  unsigned NumCoalesced = 0;
+
+  // Interference graph
+  std::set<std::pair<unsigned, unsigned>> AdjSet;
+  std::map<unsigned, std::vector<unsigned>> AdjList;
+  std::map<unsigned, unsigned> Degree;
+  std::map<unsigned, double> SpillCost;
+  std::vector<Move> Moves;
+  std::map<unsigned, std::vector<unsigned>> MoveList;  // Moves per node
+  std::map<unsigned, unsigned> Alias;
+  std::map<unsigned, unsigned> Color;
+
+  // Node worklists and sets
+  std::set<unsigned> Initial, SimplifyWorklist, FreezeWorklist,
+                     SpillWorklist, SpilledNodes, CoalescedNodes,
+                     ColoredNodes, OnStack;
+  std::vector<unsigned> SelectStack;
+
+  // Move sets
+  std::set<unsigned> CoalescedMoves, ConstrainedMoves, FrozenMoves,
+                     WorklistMoves, ActiveMoves;
+
+  void reset();
+  bool isNode(unsigned Reg) const;
+  bool isPrecolored(unsigned Reg) const { return Precolored.count(Reg); }
+
+  // Graph construction
+  void build(const MachineFunction& MF);
+  void addEdge(unsigned U, unsigned V);
+  void makeWorklist();
+
+  // Simplification, coalescing and freezing
+  std::vector<unsigned> adjacent(unsigned N) const;
+  std::vector<unsigned> nodeMoves(unsigned N) const;
+  bool isMoveRelated(unsigned N) const { return !nodeMoves(N).empty(); }
+  void simplify();
+  void decrementDegree(unsigned M);
+  void enableMoves(const std::vector<unsigned>& Nodes);
+  void coalesce();
+  void addWorklist(unsigned U);
+  bool isOK(unsigned T, unsigned R) const;
+  bool isConservative(const std::vector<unsigned>& Nodes) const;
+  unsigned getAlias(unsigned N) const;
+  void combine(unsigned U, unsigned V);
+  void freeze();
+  void freezeMoves(unsigned U);
+  void selectSpill();
+
+  // Coloring and rewriting
+  void assignColors();
+  void rewriteProgram(MachineFunction& MF);
+  void rewriteVirtualRegisters(MachineFunction& MF);
+};
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_GRAPHCOLORINGALLOCATOR_H
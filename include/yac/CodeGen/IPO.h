@@ -0,0 +1,176 @@
+#ifndef YAC_CODEGEN_IPO_H
+#define YAC_CODEGEN_IPO_H
+
+#include "yac/CodeGen/IR.h"
+#include "yac/CodeGen/Pass.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace yac {
+
+/// CallGraph - direct call edges between the functions of a module
+/// Calls name their callee, so only callees defined in the module get a
+/// node; calls to anything else are external.
+class CallGraph {
+public:
+  explicit CallGraph(IRModule* M);
+
+  /// Defined function with the given name, or nullptr if it is external
+  IRFunction* getFunction(const std::string& Name) const;
+
+  /// Calls to F from anywhere in the module
+  const std::vector<IRCallInst*>& getCallSites(IRFunction* F) const;
+
+  /// Defined functions called from F
+  const std::set<IRFunction*>& getCallees(IRFunction* F) const;
+
+  /// Callee of a call site, or nullptr if it is external
+  IRFunction* getCallee(IRCallInst* Call) const {
+    return getFunction(Call->getFuncName());
+  }
+
+private:
+  std::map<std::string, IRFunction*> Functions;
+  std::map<IRFunction*, std::vector<IRCallInst*>> CallSites;
+  std::map<IRFunction*, std::set<IRFunction*>> Callees;
+};
+
+/// IPSCCP - Interprocedural Sparse Conditional Constant Propagation
+/// Runs SCCP over the whole module at once:
+/// - Arguments flow into the parameters of 'static' functions, whose call
+///   sites are all known, so a constant passed everywhere becomes a constant
+/// - Return values flow back to every call site
+/// - Blocks only reached through a constant branch are never visited
+class IPSCCPPass : public ModulePass {
+public:
+  std::string getName() const override { return "IPSCCP"; }
+  bool run(IRModule* M) override;
+
+private:
+  enum LatticeValue {
+    Undefined,    // Not yet computed
+    Constant,     // Known constant value
+    Overdefined   // Not constant (multiple values or unknown)
+  };
+
+  struct LatticeCell {
+    LatticeValue State = Undefined;
+    int64_t ConstVal = 0;
+  };
+
+  const CallGraph* CG = nullptr;
+
+  // Functions whose parameters are fed only by calls we can see
+  std::set<IRFunction*> TrackedFunctions;
+
+  // Lattice values for SSA values and for what each function returns
+  std::map<IRValue*, LatticeCell> ValueState;
+  std::map<IRFunction*, LatticeCell> ReturnState;
+
+  // Instructions reading each value, across the module
+  std::map<IRValue*, std::vector<IRInstruction*>> Users;
+
+  std::set<std::pair<IRBasicBlock*, IRBasicBlock*>> ExecutableEdges;
+  std::set<IRBasicBlock*> ExecutableBlocks;
+  std::vector<IRInstruction*> WorkList;
+
+  // Lattice operations
+  static LatticeCell meet(const LatticeCell& A, const LatticeCell& B);
+  LatticeCell getCell(IRValue* V);
+  void mergeInValue(IRValue* V, const LatticeCell& Cell);
+  void mergeInReturn(IRFunction* F, const LatticeCell& Cell);
+
+  // Worklist management
+  void markEdgeExecutable(IRBasicBlock* From, IRBasicBlock* To);
+  void markBlockExecutable(IRBasicBlock* BB);
+  void visitInst(IRInstruction* I);
+  void visitPhi(IRPhiInst* Phi);
+  void visitCall(IRCallInst* Call);
+  void visitTerminator(IRInstruction* I);
+
+  // Rewriting
+  bool rewriteFunction(IRFunction* F);
+};
+
+/// FunctionSpecialization - Clone functions for constant arguments
+/// IPSCCP gives up on a parameter as soon as two call sites disagree. When
+/// some call sites pass literals to parameters that steer branches, this
+/// pass clones the callee for each such argument tuple, folds the clone
+/// and redirects the matching calls to it:
+/// - Tuples are ranked by call sites, weighted 8x per enclosing loop;
+///   tuples weighing less than MinWeight are too cold to clone for
+/// - A clone is kept only if folding made it smaller than the original
+/// - At most MaxClones per function and SizeBudget cloned instructions
+///   in total; functions over MaxFunctionSize are never cloned
+/// Clones get internal linkage, as only this module calls them.
+class FunctionSpecializationPass : public ModulePass {
+public:
+  FunctionSpecializationPass(unsigned MaxClones = 3, size_t SizeBudget = 400,
+                             size_t MaxFunctionSize = 100,
+                             unsigned MinWeight = 8)
+      : MaxClones(MaxClones), SizeBudget(SizeBudget),
+        MaxFunctionSize(MaxFunctionSize), MinWeight(MinWeight) {}
+
+  std::string getName() const override { return "FuncSpec"; }
+  bool run(IRModule* M) override;
+
+private:
+  unsigned MaxClones;
+  size_t SizeBudget;
+  size_t MaxFunctionSize;
+  unsigned MinWeight;  // One call in a loop, or eight outside any loop
+
+  // Constant arguments by parameter index, and the calls passing them
+  struct Candidate {
+    IRFunction* Callee;
+    std::map<size_t, int64_t> Args;
+    std::vector<IRCallInst*> Calls;
+    unsigned Weight = 0;
+  };
+
+  // Parameters whose value decides a branch or switch in F
+  std::set<size_t> findBranchParams(IRFunction* F);
+
+  std::vector<Candidate> collectCandidates(IRModule* M, const CallGraph& CG);
+
+  // Clone and fold; returns nullptr if the clone was not worth keeping
+  IRFunction* specialize(IRModule* M, const Candidate& C,
+                         const std::string& Name);
+};
+
+/// FunctionAttrs - Infer what functions may do to memory and control flow
+/// Visits the call graph bottom-up, one strongly connected component at a
+/// time, so callees are done before their callers and recursion is
+/// resolved optimistically. Loads and stores of a function's own allocas
+/// are invisible to callers; globals and calls to unknown functions are
+/// not. The results are copied onto every call site, where DCE, GVN and
+/// LICM read them.
+class FunctionAttrsPass : public ModulePass {
+public:
+  std::string getName() const override { return "FunctionAttrs"; }
+  bool run(IRModule* M) override;
+
+private:
+  // Components of the call graph, callees before callers
+  std::vector<std::vector<IRFunction*>> computeSCCs(IRModule* M,
+                                                    const CallGraph& CG);
+
+  // Attributes shared by every function in one component
+  unsigned inferSCC(const std::vector<IRFunction*>& SCC, const CallGraph& CG);
+};
+
+/// GlobalDCE - Remove unreferenced internal functions and globals
+/// External symbols may be used by other files and are always kept. From
+/// them, calls and global addresses mark what is live; any 'static'
+/// function or global left unmarked is deleted.
+class GlobalDCEPass : public ModulePass {
+public:
+  std::string getName() const override { return "GlobalDCE"; }
+  bool run(IRModule* M) override;
+};
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_IPO_H
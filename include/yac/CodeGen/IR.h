@@ -53,6 +53,39 @@ public:
   std::string toString() const;
 };
 
+/// Linkage - whether a symbol is visible to other translation units
+enum class Linkage {
+  External,  // Exported with .globl
+  Internal   // 'static': only this module can refer to it
+};
+
+/// FunctionAttr - what a function is known not to do, inferred bottom-up
+/// over the call graph by FunctionAttrs and copied onto each call site
+enum FunctionAttr : unsigned {
+  FA_ReadNone = 1u << 0,      // Touches no memory outside its own frame
+  FA_ReadOnly = 1u << 1,      // May read globals, never writes them
+  FA_NoUnwind = 1u << 2,      // Never leaves other than by returning
+  FA_WillReturn = 1u << 3,    // Always returns: no loops, no recursion
+  FA_Speculatable = 1u << 4   // Also cannot trap, so may run unconditionally
+};
+
+/// Render attributes as " readnone nounwind ..." for IR dumps
+std::string getFunctionAttrString(unsigned Attrs);
+
+/// IRGlobalVariable - module-level variable, used as a load/store address
+class IRGlobalVariable : public IRValue {
+  int64_t Initializer;
+  Linkage Link;
+
+public:
+  IRGlobalVariable(std::string Name, Type* Ty, int64_t Init, Linkage L)
+      : IRValue(VK_Global, std::move(Name), Ty), Initializer(Init), Link(L) {}
+
+  int64_t getInitializer() const { return Initializer; }
+  Linkage getLinkage() const { return Link; }
+  bool isInternal() const { return Link == Linkage::Internal; }
+};
+
 /// IRInstruction - base class for IR instructions
 class IRInstruction {
 public:
@@ -66,11 +99,11 @@ public:
     // Memory
     Load, Store, Alloca,
     // Control flow
-    Br, CondBr, Ret, Call,
+    Br, CondBr, Switch, Ret, Call,
     // Type conversions
     IntToFloat, FloatToInt,
     // Other
-    Move, Label, Phi
+    Move, Select, Label, Phi
   };
 
 private:
@@ -90,7 +123,7 @@ public:
 
   // Terminator queries
   bool isTerminator() const {
-    return Op == Br || Op == CondBr || Op == Ret;
+    return Op == Br || Op == CondBr || Op == Switch || Op == Ret;
   }
 
   static const char* getOpcodeName(Opcode Op);
@@ -146,6 +179,8 @@ public:
   IRValue* getResult() const { return Result; }
   IRValue* getPtr() const { return Ptr; }
 
+  void setPtr(IRValue* P) { Ptr = P; }
+
   std::string toString() const override;
 };
 
@@ -210,6 +245,8 @@ public:
 
   IRValue* getTarget() const { return Target; }
 
+  void setTarget(IRValue* T) { Target = T; }
+
   std::string toString() const override;
 };
 
@@ -228,8 +265,45 @@ public:
   IRValue* getTrueLabel() const { return TrueLabel; }
   IRValue* getFalseLabel() const { return FalseLabel; }
 
-  // Setter for operand replacement
+  // Setters for operand replacement
+  void setCondition(IRValue* C) { Condition = C; }
+  void setTrueLabel(IRValue* L) { TrueLabel = L; }
+  void setFalseLabel(IRValue* L) { FalseLabel = L; }
+
+  std::string toString() const override;
+};
+
+/// Switch: switch cond, label_default [val1, label1], [val2, label2], ...
+class IRSwitchInst : public IRInstruction {
+public:
+  struct CaseEntry {
+    int64_t Value;
+    IRValue* Label;
+  };
+
+private:
+  IRValue* Condition;
+  IRValue* DefaultLabel;
+  std::vector<CaseEntry> Cases;
+
+public:
+  IRSwitchInst(IRValue* Cond, IRValue* DefaultLabel)
+      : IRInstruction(Switch), Condition(Cond), DefaultLabel(DefaultLabel) {}
+
+  IRValue* getCondition() const { return Condition; }
+  IRValue* getDefaultLabel() const { return DefaultLabel; }
+
+  void addCase(int64_t Value, IRValue* Label) {
+    Cases.push_back({Value, Label});
+  }
+
+  const std::vector<CaseEntry>& getCases() const { return Cases; }
+  size_t getNumCases() const { return Cases.size(); }
+
+  // Setters for operand replacement
   void setCondition(IRValue* C) { Condition = C; }
+  void setDefaultLabel(IRValue* L) { DefaultLabel = L; }
+  void setCaseLabel(size_t Idx, IRValue* L) { Cases[Idx].Label = L; }
 
   std::string toString() const override;
 };
@@ -239,6 +313,7 @@ class IRCallInst : public IRInstruction {
   IRValue* Result;  // nullptr for void functions
   std::string FuncName;
   std::vector<IRValue*> Args;
+  unsigned Attrs = 0;
 
 public:
   IRCallInst(IRValue* Result, std::string FuncName, std::vector<IRValue*> Args)
@@ -249,6 +324,23 @@ public:
   const std::string& getFuncName() const { return FuncName; }
   const std::vector<IRValue*>& getArgs() const { return Args; }
 
+  void setArg(size_t Idx, IRValue* V) { Args[Idx] = V; }
+  void setFuncName(std::string Name) { FuncName = std::move(Name); }
+
+  // Attributes of the callee (see FunctionAttr)
+  unsigned getAttrs() const { return Attrs; }
+  void setAttrs(unsigned A) { Attrs = A; }
+  bool hasAttr(FunctionAttr A) const { return (Attrs & A) != 0; }
+
+  bool onlyReadsMemory() const {
+    return hasAttr(FA_ReadNone) || hasAttr(FA_ReadOnly);
+  }
+
+  /// Deleting the call is safe when its result is unused
+  bool isRemovable() const {
+    return onlyReadsMemory() && hasAttr(FA_NoUnwind) && hasAttr(FA_WillReturn);
+  }
+
   std::string toString() const override;
 };
 
@@ -277,6 +369,35 @@ public:
   IRValue* getResult() const { return Result; }
   IRValue* getOperand() const { return Operand; }
 
+  void setOperand(IRValue* V) { Operand = V; }
+
+  std::string toString() const override;
+};
+
+/// Select: result = select cond, true_val, false_val
+/// Picks one of two values without branching; both are always evaluated.
+class IRSelectInst : public IRInstruction {
+  IRValue* Result;
+  IRValue* Condition;
+  IRValue* TrueValue;
+  IRValue* FalseValue;
+
+public:
+  IRSelectInst(IRValue* Result, IRValue* Cond, IRValue* TrueVal,
+               IRValue* FalseVal)
+      : IRInstruction(Select), Result(Result), Condition(Cond),
+        TrueValue(TrueVal), FalseValue(FalseVal) {}
+
+  IRValue* getResult() const { return Result; }
+  IRValue* getCondition() const { return Condition; }
+  IRValue* getTrueValue() const { return TrueValue; }
+  IRValue* getFalseValue() const { return FalseValue; }
+
+  // Setters for operand replacement
+  void setCondition(IRValue* C) { Condition = C; }
+  void setTrueValue(IRValue* V) { TrueValue = V; }
+  void setFalseValue(IRValue* V) { FalseValue = V; }
+
   std::string toString() const override;
 };
 
@@ -310,6 +431,34 @@ public:
     }
   }
 
+  /// Redirect the entry coming from Old so it comes from New instead
+  void replaceIncomingBlock(IRBasicBlock* Old, IRBasicBlock* New) {
+    for (auto& Entry : Incomings) {
+      if (Entry.Block == Old) {
+        Entry.Block = New;
+      }
+    }
+  }
+
+  /// Drop the entry for a predecessor that no longer branches here
+  void removeIncomingBlock(IRBasicBlock* BB) {
+    Incomings.erase(std::remove_if(Incomings.begin(), Incomings.end(),
+                                   [BB](const PhiEntry& E) {
+                                     return E.Block == BB;
+                                   }),
+                    Incomings.end());
+  }
+
+  /// Value flowing in from BB, or nullptr if BB is not an incoming block
+  IRValue* getIncomingValueForBlock(IRBasicBlock* BB) const {
+    for (const auto& Entry : Incomings) {
+      if (Entry.Block == BB) {
+        return Entry.Value;
+      }
+    }
+    return nullptr;
+  }
+
   const std::vector<PhiEntry>& getIncomings() const { return Incomings; }
   size_t getNumIncomings() const { return Incomings.size(); }
 
@@ -370,6 +519,18 @@ public:
     }
   }
 
+  /// Insert instruction immediately before Pos
+  void insertBefore(std::unique_ptr<IRInstruction> Inst, IRInstruction* Pos) {
+    Inst->setParent(this);
+    for (auto It = Instructions.begin(); It != Instructions.end(); ++It) {
+      if (It->get() == Pos) {
+        Instructions.insert(It, std::move(Inst));
+        return;
+      }
+    }
+    Instructions.push_back(std::move(Inst));
+  }
+
   IRInstruction* getTerminator() const {
     if (Instructions.empty()) return nullptr;
     IRInstruction* Last = Instructions.back().get();
@@ -411,6 +572,8 @@ public:
 class IRFunction {
   std::string Name;
   Type* ReturnType;
+  Linkage Link = Linkage::External;
+  unsigned Attrs = 0;  // FunctionAttr bits
   std::vector<IRValue*> Parameters;
   std::vector<std::unique_ptr<IRBasicBlock>> Blocks;
   std::vector<std::unique_ptr<IRValue>> Values;  // Owned values
@@ -422,6 +585,14 @@ public:
   const std::string& getName() const { return Name; }
   Type* getReturnType() const { return ReturnType; }
 
+  Linkage getLinkage() const { return Link; }
+  void setLinkage(Linkage L) { Link = L; }
+  bool isInternal() const { return Link == Linkage::Internal; }
+
+  unsigned getAttrs() const { return Attrs; }
+  void setAttrs(unsigned A) { Attrs = A; }
+  bool hasAttr(FunctionAttr A) const { return (Attrs & A) != 0; }
+
   void addParameter(IRValue* Param) { Parameters.push_back(Param); }
   const std::vector<IRValue*>& getParameters() const { return Parameters; }
 
@@ -437,6 +608,16 @@ public:
     return Blocks;
   }
 
+  /// Delete a block. Callers must detach its CFG edges first.
+  void removeBlock(IRBasicBlock* BB) {
+    for (auto It = Blocks.begin(); It != Blocks.end(); ++It) {
+      if (It->get() == BB) {
+        Blocks.erase(It);
+        return;
+      }
+    }
+  }
+
   IRValue* createValue(IRValue::ValueKind K, const std::string& Name, Type* Ty) {
     auto Val = std::make_unique<IRValue>(K, Name, Ty);
     IRValue* Ptr = Val.get();
@@ -457,7 +638,7 @@ public:
 /// IRModule - collection of functions
 class IRModule {
   std::vector<std::unique_ptr<IRFunction>> Functions;
-  std::vector<std::unique_ptr<IRValue>> GlobalValues;
+  std::vector<std::unique_ptr<IRGlobalVariable>> GlobalValues;
 
 public:
   IRFunction* createFunction(const std::string& Name, Type* RetType) {
@@ -467,17 +648,43 @@ public:
     return Ptr;
   }
 
-  IRValue* createGlobal(const std::string& Name, Type* Ty) {
-    auto Val = std::make_unique<IRValue>(IRValue::VK_Global, Name, Ty);
-    IRValue* Ptr = Val.get();
+  IRGlobalVariable* createGlobal(const std::string& Name, Type* Ty,
+                                 int64_t Init = 0,
+                                 Linkage L = Linkage::External) {
+    auto Val = std::make_unique<IRGlobalVariable>(Name, Ty, Init, L);
+    IRGlobalVariable* Ptr = Val.get();
     GlobalValues.push_back(std::move(Val));
     return Ptr;
   }
 
+  const std::vector<std::unique_ptr<IRGlobalVariable>>& getGlobals() const {
+    return GlobalValues;
+  }
+
+  /// Delete a global. Callers must make sure nothing loads or stores it.
+  void removeGlobal(IRGlobalVariable* G) {
+    for (auto It = GlobalValues.begin(); It != GlobalValues.end(); ++It) {
+      if (It->get() == G) {
+        GlobalValues.erase(It);
+        return;
+      }
+    }
+  }
+
   const std::vector<std::unique_ptr<IRFunction>>& getFunctions() const {
     return Functions;
   }
 
+  /// Delete a function. Callers must make sure nothing calls it.
+  void removeFunction(IRFunction* F) {
+    for (auto It = Functions.begin(); It != Functions.end(); ++It) {
+      if (It->get() == F) {
+        Functions.erase(It);
+        return;
+      }
+    }
+  }
+
   void print() const;
 };
 
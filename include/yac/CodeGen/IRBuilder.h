@@ -7,6 +7,7 @@
 #include "yac/Type/Type.h"
 #include <map>
 #include <memory>
+#include <vector>
 
 namespace yac {
 
@@ -26,9 +27,23 @@ class IRBuilder : public ASTVisitor {
   // Symbol table: maps variables to their stack slots (alloca)
   std::map<VarDecl*, IRValue*> LocalVars;
 
+  // File-scope variables, live across functions
+  std::map<VarDecl*, IRGlobalVariable*> GlobalVars;
+
   // Last computed expression value
   IRValue* LastExprValue = nullptr;
 
+  // Branch targets for break/continue, innermost last
+  struct JumpTarget {
+    IRValue* Label;
+    IRBasicBlock* Block;
+  };
+  std::vector<JumpTarget> BreakTargets;
+  std::vector<JumpTarget> ContinueTargets;
+
+  // Innermost switch being lowered; case labels add themselves to it
+  IRSwitchInst* CurrentSwitch = nullptr;
+
 public:
   IRBuilder(TypeContext& TyCtx) : TyCtx(TyCtx) {
     Module = std::make_unique<IRModule>();
@@ -52,6 +67,9 @@ public:
   void visitDoStmt(DoStmt* S) override;
   void visitBreakStmt(BreakStmt* S) override;
   void visitContinueStmt(ContinueStmt* S) override;
+  void visitSwitchStmt(SwitchStmt* S) override;
+  void visitCaseStmt(CaseStmt* S) override;
+  void visitDefaultStmt(DefaultStmt* S) override;
 
   void visitIntegerLiteral(IntegerLiteral* E) override;
   void visitFloatLiteral(FloatLiteral* E) override;
@@ -67,6 +85,8 @@ private:
   // Helper methods
   IRValue* createTemp(Type* Ty);
   IRValue* createLabel(const std::string& Prefix);
+  IRValue* startSwitchLabel(const std::string& Prefix);
+  IRValue* getVarAddress(VarDecl* D);  // Stack slot or global
 
   void emitBinaryOp(BinaryOperator* E);
   void emitUnaryOp(UnaryOperator* E);
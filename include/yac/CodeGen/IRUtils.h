@@ -0,0 +1,90 @@
+#ifndef YAC_CODEGEN_IRUTILS_H
+#define YAC_CODEGEN_IRUTILS_H
+
+#include "yac/CodeGen/IR.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace yac {
+
+/// CloneMap - maps original values and blocks to their copies
+struct CloneMap {
+  std::map<IRValue*, IRValue*> Values;
+  std::map<IRBasicBlock*, IRBasicBlock*> Blocks;
+  std::map<IRBasicBlock*, IRValue*> Labels;  // Label of each new block
+
+  /// Return the copy of V, or V itself if it was not cloned
+  IRValue* lookup(IRValue* V) const {
+    auto It = Values.find(V);
+    return It != Values.end() ? It->second : V;
+  }
+
+  /// Return the copy of BB, or BB itself if it was not cloned
+  IRBasicBlock* lookup(IRBasicBlock* BB) const {
+    auto It = Blocks.find(BB);
+    return It != Blocks.end() ? It->second : BB;
+  }
+};
+
+/// Result value defined by I, or nullptr if it defines nothing
+IRValue* getDefinedValue(IRInstruction* I);
+
+/// Non-label operands read by I (phi incoming values included)
+std::vector<IRValue*> getOperands(IRInstruction* I);
+
+/// Replace every use of Old in I with New
+void replaceUsesInInstruction(IRInstruction* I, IRValue* Old, IRValue* New);
+
+/// Replace every use of Old in F with New
+void replaceAllUsesWith(IRFunction* F, IRValue* Old, IRValue* New);
+
+/// Find a block of F by name (block names double as branch labels)
+IRBasicBlock* findBlock(IRFunction* F, const std::string& Name);
+
+/// Block whose terminator jumps to Label, looked up among BB's successors
+IRBasicBlock* getSuccessorForLabel(IRBasicBlock* BB, IRValue* Label);
+
+/// Copy Blocks into F. Each new block and each value defined in it gets
+/// Suffix appended to its name. Operands, branch targets, phi incoming
+/// blocks and CFG edges inside the region are redirected to the copies;
+/// edges leaving the region keep their original targets, and phis in those
+/// targets gain an entry for the new predecessor. Phi entries in the copies
+/// that come from outside the region are left for the caller to fix.
+std::vector<IRBasicBlock*> cloneBlocks(IRFunction* F,
+                                       const std::vector<IRBasicBlock*>& Blocks,
+                                       const std::string& Suffix,
+                                       CloneMap& VMap);
+
+/// Copy F into a new function of M called Name. Parameters, values and
+/// blocks keep their names; VMap maps each of them to its copy.
+IRFunction* cloneFunction(IRModule* M, IRFunction* F, const std::string& Name,
+                          CloneMap& VMap);
+
+/// Delete the CFG edge From -> To along with To's phi entries for From
+void removeEdge(IRBasicBlock* From, IRBasicBlock* To);
+
+/// Replace a conditional branch or switch on a constant with a branch to
+/// the target it always takes, dropping the other edges. Returns true if
+/// BB's terminator was folded.
+bool foldConstantTerminator(IRBasicBlock* BB);
+
+/// Delete blocks unreachable from entry, detaching their edges and the
+/// phi entries they feed. Returns true if anything was removed.
+bool removeUnreachableBlocks(IRFunction* F);
+
+/// Split every critical edge (a conditional branch or switch into a block
+/// with several predecessors) that feeds phis, by routing it through a new
+/// block holding only an unconditional branch. Afterwards every phi edge
+/// leaves a block ending in br or enters a block with one predecessor, so
+/// out-of-SSA copies have a place to go. Returns true if anything changed.
+bool splitCriticalEdges(IRFunction* F);
+
+/// Where the out-of-SSA copies for the edge Pred -> Succ go once critical
+/// edges are split: true for the end of Pred (it ends in br), false for
+/// the start of Succ (Pred is then its only predecessor).
+bool phiCopiesGoInPredecessor(IRBasicBlock* Pred);
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_IRUTILS_H
@@ -0,0 +1,451 @@
+#ifndef YAC_CODEGEN_MACHINEIR_H
+#define YAC_CODEGEN_MACHINEIR_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace yac {
+
+class MachineBasicBlock;
+class MachineFunction;
+
+namespace X86 {
+
+/// PhysReg - x86-64 general purpose registers, numbered so that the
+/// hardware encoding is Reg - RAX. Register 0 means "no register".
+enum PhysReg : unsigned {
+  NoReg = 0,
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15,
+  NumPhysRegs
+};
+
+/// Registers numbered from here up are virtual
+constexpr unsigned FirstVirtualRegister = 1024;
+
+inline bool isVirtualRegister(unsigned Reg) {
+  return Reg >= FirstVirtualRegister;
+}
+inline bool isPhysicalRegister(unsigned Reg) {
+  return Reg != NoReg && Reg < NumPhysRegs;
+}
+
+/// Name of a register at the given width in bytes (8 or 1)
+std::string getRegName(unsigned Reg, unsigned Size = 8);
+
+/// Registers a call may overwrite under the System V AMD64 ABI
+extern const std::vector<unsigned> CallerSavedRegs;
+/// Registers a call must preserve, other than rsp and rbp
+extern const std::vector<unsigned> CalleeSavedRegs;
+/// Integer argument registers, in order
+extern const std::vector<unsigned> ArgRegs;
+
+/// CondCode - condition for jcc, setcc and cmovcc
+enum CondCode {
+  COND_NONE,
+  COND_E, COND_NE,
+  COND_L, COND_LE, COND_G, COND_GE,   // Signed
+  COND_B, COND_BE, COND_A, COND_AE    // Unsigned
+};
+
+/// Mnemonic suffix, e.g. "ge"
+const char* getCondCodeName(CondCode CC);
+/// The condition that holds exactly when CC does not
+CondCode getInverseCondCode(CondCode CC);
+/// The condition to test after swapping the operands of the comparison
+CondCode getSwappedCondCode(CondCode CC);
+
+enum Opcode : unsigned {
+  // Data movement
+  MOV,      // mov dst, src (register, immediate or memory)
+  MOVZX,    // movzx r64, r8
+  MOVSXD,   // movsxd r64, DWORD PTR mem
+  LEA,
+  CMOV,     // cmovcc dst, src
+  SETCC,    // setcc r8
+  PUSH,
+  POP,
+  // Arithmetic and logic; two-address forms read and write operand 0
+  ADD, SUB, AND, OR, XOR,
+  IMUL,     // imul dst, src  or  imul dst, src, imm
+  IMUL1,    // One-operand form: rdx:rax = rax * src
+  NEG, NOT,
+  SHL, SAR, SHR,
+  CQO,      // Sign-extend rax into rdx
+  IDIV,     // rax, rdx = rdx:rax / src, rdx:rax % src
+  // Comparisons
+  CMP, TEST, BT,
+  // Control flow
+  JMP,      // Direct to a block, or indirect through a register
+  JCC,
+  CALL,
+  RET,
+  UD2,
+  // Pseudo instructions, expanded before printing
+  PCOPY,    // Parallel copy: dst0, src0, dst1, src1, ...
+  NumOpcodes
+};
+
+/// InstrDesc - static properties of an opcode
+struct InstrDesc {
+  enum Flag : unsigned {
+    Terminator = 1u << 0,  // Ends a block (jmp, jcc, ret)
+    Branch = 1u << 1,
+    Call = 1u << 2,
+    Return = 1u << 3,
+    DefinesFlags = 1u << 4,
+    ReadsFlags = 1u << 5,
+    SideEffects = 1u << 6,  // Must stay in place and never be deleted
+    Pseudo = 1u << 7
+  };
+
+  const char* Name;
+  unsigned Flags;
+  std::vector<unsigned> ImplicitUses;
+  std::vector<unsigned> ImplicitDefs;
+};
+
+const InstrDesc& getInstrDesc(Opcode Op);
+
+} // namespace X86
+
+/// MachineOperand - one operand of a machine instruction
+class MachineOperand {
+public:
+  enum Kind {
+    MO_Register,
+    MO_Immediate,
+    MO_Memory,    // [base + index*scale + disp], a frame slot or a symbol
+    MO_Block,     // Branch target
+    MO_Symbol     // Call target
+  };
+
+  /// How an instruction accesses a register operand
+  enum RegState : unsigned {
+    Use = 1u << 0,
+    Def = 1u << 1,
+    Implicit = 1u << 2   // Not printed; constrains allocation only
+  };
+
+private:
+  Kind K;
+  unsigned Reg = X86::NoReg;     // Register, or memory base
+  unsigned Flags = 0;
+  unsigned Size = 8;             // Access width in bytes
+  int64_t Imm = 0;               // Immediate, or memory displacement
+  unsigned Index = X86::NoReg;   // Memory index register
+  unsigned Scale = 1;
+  int FrameIndex = -1;           // Frame object, before frame lowering
+  int JumpTable = -1;            // Jump table, addressed rip-relative
+  std::string Symbol;            // Global or callee name
+  MachineBasicBlock* Block = nullptr;
+
+  explicit MachineOperand(Kind K) : K(K) {}
+
+public:
+  static MachineOperand createReg(unsigned Reg, unsigned Flags = Use,
+                                  unsigned Size = 8) {
+    MachineOperand MO(MO_Register);
+    MO.Reg = Reg;
+    MO.Flags = Flags;
+    MO.Size = Size;
+    return MO;
+  }
+  static MachineOperand createImm(int64_t Val) {
+    MachineOperand MO(MO_Immediate);
+    MO.Imm = Val;
+    return MO;
+  }
+  static MachineOperand createMem(unsigned Base, int64_t Disp = 0,
+                                  unsigned Index = X86::NoReg,
+                                  unsigned Scale = 1, unsigned Size = 8) {
+    MachineOperand MO(MO_Memory);
+    MO.Reg = Base;
+    MO.Imm = Disp;
+    MO.Index = Index;
+    MO.Scale = Scale;
+    MO.Size = Size;
+    return MO;
+  }
+  static MachineOperand createFrameIndex(int FI) {
+    MachineOperand MO(MO_Memory);
+    MO.FrameIndex = FI;
+    return MO;
+  }
+  static MachineOperand createGlobal(const std::string& Name) {
+    MachineOperand MO(MO_Memory);
+    MO.Symbol = Name;
+    return MO;
+  }
+  static MachineOperand createJumpTable(int JTI) {
+    MachineOperand MO(MO_Memory);
+    MO.JumpTable = JTI;
+    return MO;
+  }
+  static MachineOperand createBlock(MachineBasicBlock* MBB) {
+    MachineOperand MO(MO_Block);
+    MO.Block = MBB;
+    return MO;
+  }
+  static MachineOperand createSymbol(const std::string& Name) {
+    MachineOperand MO(MO_Symbol);
+    MO.Symbol = Name;
+    return MO;
+  }
+
+  Kind getKind() const { return K; }
+  bool isReg() const { return K == MO_Register; }
+  bool isImm() const { return K == MO_Immediate; }
+  bool isMem() const { return K == MO_Memory; }
+  bool isBlock() const { return K == MO_Block; }
+  bool isSymbol() const { return K == MO_Symbol; }
+
+  // Registers
+  unsigned getReg() const { return Reg; }
+  void setReg(unsigned R) { Reg = R; }
+  bool isUse() const { return Flags & Use; }
+  bool isDef() const { return Flags & Def; }
+  bool isImplicit() const { return Flags & Implicit; }
+  unsigned getSize() const { return Size; }
+
+  // Immediates
+  int64_t getImm() const { return Imm; }
+  void setImm(int64_t V) { Imm = V; }
+
+  // Memory
+  unsigned getBase() const { return Reg; }
+  unsigned getIndex() const { return Index; }
+  unsigned getScale() const { return Scale; }
+  int64_t getDisp() const { return Imm; }
+  int getFrameIndex() const { return FrameIndex; }
+  int getJumpTable() const { return JumpTable; }
+  bool isFrameIndex() const { return K == MO_Memory && FrameIndex >= 0; }
+  void setIndex(unsigned R) { Index = R; }
+  void setFrameIndex(int FI) { FrameIndex = FI; }
+  /// Turn a frame slot into a concrete base + displacement address
+  void resolveFrameIndex(unsigned Base, int64_t Disp) {
+    Reg = Base;
+    Imm += Disp;
+    FrameIndex = -1;
+  }
+
+  const std::string& getSymbol() const { return Symbol; }
+  MachineBasicBlock* getBlock() const { return Block; }
+  void setBlock(MachineBasicBlock* MBB) { Block = MBB; }
+
+  /// Same register, immediate, or address
+  bool isIdenticalTo(const MachineOperand& Other) const;
+};
+
+/// MachineInstr - one x86 instruction, or a pseudo awaiting expansion.
+/// Operands are in Intel order: destination first.
+class MachineInstr {
+  X86::Opcode Op;
+  X86::CondCode CC;
+  std::vector<MachineOperand> Operands;
+  MachineBasicBlock* Parent = nullptr;
+
+public:
+  MachineInstr(X86::Opcode Op, std::vector<MachineOperand> Ops,
+               X86::CondCode CC = X86::COND_NONE)
+      : Op(Op), CC(CC), Operands(std::move(Ops)) {}
+
+  X86::Opcode getOpcode() const { return Op; }
+  const X86::InstrDesc& getDesc() const { return X86::getInstrDesc(Op); }
+  X86::CondCode getCondCode() const { return CC; }
+  void setCondCode(X86::CondCode C) { CC = C; }
+
+  std::vector<MachineOperand>& operands() { return Operands; }
+  const std::vector<MachineOperand>& operands() const { return Operands; }
+  MachineOperand& getOperand(size_t i) { return Operands[i]; }
+  const MachineOperand& getOperand(size_t i) const { return Operands[i]; }
+  size_t getNumOperands() const { return Operands.size(); }
+  void addOperand(const MachineOperand& MO) { Operands.push_back(MO); }
+
+  MachineBasicBlock* getParent() const { return Parent; }
+  void setParent(MachineBasicBlock* MBB) { Parent = MBB; }
+
+  bool isTerminator() const {
+    return getDesc().Flags & X86::InstrDesc::Terminator;
+  }
+  bool isCall() const { return getDesc().Flags & X86::InstrDesc::Call; }
+  bool isReturn() const { return getDesc().Flags & X86::InstrDesc::Return; }
+
+  /// A register-to-register mov, including mov r, r
+  bool isCopy() const;
+
+  /// Registers read (explicit, address and implicit), each listed once
+  std::vector<unsigned> getUses() const;
+  /// Registers written (explicit and implicit), each listed once
+  std::vector<unsigned> getDefs() const;
+
+  /// Replace register Old with New wherever it appears
+  void substituteReg(unsigned Old, unsigned New);
+};
+
+/// MachineBasicBlock - straight-line machine code, labelled in the output.
+/// Conditional jumps may appear before the final terminator.
+class MachineBasicBlock {
+  std::string Name;
+  std::vector<std::unique_ptr<MachineInstr>> Instrs;
+  std::vector<MachineBasicBlock*> Successors;
+  std::vector<MachineBasicBlock*> Predecessors;
+  MachineFunction* Parent = nullptr;
+
+public:
+  MachineBasicBlock(std::string Name, MachineFunction* Parent)
+      : Name(std::move(Name)), Parent(Parent) {}
+
+  const std::string& getName() const { return Name; }
+  MachineFunction* getParent() const { return Parent; }
+
+  /// Assembler label, local to the object file and unique per module
+  std::string getLabel() const;
+
+  const std::vector<std::unique_ptr<MachineInstr>>& instrs() const {
+    return Instrs;
+  }
+  size_t size() const { return Instrs.size(); }
+  bool empty() const { return Instrs.empty(); }
+
+  MachineInstr* push_back(std::unique_ptr<MachineInstr> MI) {
+    MI->setParent(this);
+    Instrs.push_back(std::move(MI));
+    return Instrs.back().get();
+  }
+  MachineInstr* insert(size_t Pos, std::unique_ptr<MachineInstr> MI) {
+    MI->setParent(this);
+    auto It = Instrs.insert(Instrs.begin() + Pos, std::move(MI));
+    return It->get();
+  }
+  void erase(size_t Pos) { Instrs.erase(Instrs.begin() + Pos); }
+  /// Take ownership of the instructions, leaving the block empty
+  std::vector<std::unique_ptr<MachineInstr>> takeInstrs() {
+    return std::move(Instrs);
+  }
+
+  /// Index of the first instruction of the terminating branch sequence
+  size_t getFirstTerminator() const;
+
+  void addSuccessor(MachineBasicBlock* Succ);
+  /// Send every branch from this block to Old to New instead, including
+  /// through jump tables
+  void replaceSuccessor(MachineBasicBlock* Old, MachineBasicBlock* New);
+  const std::vector<MachineBasicBlock*>& getSuccessors() const {
+    return Successors;
+  }
+  const std::vector<MachineBasicBlock*>& getPredecessors() const {
+    return Predecessors;
+  }
+};
+
+/// FrameObject - a stack slot, addressed from rbp once the frame is laid out
+struct FrameObject {
+  unsigned Size;
+  unsigned Align;
+  int64_t Offset = 0;  // From rbp, set by frame lowering
+  bool IsSpillSlot;
+};
+
+/// MachineFunction - machine code for one function
+class MachineFunction {
+  std::string Name;
+  bool Internal;
+  std::vector<std::unique_ptr<MachineBasicBlock>> Blocks;
+  std::vector<FrameObject> FrameObjects;
+  std::vector<std::vector<MachineBasicBlock*>> JumpTables;
+  unsigned NextVirtReg = X86::FirstVirtualRegister;
+  int64_t StackSize = 0;
+  std::vector<unsigned> SavedRegs;
+
+public:
+  MachineFunction(std::string Name, bool Internal)
+      : Name(std::move(Name)), Internal(Internal) {}
+
+  const std::string& getName() const { return Name; }
+  bool isInternal() const { return Internal; }
+
+  /// Append a block, or insert it right after After
+  MachineBasicBlock* createBlock(const std::string& Name,
+                                 MachineBasicBlock* After = nullptr);
+  const std::vector<std::unique_ptr<MachineBasicBlock>>& getBlocks() const {
+    return Blocks;
+  }
+
+  unsigned createVirtualRegister() { return NextVirtReg++; }
+  unsigned getNumVirtRegs() const {
+    return NextVirtReg - X86::FirstVirtualRegister;
+  }
+
+  int createStackObject(unsigned Size, unsigned Align, bool IsSpillSlot) {
+    FrameObjects.push_back({Size, Align, 0, IsSpillSlot});
+    return static_cast<int>(FrameObjects.size()) - 1;
+  }
+  std::vector<FrameObject>& getFrameObjects() { return FrameObjects; }
+  const std::vector<FrameObject>& getFrameObjects() const {
+    return FrameObjects;
+  }
+
+  int createJumpTable(std::vector<MachineBasicBlock*> Targets) {
+    JumpTables.push_back(std::move(Targets));
+    return static_cast<int>(JumpTables.size()) - 1;
+  }
+  const std::vector<std::vector<MachineBasicBlock*>>& getJumpTables() const {
+    return JumpTables;
+  }
+  std::string getJumpTableLabel(int JTI) const;
+  void replaceJumpTableTarget(int JTI, MachineBasicBlock* Old,
+                              MachineBasicBlock* New);
+
+  int64_t getStackSize() const { return StackSize; }
+  void setStackSize(int64_t Size) { StackSize = Size; }
+
+  /// Callee-saved registers the function writes, pushed in the prologue
+  const std::vector<unsigned>& getSavedRegs() const { return SavedRegs; }
+  void setSavedRegs(std::vector<unsigned> Regs) { SavedRegs = std::move(Regs); }
+};
+
+/// MachineLiveness - live-in and live-out virtual registers of each block
+class MachineLiveness {
+  std::map<const MachineBasicBlock*, std::set<unsigned>> LiveIn;
+  std::map<const MachineBasicBlock*, std::set<unsigned>> LiveOut;
+
+public:
+  void compute(const MachineFunction& MF);
+
+  const std::set<unsigned>& getLiveIn(const MachineBasicBlock* MBB) const {
+    return LiveIn.at(MBB);
+  }
+  const std::set<unsigned>& getLiveOut(const MachineBasicBlock* MBB) const {
+    return LiveOut.at(MBB);
+  }
+};
+
+/// MachineLoopInfo - loop nesting depth of each block. Loops are the
+/// natural loops of back edges, merged when they share a header.
+class MachineLoopInfo {
+  std::map<const MachineBasicBlock*, unsigned> Depth;
+  std::set<const MachineBasicBlock*> Headers;
+
+public:
+  void compute(const MachineFunction& MF);
+
+  /// Number of loops containing the block, 0 outside any loop
+  unsigned getLoopDepth(const MachineBasicBlock* MBB) const {
+    auto It = Depth.find(MBB);
+    return It != Depth.end() ? It->second : 0;
+  }
+
+  /// Whether the block is the target of a back edge
+  bool isLoopHeader(const MachineBasicBlock* MBB) const {
+    return Headers.count(MBB);
+  }
+};
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_MACHINEIR_H
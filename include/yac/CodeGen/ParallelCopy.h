@@ -0,0 +1,55 @@
+#ifndef YAC_CODEGEN_PARALLELCOPY_H
+#define YAC_CODEGEN_PARALLELCOPY_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace yac {
+
+/// Sequentialize a parallel copy. Each entry of Copies is a (Dest, Src)
+/// pair; all sources are read before any destination is written, and no
+/// two entries share a destination. Emit(Dest, Src) is called once per
+/// sequential move. Copies whose destination nobody else still reads go
+/// first; what remains is a set of disjoint cycles, each broken by saving
+/// one destination in Temp, which must not appear in Copies.
+template <typename Loc, typename EmitFn>
+void sequentializeCopies(std::vector<std::pair<Loc, Loc>> Copies,
+                         const Loc& Temp, EmitFn Emit) {
+  Copies.erase(std::remove_if(Copies.begin(), Copies.end(),
+                              [](const std::pair<Loc, Loc>& C) {
+                                return C.first == C.second;
+                              }),
+               Copies.end());
+
+  auto isRead = [&](const Loc& L, size_t Except) {
+    for (size_t i = 0; i < Copies.size(); ++i) {
+      if (i != Except && Copies[i].second == L) return true;
+    }
+    return false;
+  };
+
+  while (!Copies.empty()) {
+    bool Progress = false;
+    for (size_t i = 0; i < Copies.size(); ++i) {
+      if (isRead(Copies[i].first, i)) continue;
+      Emit(Copies[i].first, Copies[i].second);
+      Copies.erase(Copies.begin() + i);
+      Progress = true;
+      break;
+    }
+    if (Progress) continue;
+
+    // Every destination is still read by another copy: break a cycle by
+    // moving one destination's old value out of the way
+    Loc Saved = Copies.front().first;
+    Emit(Temp, Saved);
+    for (auto& C : Copies) {
+      if (C.second == Saved) C.second = Temp;
+    }
+  }
+}
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_PARALLELCOPY_H
@@ -91,9 +91,22 @@ public:
   virtual bool preservesInstructions() const { return false; }
 };
 
+/// ModulePass - base class for passes that work across functions
+class ModulePass {
+public:
+  virtual ~ModulePass() = default;
+  virtual std::string getName() const = 0;
+  virtual bool run(IRModule* M) = 0;
+};
+
 /// PassManager - runs passes on functions and modules
 class PassManager {
   std::vector<std::unique_ptr<Pass>> Passes;
+
+  // Module passes, each tagged with the number of function passes added
+  // before it. Running a module runs the function passes in between on
+  // every function, then the module pass.
+  std::vector<std::pair<size_t, std::unique_ptr<ModulePass>>> ModulePasses;
   bool VerifyEach = false;
   bool EnableTiming = false;
 
@@ -114,7 +127,12 @@ public:
     Passes.push_back(std::move(P));
   }
 
-  /// Run all passes on a function
+  /// Add a module pass after the function passes added so far
+  void addPass(std::unique_ptr<ModulePass> P) {
+    ModulePasses.emplace_back(Passes.size(), std::move(P));
+  }
+
+  /// Run all function passes on a function (module passes are skipped)
   bool run(IRFunction* F);
 
   /// Run all passes on a module
@@ -131,47 +149,57 @@ public:
 
 private:
   size_t countInstructions(IRFunction* F) const;
+  size_t countInstructions(IRModule* M) const;
+
+  // Run function passes [Begin, End) on F
+  bool runFunctionPasses(IRFunction* F, size_t Begin, size_t End);
+  bool runModulePass(ModulePass* P, IRModule* M);
 };
 
 // ===----------------------------------------------------------------------===
 // Common Analyses
 // ===----------------------------------------------------------------------===
 
-/// DominatorTree - dominator tree analysis
-class DominatorTree : public Analysis {
+/// DominatorTreeBase - dominator tree over the CFG or the reversed CFG
+/// Built with the Cooper-Harvey-Kennedy iterative algorithm. Each node
+/// records its DFS entry and exit numbers in the tree, so a dominance
+/// query is two comparisons. Blocks the walk never reaches have a node but
+/// are not in the tree and dominate nothing.
+class DominatorTreeBase : public Analysis {
 public:
   struct Node {
-    IRBasicBlock* Block;
+    IRBasicBlock* Block;   // nullptr for the virtual exit
     Node* IDom = nullptr;  // Immediate dominator
     std::vector<Node*> Children;
+    unsigned DFSIn = 0;    // 0 if not in the tree
+    unsigned DFSOut = 0;
   };
 
-private:
+protected:
   std::map<IRBasicBlock*, Node*> Nodes;
   Node* Root = nullptr;
   std::vector<std::unique_ptr<Node>> AllNodes;
+  bool IsPostDom;
 
-public:
-  DominatorTree() = default;
-
-  std::string getName() const override { return "DominatorTree"; }
+  explicit DominatorTreeBase(bool IsPostDom) : IsPostDom(IsPostDom) {}
 
-  void run(IRFunction* F);
+  void recalculate(IRFunction* F);
 
+public:
   bool invalidate(IRFunction* F, unsigned Mask) override {
     return (Mask & Analysis::CFG) != 0;
   }
 
-  /// Get dominator tree node for a block
+  /// Get tree node for a block
   Node* getNode(IRBasicBlock* BB) const {
     auto It = Nodes.find(BB);
     return It != Nodes.end() ? It->second : nullptr;
   }
 
-  /// Check if A dominates B
+  /// Check if A dominates B, in O(1)
   bool dominates(IRBasicBlock* A, IRBasicBlock* B) const;
 
-  /// Get immediate dominator
+  /// Get immediate dominator (nullptr for the root or the virtual exit)
   IRBasicBlock* getIDom(IRBasicBlock* BB) const {
     Node* N = getNode(BB);
     return N && N->IDom ? N->IDom->Block : nullptr;
@@ -182,6 +210,37 @@ public:
   void print() const;
 };
 
+/// DominatorTree - dominator tree analysis
+class DominatorTree : public DominatorTreeBase {
+public:
+  DominatorTree() : DominatorTreeBase(/*IsPostDom=*/false) {}
+
+  std::string getName() const override { return "DominatorTree"; }
+
+  void run(IRFunction* F) { recalculate(F); }
+};
+
+/// PostDominatorTree - post-dominator tree analysis
+/// The root is a virtual exit (a node without a block) whose children are
+/// the blocks that return. Each loop that never exits also hangs one of its
+/// blocks off the virtual exit, so every block is in the tree.
+class PostDominatorTree : public DominatorTreeBase {
+public:
+  PostDominatorTree() : DominatorTreeBase(/*IsPostDom=*/true) {}
+
+  std::string getName() const override { return "PostDominatorTree"; }
+
+  void run(IRFunction* F) { recalculate(F); }
+
+  /// Check if every path from B to the exit goes through A
+  bool postDominates(IRBasicBlock* A, IRBasicBlock* B) const {
+    return dominates(A, B);
+  }
+
+  /// Get immediate post-dominator (nullptr for the virtual exit)
+  IRBasicBlock* getIPDom(IRBasicBlock* BB) const { return getIDom(BB); }
+};
+
 /// Liveness - liveness analysis for values
 class Liveness : public Analysis {
 public:
@@ -270,16 +329,19 @@ public:
     return (Mask & (Analysis::CFG | Analysis::Instructions)) != 0;
   }
 
-  // Query loops
+  // Query loops. A block belongs to the innermost loop containing it.
   Loop* getLoopFor(IRBasicBlock* BB) const {
     auto It = BlockToLoop.find(BB);
     return It != BlockToLoop.end() ? It->second : nullptr;
   }
 
-  const std::vector<std::unique_ptr<Loop>>& getTopLevelLoops() const {
+  const std::vector<Loop*>& getTopLevelLoops() const {
     return TopLevelLoops;
   }
 
+  // Every loop, each one after all of its sub-loops
+  std::vector<Loop*> getLoopsInnermostFirst() const;
+
   unsigned getLoopDepth(IRBasicBlock* BB) const {
     Loop* L = getLoopFor(BB);
     return L ? L->getLoopDepth() : 0;
@@ -292,11 +354,13 @@ public:
   }
 
 private:
-  std::vector<std::unique_ptr<Loop>> TopLevelLoops;
+  std::vector<std::unique_ptr<Loop>> Loops;  // Owns every loop
+  std::vector<Loop*> TopLevelLoops;
   std::map<IRBasicBlock*, Loop*> BlockToLoop;
 
   // Analysis helpers
   void identifyLoops(IRFunction* F, DominatorTree* DT);
+  void buildLoopTree();
   Loop* createLoop(IRBasicBlock* Header);
   void populateLoop(Loop* L, IRBasicBlock* BB, const std::set<IRBasicBlock*>& BackEdgeSources);
 };
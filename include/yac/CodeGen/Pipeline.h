@@ -0,0 +1,15 @@
+#ifndef YAC_CODEGEN_PIPELINE_H
+#define YAC_CODEGEN_PIPELINE_H
+
+#include "yac/CodeGen/Pass.h"
+
+namespace yac {
+
+/// addOptimizationPasses - queue the passes run at -O<OptLevel>
+/// Each level adds to the passes of the level below it. Level 0 adds
+/// nothing.
+void addOptimizationPasses(PassManager& PM, unsigned OptLevel);
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_PIPELINE_H
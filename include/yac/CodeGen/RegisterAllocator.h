@@ -1,78 +1,186 @@
 #ifndef YAC_CODEGEN_REGISTERALLOCATOR_H
 #define YAC_CODEGEN_REGISTERALLOCATOR_H
 
-#include "yac/CodeGen/IR.h"
+#include "yac/CodeGen/MachineIR.h"
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <set>
-#include <string>
 #include <vector>
 
 namespace yac {
 
-/// Live interval for a value
-struct LiveInterval {
-  IRValue* Value;
-  int Start;  // First instruction index where value is live
-  int End;    // Last instruction index where value is live
-
-  LiveInterval(IRValue* V, int S, int E) : Value(V), Start(S), End(E) {}
+/// LiveRange - half-open span [Start, End) of slot indices. Instruction i
+/// reads its operands at 2i and writes its results at 2i + 1.
+struct LiveRange {
+  int Start;
+  int End;
+};
 
-  bool overlaps(const LiveInterval& Other) const {
-    return !(End < Other.Start || Other.End < Start);
-  }
+/// UsePosition - a slot where an instruction reads or writes the value
+struct UsePosition {
+  int Pos;
+  bool NeedsReg;  // False where a stack slot operand works just as well
+  double Freq = 0;        // How often the use runs
+  double FreqBefore = 0;  // Of the register's uses before this one
+};
 
-  bool operator<(const LiveInterval& Other) const {
-    return Start < Other.Start;
-  }
+/// LiveInterval - where a virtual register, or one piece of it after
+/// splitting, is live. Ranges are sorted and disjoint; the gaps between
+/// them are lifetime holes another value may use the register for.
+struct LiveInterval {
+  unsigned Reg;
+  std::vector<LiveRange> Ranges;
+  std::vector<UsePosition> Uses;
+  unsigned PhysReg = X86::NoReg;  // NoReg once the piece lives on the stack
+
+  explicit LiveInterval(unsigned R) : Reg(R) {}
+
+  int start() const { return Ranges.front().Start; }
+  int end() const { return Ranges.back().End; }
+  bool covers(int Pos) const;
+
+  /// First slot covered by both intervals, or INT_MAX
+  int nextIntersection(const LiveInterval& Other) const;
+  /// First use at or after Pos, or INT_MAX; optionally register uses only
+  int nextUseAfter(int Pos, bool NeedsRegOnly) const;
+  /// Index of the first use at or after Pos
+  size_t findUse(int Pos) const;
+
+  // Construction, walking each block backwards. Ranges and uses arrive
+  // latest first and are appended as they come; finish() puts them in
+  // order.
+  void addRange(int Start, int End);
+  void setFrom(int Start);
+  void addUse(int Pos, bool NeedsReg);
+  void finish();
+
+  /// Add a use to a finished interval
+  void insertUse(int Pos, bool NeedsReg);
 };
 
-/// Linear scan register allocator
+/// Linear scan register allocator over machine IR, after Wimmer and
+/// Mössenböck. Copy-related virtual registers that do not interfere are
+/// coalesced first. Intervals keep their lifetime holes; when no register
+/// is free for a whole interval it is split, and pieces that lose their
+/// register live on the stack until the next use that needs one, where
+/// they get a second chance. Blocks are numbered with each loop's blocks
+/// together; the register taken is the one whose holders are cheapest to
+/// spill, counting each use by the loop depth it sits at, and split
+/// points move to the shallowest block boundary available so spill code
+/// stays out of loops. Moves at split points and along CFG edges
+/// reconnect the pieces, except that a value is stored right after its
+/// defs instead when that is cheaper than storing on every way out of a
+/// register. Values defined once by a constant or a cheap address
+/// computation are recomputed rather than reloaded where their operands
+/// are at hand, and never stored when every reload can be. On return the
+/// function refers to physical registers only and parallel copies have
+/// been expanded.
 class RegisterAllocator {
 public:
   RegisterAllocator() {
-    // Available physical registers (caller-saved for now)
+    // Caller-saved registers first, since using them costs nothing when
+    // no call intervenes; values live across calls end up in the
+    // callee-saved ones, which frame lowering saves. r10 and r11 are left
+    // out: the instruction selector uses them as scratch registers.
     AvailableRegs = {
-      "rax", "rcx", "rdx", "rsi", "rdi",
-      "r8", "r9", "r10", "r11"
+      X86::R8, X86::R9, X86::RAX, X86::RCX, X86::RDI, X86::RDX, X86::RSI,
+      X86::RBX, X86::R12, X86::R13, X86::R14, X86::R15
     };
   }
 
   /// Allocate registers for a function
-  void allocate(IRFunction* F);
-
-  /// Get the register assigned to a value
-  std::string getRegister(IRValue* V) const;
+  void allocate(MachineFunction& MF);
 
-  /// Check if a value is spilled to stack
-  bool isSpilled(IRValue* V) const;
+  /// Get the register assigned where a virtual register is defined, or
+  /// NoReg if it starts out on the stack
+  unsigned getRegister(unsigned VReg) const;
 
-  /// Get stack offset for a spilled value
-  int getStackOffset(IRValue* V) const;
-
-  /// Get total stack space needed for spills
-  int getSpillSlotSize() const { return SpillSlotCount * 8; }
+  /// Number of virtual registers given a stack slot
+  unsigned getNumSpilled() const { return NumSpilled; }
+  /// Number of intervals split
+  unsigned getNumSplits() const { return NumSplits; }
+  /// Number of reloads replaced by recomputing the value
+  unsigned getNumRemats() const { return NumRemats; }
 
 private:
-  std::vector<std::string> AvailableRegs;
-  std::map<IRValue*, std::string> ValueToReg;     // Allocated registers
-  std::map<IRValue*, int> ValueToStackSlot;       // Spilled values
-  int SpillSlotCount = 0;
+  using IntervalList = std::vector<LiveInterval*>;
+  // Locations are registers, or stack slots encoded as -(FrameIndex + 1)
+  using CopyList = std::vector<std::pair<int64_t, int64_t>>;
+  using InsertPoint = std::pair<const MachineBasicBlock*, size_t>;
+
+  std::vector<unsigned> AvailableRegs;
+  std::vector<std::unique_ptr<LiveInterval>> Intervals;
+  // Tables per virtual register, from the first one on
+  std::vector<IntervalList> Pieces;             // In order
+  std::vector<unsigned> Hints;                  // Copy-related physreg
+  std::vector<int> VRegToStackSlot;             // -1 unless spilled
+  std::vector<std::vector<int>> DefSlots;       // In order
+  std::vector<bool> StoredAtDef;                // Slot written at each def
+  std::vector<std::unique_ptr<MachineInstr>> RematDefs;
+  std::vector<bool> Rematerialized;             // Slot never read
+  std::map<unsigned, LiveInterval> FixedIntervals;
+  std::vector<MachineBasicBlock*> Order;        // Blocks as numbered
+  std::map<const MachineBasicBlock*, size_t> OrderIndex;
+  std::vector<int> BlockStarts;                 // First slot of each block
+  std::vector<unsigned> LoopDepths;             // Per block
+  std::vector<unsigned> EntryDepths;            // Of moves at a block's top
+  std::vector<std::vector<size_t>> ShallowestEntries;  // Per run of 2^k blocks
+  std::vector<std::vector<unsigned>> LiveIns;   // Per block
+  std::map<InsertPoint, CopyList> SplitMoves;   // Before an instruction
+  std::map<InsertPoint, CopyList> EdgeMoves;    // After any split moves
+  // Values recomputed rather than reloaded, after the moves at each point
+  using InstrList = std::vector<std::unique_ptr<MachineInstr>>;
+  std::map<InsertPoint, InstrList> SplitRemats, EdgeRemats;
+  unsigned NumSpilled = 0;
+  unsigned NumSplits = 0;
+  unsigned NumRemats = 0;
+
+  // Linear scan state
+  std::multimap<int, LiveInterval*> Unhandled;
+  IntervalList Active, Inactive;
+
+  // Copy coalescing
+  void coalesceCopies(MachineFunction& MF);
 
   // Live interval computation
-  std::vector<LiveInterval> computeLiveIntervals(IRFunction* F);
-  std::map<IRValue*, std::set<int>> computeLiveness(IRFunction* F);
-  int getInstructionIndex(IRFunction* F, IRInstruction* I);
-
-  // Allocation helpers
-  void allocateInterval(LiveInterval& Interval,
-                        std::vector<LiveInterval>& Active);
-  void expireOldIntervals(int CurrentStart,
-                          std::vector<LiveInterval>& Active,
-                          std::set<std::string>& FreeRegs);
-  void spillAtInterval(LiveInterval& Interval,
-                       std::vector<LiveInterval>& Active);
+  void computeBlockOrder(const MachineFunction& MF,
+                         const MachineLoopInfo& Loops);
+  void computeLiveIntervals(const MachineFunction& MF);
+
+  // Allocation
+  void runLinearScan(MachineFunction& MF);
+  bool tryAllocateFreeReg(LiveInterval* Current);
+  void allocateBlockedReg(MachineFunction& MF, LiveInterval* Current);
+  LiveInterval* splitInterval(LiveInterval* LI, int Pos);
+  void spillInterval(MachineFunction& MF, LiveInterval* LI, int Pos);
+  void assignStackSlot(MachineFunction& MF, unsigned VReg);
+  LiveInterval* getPieceAt(unsigned VReg, int Pos) const;
+  int64_t getLocation(const LiveInterval* LI) const;
+
+  // Spill costs and placement
+  size_t getBlockAt(int Pos) const;
+  double getSpillWeight(const LiveInterval* LI, int From) const;
+  int findSplitPos(int Min, int Max) const;
+  void placeSpillStores();
+
+  // Rematerialization
+  bool isRematerializable(const MachineInstr& MI) const;
+  bool canRematerialize(unsigned VReg, int Pos) const;
+  std::unique_ptr<MachineInstr> rematerialize(unsigned VReg, unsigned PhysReg,
+                                              int Pos) const;
+  void findRematerialized();
+  void emitRemats(MachineBasicBlock* MBB, InstrList Remats);
+
+  // Rewriting
+  void rewriteVirtualRegisters();
+  void resolveSplits(MachineFunction& MF);
 };
 
+/// Lower the parallel copies of an allocated function to movs. Cycles are
+/// broken through r11; memory-to-memory copies go through r10.
+void expandParallelCopies(MachineFunction& MF);
+
 } // namespace yac
 
 #endif // YAC_CODEGEN_REGISTERALLOCATOR_H
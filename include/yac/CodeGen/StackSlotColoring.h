@@ -0,0 +1,23 @@
+#ifndef YAC_CODEGEN_STACKSLOTCOLORING_H
+#define YAC_CODEGEN_STACKSLOTCOLORING_H
+
+#include "yac/CodeGen/MachineIR.h"
+#include <cstdint>
+
+namespace yac {
+
+/// Bytes the frame objects of MF take when laid out in order, padding
+/// included
+int64_t getFrameObjectsSize(const MachineFunction& MF);
+
+/// Share stack slots between frame objects whose lifetimes never overlap,
+/// after register allocation. A slot is live from a mov that writes all of
+/// it to the reads that follow; objects accessed any other way, such as
+/// through an address taken with lea, keep a slot of their own. Objects
+/// nothing refers to are dropped, and the rest are ordered by alignment
+/// and size so that padding is minimal. Returns the bytes saved.
+int64_t colorStackSlots(MachineFunction& MF);
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_STACKSLOTCOLORING_H
@@ -0,0 +1,36 @@
+#ifndef YAC_CODEGEN_SWITCHLOWERING_H
+#define YAC_CODEGEN_SWITCHLOWERING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace yac {
+
+/// SwitchStrategy - how the backend dispatches an IR switch
+enum class SwitchStrategy {
+  CompareTree,  // Balanced binary search over the case values
+  JumpTable,    // Bounds check plus an indirect jump through .rodata
+  BitTest       // One mask test per destination over a small value range
+};
+
+/// Jump tables need at least this many cases...
+constexpr size_t MinJumpTableCases = 4;
+/// ...filling at least this percentage of the table slots...
+constexpr unsigned MinJumpTableDensity = 40;
+/// ...and no more than this many slots.
+constexpr uint64_t MaxJumpTableSize = 4096;
+
+/// Bit tests need every case value to fit in one 64-bit mask and at most
+/// this many distinct destinations.
+constexpr size_t MaxBitTestDests = 3;
+
+/// Choose a lowering for a switch. SortedValues holds the case values in
+/// ascending order without duplicates; NumDests is the number of distinct
+/// non-default destinations.
+SwitchStrategy chooseSwitchStrategy(const std::vector<int64_t>& SortedValues,
+                                    size_t NumDests);
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_SWITCHLOWERING_H
@@ -78,6 +78,41 @@ private:
       std::set<IRInstruction*>& Live);
 };
 
+/// ADCE - Aggressive dead code elimination
+/// Assumes everything is dead until proven otherwise. Stores, returns and
+/// calls with side effects are live; a block is live if it holds a live
+/// instruction, and a conditional branch is live only if a live block is
+/// control dependent on it. Dead branches jump straight to their nearest
+/// live post-dominator, so loops and ifs that compute nothing used
+/// disappear together with their conditions.
+class ADCEPass : public Pass {
+public:
+  std::string getName() const override { return "ADCE"; }
+  bool run(IRFunction* F, AnalysisManager& AM) override;
+
+  bool preservesCFG() const override { return false; }
+  bool preservesInstructions() const override { return false; }
+
+private:
+  std::set<IRInstruction*> LiveInsts;
+  std::set<IRBasicBlock*> LiveBlocks;
+  std::vector<IRInstruction*> Worklist;
+  std::map<IRValue*, IRInstruction*> Defs;
+  PostDominatorTree* PDT = nullptr;
+
+  // Blocks whose branch decides whether each block runs
+  std::map<IRBasicBlock*, std::set<IRBasicBlock*>> ControlDeps;
+
+  void computeControlDependence(IRFunction* F);
+
+  void markLive(IRInstruction* I);
+  void markLive(IRBasicBlock* BB);
+  void propagateLiveness();
+
+  // Nearest live block on BB's post-dominator chain, or nullptr
+  IRBasicBlock* findLivePostDominator(IRBasicBlock* BB);
+};
+
 /// ConstantPropagation - Propagate and fold constants
 class ConstantPropagationPass : public Pass {
 public:
@@ -98,8 +133,14 @@ private:
 };
 
 /// SimplifyCFG - Simplify control flow graph
+/// Also if-converts small diamonds and triangles: when the conditional
+/// arms only compute cheap, side-effect-free values, they are hoisted into
+/// the branching block and the join's phis become selects.
 class SimplifyCFGPass : public Pass {
 public:
+  SimplifyCFGPass(size_t SpeculationThreshold = 2)
+      : SpeculationThreshold(SpeculationThreshold) {}
+
   std::string getName() const override { return "SimplifyCFG"; }
   bool run(IRFunction* F, AnalysisManager& AM) override;
 
@@ -107,8 +148,19 @@ public:
   bool preservesInstructions() const override { return false; }
 
 private:
+  size_t SpeculationThreshold;  // Max instructions hoisted from each arm
+
   bool mergeBlocks(IRBasicBlock* Pred, IRBasicBlock* Succ);
   bool removeUnreachableBlocks(IRFunction* F);
+
+  // Check if Arm, entered only from Pred, can run unconditionally. On
+  // success Join is set to the block it falls into
+  bool isSpeculatableArm(IRBasicBlock* Arm, IRBasicBlock* Pred,
+                         IRBasicBlock*& Join);
+
+  // Replace the conditional branch ending BB with selects, if its arms
+  // form a diamond or triangle that is cheap to speculate
+  bool foldBranchToSelect(IRFunction* F, IRBasicBlock* BB);
 };
 
 /// CopyPropagation - Eliminate redundant copies/moves
@@ -140,9 +192,14 @@ public:
   std::string getName() const override { return "SCCP"; }
   bool run(IRFunction* F, AnalysisManager& AM) override;
 
-  bool preservesCFG() const override { return true; }
+  bool preservesCFG() const override { return false; }
   bool preservesInstructions() const override { return false; }
 
+  // Constant folding shared with IPSCCP. Return false if Op cannot be
+  // folded (unknown opcode, division by zero)
+  static bool tryEvaluateBinary(IRInstruction::Opcode Op, int64_t LHS, int64_t RHS, int64_t& Result);
+  static bool tryEvaluateUnary(IRInstruction::Opcode Op, int64_t Operand, int64_t& Result);
+
 private:
   enum LatticeValue {
     Undefined,    // Not yet computed
@@ -158,6 +215,9 @@ private:
   // Lattice values for each SSA value
   std::map<IRValue*, LatticeCell> ValueState;
 
+  // Instructions reading each value, revisited when it changes
+  std::map<IRValue*, std::vector<IRInstruction*>> Users;
+
   // Executable edges and blocks
   std::set<std::pair<IRBasicBlock*, IRBasicBlock*>> ExecutableEdges;
   std::set<IRBasicBlock*> ExecutableBlocks;
@@ -179,13 +239,11 @@ private:
   void visitBinaryInst(IRBinaryInst* BinOp);
   void visitUnaryInst(IRUnaryInst* UnOp);
   void visitCondBr(IRCondBrInst* Br);
-
-  // Evaluation
-  bool tryEvaluateBinary(IRInstruction::Opcode Op, int64_t LHS, int64_t RHS, int64_t& Result);
-  bool tryEvaluateUnary(IRInstruction::Opcode Op, int64_t Operand, int64_t& Result);
+  void visitSwitch(IRSwitchInst* Switch);
+  void visitSelect(IRSelectInst* Sel);
 
   // Rewriting
-  void rewriteFunction(IRFunction* F);
+  bool rewriteFunction(IRFunction* F);
 };
 
 /// GVN - Global Value Numbering (lite version)
@@ -204,12 +262,15 @@ private:
   struct Expression {
     IRInstruction::Opcode Op;
     std::vector<IRValue*> Operands;
+    std::string Callee;  // Calls only
 
     bool operator<(const Expression& Other) const;
   };
 
-  // Value numbering maps
+  // Value numbering maps. Calls that read memory are kept apart so a store
+  // or a call that may write can forget them.
   std::map<Expression, IRValue*> ExpressionMap;
+  std::map<Expression, IRValue*> ReadOnlyCalls;
   std::map<IRValue*, IRValue*> Replacements;
 
   // Build expression from instruction
@@ -222,6 +283,64 @@ private:
   void replaceAllUsesWith(IRFunction* F, IRValue* Old, IRValue* New);
 };
 
+/// Reassociate - Reorder trees of associative integer operations
+/// Operands are ranked constants < arguments < loop-invariant values <
+/// loop-variant values and the tree is rebuilt in rank order, so all
+/// constants fold into one and invariant subtrees become visible to LICM.
+/// Repeated constant multipliers in sums are factored: x*4 + y*4 becomes
+/// (x + y)*4.
+class ReassociatePass : public Pass {
+public:
+  std::string getName() const override { return "Reassociate"; }
+  bool run(IRFunction* F, AnalysisManager& AM) override;
+
+  bool preservesCFG() const override { return true; }
+  bool preservesInstructions() const override { return false; }
+
+private:
+  enum Rank {
+    RankConstant = 0,
+    RankArgument = 1,
+    RankInvariant = 2,
+    RankVariant = 3
+  };
+
+  IRFunction* CurrentFunc = nullptr;
+  LoopInfo* LI = nullptr;
+
+  // Kept up to date as trees are rewritten, so each rewrite only costs
+  // the instructions it touches
+  std::map<IRValue*, IRInstruction*> DefMap;
+  std::map<IRValue*, unsigned> UseCount;
+  std::map<std::pair<Loop*, IRValue*>, unsigned> RankCache;
+  std::set<IRInstruction*> Erased;
+  unsigned NumCreated = 0;
+
+  unsigned getRank(IRValue* V, Loop* L);
+
+  // Record or forget the value I defines and the operands it uses
+  void addUses(IRInstruction* I);
+  void dropUses(IRInstruction* I);
+
+  // Check if V can be folded into a tree of Op in BB that uses it
+  bool isTreeNode(IRValue* V, IRInstruction::Opcode Op, IRBasicBlock* BB);
+
+  // Collect the leaves and inner nodes of the tree rooted at Root
+  void linearize(IRBinaryInst* Root, IRInstruction::Opcode Op,
+                 std::vector<IRValue*>& Leaves,
+                 std::vector<IRInstruction*>& Nodes);
+
+  // Replace groups of mul-by-C leaves with one multiply of their sum
+  bool factorMultiplies(IRBinaryInst* Root, std::vector<IRValue*>& Leaves,
+                        std::vector<IRInstruction*>& Dead, Loop* L);
+
+  // Emit Ops combined left to right before Pos
+  IRValue* emitChain(IRInstruction::Opcode Op, const std::vector<IRValue*>& Ops,
+                     IRInstruction* Pos, Type* Ty);
+
+  bool rewriteTree(IRBinaryInst* Root);
+};
+
 /// LICM - Loop Invariant Code Motion
 /// Moves loop-invariant computations out of loops
 class LICMPass : public Pass {
@@ -233,6 +352,9 @@ public:
   bool preservesInstructions() const override { return false; }
 
 private:
+  // Values defined inside the loop being processed
+  std::set<IRValue*> LoopDefs;
+
   // Check if an instruction is loop invariant
   bool isLoopInvariant(IRInstruction* I, Loop* L, const std::set<IRValue*>& LoopInvariants);
 
@@ -243,6 +365,43 @@ private:
   void hoistInstruction(IRInstruction* I, IRBasicBlock* Preheader);
 };
 
+/// GCM - Global code motion (Click's schedule early / schedule late)
+/// Pure instructions are not tied to the block they were written in. Each
+/// one is first scheduled as early as its operands allow, then as late as
+/// its uses allow, and finally placed on the dominator tree path between
+/// the two at the shallowest loop depth, preferring the latest block. This
+/// hoists invariant work out of loops and sinks values used on one path
+/// into that path.
+class GCMPass : public Pass {
+public:
+  std::string getName() const override { return "GCM"; }
+  bool run(IRFunction* F, AnalysisManager& AM) override;
+
+  bool preservesCFG() const override { return true; }
+  bool preservesInstructions() const override { return false; }
+
+private:
+  DominatorTree* DT = nullptr;
+  LoopInfo* LI = nullptr;
+  IRBasicBlock* Entry = nullptr;
+
+  std::map<IRBasicBlock*, unsigned> DomDepth;
+  std::map<IRValue*, IRInstruction*> Defs;
+  std::map<IRValue*, std::vector<IRInstruction*>> Users;
+  std::map<IRInstruction*, IRBasicBlock*> Early;
+  std::map<IRInstruction*, IRBasicBlock*> Late;
+
+  // Instructions in the order they were scheduled late: users first
+  std::vector<IRInstruction*> Order;
+
+  // Loads, stores, phis, branches and anything that may trap stay put
+  bool isPinned(IRInstruction* I) const;
+
+  IRBasicBlock* scheduleEarly(IRInstruction* I);
+  IRBasicBlock* scheduleLate(IRInstruction* I);
+  IRBasicBlock* findLCA(IRBasicBlock* A, IRBasicBlock* B) const;
+};
+
 /// Inlining - Function inlining with cost budget
 /// Inlines small functions to eliminate call overhead
 class InliningPass : public Pass {
@@ -293,6 +452,45 @@ private:
   bool unrollLoop(Loop* L, unsigned Factor);
 };
 
+/// LoopUnswitch - Hoist loop-invariant conditional branches out of loops
+/// Clones the loop so each copy runs with the branch folded one way, and
+/// selects between the copies once in the preheader
+class LoopUnswitchPass : public Pass {
+public:
+  LoopUnswitchPass(size_t SizeThreshold = 60, size_t GrowthBudget = 200)
+      : SizeThreshold(SizeThreshold), GrowthBudget(GrowthBudget) {}
+
+  std::string getName() const override { return "LoopUnswitch"; }
+  bool run(IRFunction* F, AnalysisManager& AM) override;
+
+  bool preservesCFG() const override { return false; }
+  bool preservesInstructions() const override { return false; }
+
+private:
+  size_t SizeThreshold;  // Max instructions in a loop we are willing to copy
+  size_t GrowthBudget;   // Max instructions added to one function
+  unsigned NumUnswitched = 0;
+
+  // Defining instruction of every value in the function
+  std::map<IRValue*, IRInstruction*> DefMap;
+
+  // Check if V has the same value on every iteration of L. Pure
+  // instructions inside L that V depends on are collected in Chain
+  bool isInvariant(IRValue* V, Loop* L, std::vector<IRInstruction*>& Chain);
+
+  // Find a conditional branch in L worth unswitching
+  IRCondBrInst* findCandidate(Loop* L, std::vector<IRInstruction*>& Chain);
+
+  // Values defined in L and used outside it
+  std::vector<IRValue*> getLiveOuts(Loop* L);
+
+  bool unswitchLoop(IRFunction* F, Loop* L, IRCondBrInst* Br,
+                    const std::vector<IRInstruction*>& Chain);
+
+  // Replace Br with an unconditional branch to the side selected by Taken
+  void foldBranch(IRCondBrInst* Br, bool Taken);
+};
+
 } // namespace yac
 
 #endif // YAC_CODEGEN_TRANSFORMS_H
@@ -0,0 +1,29 @@
+#ifndef YAC_CODEGEN_X86ASMPRINTER_H
+#define YAC_CODEGEN_X86ASMPRINTER_H
+
+#include "yac/CodeGen/MachineIR.h"
+#include <iostream>
+#include <string>
+
+namespace yac {
+
+/// X86AsmPrinter - writes machine IR as Intel-syntax GNU assembly. The
+/// function must be fully lowered: physical registers only, no pseudo
+/// instructions and no unresolved frame indices.
+class X86AsmPrinter {
+public:
+  X86AsmPrinter(std::ostream& Out) : OS(Out) {}
+
+  void printFunction(const MachineFunction& MF);
+  void printInstruction(const MachineInstr& MI);
+
+private:
+  std::ostream& OS;
+
+  void printOperand(const MachineInstr& MI, const MachineOperand& Op);
+  void printJumpTables(const MachineFunction& MF);
+};
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_X86ASMPRINTER_H
@@ -0,0 +1,115 @@
+#ifndef YAC_CODEGEN_X86ISEL_H
+#define YAC_CODEGEN_X86ISEL_H
+
+#include "yac/CodeGen/IR.h"
+#include "yac/CodeGen/MachineIR.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace yac {
+
+/// X86InstrSelector - lowers an IR function to machine IR over virtual
+/// registers. Each IR value gets one virtual register; phis become parallel
+/// copies on their incoming edges, so critical edges must be split first.
+/// r10 and r11 are scratch registers the selector may use directly.
+///
+/// Before a block is selected, expression trees of single-use values are
+/// matched against x86 patterns: address arithmetic becomes one lea or a
+/// memory operand, loads feed ALU instructions directly, and comparisons
+/// read only by branches and selects set the flags right where they are
+/// tested. Instructions covered by a pattern rooted elsewhere are not
+/// selected on their own.
+class X86InstrSelector {
+public:
+  std::unique_ptr<MachineFunction> select(IRFunction* F);
+
+private:
+  /// AddressMode - base + index*scale + disp over IR values
+  struct AddressMode {
+    IRValue* Base = nullptr;
+    IRValue* Index = nullptr;
+    unsigned Scale = 1;
+    int64_t Disp = 0;
+  };
+
+  MachineFunction* MF = nullptr;
+  MachineBasicBlock* MBB = nullptr;  // Insertion point
+  std::map<IRValue*, unsigned> VRegs;
+  std::map<IRValue*, int> FrameSlots;  // Allocas
+  std::map<std::string, IRBasicBlock*> LabelToBlock;
+  std::map<IRBasicBlock*, MachineBasicBlock*> BlockMap;
+  std::map<IRValue*, IRBinaryInst*> CompareDefs;  // Comparisons by result
+
+  // Pattern matching state
+  std::map<IRValue*, IRInstruction*> Defs;
+  std::map<IRValue*, unsigned> UseCounts;
+  std::map<IRInstruction*, size_t> Positions;  // Index within the block
+  std::set<IRInstruction*> Covered;           // Selected as part of a user
+  std::map<IRInstruction*, AddressMode> Addresses;  // lea roots, loads, stores
+  std::map<IRInstruction*, IRLoadInst*> FoldedLoads;  // Memory operands
+  std::set<IRBinaryInst*> FusedCompares;  // Only set flags for their users
+
+  void matchPatterns(IRBasicBlock* BB);
+  bool isFoldable(IRValue* V, IRInstruction* User);
+  IRLoadInst* getFoldableLoad(IRValue* V, IRInstruction* User);
+  bool writesMemoryBetween(IRInstruction* From, IRInstruction* To);
+  bool matchAddress(IRValue* V, IRInstruction* User, AddressMode& AM,
+                    std::vector<IRInstruction*>& Matched, unsigned Depth);
+  bool matchAddressNode(IRInstruction* I, AddressMode& AM,
+                        std::vector<IRInstruction*>& Matched, unsigned Depth);
+  MachineOperand getAddressOperand(const AddressMode& AM);
+
+  // Operand construction
+  unsigned getVReg(IRValue* V);
+  unsigned getReg(IRValue* V);  // Materializes constants
+  MachineOperand getRegOrImm(IRValue* V);
+  MachineOperand getAddress(IRValue* Ptr);
+  MachineOperand getAddress(IRInstruction* Access, IRValue* Ptr);
+  MachineBasicBlock* getBlock(IRValue* Label);
+
+  MachineInstr* emit(X86::Opcode Op, std::vector<MachineOperand> Ops,
+                     X86::CondCode CC = X86::COND_NONE);
+  void emitCopy(unsigned Dst, const MachineOperand& Src);
+
+  // Instruction selection
+  void selectInstruction(IRInstruction* I);
+  void selectBinary(IRBinaryInst* I);
+  void selectMulByConstant(unsigned Result, IRValue* X, int64_t C);
+  void selectCompare(IRBinaryInst* I);
+  X86::CondCode emitCompare(IRBinaryInst* Cmp);
+  void selectDivRem(IRBinaryInst* I);
+  void selectDivRemByConstant(bool IsRem, int64_t D, unsigned Result);
+  void selectUnary(IRUnaryInst* I);
+  void selectLoad(IRLoadInst* I);
+  void selectStore(IRStoreInst* I);
+  void selectRet(IRRetInst* I);
+  void selectBr(IRBrInst* I);
+  void selectCondBr(IRCondBrInst* I);
+  void selectCall(IRCallInst* I);
+  void selectSelect(IRSelectInst* I);
+  bool selectFusedCompare(IRValue* Cond, X86::CondCode& CC);
+  void selectPhiCopies(IRBasicBlock* From, IRBasicBlock* To);
+
+  // Switch lowering. The selector is in r11; each case names the block it
+  // jumps to, sorted by value.
+  using SwitchCaseList = std::vector<std::pair<int64_t, MachineBasicBlock*>>;
+  void selectSwitch(IRSwitchInst* I);
+  void emitCompareImm(unsigned Reg, int64_t Value);
+  void emitSwitchRangeCheck(int64_t Min, uint64_t Span,
+                            MachineBasicBlock* Default);
+  void emitSwitchJumpTable(const SwitchCaseList& Cases,
+                           MachineBasicBlock* Default);
+  void emitSwitchBitTests(const SwitchCaseList& Cases,
+                          MachineBasicBlock* Default);
+  void emitSwitchCompareTree(const SwitchCaseList& Cases, size_t Lo, size_t Hi,
+                             MachineBasicBlock* Default,
+                             const std::string& Prefix, unsigned& NextLabel);
+  void emitBranch(X86::CondCode CC, MachineBasicBlock* Target);
+};
+
+} // namespace yac
+
+#endif // YAC_CODEGEN_X86ISEL_H
@@ -2,20 +2,28 @@
 #define YAC_CODEGEN_X86_64BACKEND_H
 
 #include "yac/CodeGen/IR.h"
-#include "yac/CodeGen/RegisterAllocator.h"
+#include "yac/CodeGen/MachineIR.h"
 #include <iostream>
 #include <map>
-#include <set>
 #include <string>
-#include <vector>
 
 namespace yac {
 
-/// X86_64Backend - generates x86-64 assembly from IR
-/// Uses linear scan register allocation
+/// RegAllocKind - which register allocator the backend runs
+enum class RegAllocKind {
+  LinearScan,     // Fast; splits intervals rather than spilling them whole
+  GraphColoring   // Iterated register coalescing; slower, fewer copies
+};
+
+/// X86_64Backend - generates x86-64 assembly from IR. Each function goes
+/// through instruction selection to machine IR, register allocation,
+/// branch cleanup, stack slot coloring, frame lowering and the assembly
+/// printer.
 class X86_64Backend {
 public:
-  X86_64Backend(std::ostream& Out) : OS(Out) {}
+  X86_64Backend(std::ostream& Out,
+                RegAllocKind RegAlloc = RegAllocKind::LinearScan)
+      : OS(Out), RegAlloc(RegAlloc) {}
 
   /// Generate assembly for a module
   void generateAssembly(IRModule* M);
@@ -23,33 +31,22 @@ public:
   /// Generate assembly for a function
   void generateFunction(IRFunction* F);
 
+  /// Frame bytes stack slot coloring saved, per function generated
+  const std::map<std::string, int64_t>& getFrameBytesSaved() const {
+    return FrameBytesSaved;
+  }
+
 private:
   std::ostream& OS;
-  RegisterAllocator* RegAlloc = nullptr;  // Current function's allocator
-  std::map<std::string, IRBasicBlock*> LabelToBlock;  // Maps label names to blocks
-
-  // Instruction generation
-  void generateInstruction(IRInstruction* I);
-  void generateBinaryInst(IRBinaryInst* I);
-  void generateUnaryInst(IRUnaryInst* I);
-  void generateLoadInst(IRLoadInst* I);
-  void generateStoreInst(IRStoreInst* I);
-  void generateAllocaInst(IRAllocaInst* I);
-  void generateRetInst(IRRetInst* I);
-  void generateBrInst(IRBrInst* I);
-  void generateCondBrInst(IRCondBrInst* I);
-  void generateCallInst(IRCallInst* I);
-  void generatePhiInst(IRPhiInst* I);
-
-  // Helper methods
-  std::string getOperand(IRValue* V);
-  std::string allocResult(IRValue* V);  // Allocate register for result
-  std::string getByteReg(const std::string& Reg);
-  void emitPrologue(IRFunction* F);
-  void emitEpilogue(IRFunction* F);
-  void emitPhiMoves(IRBasicBlock* FromBB, IRBasicBlock* ToBB);
-  void loadSpilledValue(IRValue* V, const std::string& TempReg);
-  void storeSpilledValue(IRValue* V, const std::string& TempReg);
+  RegAllocKind RegAlloc;
+  std::map<std::string, int64_t> FrameBytesSaved;
+
+  // Branches to the next block in layout become fallthroughs
+  void optimizeBranches(MachineFunction& MF);
+
+  // Frame lowering
+  void layoutFrame(MachineFunction& MF);
+  void insertPrologueEpilogue(MachineFunction& MF);
 };
 
 } // namespace yac
@@ -62,6 +62,9 @@ private:
   Stmt* parseWhileStatement();
   Stmt* parseForStatement();
   Stmt* parseDoStatement();
+  Stmt* parseSwitchStatement();
+  Stmt* parseCaseStatement();
+  Stmt* parseDefaultStatement();
   Stmt* parseReturnStatement();
   Stmt* parseExpressionStatement();
 
@@ -33,6 +33,10 @@ enum class TokenKind {
   KW_return,
   KW_break,
   KW_continue,
+  KW_switch,
+  KW_case,
+  KW_default,
+  KW_static,
 
   // Operators
   Plus,           // +
@@ -72,6 +76,7 @@ enum class TokenKind {
   RBracket,       // ]
   Comma,          // ,
   Semicolon,      // ;
+  Colon,          // :
 
   // Special
   Unknown
@@ -128,7 +133,7 @@ public:
   }
 
   bool isKeyword() const {
-    return Kind >= TokenKind::KW_int && Kind <= TokenKind::KW_continue;
+    return Kind >= TokenKind::KW_int && Kind <= TokenKind::KW_default;
   }
 
   bool isOperator() const {
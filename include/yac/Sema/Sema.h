@@ -6,6 +6,8 @@
 #include "yac/Basic/Diagnostic.h"
 #include "yac/Sema/SymbolTable.h"
 #include "yac/Type/Type.h"
+#include <set>
+#include <vector>
 
 namespace yac {
 
@@ -20,6 +22,13 @@ class Sema : public ASTVisitor {
   FunctionDecl* CurrentFunction = nullptr;
   int LoopDepth = 0;  // Track if we're inside a loop (for break/continue)
 
+  // Case values seen by each enclosing switch, innermost last
+  struct SwitchInfo {
+    std::set<int64_t> CaseValues;
+    bool HasDefault = false;
+  };
+  std::vector<SwitchInfo> SwitchStack;
+
   // Type of the last visited expression (for type checking)
   Type* LastExprType = nullptr;
 
@@ -50,6 +59,9 @@ public:
   void visitDoStmt(DoStmt* S) override;
   void visitBreakStmt(BreakStmt* S) override;
   void visitContinueStmt(ContinueStmt* S) override;
+  void visitSwitchStmt(SwitchStmt* S) override;
+  void visitCaseStmt(CaseStmt* S) override;
+  void visitDefaultStmt(DefaultStmt* S) override;
 
   // Visitor methods for expressions
   void visitIntegerLiteral(IntegerLiteral* E) override;
@@ -75,6 +87,10 @@ private:
   bool isIntegerType(Type* Ty);
   bool isScalarType(Type* Ty);
 
+  /// Fold an integer constant expression (case labels). Returns false if
+  /// E is not a constant.
+  bool evaluateIntegerConstant(Expr* E, int64_t& Result);
+
   /// Symbol table helpers
   bool declareSymbol(const std::string& Name, Type* Ty, Decl* D, Symbol::SymbolKind Kind);
   Symbol* lookupSymbol(const std::string& Name, SourceLocation Loc);
@@ -90,6 +90,15 @@ void ASTVisitor::visit(Stmt* S) {
   case ASTNode::NK_ContinueStmt:
     visitContinueStmt(static_cast<ContinueStmt*>(S));
     break;
+  case ASTNode::NK_SwitchStmt:
+    visitSwitchStmt(static_cast<SwitchStmt*>(S));
+    break;
+  case ASTNode::NK_CaseStmt:
+    visitCaseStmt(static_cast<CaseStmt*>(S));
+    break;
+  case ASTNode::NK_DefaultStmt:
+    visitDefaultStmt(static_cast<DefaultStmt*>(S));
+    break;
   default:
     break;
   }
@@ -353,6 +362,44 @@ void ASTPrinter::visitContinueStmt(ContinueStmt* S) {
   OS << "ContinueStmt\n";
 }
 
+void ASTPrinter::visitSwitchStmt(SwitchStmt* S) {
+  printIndent();
+  OS << "SwitchStmt:\n";
+  increaseIndent();
+  printIndent();
+  OS << "Condition:\n";
+  increaseIndent();
+  visit(S->getCondition());
+  decreaseIndent();
+  printIndent();
+  OS << "Body:\n";
+  increaseIndent();
+  visit(S->getBody());
+  decreaseIndent();
+  decreaseIndent();
+}
+
+void ASTPrinter::visitCaseStmt(CaseStmt* S) {
+  printIndent();
+  OS << "CaseStmt:\n";
+  increaseIndent();
+  printIndent();
+  OS << "Value:\n";
+  increaseIndent();
+  visit(S->getValueExpr());
+  decreaseIndent();
+  visit(S->getSubStmt());
+  decreaseIndent();
+}
+
+void ASTPrinter::visitDefaultStmt(DefaultStmt* S) {
+  printIndent();
+  OS << "DefaultStmt:\n";
+  increaseIndent();
+  visit(S->getSubStmt());
+  decreaseIndent();
+}
+
 // Declarations
 void ASTPrinter::visitVarDecl(VarDecl* D) {
   printIndent();
@@ -360,6 +407,9 @@ void ASTPrinter::visitVarDecl(VarDecl* D) {
   if (D->getType()) {
     OS << D->getType()->toString();
   }
+  if (D->isStatic()) {
+    OS << " static";
+  }
   OS << "\n";
   if (D->hasInit()) {
     increaseIndent();
@@ -387,6 +437,9 @@ void ASTPrinter::visitFunctionDecl(FunctionDecl* D) {
   if (D->getReturnType()) {
     OS << D->getReturnType()->toString();
   }
+  if (D->isStatic()) {
+    OS << " static";
+  }
   OS << "\n";
   increaseIndent();
   if (D->getNumParams() > 0) {
@@ -0,0 +1,62 @@
+#include "yac/CodeGen/DivisionByConstant.h"
+
+namespace yac {
+
+static uint64_t magnitude(int64_t D) {
+  // Negate in unsigned arithmetic so INT64_MIN does not overflow
+  return D < 0 ? 0 - static_cast<uint64_t>(D) : static_cast<uint64_t>(D);
+}
+
+bool isPowerOf2Divisor(int64_t D, unsigned& Log2) {
+  uint64_t AD = magnitude(D);
+  if (AD < 2 || (AD & (AD - 1)) != 0) {
+    return false;
+  }
+
+  Log2 = 0;
+  while ((AD >>= 1) != 0) {
+    ++Log2;
+  }
+  return true;
+}
+
+SignedDivMagic computeSignedDivMagic(int64_t D) {
+  const uint64_t Two63 = 1ULL << 63;
+
+  uint64_t AD = magnitude(D);
+  uint64_t T = Two63 + (static_cast<uint64_t>(D) >> 63);
+  uint64_t ANC = T - 1 - T % AD;  // Absolute value of nc
+  unsigned P = 63;
+  uint64_t Q1 = Two63 / ANC;      // 2^p / |nc|
+  uint64_t R1 = Two63 - Q1 * ANC; // rem(2^p, |nc|)
+  uint64_t Q2 = Two63 / AD;       // 2^p / |d|
+  uint64_t R2 = Two63 - Q2 * AD;  // rem(2^p, |d|)
+  uint64_t Delta;
+
+  do {
+    ++P;
+    Q1 <<= 1;
+    R1 <<= 1;
+    if (R1 >= ANC) {
+      ++Q1;
+      R1 -= ANC;
+    }
+    Q2 <<= 1;
+    R2 <<= 1;
+    if (R2 >= AD) {
+      ++Q2;
+      R2 -= AD;
+    }
+    Delta = AD - R2;
+  } while (Q1 < Delta || (Q1 == Delta && R1 == 0));
+
+  SignedDivMagic Magic;
+  Magic.Multiplier = static_cast<int64_t>(Q2 + 1);
+  if (D < 0) {
+    Magic.Multiplier = static_cast<int64_t>(0 - static_cast<uint64_t>(Magic.Multiplier));
+  }
+  Magic.Shift = P - 64;
+  return Magic;
+}
+
+} // namespace yac
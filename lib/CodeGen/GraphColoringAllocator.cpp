@@ -0,0 +1,537 @@
+#include "yac/CodeGen/GraphColoringAllocator.h"
+#include "yac/CodeGen/RegisterAllocator.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+namespace yac {
+
+using MO = MachineOperand;
+
+static bool isInt32(int64_t V) { return V >= INT32_MIN && V <= INT32_MAX; }
+
+// Physical registers never leave the graph
+static constexpr unsigned InfiniteDegree = UINT_MAX / 2;
+
+void GraphColoringAllocator::allocate(MachineFunction& MF) {
+  Precolored = std::set<unsigned>(AvailableRegs.begin(), AvailableRegs.end());
+  VRegToStackSlot.clear();
+  NoSpill.clear();
+  NumSpilled = 0;
+  NumCoalesced = 0;
+
+  // Spilled registers are replaced by short-lived temporaries around each
+  // use and def, which changes the graph; start over until nothing spills
+  while (true) {
+    reset();
+    build(MF);
+    makeWorklist();
+    while (!SimplifyWorklist.empty() || !WorklistMoves.empty() ||
+           !FreezeWorklist.empty() || !SpillWorklist.empty()) {
+      if (!SimplifyWorklist.empty()) {
+        simplify();
+      } else if (!WorklistMoves.empty()) {
+        coalesce();
+      } else if (!FreezeWorklist.empty()) {
+        freeze();
+      } else {
+        selectSpill();
+      }
+    }
+    assignColors();
+    if (SpilledNodes.empty()) break;
+    rewriteProgram(MF);
+  }
+
+  NumCoalesced = static_cast<unsigned>(CoalescedMoves.size());
+  rewriteVirtualRegisters(MF);
+  expandParallelCopies(MF);
+}
+
+void GraphColoringAllocator::reset() {
+  AdjSet.clear();
+  AdjList.clear();
+  Degree.clear();
+  SpillCost.clear();
+  Moves.clear();
+  MoveList.clear();
+  Alias.clear();
+  Color.clear();
+  Initial.clear();
+  SimplifyWorklist.clear();
+  FreezeWorklist.clear();
+  SpillWorklist.clear();
+  SpilledNodes.clear();
+  CoalescedNodes.clear();
+  ColoredNodes.clear();
+  OnStack.clear();
+  SelectStack.clear();
+  CoalescedMoves.clear();
+  ConstrainedMoves.clear();
+  FrozenMoves.clear();
+  WorklistMoves.clear();
+  ActiveMoves.clear();
+
+  for (unsigned Reg : Precolored) {
+    Color[Reg] = Reg;
+    Degree[Reg] = InfiniteDegree;
+  }
+}
+
+bool GraphColoringAllocator::isNode(unsigned Reg) const {
+  // r10, r11, rsp and rbp are never handed out, so nothing competes
+  // with their uses
+  return X86::isVirtualRegister(Reg) || isPrecolored(Reg);
+}
+
+// ===----------------------------------------------------------------------===
+// Graph construction
+// ===----------------------------------------------------------------------===
+
+void GraphColoringAllocator::build(const MachineFunction& MF) {
+  MachineLiveness LV;
+  LV.compute(MF);
+  MachineLoopInfo Loops;
+  Loops.compute(MF);
+
+  for (const auto& MBB : MF.getBlocks()) {
+    // Each use or def costs a memory access if spilled, ten times over
+    // for every loop around it
+    double Weight = std::pow(10.0, std::min(Loops.getLoopDepth(MBB.get()), 6u));
+
+    // Physical registers never live across blocks: the instruction
+    // selector copies them to and from virtual registers next to the
+    // instruction that needs them
+    std::set<unsigned> Live = LV.getLiveOut(MBB.get());
+    const auto& Instrs = MBB->instrs();
+    for (auto It = Instrs.rbegin(); It != Instrs.rend(); ++It) {
+      const MachineInstr& MI = **It;
+
+      std::vector<unsigned> Uses, Defs;
+      for (unsigned Reg : MI.getUses()) {
+        if (isNode(Reg)) Uses.push_back(Reg);
+      }
+      for (unsigned Reg : MI.getDefs()) {
+        if (isNode(Reg)) Defs.push_back(Reg);
+      }
+      for (unsigned Reg : Uses) {
+        if (X86::isVirtualRegister(Reg)) SpillCost[Reg] += Weight;
+      }
+      for (unsigned Reg : Defs) {
+        if (X86::isVirtualRegister(Reg)) SpillCost[Reg] += Weight;
+      }
+
+      // Copy source of each defined register: a candidate for coalescing,
+      // and the one live value the destination does not interfere with
+      std::map<unsigned, unsigned> CopySrc;
+      auto addCopy = [&](const MO& Dst, const MO& Src) {
+        if (!Dst.isReg() || !Src.isReg() || Dst.getSize() != 8 ||
+            Src.getSize() != 8 || !isNode(Dst.getReg()) ||
+            !isNode(Src.getReg())) {
+          return;
+        }
+        CopySrc[Dst.getReg()] = Src.getReg();
+      };
+      if (MI.getOpcode() == X86::PCOPY) {
+        for (size_t i = 0; i + 1 < MI.getNumOperands(); i += 2)
+          addCopy(MI.getOperand(i), MI.getOperand(i + 1));
+      } else if (MI.isCopy()) {
+        addCopy(MI.getOperand(0), MI.getOperand(1));
+      }
+      for (const auto& [Dst, Src] : CopySrc) {
+        if (Dst == Src) continue;
+        if (!X86::isVirtualRegister(Dst) && !X86::isVirtualRegister(Src))
+          continue;
+        unsigned M = static_cast<unsigned>(Moves.size());
+        Moves.push_back({Dst, Src});
+        MoveList[Dst].push_back(M);
+        MoveList[Src].push_back(M);
+        WorklistMoves.insert(M);
+      }
+
+      for (unsigned D : Defs) {
+        auto Src = CopySrc.find(D);
+        for (unsigned L : Live) {
+          if (Src == CopySrc.end() || Src->second != L) addEdge(L, D);
+        }
+        for (unsigned Other : Defs) addEdge(D, Other);
+      }
+      for (unsigned D : Defs) Live.erase(D);
+      for (unsigned U : Uses) Live.insert(U);
+      for (unsigned Reg : Uses) {
+        if (X86::isVirtualRegister(Reg)) Initial.insert(Reg);
+      }
+      for (unsigned Reg : Defs) {
+        if (X86::isVirtualRegister(Reg)) Initial.insert(Reg);
+      }
+    }
+  }
+}
+
+void GraphColoringAllocator::addEdge(unsigned U, unsigned V) {
+  if (U == V || AdjSet.count({U, V})) return;
+  if (isPrecolored(U) && isPrecolored(V)) return;
+  AdjSet.insert({U, V});
+  AdjSet.insert({V, U});
+  if (!isPrecolored(U)) {
+    AdjList[U].push_back(V);
+    Degree[U]++;
+  }
+  if (!isPrecolored(V)) {
+    AdjList[V].push_back(U);
+    Degree[V]++;
+  }
+}
+
+void GraphColoringAllocator::makeWorklist() {
+  unsigned K = static_cast<unsigned>(AvailableRegs.size());
+  for (unsigned N : Initial) {
+    if (Degree[N] >= K) {
+      SpillWorklist.insert(N);
+    } else if (isMoveRelated(N)) {
+      FreezeWorklist.insert(N);
+    } else {
+      SimplifyWorklist.insert(N);
+    }
+  }
+  Initial.clear();
+}
+
+// ===----------------------------------------------------------------------===
+// Simplification, coalescing and freezing
+// ===----------------------------------------------------------------------===
+
+std::vector<unsigned> GraphColoringAllocator::adjacent(unsigned N) const {
+  std::vector<unsigned> Result;
+  auto It = AdjList.find(N);
+  if (It == AdjList.end()) return Result;
+  for (unsigned M : It->second) {
+    if (!OnStack.count(M) && !CoalescedNodes.count(M)) Result.push_back(M);
+  }
+  return Result;
+}
+
+std::vector<unsigned> GraphColoringAllocator::nodeMoves(unsigned N) const {
+  std::vector<unsigned> Result;
+  auto It = MoveList.find(N);
+  if (It == MoveList.end()) return Result;
+  for (unsigned M : It->second) {
+    if (ActiveMoves.count(M) || WorklistMoves.count(M)) Result.push_back(M);
+  }
+  return Result;
+}
+
+void GraphColoringAllocator::simplify() {
+  unsigned N = *SimplifyWorklist.begin();
+  SimplifyWorklist.erase(SimplifyWorklist.begin());
+  SelectStack.push_back(N);
+  OnStack.insert(N);
+  for (unsigned M : adjacent(N)) decrementDegree(M);
+}
+
+void GraphColoringAllocator::decrementDegree(unsigned M) {
+  unsigned K = static_cast<unsigned>(AvailableRegs.size());
+  unsigned D = Degree[M];
+  Degree[M] = D - 1;
+  if (D != K) return;
+
+  // M just became colorable
+  std::vector<unsigned> Nodes = adjacent(M);
+  Nodes.push_back(M);
+  enableMoves(Nodes);
+  SpillWorklist.erase(M);
+  if (isMoveRelated(M)) {
+    FreezeWorklist.insert(M);
+  } else {
+    SimplifyWorklist.insert(M);
+  }
+}
+
+void GraphColoringAllocator::enableMoves(const std::vector<unsigned>& Nodes) {
+  for (unsigned N : Nodes) {
+    for (unsigned M : nodeMoves(N)) {
+      if (ActiveMoves.erase(M)) WorklistMoves.insert(M);
+    }
+  }
+}
+
+void GraphColoringAllocator::coalesce() {
+  unsigned M = *WorklistMoves.begin();
+  WorklistMoves.erase(WorklistMoves.begin());
+  unsigned X = getAlias(Moves[M].Dst);
+  unsigned Y = getAlias(Moves[M].Src);
+  unsigned U = isPrecolored(Y) ? Y : X;
+  unsigned V = isPrecolored(Y) ? X : Y;
+
+  if (U == V) {
+    CoalescedMoves.insert(M);
+    addWorklist(U);
+    return;
+  }
+  if (isPrecolored(V) || AdjSet.count({U, V})) {
+    ConstrainedMoves.insert(M);
+    addWorklist(U);
+    addWorklist(V);
+    return;
+  }
+
+  // George's test against a physical register, Briggs' otherwise
+  bool CanCombine;
+  if (isPrecolored(U)) {
+    CanCombine = true;
+    for (unsigned T : adjacent(V)) {
+      if (!isOK(T, U)) CanCombine = false;
+    }
+  } else {
+    std::vector<unsigned> Nodes = adjacent(U);
+    std::vector<unsigned> More = adjacent(V);
+    Nodes.insert(Nodes.end(), More.begin(), More.end());
+    std::sort(Nodes.begin(), Nodes.end());
+    Nodes.erase(std::unique(Nodes.begin(), Nodes.end()), Nodes.end());
+    CanCombine = isConservative(Nodes);
+  }
+  if (CanCombine) {
+    CoalescedMoves.insert(M);
+    combine(U, V);
+    addWorklist(U);
+  } else {
+    ActiveMoves.insert(M);
+  }
+}
+
+void GraphColoringAllocator::addWorklist(unsigned U) {
+  unsigned K = static_cast<unsigned>(AvailableRegs.size());
+  if (!isPrecolored(U) && !isMoveRelated(U) && Degree[U] < K) {
+    FreezeWorklist.erase(U);
+    SimplifyWorklist.insert(U);
+  }
+}
+
+bool GraphColoringAllocator::isOK(unsigned T, unsigned R) const {
+  unsigned K = static_cast<unsigned>(AvailableRegs.size());
+  return Degree.at(T) < K || isPrecolored(T) || AdjSet.count({T, R});
+}
+
+bool GraphColoringAllocator::isConservative(
+    const std::vector<unsigned>& Nodes) const {
+  unsigned K = static_cast<unsigned>(AvailableRegs.size());
+  unsigned Significant = 0;
+  for (unsigned N : Nodes) {
+    if (Degree.at(N) >= K) Significant++;
+  }
+  return Significant < K;
+}
+
+unsigned GraphColoringAllocator::getAlias(unsigned N) const {
+  while (CoalescedNodes.count(N)) N = Alias.at(N);
+  return N;
+}
+
+void GraphColoringAllocator::combine(unsigned U, unsigned V) {
+  unsigned K = static_cast<unsigned>(AvailableRegs.size());
+  if (!FreezeWorklist.erase(V)) SpillWorklist.erase(V);
+  CoalescedNodes.insert(V);
+  Alias[V] = U;
+  std::vector<unsigned>& UMoves = MoveList[U];
+  const std::vector<unsigned>& VMoves = MoveList[V];
+  UMoves.insert(UMoves.end(), VMoves.begin(), VMoves.end());
+  enableMoves({V});
+
+  for (unsigned T : adjacent(V)) {
+    addEdge(T, U);
+    decrementDegree(T);
+  }
+  if (Degree[U] >= K && FreezeWorklist.erase(U)) SpillWorklist.insert(U);
+
+  // The merged node costs what both halves did
+  if (!isPrecolored(U)) SpillCost[U] += SpillCost[V];
+  if (NoSpill.count(V)) NoSpill.insert(U);
+}
+
+void GraphColoringAllocator::freeze() {
+  unsigned U = *FreezeWorklist.begin();
+  FreezeWorklist.erase(FreezeWorklist.begin());
+  SimplifyWorklist.insert(U);
+  freezeMoves(U);
+}
+
+void GraphColoringAllocator::freezeMoves(unsigned U) {
+  unsigned K = static_cast<unsigned>(AvailableRegs.size());
+  for (unsigned M : nodeMoves(U)) {
+    unsigned X = Moves[M].Dst;
+    unsigned Y = Moves[M].Src;
+    unsigned V = getAlias(Y) == getAlias(U) ? getAlias(X) : getAlias(Y);
+    ActiveMoves.erase(M);
+    FrozenMoves.insert(M);
+    if (!isPrecolored(V) && nodeMoves(V).empty() && Degree[V] < K) {
+      FreezeWorklist.erase(V);
+      SimplifyWorklist.insert(V);
+    }
+  }
+}
+
+void GraphColoringAllocator::selectSpill() {
+  // Cheapest per neighbour it would free up; reload and store
+  // temporaries only when nothing else is left
+  unsigned Best = 0;
+  double BestCost = 0;
+  for (unsigned N : SpillWorklist) {
+    double Cost = SpillCost[N] / std::max(Degree[N], 1u);
+    if (NoSpill.count(N)) Cost += 1e30;
+    if (Best == 0 || Cost < BestCost) {
+      Best = N;
+      BestCost = Cost;
+    }
+  }
+  SpillWorklist.erase(Best);
+  SimplifyWorklist.insert(Best);
+  freezeMoves(Best);
+}
+
+// ===----------------------------------------------------------------------===
+// Coloring and rewriting
+// ===----------------------------------------------------------------------===
+
+void GraphColoringAllocator::assignColors() {
+  while (!SelectStack.empty()) {
+    unsigned N = SelectStack.back();
+    SelectStack.pop_back();
+    OnStack.erase(N);
+
+    std::set<unsigned> Taken;
+    for (unsigned W : AdjList[N]) {
+      unsigned A = getAlias(W);
+      if (ColoredNodes.count(A) || isPrecolored(A)) Taken.insert(Color[A]);
+    }
+
+    // Caller-saved registers come first in the pool
+    unsigned Reg = X86::NoReg;
+    for (unsigned R : AvailableRegs) {
+      if (!Taken.count(R)) {
+        Reg = R;
+        break;
+      }
+    }
+    if (Reg == X86::NoReg) {
+      SpilledNodes.insert(N);
+    } else {
+      ColoredNodes.insert(N);
+      Color[N] = Reg;
+    }
+  }
+  for (unsigned N : CoalescedNodes) {
+    unsigned A = getAlias(N);
+    if (Color.count(A)) Color[N] = Color[A];
+  }
+}
+
+void GraphColoringAllocator::rewriteProgram(MachineFunction& MF) {
+  for (unsigned Reg : SpilledNodes) {
+    VRegToStackSlot[Reg] = MF.createStackObject(8, 8, /*IsSpillSlot=*/true);
+    NumSpilled++;
+  }
+  auto isSpilled = [&](const MO& Op) {
+    return Op.isReg() && SpilledNodes.count(Op.getReg());
+  };
+  auto getSlot = [&](unsigned Reg) {
+    return MO::createFrameIndex(VRegToStackSlot[Reg]);
+  };
+
+  for (const auto& MBB : MF.getBlocks()) {
+    auto Instrs = MBB->takeInstrs();
+    for (auto& MI : Instrs) {
+      std::vector<unsigned> Refs;
+      for (unsigned Reg : MI->getUses())
+        if (SpilledNodes.count(Reg)) Refs.push_back(Reg);
+      for (unsigned Reg : MI->getDefs())
+        if (SpilledNodes.count(Reg) &&
+            std::find(Refs.begin(), Refs.end(), Reg) == Refs.end())
+          Refs.push_back(Reg);
+      if (Refs.empty()) {
+        MBB->push_back(std::move(MI));
+        continue;
+      }
+
+      // Parallel copies take stack slots directly; their expansion routes
+      // memory-to-memory copies through a scratch register
+      if (MI->getOpcode() == X86::PCOPY) {
+        for (MO& Op : MI->operands()) {
+          if (isSpilled(Op)) Op = getSlot(Op.getReg());
+        }
+        MBB->push_back(std::move(MI));
+        continue;
+      }
+
+      // A mov between a spilled register and a register or small immediate
+      // becomes a load or store
+      if (MI->getOpcode() == X86::MOV && MI->getNumOperands() == 2) {
+        MO& Dst = MI->getOperand(0);
+        MO& Src = MI->getOperand(1);
+        bool SrcOK = (Src.isReg() && !isSpilled(Src) && Src.getSize() == 8) ||
+                     (Src.isImm() && isInt32(Src.getImm()));
+        if (isSpilled(Dst) && SrcOK) {
+          Dst = getSlot(Dst.getReg());
+          MBB->push_back(std::move(MI));
+          continue;
+        }
+        if (isSpilled(Src) && Dst.isReg() && !isSpilled(Dst) &&
+            Dst.getSize() == 8) {
+          Src = getSlot(Src.getReg());
+          MBB->push_back(std::move(MI));
+          continue;
+        }
+      }
+
+      // Otherwise reload into a fresh temporary before the instruction and
+      // store it back after
+      std::vector<unsigned> Uses = MI->getUses();
+      std::vector<unsigned> Defs = MI->getDefs();
+      std::vector<std::unique_ptr<MachineInstr>> Stores;
+      for (unsigned Reg : Refs) {
+        unsigned Temp = MF.createVirtualRegister();
+        NoSpill.insert(Temp);
+        if (std::find(Uses.begin(), Uses.end(), Reg) != Uses.end()) {
+          MBB->push_back(std::make_unique<MachineInstr>(
+            X86::MOV, std::vector<MO>{MO::createReg(Temp, MO::Def),
+                                      getSlot(Reg)}));
+        }
+        if (std::find(Defs.begin(), Defs.end(), Reg) != Defs.end()) {
+          Stores.push_back(std::make_unique<MachineInstr>(
+            X86::MOV, std::vector<MO>{getSlot(Reg), MO::createReg(Temp)}));
+        }
+        MI->substituteReg(Reg, Temp);
+      }
+      MBB->push_back(std::move(MI));
+      for (auto& Store : Stores) MBB->push_back(std::move(Store));
+    }
+  }
+}
+
+void GraphColoringAllocator::rewriteVirtualRegisters(MachineFunction& MF) {
+  for (const auto& MBB : MF.getBlocks()) {
+    auto Instrs = MBB->takeInstrs();
+    for (auto& MI : Instrs) {
+      for (MO& Op : MI->operands()) {
+        if (Op.isReg() && X86::isVirtualRegister(Op.getReg())) {
+          Op.setReg(Color[Op.getReg()]);
+        } else if (Op.isMem()) {
+          if (X86::isVirtualRegister(Op.getBase()))
+            Op.setReg(Color[Op.getBase()]);
+          if (X86::isVirtualRegister(Op.getIndex()))
+            Op.setIndex(Color[Op.getIndex()]);
+        }
+      }
+
+      // Copies between values that ended up in the same register
+      if (MI->isCopy() &&
+          MI->getOperand(0).getReg() == MI->getOperand(1).getReg() &&
+          MI->getOperand(0).getSize() == MI->getOperand(1).getSize()) {
+        continue;
+      }
+      MBB->push_back(std::move(MI));
+    }
+  }
+}
+
+} // namespace yac
@@ -0,0 +1,781 @@
+#include "yac/CodeGen/IPO.h"
+#include "yac/CodeGen/IRUtils.h"
+#include "yac/CodeGen/Transforms.h"
+#include <algorithm>
+
+namespace yac {
+
+// ===----------------------------------------------------------------------===
+// Call Graph
+// ===----------------------------------------------------------------------===
+
+CallGraph::CallGraph(IRModule* M) {
+  for (const auto& F : M->getFunctions()) {
+    Functions[F->getName()] = F.get();
+  }
+
+  for (const auto& F : M->getFunctions()) {
+    for (const auto& BB : F->getBlocks()) {
+      for (const auto& Inst : BB->getInstructions()) {
+        auto* Call = dynamic_cast<IRCallInst*>(Inst.get());
+        if (!Call) continue;
+
+        if (IRFunction* Callee = getFunction(Call->getFuncName())) {
+          CallSites[Callee].push_back(Call);
+          Callees[F.get()].insert(Callee);
+        }
+      }
+    }
+  }
+}
+
+IRFunction* CallGraph::getFunction(const std::string& Name) const {
+  auto It = Functions.find(Name);
+  return It != Functions.end() ? It->second : nullptr;
+}
+
+const std::vector<IRCallInst*>& CallGraph::getCallSites(IRFunction* F) const {
+  static const std::vector<IRCallInst*> None;
+  auto It = CallSites.find(F);
+  return It != CallSites.end() ? It->second : None;
+}
+
+const std::set<IRFunction*>& CallGraph::getCallees(IRFunction* F) const {
+  static const std::set<IRFunction*> None;
+  auto It = Callees.find(F);
+  return It != Callees.end() ? It->second : None;
+}
+
+// ===----------------------------------------------------------------------===
+// IPSCCP (Interprocedural Sparse Conditional Constant Propagation) Pass
+// ===----------------------------------------------------------------------===
+
+IPSCCPPass::LatticeCell IPSCCPPass::meet(const LatticeCell& A,
+                                         const LatticeCell& B) {
+  if (A.State == Undefined) return B;
+  if (B.State == Undefined) return A;
+  if (A.State == Overdefined || B.State == Overdefined) {
+    return {Overdefined, 0};
+  }
+  if (A.ConstVal == B.ConstVal) {
+    return A;
+  }
+  return {Overdefined, 0};
+}
+
+IPSCCPPass::LatticeCell IPSCCPPass::getCell(IRValue* V) {
+  if (V->isConstant()) {
+    return {Constant, V->getConstant()};
+  }
+  return ValueState[V];
+}
+
+void IPSCCPPass::mergeInValue(IRValue* V, const LatticeCell& Cell) {
+  LatticeCell& Old = ValueState[V];
+  LatticeCell New = meet(Old, Cell);
+  if (New.State == Old.State && New.ConstVal == Old.ConstVal) return;
+
+  Old = New;
+  for (IRInstruction* User : Users[V]) {
+    WorkList.push_back(User);
+  }
+}
+
+void IPSCCPPass::mergeInReturn(IRFunction* F, const LatticeCell& Cell) {
+  LatticeCell& Old = ReturnState[F];
+  LatticeCell New = meet(Old, Cell);
+  if (New.State == Old.State && New.ConstVal == Old.ConstVal) return;
+
+  // Every caller sees the new return value
+  Old = New;
+  for (IRCallInst* Call : CG->getCallSites(F)) {
+    WorkList.push_back(Call);
+  }
+}
+
+void IPSCCPPass::markEdgeExecutable(IRBasicBlock* From, IRBasicBlock* To) {
+  if (!ExecutableEdges.insert({From, To}).second) return;
+
+  if (ExecutableBlocks.count(To)) {
+    // Only the phis can see the new edge
+    for (const auto& Inst : To->getInstructions()) {
+      if (Inst->getOpcode() == IRInstruction::Phi) {
+        WorkList.push_back(Inst.get());
+      }
+    }
+    return;
+  }
+
+  markBlockExecutable(To);
+}
+
+void IPSCCPPass::markBlockExecutable(IRBasicBlock* BB) {
+  if (!ExecutableBlocks.insert(BB).second) return;
+
+  for (const auto& Inst : BB->getInstructions()) {
+    WorkList.push_back(Inst.get());
+  }
+}
+
+void IPSCCPPass::visitPhi(IRPhiInst* Phi) {
+  IRBasicBlock* BB = Phi->getParent();
+  LatticeCell Result;
+
+  for (const auto& Entry : Phi->getIncomings()) {
+    if (ExecutableEdges.count({Entry.Block, BB})) {
+      Result = meet(Result, getCell(Entry.Value));
+    }
+  }
+
+  mergeInValue(Phi->getResult(), Result);
+}
+
+void IPSCCPPass::visitCall(IRCallInst* Call) {
+  IRFunction* Callee = CG->getCallee(Call);
+
+  if (Callee && TrackedFunctions.count(Callee)) {
+    const auto& Params = Callee->getParameters();
+    const auto& Args = Call->getArgs();
+    for (size_t i = 0; i < Params.size(); ++i) {
+      mergeInValue(Params[i], i < Args.size() ? getCell(Args[i])
+                                              : LatticeCell{Overdefined, 0});
+    }
+    if (!Callee->getBlocks().empty()) {
+      markBlockExecutable(Callee->getBlocks()[0].get());
+    }
+  }
+
+  if (IRValue* Result = Call->getResult()) {
+    // External callees may return anything
+    mergeInValue(Result, Callee ? ReturnState[Callee]
+                                : LatticeCell{Overdefined, 0});
+  }
+}
+
+void IPSCCPPass::visitTerminator(IRInstruction* I) {
+  IRBasicBlock* BB = I->getParent();
+
+  if (auto* Ret = dynamic_cast<IRRetInst*>(I)) {
+    if (Ret->hasRetValue()) {
+      mergeInReturn(BB->getParent(), getCell(Ret->getRetValue()));
+    }
+    return;
+  }
+
+  // A constant condition makes only the taken edge executable
+  IRValue* Taken = nullptr;
+  if (auto* CondBr = dynamic_cast<IRCondBrInst*>(I)) {
+    LatticeCell Cond = getCell(CondBr->getCondition());
+    if (Cond.State == Undefined) return;
+    if (Cond.State == Constant) {
+      Taken = Cond.ConstVal ? CondBr->getTrueLabel() : CondBr->getFalseLabel();
+    }
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(I)) {
+    LatticeCell Cond = getCell(Switch->getCondition());
+    if (Cond.State == Undefined) return;
+    if (Cond.State == Constant) {
+      Taken = Switch->getDefaultLabel();
+      for (const auto& Case : Switch->getCases()) {
+        if (Case.Value == Cond.ConstVal) {
+          Taken = Case.Label;
+          break;
+        }
+      }
+    }
+  }
+
+  if (Taken) {
+    if (IRBasicBlock* Succ = getSuccessorForLabel(BB, Taken)) {
+      markEdgeExecutable(BB, Succ);
+    }
+    return;
+  }
+
+  for (IRBasicBlock* Succ : BB->getSuccessors()) {
+    markEdgeExecutable(BB, Succ);
+  }
+}
+
+void IPSCCPPass::visitInst(IRInstruction* I) {
+  if (I->isTerminator()) {
+    visitTerminator(I);
+    return;
+  }
+
+  if (auto* Phi = dynamic_cast<IRPhiInst*>(I)) {
+    visitPhi(Phi);
+  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    visitCall(Call);
+  } else if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+    LatticeCell LHS = getCell(BinOp->getLHS());
+    LatticeCell RHS = getCell(BinOp->getRHS());
+    if (LHS.State == Undefined || RHS.State == Undefined) return;
+
+    int64_t Result;
+    if (LHS.State == Constant && RHS.State == Constant &&
+        SCCPPass::tryEvaluateBinary(BinOp->getOpcode(), LHS.ConstVal,
+                                    RHS.ConstVal, Result)) {
+      mergeInValue(BinOp->getResult(), {Constant, Result});
+    } else {
+      mergeInValue(BinOp->getResult(), {Overdefined, 0});
+    }
+  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(I)) {
+    LatticeCell Op = getCell(UnOp->getOperand());
+    if (Op.State == Undefined) return;
+
+    int64_t Result;
+    if (Op.State == Constant &&
+        SCCPPass::tryEvaluateUnary(UnOp->getOpcode(), Op.ConstVal, Result)) {
+      mergeInValue(UnOp->getResult(), {Constant, Result});
+    } else {
+      mergeInValue(UnOp->getResult(), {Overdefined, 0});
+    }
+  } else if (auto* Sel = dynamic_cast<IRSelectInst*>(I)) {
+    LatticeCell Cond = getCell(Sel->getCondition());
+    if (Cond.State == Undefined) return;
+
+    if (Cond.State == Constant) {
+      mergeInValue(Sel->getResult(),
+                   getCell(Cond.ConstVal ? Sel->getTrueValue()
+                                         : Sel->getFalseValue()));
+    } else {
+      mergeInValue(Sel->getResult(), meet(getCell(Sel->getTrueValue()),
+                                          getCell(Sel->getFalseValue())));
+    }
+  } else if (auto* Move = dynamic_cast<IRMoveInst*>(I)) {
+    mergeInValue(Move->getResult(), getCell(Move->getOperand()));
+  } else if (IRValue* Def = getDefinedValue(I)) {
+    // Loads, allocas and conversions are not tracked
+    mergeInValue(Def, {Overdefined, 0});
+  }
+}
+
+bool IPSCCPPass::rewriteFunction(IRFunction* F) {
+  bool Changed = false;
+
+  // Parameters first: a constant passed by every caller
+  for (IRValue* Param : F->getParameters()) {
+    auto It = ValueState.find(Param);
+    if (It != ValueState.end() && It->second.State == Constant) {
+      replaceAllUsesWith(F, Param, F->createConstant(It->second.ConstVal));
+      Changed = true;
+    }
+  }
+
+  for (const auto& BB : F->getBlocks()) {
+    if (!ExecutableBlocks.count(BB.get())) continue;
+
+    std::vector<IRInstruction*> Dead;
+    for (const auto& Inst : BB->getInstructions()) {
+      IRValue* Def = getDefinedValue(Inst.get());
+      if (!Def) continue;
+
+      auto It = ValueState.find(Def);
+      if (It == ValueState.end() || It->second.State != Constant) continue;
+
+      replaceAllUsesWith(F, Def, F->createConstant(It->second.ConstVal));
+      Changed = true;
+
+      // Calls keep their side effects; only the result goes away
+      if (Inst->getOpcode() != IRInstruction::Call) {
+        Dead.push_back(Inst.get());
+      }
+    }
+    for (IRInstruction* I : Dead) {
+      BB->removeInstruction(I);
+    }
+  }
+
+  for (const auto& BB : F->getBlocks()) {
+    if (ExecutableBlocks.count(BB.get())) {
+      Changed |= foldConstantTerminator(BB.get());
+    }
+  }
+
+  Changed |= removeUnreachableBlocks(F);
+  return Changed;
+}
+
+bool IPSCCPPass::run(IRModule* M) {
+  CallGraph Graph(M);
+  CG = &Graph;
+
+  TrackedFunctions.clear();
+  ValueState.clear();
+  ReturnState.clear();
+  Users.clear();
+  ExecutableEdges.clear();
+  ExecutableBlocks.clear();
+  WorkList.clear();
+
+  // Only 'static' functions are sure to be called from nowhere but this
+  // module. Other files may call the rest with any arguments, so for them
+  // only what they return is propagated.
+  for (const auto& F : M->getFunctions()) {
+    if (F->isInternal()) {
+      TrackedFunctions.insert(F.get());
+    }
+
+    for (const auto& BB : F->getBlocks()) {
+      for (const auto& Inst : BB->getInstructions()) {
+        for (IRValue* Op : getOperands(Inst.get())) {
+          Users[Op].push_back(Inst.get());
+        }
+      }
+    }
+  }
+
+  // Untracked functions may be entered at any time with any arguments
+  for (const auto& F : M->getFunctions()) {
+    if (TrackedFunctions.count(F.get()) || F->getBlocks().empty()) continue;
+
+    for (IRValue* Param : F->getParameters()) {
+      mergeInValue(Param, {Overdefined, 0});
+    }
+    markBlockExecutable(F->getBlocks()[0].get());
+  }
+
+  while (!WorkList.empty()) {
+    IRInstruction* I = WorkList.back();
+    WorkList.pop_back();
+
+    if (ExecutableBlocks.count(I->getParent())) {
+      visitInst(I);
+    }
+  }
+
+  bool Changed = false;
+  for (const auto& F : M->getFunctions()) {
+    // Nothing is known about a function no live call reaches
+    if (F->getBlocks().empty() ||
+        !ExecutableBlocks.count(F->getBlocks()[0].get())) {
+      continue;
+    }
+    Changed |= rewriteFunction(F.get());
+  }
+
+  CG = nullptr;
+  return Changed;
+}
+
+// ===----------------------------------------------------------------------===
+// Function Specialization Pass
+// ===----------------------------------------------------------------------===
+
+namespace {
+
+size_t countInstructions(IRFunction* F) {
+  size_t Count = 0;
+  for (const auto& BB : F->getBlocks()) {
+    Count += BB->getInstructions().size();
+  }
+  return Count;
+}
+
+} // anonymous namespace
+
+std::set<size_t> FunctionSpecializationPass::findBranchParams(IRFunction* F) {
+  std::map<IRValue*, std::vector<IRInstruction*>> Users;
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      for (IRValue* Op : getOperands(Inst.get())) {
+        Users[Op].push_back(Inst.get());
+      }
+    }
+  }
+
+  std::set<size_t> Result;
+  const auto& Params = F->getParameters();
+  for (size_t i = 0; i < Params.size(); ++i) {
+    // Follow the values computed from the parameter until one of them
+    // picks a successor or a select operand
+    std::vector<IRValue*> WorkList = {Params[i]};
+    std::set<IRValue*> Seen = {Params[i]};
+    while (!WorkList.empty() && !Result.count(i)) {
+      IRValue* V = WorkList.back();
+      WorkList.pop_back();
+
+      for (IRInstruction* User : Users[V]) {
+        auto* CondBr = dynamic_cast<IRCondBrInst*>(User);
+        auto* Switch = dynamic_cast<IRSwitchInst*>(User);
+        auto* Sel = dynamic_cast<IRSelectInst*>(User);
+        if ((CondBr && CondBr->getCondition() == V) ||
+            (Switch && Switch->getCondition() == V) ||
+            (Sel && Sel->getCondition() == V)) {
+          Result.insert(i);
+          break;
+        }
+
+        // Only pure computations carry the constant forward
+        switch (User->getOpcode()) {
+          case IRInstruction::Load:
+          case IRInstruction::Store:
+          case IRInstruction::Alloca:
+          case IRInstruction::Call:
+            continue;
+          default:
+            break;
+        }
+        IRValue* Def = getDefinedValue(User);
+        if (Def && Seen.insert(Def).second) {
+          WorkList.push_back(Def);
+        }
+      }
+    }
+  }
+
+  return Result;
+}
+
+std::vector<FunctionSpecializationPass::Candidate>
+FunctionSpecializationPass::collectCandidates(IRModule* M,
+                                              const CallGraph& CG) {
+  std::vector<Candidate> Candidates;
+  std::map<std::pair<IRFunction*, std::map<size_t, int64_t>>, size_t> Index;
+  std::map<IRFunction*, LoopInfo> Loops;
+
+  for (const auto& F : M->getFunctions()) {
+    if (F->getName() == "main" || F->getBlocks().empty() ||
+        countInstructions(F.get()) > MaxFunctionSize) {
+      continue;
+    }
+
+    std::set<size_t> BranchParams = findBranchParams(F.get());
+    if (BranchParams.empty()) continue;
+
+    for (IRCallInst* Call : CG.getCallSites(F.get())) {
+      std::map<size_t, int64_t> Args;
+      for (size_t i : BranchParams) {
+        if (i < Call->getArgs().size() && Call->getArgs()[i]->isConstant()) {
+          Args[i] = Call->getArgs()[i]->getConstant();
+        }
+      }
+      if (Args.empty()) continue;
+
+      // A call inside a loop counts for more than one outside
+      IRFunction* Caller = Call->getParent()->getParent();
+      auto LI = Loops.find(Caller);
+      if (LI == Loops.end()) {
+        LI = Loops.emplace(Caller, LoopInfo()).first;
+        LI->second.run(Caller);
+      }
+      unsigned Depth = std::min(LI->second.getLoopDepth(Call->getParent()), 4u);
+      unsigned Weight = 1;
+      for (unsigned d = 0; d < Depth; ++d) {
+        Weight *= 8;
+      }
+
+      auto Key = std::make_pair(F.get(), Args);
+      auto It = Index.find(Key);
+      if (It == Index.end()) {
+        It = Index.emplace(Key, Candidates.size()).first;
+        Candidates.push_back({F.get(), Args, {}, 0});
+      }
+      Candidates[It->second].Calls.push_back(Call);
+      Candidates[It->second].Weight += Weight;
+    }
+  }
+
+  std::stable_sort(Candidates.begin(), Candidates.end(),
+                   [](const Candidate& A, const Candidate& B) {
+                     return A.Weight > B.Weight;
+                   });
+  return Candidates;
+}
+
+IRFunction* FunctionSpecializationPass::specialize(IRModule* M,
+                                                   const Candidate& C,
+                                                   const std::string& Name) {
+  CloneMap VMap;
+  IRFunction* Clone = cloneFunction(M, C.Callee, Name, VMap);
+  Clone->setLinkage(Linkage::Internal);
+  for (const auto& Arg : C.Args) {
+    replaceAllUsesWith(Clone, Clone->getParameters()[Arg.first],
+                       Clone->createConstant(Arg.second));
+  }
+
+  // The parts of the function pipeline that fold known arguments
+  AnalysisManager AM(Clone);
+  SCCPPass SCCP;
+  CopyPropagationPass CopyProp;
+  SimplifyCFGPass SimplifyCFG;
+  SCCP.run(Clone, AM);
+  AM.invalidate(Analysis::All);
+  CopyProp.run(Clone, AM);
+  SimplifyCFG.run(Clone, AM);
+
+  if (countInstructions(Clone) >= countInstructions(C.Callee)) {
+    M->removeFunction(Clone);
+    return nullptr;
+  }
+  return Clone;
+}
+
+bool FunctionSpecializationPass::run(IRModule* M) {
+  CallGraph CG(M);
+  std::vector<Candidate> Candidates = collectCandidates(M, CG);
+
+  std::map<IRFunction*, unsigned> NumClones;
+  size_t Used = 0;
+  bool Changed = false;
+
+  for (const Candidate& C : Candidates) {
+    // Sorted by weight, so every remaining tuple is colder still
+    if (C.Weight < MinWeight) break;
+
+    unsigned& N = NumClones[C.Callee];
+    if (N >= MaxClones) continue;
+
+    // Charge the unfolded size up front so the budget is never overrun
+    if (Used + countInstructions(C.Callee) > SizeBudget) continue;
+
+    IRFunction* Clone =
+        specialize(M, C, C.Callee->getName() + ".spec" + std::to_string(N));
+    if (!Clone) continue;
+
+    Used += countInstructions(Clone);
+    ++N;
+    for (IRCallInst* Call : C.Calls) {
+      Call->setFuncName(Clone->getName());
+    }
+    Changed = true;
+  }
+
+  return Changed;
+}
+
+// ===----------------------------------------------------------------------===
+// Function Attribute Inference
+// ===----------------------------------------------------------------------===
+
+std::vector<std::vector<IRFunction*>>
+FunctionAttrsPass::computeSCCs(IRModule* M, const CallGraph& CG) {
+  // Tarjan's algorithm, iterative so deep call chains cannot overflow the
+  // stack. Components come out callees first.
+  std::vector<std::vector<IRFunction*>> SCCs;
+  std::map<IRFunction*, unsigned> Index;
+  std::map<IRFunction*, unsigned> LowLink;
+  std::set<IRFunction*> OnStack;
+  std::vector<IRFunction*> Stack;
+  unsigned NextIndex = 0;
+
+  struct Frame {
+    IRFunction* F;
+    std::vector<IRFunction*> Callees;
+    size_t Next;
+  };
+
+  for (const auto& Root : M->getFunctions()) {
+    if (Index.count(Root.get())) continue;
+
+    std::vector<Frame> CallStack;
+    auto Enter = [&](IRFunction* F) {
+      Index[F] = LowLink[F] = NextIndex++;
+      Stack.push_back(F);
+      OnStack.insert(F);
+      const auto& Callees = CG.getCallees(F);
+      CallStack.push_back({F, {Callees.begin(), Callees.end()}, 0});
+    };
+    Enter(Root.get());
+
+    while (!CallStack.empty()) {
+      Frame& Top = CallStack.back();
+      if (Top.Next < Top.Callees.size()) {
+        IRFunction* Callee = Top.Callees[Top.Next++];
+        if (!Index.count(Callee)) {
+          Enter(Callee);
+        } else if (OnStack.count(Callee)) {
+          LowLink[Top.F] = std::min(LowLink[Top.F], Index[Callee]);
+        }
+        continue;
+      }
+
+      IRFunction* F = Top.F;
+      CallStack.pop_back();
+      if (!CallStack.empty()) {
+        IRFunction* Caller = CallStack.back().F;
+        LowLink[Caller] = std::min(LowLink[Caller], LowLink[F]);
+      }
+
+      if (LowLink[F] == Index[F]) {
+        std::vector<IRFunction*> SCC;
+        IRFunction* Member;
+        do {
+          Member = Stack.back();
+          Stack.pop_back();
+          OnStack.erase(Member);
+          SCC.push_back(Member);
+        } while (Member != F);
+        SCCs.push_back(std::move(SCC));
+      }
+    }
+  }
+
+  return SCCs;
+}
+
+unsigned FunctionAttrsPass::inferSCC(const std::vector<IRFunction*>& SCC,
+                                     const CallGraph& CG) {
+  std::set<IRFunction*> Members(SCC.begin(), SCC.end());
+  bool Reads = false;
+  bool Writes = false;
+  bool NoUnwind = true;
+  bool WillReturn = true;
+  bool NoTrap = true;
+
+  for (IRFunction* F : SCC) {
+    // Declarations have no body to look at
+    if (F->getBlocks().empty()) return 0;
+
+    // A loop might never terminate
+    LoopInfo LI;
+    LI.run(F);
+    if (!LI.getTopLevelLoops().empty()) WillReturn = false;
+
+    std::set<IRValue*> Frame;
+    for (const auto& BB : F->getBlocks()) {
+      for (const auto& Inst : BB->getInstructions()) {
+        if (auto* Alloca = dynamic_cast<IRAllocaInst*>(Inst.get())) {
+          Frame.insert(Alloca->getResult());
+        }
+      }
+    }
+
+    for (const auto& BB : F->getBlocks()) {
+      for (const auto& Inst : BB->getInstructions()) {
+        if (auto* Load = dynamic_cast<IRLoadInst*>(Inst.get())) {
+          if (!Frame.count(Load->getPtr())) Reads = true;
+        } else if (auto* Store = dynamic_cast<IRStoreInst*>(Inst.get())) {
+          if (!Frame.count(Store->getPtr())) Writes = true;
+        } else if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
+          // Only a known divisor other than 0 and -1 cannot fault
+          IRValue* RHS = BinOp->getRHS();
+          if ((BinOp->getOpcode() == IRInstruction::Div ||
+               BinOp->getOpcode() == IRInstruction::Mod) &&
+              (!RHS->isConstant() || RHS->getConstant() == 0 ||
+               RHS->getConstant() == -1)) {
+            NoTrap = false;
+          }
+        } else if (auto* Call = dynamic_cast<IRCallInst*>(Inst.get())) {
+          IRFunction* Callee = CG.getCallee(Call);
+          if (Callee && Members.count(Callee)) {
+            WillReturn = false;  // Recursion
+            continue;
+          }
+
+          // Nothing is known about functions defined elsewhere
+          unsigned Attrs = Callee ? Callee->getAttrs() : 0;
+          if (!(Attrs & FA_ReadNone)) {
+            if (Attrs & FA_ReadOnly) {
+              Reads = true;
+            } else {
+              Writes = true;
+            }
+          }
+          if (!(Attrs & FA_NoUnwind)) NoUnwind = false;
+          if (!(Attrs & FA_WillReturn)) WillReturn = false;
+          if (!(Attrs & FA_Speculatable)) NoTrap = false;
+        }
+      }
+    }
+  }
+
+  unsigned Attrs = 0;
+  if (!Writes) Attrs |= Reads ? FA_ReadOnly : FA_ReadNone;
+  if (NoUnwind) Attrs |= FA_NoUnwind;
+  if (WillReturn) Attrs |= FA_WillReturn;
+  if ((Attrs & FA_ReadNone) && NoUnwind && WillReturn && NoTrap) {
+    Attrs |= FA_Speculatable;
+  }
+  return Attrs;
+}
+
+bool FunctionAttrsPass::run(IRModule* M) {
+  CallGraph CG(M);
+  bool Changed = false;
+
+  for (const auto& SCC : computeSCCs(M, CG)) {
+    unsigned Attrs = inferSCC(SCC, CG);
+    for (IRFunction* F : SCC) {
+      if (F->getAttrs() != Attrs) {
+        F->setAttrs(Attrs);
+        Changed = true;
+      }
+    }
+  }
+
+  // Function passes only see call sites, so each call carries its callee's
+  // attributes
+  for (const auto& F : M->getFunctions()) {
+    for (const auto& BB : F->getBlocks()) {
+      for (const auto& Inst : BB->getInstructions()) {
+        auto* Call = dynamic_cast<IRCallInst*>(Inst.get());
+        if (!Call) continue;
+        IRFunction* Callee = CG.getCallee(Call);
+        unsigned Attrs = Callee ? Callee->getAttrs() : 0;
+        if (Call->getAttrs() != Attrs) {
+          Call->setAttrs(Attrs);
+          Changed = true;
+        }
+      }
+    }
+  }
+
+  return Changed;
+}
+
+// ===----------------------------------------------------------------------===
+// Global Dead Code Elimination
+// ===----------------------------------------------------------------------===
+
+bool GlobalDCEPass::run(IRModule* M) {
+  CallGraph CG(M);
+  std::set<IRFunction*> LiveFunctions;
+  std::set<IRValue*> LiveGlobals;
+  std::vector<IRFunction*> WorkList;
+
+  for (const auto& F : M->getFunctions()) {
+    if (!F->isInternal()) {
+      LiveFunctions.insert(F.get());
+      WorkList.push_back(F.get());
+    }
+  }
+  for (const auto& G : M->getGlobals()) {
+    if (!G->isInternal()) LiveGlobals.insert(G.get());
+  }
+
+  while (!WorkList.empty()) {
+    IRFunction* F = WorkList.back();
+    WorkList.pop_back();
+
+    for (IRFunction* Callee : CG.getCallees(F)) {
+      if (LiveFunctions.insert(Callee).second) {
+        WorkList.push_back(Callee);
+      }
+    }
+
+    for (const auto& BB : F->getBlocks()) {
+      for (const auto& Inst : BB->getInstructions()) {
+        for (IRValue* Op : getOperands(Inst.get())) {
+          if (Op && Op->isGlobal()) LiveGlobals.insert(Op);
+        }
+      }
+    }
+  }
+
+  std::vector<IRFunction*> DeadFunctions;
+  for (const auto& F : M->getFunctions()) {
+    if (!LiveFunctions.count(F.get())) DeadFunctions.push_back(F.get());
+  }
+  std::vector<IRGlobalVariable*> DeadGlobals;
+  for (const auto& G : M->getGlobals()) {
+    if (!LiveGlobals.count(G.get())) DeadGlobals.push_back(G.get());
+  }
+
+  for (IRFunction* F : DeadFunctions) M->removeFunction(F);
+  for (IRGlobalVariable* G : DeadGlobals) M->removeGlobal(G);
+
+  return !DeadFunctions.empty() || !DeadGlobals.empty();
+}
+
+} // namespace yac
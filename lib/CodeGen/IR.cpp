@@ -54,11 +54,13 @@ const char* IRInstruction::getOpcodeName(Opcode Op) {
   case Alloca: return "alloca";
   case Br: return "br";
   case CondBr: return "condbr";
+  case Switch: return "switch";
   case Ret: return "ret";
   case Call: return "call";
   case IntToFloat: return "itof";
   case FloatToInt: return "ftoi";
   case Move: return "move";
+  case Select: return "select";
   case Label: return "label";
   case Phi: return "phi";
   default: return "unknown";
@@ -103,6 +105,16 @@ std::string IRCondBrInst::toString() const {
          TrueLabel->toString() + ", " + FalseLabel->toString();
 }
 
+std::string IRSwitchInst::toString() const {
+  std::string Str = "switch " + Condition->toString() + ", " +
+                    DefaultLabel->toString();
+  for (const auto& Case : Cases) {
+    Str += " [" + std::to_string(Case.Value) + ", " +
+           Case.Label->toString() + "]";
+  }
+  return Str;
+}
+
 std::string IRCallInst::toString() const {
   std::string Str;
   if (Result) {
@@ -125,6 +137,11 @@ std::string IRMoveInst::toString() const {
   return Result->toString() + " = " + Operand->toString();
 }
 
+std::string IRSelectInst::toString() const {
+  return Result->toString() + " = select " + Condition->toString() + ", " +
+         TrueValue->toString() + ", " + FalseValue->toString();
+}
+
 std::string IRPhiInst::toString() const {
   std::string Str = Result->toString() + " = phi ";
   for (size_t i = 0; i < Incomings.size(); ++i) {
@@ -150,13 +167,25 @@ void IRBasicBlock::print() const {
 // IRFunction
 // ===----------------------------------------------------------------------===
 
+std::string getFunctionAttrString(unsigned Attrs) {
+  std::string Str;
+  if (Attrs & FA_ReadNone) Str += " readnone";
+  if (Attrs & FA_ReadOnly) Str += " readonly";
+  if (Attrs & FA_NoUnwind) Str += " nounwind";
+  if (Attrs & FA_WillReturn) Str += " willreturn";
+  if (Attrs & FA_Speculatable) Str += " speculatable";
+  return Str;
+}
+
 void IRFunction::print() const {
-  std::cout << "\nfunction " << Name << "(";
+  std::cout << "\n" << (isInternal() ? "internal " : "") << "function "
+            << Name << "(";
   for (size_t i = 0; i < Parameters.size(); ++i) {
     if (i > 0) std::cout << ", ";
     std::cout << Parameters[i]->toString() << ": " << Parameters[i]->getType()->toString();
   }
-  std::cout << ") -> " << ReturnType->toString() << " {\n";
+  std::cout << ") -> " << ReturnType->toString()
+            << getFunctionAttrString(Attrs) << " {\n";
 
   for (const auto& Block : Blocks) {
     Block->print();
@@ -175,7 +204,10 @@ void IRModule::print() const {
   if (!GlobalValues.empty()) {
     std::cout << "\nGlobals:\n";
     for (const auto& Global : GlobalValues) {
-      std::cout << "  " << Global->toString() << ": " << Global->getType()->toString() << "\n";
+      std::cout << "  " << Global->toString() << ": "
+                << Global->getType()->toString() << " = "
+                << Global->getInitializer()
+                << (Global->isInternal() ? " internal" : "") << "\n";
     }
   }
 
@@ -1,4 +1,5 @@
 #include "yac/CodeGen/IRBuilder.h"
+#include "yac/CodeGen/IRUtils.h"
 
 namespace yac {
 
@@ -29,6 +30,40 @@ IRValue* IRBuilder::createLabel(const std::string& Prefix) {
   return CurrentFunc->createValue(IRValue::VK_Label, Name, nullptr);
 }
 
+IRValue* IRBuilder::startSwitchLabel(const std::string& Prefix) {
+  // Adjacent labels ("case 1: case 2:") share one block, so the switch
+  // sees a single destination for them
+  const auto& Insts = CurrentBlock->getInstructions();
+  if (Insts.size() == 1 && CurrentBlock->getNumPredecessors() > 0 &&
+      CurrentBlock->getPredecessors().back() == CurrentSwitch->getParent()) {
+    if (auto* LabelInst = dynamic_cast<IRLabelInst*>(Insts[0].get())) {
+      return LabelInst->getLabel();
+    }
+  }
+
+  IRValue* Label = createLabel(Prefix);
+  IRBasicBlock* LabelBlock = CurrentFunc->createBlock(Label->getName());
+
+  // Fall through from the statements above the label
+  if (!CurrentBlock->getTerminator()) {
+    emit<IRBrInst>(Label);
+    CurrentBlock->addSuccessor(LabelBlock);
+  }
+  CurrentSwitch->getParent()->addSuccessor(LabelBlock);
+
+  CurrentBlock = LabelBlock;
+  emit<IRLabelInst>(Label);
+  return Label;
+}
+
+IRValue* IRBuilder::getVarAddress(VarDecl* D) {
+  auto It = GlobalVars.find(D);
+  if (It != GlobalVars.end()) {
+    return It->second;
+  }
+  return LocalVars[D];
+}
+
 IRInstruction::Opcode IRBuilder::getIROpcode(BinaryOperatorKind Op) {
   switch (Op) {
   case BinaryOperatorKind::Add: return IRInstruction::Add;
@@ -64,8 +99,14 @@ IRInstruction::Opcode IRBuilder::getIROpcode(UnaryOperatorKind Op) {
 // ===----------------------------------------------------------------------===
 
 void IRBuilder::visitFunctionDecl(FunctionDecl* D) {
+  // Prototypes produce no IR; calls refer to the definition by name
+  if (!D->getBody()) return;
+
   // Create function
   CurrentFunc = Module->createFunction(D->getName(), D->getReturnType());
+  if (D->isStatic()) {
+    CurrentFunc->setLinkage(Linkage::Internal);
+  }
 
   // Add parameters
   for (ParmVarDecl* Param : D->getParams()) {
@@ -103,6 +144,10 @@ void IRBuilder::visitFunctionDecl(FunctionDecl* D) {
     emit<IRRetInst>(nullptr);
   }
 
+  // Drop code that can never run, such as statements before the first
+  // label of a switch
+  removeUnreachableBlocks(CurrentFunc);
+
   // Cleanup
   LocalVars.clear();
   CurrentFunc = nullptr;
@@ -110,9 +155,24 @@ void IRBuilder::visitFunctionDecl(FunctionDecl* D) {
 }
 
 void IRBuilder::visitVarDecl(VarDecl* D) {
-  // Allocate stack slot
+  // File scope: Sema has already folded the initializer
+  if (!CurrentFunc) {
+    GlobalVars[D] = Module->createGlobal(
+        D->getName(), D->getType(), D->getInitValue(),
+        D->isStatic() ? Linkage::Internal : Linkage::External);
+    return;
+  }
+
+  // Allocate stack slot. Slots live in the entry block, where Mem2Reg
+  // looks for them, even for locals declared inside a loop body.
   IRValue* Slot = createTemp(D->getType());
-  emit<IRAllocaInst>(Slot, D->getType());
+  IRBasicBlock* Entry = CurrentFunc->getBlocks()[0].get();
+  if (CurrentBlock == Entry) {
+    emit<IRAllocaInst>(Slot, D->getType());
+  } else {
+    Entry->insertBeforeTerminator(
+        std::make_unique<IRAllocaInst>(Slot, D->getType()));
+  }
   LocalVars[D] = Slot;
 
   // Initialize if there's an initializer
@@ -192,14 +252,17 @@ void IRBuilder::visitIfStmt(IfStmt* S) {
   // Generate then block
   CurrentBlock = ThenBlock;
   visit(S->getThen());
-  bool thenHasTerminator = CurrentBlock->getTerminator() != nullptr;
+  IRBasicBlock* ThenEnd = CurrentBlock;
+  bool thenHasTerminator = ThenEnd->getTerminator() != nullptr;
 
   // Else block (if present)
+  IRBasicBlock* ElseEnd = nullptr;
   bool elseHasTerminator = false;
   if (S->hasElse()) {
     CurrentBlock = ElseBlock;
     visit(S->getElse());
-    elseHasTerminator = CurrentBlock->getTerminator() != nullptr;
+    ElseEnd = CurrentBlock;
+    elseHasTerminator = ElseEnd->getTerminator() != nullptr;
   }
 
   // Now we know if we need an EndBlock
@@ -216,17 +279,18 @@ void IRBuilder::visitIfStmt(IfStmt* S) {
       CondBlock->addSuccessor(EndBlock);
     }
 
-    // Emit branches to EndBlock if needed
+    // Emit branches to EndBlock if needed. Nested control flow may have
+    // moved the insertion point, so branch from where each arm ended.
     if (!thenHasTerminator) {
-      CurrentBlock = ThenBlock;
+      CurrentBlock = ThenEnd;
       emit<IRBrInst>(EndLabel);
-      ThenBlock->addSuccessor(EndBlock);
+      ThenEnd->addSuccessor(EndBlock);
     }
 
     if (S->hasElse() && !elseHasTerminator) {
-      CurrentBlock = ElseBlock;
+      CurrentBlock = ElseEnd;
       emit<IRBrInst>(EndLabel);
-      ElseBlock->addSuccessor(EndBlock);
+      ElseEnd->addSuccessor(EndBlock);
     }
 
     // Make EndBlock current
@@ -260,17 +324,21 @@ void IRBuilder::visitWhileStmt(WhileStmt* S) {
   visit(S->getCondition());
   IRValue* Cond = LastExprValue;
   emit<IRCondBrInst>(Cond, BodyLabel, EndLabel);
-  CondBlock->addSuccessor(BodyBlock);
-  CondBlock->addSuccessor(EndBlock);
+  CurrentBlock->addSuccessor(BodyBlock);
+  CurrentBlock->addSuccessor(EndBlock);
 
   // Body block
   CurrentBlock = BodyBlock;
   emit<IRLabelInst>(BodyLabel);
+  BreakTargets.push_back({EndLabel, EndBlock});
+  ContinueTargets.push_back({CondLabel, CondBlock});
   visit(S->getBody());
+  BreakTargets.pop_back();
+  ContinueTargets.pop_back();
   // Only emit branch if block doesn't already have a terminator
   if (!CurrentBlock->getTerminator()) {
     emit<IRBrInst>(CondLabel);
-    BodyBlock->addSuccessor(CondBlock);
+    CurrentBlock->addSuccessor(CondBlock);
   }
 
   // End block
@@ -309,8 +377,8 @@ void IRBuilder::visitForStmt(ForStmt* S) {
     visit(S->getCondition());
     IRValue* Cond = LastExprValue;
     emit<IRCondBrInst>(Cond, BodyLabel, EndLabel);
-    CondBlock->addSuccessor(BodyBlock);
-    CondBlock->addSuccessor(EndBlock);
+    CurrentBlock->addSuccessor(BodyBlock);
+    CurrentBlock->addSuccessor(EndBlock);
   } else {
     emit<IRBrInst>(BodyLabel);
     CondBlock->addSuccessor(BodyBlock);
@@ -319,11 +387,15 @@ void IRBuilder::visitForStmt(ForStmt* S) {
   // Body block
   CurrentBlock = BodyBlock;
   emit<IRLabelInst>(BodyLabel);
+  BreakTargets.push_back({EndLabel, EndBlock});
+  ContinueTargets.push_back({IncLabel, IncBlock});
   visit(S->getBody());
+  BreakTargets.pop_back();
+  ContinueTargets.pop_back();
   // Only emit branch if block doesn't already have a terminator
   if (!CurrentBlock->getTerminator()) {
     emit<IRBrInst>(IncLabel);
-    BodyBlock->addSuccessor(IncBlock);
+    CurrentBlock->addSuccessor(IncBlock);
   }
 
   // Increment block
@@ -333,7 +405,7 @@ void IRBuilder::visitForStmt(ForStmt* S) {
     visit(S->getIncrement());
   }
   emit<IRBrInst>(CondLabel);
-  IncBlock->addSuccessor(CondBlock);
+  CurrentBlock->addSuccessor(CondBlock);
 
   // End block
   CurrentBlock = EndBlock;
@@ -360,11 +432,15 @@ void IRBuilder::visitDoStmt(DoStmt* S) {
   // Body block
   CurrentBlock = BodyBlock;
   emit<IRLabelInst>(BodyLabel);
+  BreakTargets.push_back({EndLabel, EndBlock});
+  ContinueTargets.push_back({CondLabel, CondBlock});
   visit(S->getBody());
+  BreakTargets.pop_back();
+  ContinueTargets.pop_back();
   // Only emit branch if block doesn't already have a terminator
   if (!CurrentBlock->getTerminator()) {
     emit<IRBrInst>(CondLabel);
-    BodyBlock->addSuccessor(CondBlock);
+    CurrentBlock->addSuccessor(CondBlock);
   }
 
   // Condition block
@@ -373,8 +449,8 @@ void IRBuilder::visitDoStmt(DoStmt* S) {
   visit(S->getCondition());
   IRValue* Cond = LastExprValue;
   emit<IRCondBrInst>(Cond, BodyLabel, EndLabel);
-  CondBlock->addSuccessor(BodyBlock);
-  CondBlock->addSuccessor(EndBlock);
+  CurrentBlock->addSuccessor(BodyBlock);
+  CurrentBlock->addSuccessor(EndBlock);
 
   // End block
   CurrentBlock = EndBlock;
@@ -382,13 +458,86 @@ void IRBuilder::visitDoStmt(DoStmt* S) {
 }
 
 void IRBuilder::visitBreakStmt(BreakStmt* S) {
-  // TODO: Need to track loop end labels for break/continue
-  // For now, emit a placeholder
+  // Sema rejects break outside a loop or switch
+  if (BreakTargets.empty() || CurrentBlock->getTerminator()) return;
+
+  const JumpTarget& Target = BreakTargets.back();
+  emit<IRBrInst>(Target.Label);
+  CurrentBlock->addSuccessor(Target.Block);
 }
 
 void IRBuilder::visitContinueStmt(ContinueStmt* S) {
-  // TODO: Need to track loop condition labels for break/continue
-  // For now, emit a placeholder
+  // Sema rejects continue outside a loop
+  if (ContinueTargets.empty() || CurrentBlock->getTerminator()) return;
+
+  const JumpTarget& Target = ContinueTargets.back();
+  emit<IRBrInst>(Target.Label);
+  CurrentBlock->addSuccessor(Target.Block);
+}
+
+void IRBuilder::visitSwitchStmt(SwitchStmt* S) {
+  // Evaluate selector
+  visit(S->getCondition());
+  IRValue* Cond = LastExprValue;
+
+  IRValue* EndLabel = createLabel("switch_end");
+  IRBasicBlock* SwitchBlock = CurrentBlock;
+  IRBasicBlock* EndBlock = CurrentFunc->createBlock(EndLabel->getName());
+
+  // Emit the terminator up front; case and default labels fill in its
+  // targets as the body is visited. Without a default, control leaves the
+  // switch.
+  auto Switch = std::make_unique<IRSwitchInst>(Cond, EndLabel);
+  IRSwitchInst* SwitchInst = Switch.get();
+  emit(std::move(Switch));
+
+  // Statements ahead of the first label can never run. They go in a block
+  // of their own with no predecessors, dropped when the function is done.
+  auto* Body = dynamic_cast<CompoundStmt*>(S->getBody());
+  bool StartsWithLabel =
+      Body && !Body->getStmts().empty() &&
+      (dynamic_cast<CaseStmt*>(Body->getStmts()[0].get()) ||
+       dynamic_cast<DefaultStmt*>(Body->getStmts()[0].get()));
+  if (!StartsWithLabel) {
+    IRValue* DeadLabel = createLabel("switch_body");
+    CurrentBlock = CurrentFunc->createBlock(DeadLabel->getName());
+    emit<IRLabelInst>(DeadLabel);
+  }
+
+  IRSwitchInst* PrevSwitch = CurrentSwitch;
+  CurrentSwitch = SwitchInst;
+  BreakTargets.push_back({EndLabel, EndBlock});
+  visit(S->getBody());
+  BreakTargets.pop_back();
+  CurrentSwitch = PrevSwitch;
+
+  if (SwitchInst->getDefaultLabel() == EndLabel) {
+    SwitchBlock->addSuccessor(EndBlock);
+  }
+
+  // Fall off the end of the last case
+  if (!CurrentBlock->getTerminator()) {
+    emit<IRBrInst>(EndLabel);
+    CurrentBlock->addSuccessor(EndBlock);
+  }
+
+  // End block
+  CurrentBlock = EndBlock;
+  emit<IRLabelInst>(EndLabel);
+}
+
+void IRBuilder::visitCaseStmt(CaseStmt* S) {
+  if (CurrentSwitch) {
+    CurrentSwitch->addCase(S->getValue(), startSwitchLabel("case"));
+  }
+  visit(S->getSubStmt());
+}
+
+void IRBuilder::visitDefaultStmt(DefaultStmt* S) {
+  if (CurrentSwitch) {
+    CurrentSwitch->setDefaultLabel(startSwitchLabel("default"));
+  }
+  visit(S->getSubStmt());
 }
 
 // ===----------------------------------------------------------------------===
@@ -424,7 +573,7 @@ void IRBuilder::visitDeclRefExpr(DeclRefExpr* E) {
   }
 
   // Load from variable's stack slot
-  IRValue* Slot = LocalVars[Var];
+  IRValue* Slot = getVarAddress(Var);
   IRValue* Result = createTemp(Var->getType());
   emit<IRLoadInst>(Result, Slot);
   LastExprValue = Result;
@@ -483,8 +632,9 @@ void IRBuilder::visitBinaryOperator(BinaryOperator* E) {
     CurrentBlock = RHSBlock;
     visit(E->getRHS());
     IRValue* RHSResult = LastExprValue;
+    IRBasicBlock* RHSResultBlock = CurrentBlock;
     emit<IRBrInst>(EndLabel);
-    RHSBlock->addSuccessor(EndBlock);
+    RHSResultBlock->addSuccessor(EndBlock);
 
     // End block - use phi to merge results
     CurrentBlock = EndBlock;
@@ -493,7 +643,7 @@ void IRBuilder::visitBinaryOperator(BinaryOperator* E) {
     IRValue* Result = createTemp(TyCtx.getIntType());
     auto Phi = std::make_unique<IRPhiInst>(Result);
     Phi->addIncoming(LHSResult, LHSResultBlock);
-    Phi->addIncoming(RHSResult, RHSBlock);
+    Phi->addIncoming(RHSResult, RHSResultBlock);
     emit(std::move(Phi));
 
     LastExprValue = Result;
@@ -534,7 +684,7 @@ void IRBuilder::emitAssignment(BinaryOperator* E) {
   }
 
   VarDecl* Var = LHSRef->getDecl();
-  IRValue* Slot = LocalVars[Var];
+  IRValue* Slot = getVarAddress(Var);
 
   // Evaluate RHS
   if (E->getOp() == BinaryOperatorKind::Assign) {
@@ -580,7 +730,7 @@ void IRBuilder::visitUnaryOperator(UnaryOperator* E) {
     if (!Ref) return;
 
     VarDecl* Var = Ref->getDecl();
-    IRValue* Slot = LocalVars[Var];
+    IRValue* Slot = getVarAddress(Var);
 
     // Load current value
     IRValue* Current = createTemp(Var->getType());
@@ -0,0 +1,513 @@
+#include "yac/CodeGen/IRUtils.h"
+#include <algorithm>
+#include <queue>
+#include <set>
+
+namespace yac {
+
+// ===----------------------------------------------------------------------===
+// Operand queries and rewriting
+// ===----------------------------------------------------------------------===
+
+IRValue* getDefinedValue(IRInstruction* I) {
+  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+    return BinOp->getResult();
+  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(I)) {
+    return UnOp->getResult();
+  } else if (auto* Load = dynamic_cast<IRLoadInst*>(I)) {
+    return Load->getResult();
+  } else if (auto* Alloca = dynamic_cast<IRAllocaInst*>(I)) {
+    return Alloca->getResult();
+  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    return Call->getResult();
+  } else if (auto* Move = dynamic_cast<IRMoveInst*>(I)) {
+    return Move->getResult();
+  } else if (auto* Sel = dynamic_cast<IRSelectInst*>(I)) {
+    return Sel->getResult();
+  } else if (auto* Phi = dynamic_cast<IRPhiInst*>(I)) {
+    return Phi->getResult();
+  }
+  return nullptr;
+}
+
+std::vector<IRValue*> getOperands(IRInstruction* I) {
+  std::vector<IRValue*> Ops;
+
+  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+    Ops.push_back(BinOp->getLHS());
+    Ops.push_back(BinOp->getRHS());
+  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(I)) {
+    Ops.push_back(UnOp->getOperand());
+  } else if (auto* Load = dynamic_cast<IRLoadInst*>(I)) {
+    Ops.push_back(Load->getPtr());
+  } else if (auto* Store = dynamic_cast<IRStoreInst*>(I)) {
+    Ops.push_back(Store->getValue());
+    Ops.push_back(Store->getPtr());
+  } else if (auto* Ret = dynamic_cast<IRRetInst*>(I)) {
+    if (Ret->hasRetValue()) {
+      Ops.push_back(Ret->getRetValue());
+    }
+  } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(I)) {
+    Ops.push_back(CondBr->getCondition());
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(I)) {
+    Ops.push_back(Switch->getCondition());
+  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    for (IRValue* Arg : Call->getArgs()) {
+      Ops.push_back(Arg);
+    }
+  } else if (auto* Move = dynamic_cast<IRMoveInst*>(I)) {
+    Ops.push_back(Move->getOperand());
+  } else if (auto* Sel = dynamic_cast<IRSelectInst*>(I)) {
+    Ops.push_back(Sel->getCondition());
+    Ops.push_back(Sel->getTrueValue());
+    Ops.push_back(Sel->getFalseValue());
+  } else if (auto* Phi = dynamic_cast<IRPhiInst*>(I)) {
+    for (const auto& Entry : Phi->getIncomings()) {
+      Ops.push_back(Entry.Value);
+    }
+  }
+
+  return Ops;
+}
+
+void replaceUsesInInstruction(IRInstruction* I, IRValue* Old, IRValue* New) {
+  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+    if (BinOp->getLHS() == Old) BinOp->setLHS(New);
+    if (BinOp->getRHS() == Old) BinOp->setRHS(New);
+  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(I)) {
+    if (UnOp->getOperand() == Old) UnOp->setOperand(New);
+  } else if (auto* Load = dynamic_cast<IRLoadInst*>(I)) {
+    if (Load->getPtr() == Old) Load->setPtr(New);
+  } else if (auto* Store = dynamic_cast<IRStoreInst*>(I)) {
+    if (Store->getValue() == Old) Store->setValue(New);
+    if (Store->getPtr() == Old) Store->setPtr(New);
+  } else if (auto* Ret = dynamic_cast<IRRetInst*>(I)) {
+    if (Ret->hasRetValue() && Ret->getRetValue() == Old) Ret->setRetValue(New);
+  } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(I)) {
+    if (CondBr->getCondition() == Old) CondBr->setCondition(New);
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(I)) {
+    if (Switch->getCondition() == Old) Switch->setCondition(New);
+  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    for (size_t i = 0; i < Call->getArgs().size(); ++i) {
+      if (Call->getArgs()[i] == Old) Call->setArg(i, New);
+    }
+  } else if (auto* Move = dynamic_cast<IRMoveInst*>(I)) {
+    if (Move->getOperand() == Old) Move->setOperand(New);
+  } else if (auto* Sel = dynamic_cast<IRSelectInst*>(I)) {
+    if (Sel->getCondition() == Old) Sel->setCondition(New);
+    if (Sel->getTrueValue() == Old) Sel->setTrueValue(New);
+    if (Sel->getFalseValue() == Old) Sel->setFalseValue(New);
+  } else if (auto* Phi = dynamic_cast<IRPhiInst*>(I)) {
+    Phi->replaceIncomingValue(Old, New);
+  }
+}
+
+void replaceAllUsesWith(IRFunction* F, IRValue* Old, IRValue* New) {
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      replaceUsesInInstruction(Inst.get(), Old, New);
+    }
+  }
+}
+
+// ===----------------------------------------------------------------------===
+// Block lookup
+// ===----------------------------------------------------------------------===
+
+IRBasicBlock* findBlock(IRFunction* F, const std::string& Name) {
+  for (const auto& BB : F->getBlocks()) {
+    if (BB->getName() == Name) {
+      return BB.get();
+    }
+  }
+  return nullptr;
+}
+
+IRBasicBlock* getSuccessorForLabel(IRBasicBlock* BB, IRValue* Label) {
+  for (IRBasicBlock* Succ : BB->getSuccessors()) {
+    if (Succ->getName() == Label->getName()) {
+      return Succ;
+    }
+  }
+  return nullptr;
+}
+
+// ===----------------------------------------------------------------------===
+// Cloning
+// ===----------------------------------------------------------------------===
+
+namespace {
+
+/// Copy I with a fresh result value; operands still refer to the originals
+std::unique_ptr<IRInstruction> cloneInstruction(IRInstruction* I,
+                                                IRFunction* F,
+                                                const std::string& Suffix,
+                                                CloneMap& VMap) {
+  auto MapResult = [&](IRValue* V) -> IRValue* {
+    if (!V) return nullptr;
+    IRValue* NewV = F->createValue(V->getKind(), V->getName() + Suffix,
+                                   V->getType());
+    VMap.Values[V] = NewV;
+    return NewV;
+  };
+
+  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+    return std::make_unique<IRBinaryInst>(BinOp->getOpcode(),
+                                          MapResult(BinOp->getResult()),
+                                          BinOp->getLHS(), BinOp->getRHS());
+  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(I)) {
+    return std::make_unique<IRUnaryInst>(UnOp->getOpcode(),
+                                         MapResult(UnOp->getResult()),
+                                         UnOp->getOperand());
+  } else if (auto* Load = dynamic_cast<IRLoadInst*>(I)) {
+    return std::make_unique<IRLoadInst>(MapResult(Load->getResult()),
+                                        Load->getPtr());
+  } else if (auto* Store = dynamic_cast<IRStoreInst*>(I)) {
+    return std::make_unique<IRStoreInst>(Store->getValue(), Store->getPtr());
+  } else if (auto* Alloca = dynamic_cast<IRAllocaInst*>(I)) {
+    return std::make_unique<IRAllocaInst>(MapResult(Alloca->getResult()),
+                                          Alloca->getAllocType());
+  } else if (auto* Ret = dynamic_cast<IRRetInst*>(I)) {
+    return std::make_unique<IRRetInst>(Ret->getRetValue());
+  } else if (auto* Br = dynamic_cast<IRBrInst*>(I)) {
+    return std::make_unique<IRBrInst>(Br->getTarget());
+  } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(I)) {
+    return std::make_unique<IRCondBrInst>(CondBr->getCondition(),
+                                          CondBr->getTrueLabel(),
+                                          CondBr->getFalseLabel());
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(I)) {
+    auto NewSwitch = std::make_unique<IRSwitchInst>(Switch->getCondition(),
+                                                    Switch->getDefaultLabel());
+    for (const auto& Case : Switch->getCases()) {
+      NewSwitch->addCase(Case.Value, Case.Label);
+    }
+    return NewSwitch;
+  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    auto NewCall = std::make_unique<IRCallInst>(MapResult(Call->getResult()),
+                                                Call->getFuncName(),
+                                                Call->getArgs());
+    NewCall->setAttrs(Call->getAttrs());
+    return NewCall;
+  } else if (auto* Move = dynamic_cast<IRMoveInst*>(I)) {
+    return std::make_unique<IRMoveInst>(MapResult(Move->getResult()),
+                                        Move->getOperand());
+  } else if (auto* Sel = dynamic_cast<IRSelectInst*>(I)) {
+    return std::make_unique<IRSelectInst>(MapResult(Sel->getResult()),
+                                          Sel->getCondition(),
+                                          Sel->getTrueValue(),
+                                          Sel->getFalseValue());
+  } else if (auto* Phi = dynamic_cast<IRPhiInst*>(I)) {
+    auto NewPhi = std::make_unique<IRPhiInst>(MapResult(Phi->getResult()));
+    for (const auto& Entry : Phi->getIncomings()) {
+      NewPhi->addIncoming(Entry.Value, Entry.Block);
+    }
+    return NewPhi;
+  }
+  return nullptr;
+}
+
+/// Point operands, labels and phi blocks of a copied instruction at copies
+void remapInstruction(IRInstruction* I, const CloneMap& VMap,
+                      const std::map<std::string, IRValue*>& LabelMap) {
+  auto MapLabel = [&](IRValue* L) {
+    auto It = LabelMap.find(L->getName());
+    return It != LabelMap.end() ? It->second : L;
+  };
+
+  if (auto* Phi = dynamic_cast<IRPhiInst*>(I)) {
+    std::vector<IRPhiInst::PhiEntry> Entries = Phi->getIncomings();
+    for (const auto& Entry : Entries) {
+      Phi->replaceIncomingBlock(Entry.Block, VMap.lookup(Entry.Block));
+    }
+  } else if (auto* Br = dynamic_cast<IRBrInst*>(I)) {
+    Br->setTarget(MapLabel(Br->getTarget()));
+  } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(I)) {
+    CondBr->setTrueLabel(MapLabel(CondBr->getTrueLabel()));
+    CondBr->setFalseLabel(MapLabel(CondBr->getFalseLabel()));
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(I)) {
+    Switch->setDefaultLabel(MapLabel(Switch->getDefaultLabel()));
+    for (size_t i = 0; i < Switch->getNumCases(); ++i) {
+      Switch->setCaseLabel(i, MapLabel(Switch->getCases()[i].Label));
+    }
+  }
+
+  for (IRValue* Op : getOperands(I)) {
+    IRValue* NewOp = VMap.lookup(Op);
+    if (NewOp != Op) {
+      replaceUsesInInstruction(I, Op, NewOp);
+    }
+  }
+}
+
+/// Copy Blocks into Dest; see cloneBlocks
+std::vector<IRBasicBlock*> cloneBlocksInto(
+    IRFunction* Dest, const std::vector<IRBasicBlock*>& Blocks,
+    const std::string& Suffix, CloneMap& VMap) {
+  std::vector<IRBasicBlock*> NewBlocks;
+  std::map<std::string, IRValue*> LabelMap;
+
+  // Create the blocks first so branches and phis can refer to any of them
+  for (IRBasicBlock* BB : Blocks) {
+    IRBasicBlock* NewBB = Dest->createBlock(BB->getName() + Suffix);
+    IRValue* NewLabel = Dest->createValue(IRValue::VK_Label, NewBB->getName(),
+                                          nullptr);
+    VMap.Blocks[BB] = NewBB;
+    VMap.Labels[NewBB] = NewLabel;
+    LabelMap[BB->getName()] = NewLabel;
+    NewBlocks.push_back(NewBB);
+  }
+
+  for (IRBasicBlock* BB : Blocks) {
+    IRBasicBlock* NewBB = VMap.Blocks[BB];
+    for (const auto& Inst : BB->getInstructions()) {
+      if (dynamic_cast<IRLabelInst*>(Inst.get())) {
+        NewBB->addInstruction(std::make_unique<IRLabelInst>(VMap.Labels[NewBB]));
+      } else {
+        NewBB->addInstruction(cloneInstruction(Inst.get(), Dest, Suffix, VMap));
+      }
+    }
+  }
+
+  // Values may be used before their definition in block order (phis), so
+  // remap only once every result has a copy
+  for (IRBasicBlock* NewBB : NewBlocks) {
+    for (const auto& Inst : NewBB->getInstructions()) {
+      remapInstruction(Inst.get(), VMap, LabelMap);
+    }
+  }
+
+  for (IRBasicBlock* BB : Blocks) {
+    IRBasicBlock* NewBB = VMap.Blocks[BB];
+    for (IRBasicBlock* Succ : BB->getSuccessors()) {
+      IRBasicBlock* NewSucc = VMap.lookup(Succ);
+      NewBB->addSuccessor(NewSucc);
+
+      // Exit edge: the target now has one more predecessor
+      if (NewSucc == Succ) {
+        for (const auto& Inst : Succ->getInstructions()) {
+          auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get());
+          if (!Phi) break;
+          if (IRValue* V = Phi->getIncomingValueForBlock(BB)) {
+            Phi->addIncoming(VMap.lookup(V), NewBB);
+          }
+        }
+      }
+    }
+  }
+
+  return NewBlocks;
+}
+
+} // anonymous namespace
+
+std::vector<IRBasicBlock*> cloneBlocks(IRFunction* F,
+                                       const std::vector<IRBasicBlock*>& Blocks,
+                                       const std::string& Suffix,
+                                       CloneMap& VMap) {
+  return cloneBlocksInto(F, Blocks, Suffix, VMap);
+}
+
+IRFunction* cloneFunction(IRModule* M, IRFunction* F, const std::string& Name,
+                          CloneMap& VMap) {
+  IRFunction* NewF = M->createFunction(Name, F->getReturnType());
+  NewF->setAttrs(F->getAttrs());
+  for (IRValue* Param : F->getParameters()) {
+    IRValue* NewParam = NewF->createValue(Param->getKind(), Param->getName(),
+                                          Param->getType());
+    NewF->addParameter(NewParam);
+    VMap.Values[Param] = NewParam;
+  }
+
+  // Constants belong to the function that created them, so the copy gets
+  // its own and outlives F
+  std::vector<IRBasicBlock*> Blocks;
+  for (const auto& BB : F->getBlocks()) {
+    Blocks.push_back(BB.get());
+    for (const auto& Inst : BB->getInstructions()) {
+      for (IRValue* Op : getOperands(Inst.get())) {
+        if (Op->isConstant() && !VMap.Values.count(Op)) {
+          VMap.Values[Op] = NewF->createConstant(Op->getConstant());
+        }
+      }
+    }
+  }
+  cloneBlocksInto(NewF, Blocks, "", VMap);
+  return NewF;
+}
+
+// ===----------------------------------------------------------------------===
+// CFG cleanup
+// ===----------------------------------------------------------------------===
+
+void removeEdge(IRBasicBlock* From, IRBasicBlock* To) {
+  From->removeSuccessor(To);
+
+  for (const auto& Inst : To->getInstructions()) {
+    if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
+      Phi->removeIncomingBlock(From);
+    }
+  }
+}
+
+bool foldConstantTerminator(IRBasicBlock* BB) {
+  IRInstruction* Term = BB->getTerminator();
+  IRValue* Taken = nullptr;
+
+  if (auto* CondBr = dynamic_cast<IRCondBrInst*>(Term)) {
+    IRValue* Cond = CondBr->getCondition();
+    if (Cond->isConstant()) {
+      Taken = Cond->getConstant() ? CondBr->getTrueLabel()
+                                  : CondBr->getFalseLabel();
+    }
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(Term)) {
+    IRValue* Cond = Switch->getCondition();
+    if (Cond->isConstant()) {
+      Taken = Switch->getDefaultLabel();
+      for (const auto& Case : Switch->getCases()) {
+        if (Case.Value == Cond->getConstant()) {
+          Taken = Case.Label;
+          break;
+        }
+      }
+    }
+  }
+  if (!Taken) return false;
+
+  IRBasicBlock* TakenBB = getSuccessorForLabel(BB, Taken);
+  std::vector<IRBasicBlock*> Succs = BB->getSuccessors();
+  for (IRBasicBlock* Succ : Succs) {
+    if (Succ != TakenBB) {
+      removeEdge(BB, Succ);
+    }
+  }
+
+  BB->removeInstruction(Term);
+  BB->addInstruction(std::make_unique<IRBrInst>(Taken));
+  return true;
+}
+
+bool removeUnreachableBlocks(IRFunction* F) {
+  if (F->getBlocks().empty()) return false;
+
+  std::set<IRBasicBlock*> Reachable;
+  std::queue<IRBasicBlock*> Worklist;
+
+  IRBasicBlock* Entry = F->getBlocks()[0].get();
+  Reachable.insert(Entry);
+  Worklist.push(Entry);
+
+  while (!Worklist.empty()) {
+    IRBasicBlock* BB = Worklist.front();
+    Worklist.pop();
+
+    for (IRBasicBlock* Succ : BB->getSuccessors()) {
+      if (Reachable.insert(Succ).second) {
+        Worklist.push(Succ);
+      }
+    }
+  }
+
+  std::vector<IRBasicBlock*> Dead;
+  for (const auto& BB : F->getBlocks()) {
+    if (!Reachable.count(BB.get())) {
+      Dead.push_back(BB.get());
+    }
+  }
+
+  // Detach every dead block before deleting any, so no live block is left
+  // holding a dangling predecessor pointer
+  for (IRBasicBlock* BB : Dead) {
+    std::vector<IRBasicBlock*> Succs = BB->getSuccessors();
+    for (IRBasicBlock* Succ : Succs) {
+      removeEdge(BB, Succ);
+    }
+  }
+
+  for (IRBasicBlock* BB : Dead) {
+    F->removeBlock(BB);
+  }
+
+  return !Dead.empty();
+}
+
+// ===----------------------------------------------------------------------===
+// Critical edges
+// ===----------------------------------------------------------------------===
+
+/// Point every label in Term that names Old at New instead.
+static void retargetTerminator(IRInstruction* Term, const std::string& Old,
+                               IRValue* New) {
+  if (auto* Br = dynamic_cast<IRBrInst*>(Term)) {
+    if (Br->getTarget()->getName() == Old) Br->setTarget(New);
+  } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(Term)) {
+    if (CondBr->getTrueLabel()->getName() == Old) CondBr->setTrueLabel(New);
+    if (CondBr->getFalseLabel()->getName() == Old) CondBr->setFalseLabel(New);
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(Term)) {
+    if (Switch->getDefaultLabel()->getName() == Old)
+      Switch->setDefaultLabel(New);
+    for (size_t i = 0; i < Switch->getNumCases(); ++i) {
+      if (Switch->getCases()[i].Label->getName() == Old)
+        Switch->setCaseLabel(i, New);
+    }
+  }
+}
+
+bool splitCriticalEdges(IRFunction* F) {
+  std::set<std::string> Names;
+  for (const auto& BB : F->getBlocks()) Names.insert(BB->getName());
+
+  // Collect first: splitting appends blocks to F
+  std::vector<std::pair<IRBasicBlock*, IRBasicBlock*>> Edges;
+  for (const auto& BB : F->getBlocks()) {
+    if (phiCopiesGoInPredecessor(BB.get())) continue;
+    std::set<IRBasicBlock*> Seen;
+    for (IRBasicBlock* Succ : BB->getSuccessors()) {
+      if (!Seen.insert(Succ).second) continue;
+      const auto& Preds = Succ->getPredecessors();
+      if (std::set<IRBasicBlock*>(Preds.begin(), Preds.end()).size() < 2)
+        continue;
+      bool HasPhi = !Succ->getInstructions().empty() &&
+        dynamic_cast<IRPhiInst*>(Succ->getInstructions().front().get());
+      if (HasPhi) Edges.push_back({BB.get(), Succ});
+    }
+  }
+
+  for (auto& [Pred, Succ] : Edges) {
+    std::string Name = Pred->getName() + "_" + Succ->getName();
+    for (unsigned N = 1; Names.count(Name); ++N) {
+      Name = Pred->getName() + "_" + Succ->getName() + std::to_string(N);
+    }
+    Names.insert(Name);
+
+    IRBasicBlock* Split = F->createBlock(Name);
+    IRValue* SplitLabel = F->createValue(IRValue::VK_Label, Name, nullptr);
+    IRValue* SuccLabel =
+      F->createValue(IRValue::VK_Label, Succ->getName(), nullptr);
+    Split->addInstruction(std::make_unique<IRLabelInst>(SplitLabel));
+    Split->addInstruction(std::make_unique<IRBrInst>(SuccLabel));
+
+    retargetTerminator(Pred->getTerminator(), Succ->getName(), SplitLabel);
+
+    // A switch may reach Succ through several cases; drop every copy
+    while (std::count(Pred->getSuccessors().begin(),
+                      Pred->getSuccessors().end(), Succ)) {
+      Pred->removeSuccessor(Succ);
+    }
+    Pred->addSuccessor(Split);
+    Split->addSuccessor(Succ);
+
+    for (const auto& I : Succ->getInstructions()) {
+      auto* Phi = dynamic_cast<IRPhiInst*>(I.get());
+      if (!Phi) break;
+      Phi->replaceIncomingBlock(Pred, Split);
+    }
+  }
+
+  return !Edges.empty();
+}
+
+bool phiCopiesGoInPredecessor(IRBasicBlock* Pred) {
+  return dynamic_cast<IRBrInst*>(Pred->getTerminator()) != nullptr;
+}
+
+} // namespace yac
@@ -1,4 +1,5 @@
 #include "yac/CodeGen/IRVerifier.h"
+#include <algorithm>
 #include <iostream>
 #include <set>
 #include <map>
@@ -269,18 +270,43 @@ bool IRVerifier::checkDefBeforeUse(IRFunction* F) {
     Defined.insert(Param);
   }
 
-  // Walk through blocks in order (TODO: use RPO order for better checking)
+  // Walk blocks in reverse post-order so definitions are seen before uses
+  // even when a transform leaves a dominating block later in the layout
+  std::vector<IRBasicBlock*> Order;
+  std::set<IRBasicBlock*> Seen;
+  std::vector<std::pair<IRBasicBlock*, size_t>> Stack;
+  if (!F->getBlocks().empty()) {
+    Stack.push_back({F->getBlocks()[0].get(), 0});
+    Seen.insert(F->getBlocks()[0].get());
+  }
+  while (!Stack.empty()) {
+    auto& Top = Stack.back();
+    if (Top.second < Top.first->getSuccessors().size()) {
+      IRBasicBlock* Succ = Top.first->getSuccessors()[Top.second++];
+      if (Seen.insert(Succ).second) {
+        Stack.push_back({Succ, 0});
+      }
+    } else {
+      Order.push_back(Top.first);
+      Stack.pop_back();
+    }
+  }
+  std::reverse(Order.begin(), Order.end());
   for (const auto& BB : F->getBlocks()) {
+    if (!Seen.count(BB.get())) Order.push_back(BB.get());
+  }
+
+  for (IRBasicBlock* BB : Order) {
     for (const auto& Inst : BB->getInstructions()) {
       // Check operands are defined based on instruction type
       if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
         if (!BinOp->getLHS()->isConstant() && !Defined.count(BinOp->getLHS())) {
-          addError("Use of undefined value", F, BB.get(), BinOp);
+          addError("Use of undefined value", F, BB, BinOp);
           Valid = false;
           if (FailFast) return false;
         }
         if (!BinOp->getRHS()->isConstant() && !Defined.count(BinOp->getRHS())) {
-          addError("Use of undefined value", F, BB.get(), BinOp);
+          addError("Use of undefined value", F, BB, BinOp);
           Valid = false;
           if (FailFast) return false;
         }
@@ -290,7 +316,7 @@ bool IRVerifier::checkDefBeforeUse(IRFunction* F) {
       else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(Inst.get())) {
         // Check operand is defined
         if (!UnOp->getOperand()->isConstant() && !Defined.count(UnOp->getOperand())) {
-          addError("Use of undefined value", F, BB.get(), UnOp);
+          addError("Use of undefined value", F, BB, UnOp);
           Valid = false;
           if (FailFast) return false;
         }
@@ -302,9 +328,10 @@ bool IRVerifier::checkDefBeforeUse(IRFunction* F) {
         Defined.insert(Alloca->getResult());
       }
       else if (auto* Load = dynamic_cast<IRLoadInst*>(Inst.get())) {
-        // Check pointer is defined
-        if (!Load->getPtr()->isConstant() && !Defined.count(Load->getPtr())) {
-          addError("Use of undefined value", F, BB.get(), Load);
+        // Check pointer is defined (globals are defined by the module)
+        if (!Load->getPtr()->isConstant() && !Load->getPtr()->isGlobal() &&
+            !Defined.count(Load->getPtr())) {
+          addError("Use of undefined value", F, BB, Load);
           Valid = false;
           if (FailFast) return false;
         }
@@ -314,13 +341,14 @@ bool IRVerifier::checkDefBeforeUse(IRFunction* F) {
       else if (auto* Store = dynamic_cast<IRStoreInst*>(Inst.get())) {
         // Check value is defined
         if (!Store->getValue()->isConstant() && !Defined.count(Store->getValue())) {
-          addError("Use of undefined value", F, BB.get(), Store);
+          addError("Use of undefined value", F, BB, Store);
           Valid = false;
           if (FailFast) return false;
         }
         // Check pointer is defined
-        if (!Store->getPtr()->isConstant() && !Defined.count(Store->getPtr())) {
-          addError("Use of undefined value", F, BB.get(), Store);
+        if (!Store->getPtr()->isConstant() && !Store->getPtr()->isGlobal() &&
+            !Defined.count(Store->getPtr())) {
+          addError("Use of undefined value", F, BB, Store);
           Valid = false;
           if (FailFast) return false;
         }
@@ -329,7 +357,7 @@ bool IRVerifier::checkDefBeforeUse(IRFunction* F) {
         // Check arguments
         for (IRValue* Arg : Call->getArgs()) {
           if (!Arg->isConstant() && !Defined.count(Arg)) {
-            addError("Use of undefined value", F, BB.get(), Call);
+            addError("Use of undefined value", F, BB, Call);
             Valid = false;
             if (FailFast) return false;
           }
@@ -342,7 +370,7 @@ bool IRVerifier::checkDefBeforeUse(IRFunction* F) {
       else if (auto* Ret = dynamic_cast<IRRetInst*>(Inst.get())) {
         // Check return value if present
         if (Ret->hasRetValue() && !Ret->getRetValue()->isConstant() && !Defined.count(Ret->getRetValue())) {
-          addError("Use of undefined value", F, BB.get(), Ret);
+          addError("Use of undefined value", F, BB, Ret);
           Valid = false;
           if (FailFast) return false;
         }
@@ -350,11 +378,29 @@ bool IRVerifier::checkDefBeforeUse(IRFunction* F) {
       else if (auto* Br = dynamic_cast<IRCondBrInst*>(Inst.get())) {
         // Check condition
         if (!Br->getCondition()->isConstant() && !Defined.count(Br->getCondition())) {
-          addError("Use of undefined value", F, BB.get(), Br);
+          addError("Use of undefined value", F, BB, Br);
           Valid = false;
           if (FailFast) return false;
         }
       }
+      else if (auto* Switch = dynamic_cast<IRSwitchInst*>(Inst.get())) {
+        if (!Switch->getCondition()->isConstant() && !Defined.count(Switch->getCondition())) {
+          addError("Use of undefined value", F, BB, Switch);
+          Valid = false;
+          if (FailFast) return false;
+        }
+      }
+      else if (auto* Sel = dynamic_cast<IRSelectInst*>(Inst.get())) {
+        for (IRValue* Op : {Sel->getCondition(), Sel->getTrueValue(),
+                            Sel->getFalseValue()}) {
+          if (!Op->isConstant() && !Defined.count(Op)) {
+            addError("Use of undefined value", F, BB, Sel);
+            Valid = false;
+            if (FailFast) return false;
+          }
+        }
+        Defined.insert(Sel->getResult());
+      }
       else if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
         // Phi node defines its result
         Defined.insert(Phi->getResult());
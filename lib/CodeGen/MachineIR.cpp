@@ -0,0 +1,403 @@
+#include "yac/CodeGen/MachineIR.h"
+#include <algorithm>
+
+namespace yac {
+
+// ===----------------------------------------------------------------------===
+// X86 target description
+// ===----------------------------------------------------------------------===
+
+namespace X86 {
+
+std::string getRegName(unsigned Reg, unsigned Size) {
+  static const char* Names64[] = {
+    "noreg", "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+  };
+  static const char* Names8[] = {
+    "noreg", "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+  };
+
+  if (isVirtualRegister(Reg)) {
+    return "%v" + std::to_string(Reg - FirstVirtualRegister) +
+           (Size == 1 ? ".b" : "");
+  }
+  if (Reg >= NumPhysRegs) return "noreg";
+  return Size == 1 ? Names8[Reg] : Names64[Reg];
+}
+
+const std::vector<unsigned> CallerSavedRegs = {
+  RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11
+};
+
+const std::vector<unsigned> CalleeSavedRegs = {RBX, R12, R13, R14, R15};
+
+const std::vector<unsigned> ArgRegs = {RDI, RSI, RDX, RCX, R8, R9};
+
+const char* getCondCodeName(CondCode CC) {
+  switch (CC) {
+  case COND_E: return "e";
+  case COND_NE: return "ne";
+  case COND_L: return "l";
+  case COND_LE: return "le";
+  case COND_G: return "g";
+  case COND_GE: return "ge";
+  case COND_B: return "b";
+  case COND_BE: return "be";
+  case COND_A: return "a";
+  case COND_AE: return "ae";
+  case COND_NONE: break;
+  }
+  return "";
+}
+
+CondCode getInverseCondCode(CondCode CC) {
+  switch (CC) {
+  case COND_E: return COND_NE;
+  case COND_NE: return COND_E;
+  case COND_L: return COND_GE;
+  case COND_LE: return COND_G;
+  case COND_G: return COND_LE;
+  case COND_GE: return COND_L;
+  case COND_B: return COND_AE;
+  case COND_BE: return COND_A;
+  case COND_A: return COND_BE;
+  case COND_AE: return COND_B;
+  case COND_NONE: break;
+  }
+  return COND_NONE;
+}
+
+CondCode getSwappedCondCode(CondCode CC) {
+  switch (CC) {
+  case COND_L: return COND_G;
+  case COND_LE: return COND_GE;
+  case COND_G: return COND_L;
+  case COND_GE: return COND_LE;
+  case COND_B: return COND_A;
+  case COND_BE: return COND_AE;
+  case COND_A: return COND_B;
+  case COND_AE: return COND_BE;
+  default: return CC;  // E and NE are symmetric
+  }
+}
+
+const InstrDesc& getInstrDesc(Opcode Op) {
+  using D = InstrDesc;
+  static const InstrDesc Table[NumOpcodes] = {
+    {"mov", 0, {}, {}},
+    {"movzx", 0, {}, {}},
+    {"movsxd", 0, {}, {}},
+    {"lea", 0, {}, {}},
+    {"cmov", D::ReadsFlags, {}, {}},
+    {"set", D::ReadsFlags, {}, {}},
+    {"push", D::SideEffects, {}, {}},
+    {"pop", D::SideEffects, {}, {}},
+    {"add", D::DefinesFlags, {}, {}},
+    {"sub", D::DefinesFlags, {}, {}},
+    {"and", D::DefinesFlags, {}, {}},
+    {"or", D::DefinesFlags, {}, {}},
+    {"xor", D::DefinesFlags, {}, {}},
+    {"imul", D::DefinesFlags, {}, {}},
+    {"imul", D::DefinesFlags, {RAX}, {RAX, RDX}},
+    {"neg", D::DefinesFlags, {}, {}},
+    {"not", 0, {}, {}},
+    {"shl", D::DefinesFlags, {}, {}},
+    {"sar", D::DefinesFlags, {}, {}},
+    {"shr", D::DefinesFlags, {}, {}},
+    {"cqo", 0, {RAX}, {RDX}},
+    {"idiv", D::DefinesFlags | D::SideEffects, {RAX, RDX}, {RAX, RDX}},
+    {"cmp", D::DefinesFlags, {}, {}},
+    {"test", D::DefinesFlags, {}, {}},
+    {"bt", D::DefinesFlags, {}, {}},
+    {"jmp", D::Terminator | D::Branch, {}, {}},
+    {"j", D::Terminator | D::Branch | D::ReadsFlags, {}, {}},
+    {"call", D::Call | D::SideEffects | D::DefinesFlags, {},
+     {RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11}},
+    {"ret", D::Terminator | D::Return | D::SideEffects, {}, {}},
+    {"ud2", D::SideEffects, {}, {}},
+    {"pcopy", D::Pseudo, {}, {}},
+  };
+  return Table[Op];
+}
+
+} // namespace X86
+
+// ===----------------------------------------------------------------------===
+// MachineOperand and MachineInstr
+// ===----------------------------------------------------------------------===
+
+bool MachineOperand::isIdenticalTo(const MachineOperand& Other) const {
+  if (K != Other.K) return false;
+  switch (K) {
+  case MO_Register:
+    return Reg == Other.Reg && Size == Other.Size;
+  case MO_Immediate:
+    return Imm == Other.Imm;
+  case MO_Memory:
+    return Reg == Other.Reg && Imm == Other.Imm && Index == Other.Index &&
+           Scale == Other.Scale && Size == Other.Size &&
+           FrameIndex == Other.FrameIndex && JumpTable == Other.JumpTable &&
+           Symbol == Other.Symbol;
+  case MO_Block:
+    return Block == Other.Block;
+  case MO_Symbol:
+    return Symbol == Other.Symbol;
+  }
+  return false;
+}
+
+bool MachineInstr::isCopy() const {
+  return Op == X86::MOV && Operands.size() == 2 && Operands[0].isReg() &&
+         Operands[1].isReg();
+}
+
+std::vector<unsigned> MachineInstr::getUses() const {
+  std::vector<unsigned> Uses;
+  auto add = [&](unsigned Reg) {
+    if (Reg != X86::NoReg &&
+        std::find(Uses.begin(), Uses.end(), Reg) == Uses.end()) {
+      Uses.push_back(Reg);
+    }
+  };
+  for (const MachineOperand& MO : Operands) {
+    if (MO.isReg() && MO.isUse()) {
+      add(MO.getReg());
+    } else if (MO.isMem()) {
+      add(MO.getBase());
+      add(MO.getIndex());
+    }
+  }
+  for (unsigned Reg : getDesc().ImplicitUses) add(Reg);
+  return Uses;
+}
+
+std::vector<unsigned> MachineInstr::getDefs() const {
+  std::vector<unsigned> Defs;
+  auto add = [&](unsigned Reg) {
+    if (Reg != X86::NoReg &&
+        std::find(Defs.begin(), Defs.end(), Reg) == Defs.end()) {
+      Defs.push_back(Reg);
+    }
+  };
+  for (const MachineOperand& MO : Operands) {
+    if (MO.isReg() && MO.isDef()) add(MO.getReg());
+  }
+  for (unsigned Reg : getDesc().ImplicitDefs) add(Reg);
+  return Defs;
+}
+
+void MachineInstr::substituteReg(unsigned Old, unsigned New) {
+  for (MachineOperand& MO : Operands) {
+    if (MO.isReg() && MO.getReg() == Old) {
+      MO.setReg(New);
+    } else if (MO.isMem()) {
+      if (MO.getBase() == Old) MO.setReg(New);
+      if (MO.getIndex() == Old) MO.setIndex(New);
+    }
+  }
+}
+
+// ===----------------------------------------------------------------------===
+// MachineBasicBlock and MachineFunction
+// ===----------------------------------------------------------------------===
+
+std::string MachineBasicBlock::getLabel() const {
+  return ".L" + Parent->getName() + "_" + Name;
+}
+
+size_t MachineBasicBlock::getFirstTerminator() const {
+  size_t Pos = Instrs.size();
+  while (Pos > 0 && Instrs[Pos - 1]->isTerminator()) --Pos;
+  return Pos;
+}
+
+void MachineBasicBlock::addSuccessor(MachineBasicBlock* Succ) {
+  if (std::find(Successors.begin(), Successors.end(), Succ) !=
+      Successors.end()) {
+    return;
+  }
+  Successors.push_back(Succ);
+  Succ->Predecessors.push_back(this);
+}
+
+void MachineBasicBlock::replaceSuccessor(MachineBasicBlock* Old,
+                                         MachineBasicBlock* New) {
+  std::replace(Successors.begin(), Successors.end(), Old, New);
+  Old->Predecessors.erase(std::remove(Old->Predecessors.begin(),
+                                      Old->Predecessors.end(), this),
+                          Old->Predecessors.end());
+  New->Predecessors.push_back(this);
+
+  for (const auto& MI : Instrs) {
+    for (MachineOperand& Op : MI->operands()) {
+      if (Op.isBlock() && Op.getBlock() == Old) {
+        Op.setBlock(New);
+      } else if (Op.isMem() && Op.getJumpTable() >= 0) {
+        Parent->replaceJumpTableTarget(Op.getJumpTable(), Old, New);
+      }
+    }
+  }
+}
+
+MachineBasicBlock* MachineFunction::createBlock(const std::string& Name,
+                                                MachineBasicBlock* After) {
+  auto MBB = std::make_unique<MachineBasicBlock>(Name, this);
+  MachineBasicBlock* Ptr = MBB.get();
+  auto Pos = Blocks.end();
+  if (After) {
+    Pos = std::find_if(Blocks.begin(), Blocks.end(),
+                       [After](const auto& B) { return B.get() == After; });
+    if (Pos != Blocks.end()) ++Pos;
+  }
+  Blocks.insert(Pos, std::move(MBB));
+  return Ptr;
+}
+
+std::string MachineFunction::getJumpTableLabel(int JTI) const {
+  return ".L" + Name + "_jt" + std::to_string(JTI);
+}
+
+void MachineFunction::replaceJumpTableTarget(int JTI, MachineBasicBlock* Old,
+                                             MachineBasicBlock* New) {
+  std::replace(JumpTables[JTI].begin(), JumpTables[JTI].end(), Old, New);
+}
+
+// ===----------------------------------------------------------------------===
+// MachineLiveness
+// ===----------------------------------------------------------------------===
+
+void MachineLiveness::compute(const MachineFunction& MF) {
+  LiveIn.clear();
+  LiveOut.clear();
+
+  // Upward-exposed uses and defs of virtual registers in each block
+  std::map<const MachineBasicBlock*, std::set<unsigned>> Use, Def;
+  for (const auto& MBB : MF.getBlocks()) {
+    auto& BlockUse = Use[MBB.get()];
+    auto& BlockDef = Def[MBB.get()];
+    for (const auto& MI : MBB->instrs()) {
+      for (unsigned Reg : MI->getUses()) {
+        if (X86::isVirtualRegister(Reg) && !BlockDef.count(Reg))
+          BlockUse.insert(Reg);
+      }
+      for (unsigned Reg : MI->getDefs()) {
+        if (X86::isVirtualRegister(Reg)) BlockDef.insert(Reg);
+      }
+    }
+    LiveIn[MBB.get()];
+    LiveOut[MBB.get()];
+  }
+
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    const auto& Blocks = MF.getBlocks();
+    for (auto It = Blocks.rbegin(); It != Blocks.rend(); ++It) {
+      const MachineBasicBlock* MBB = It->get();
+
+      std::set<unsigned> NewOut;
+      for (const MachineBasicBlock* Succ : MBB->getSuccessors()) {
+        const auto& SuccIn = LiveIn[Succ];
+        NewOut.insert(SuccIn.begin(), SuccIn.end());
+      }
+
+      std::set<unsigned> NewIn = Use[MBB];
+      for (unsigned Reg : NewOut) {
+        if (!Def[MBB].count(Reg)) NewIn.insert(Reg);
+      }
+
+      if (NewIn != LiveIn[MBB] || NewOut != LiveOut[MBB]) {
+        LiveIn[MBB] = std::move(NewIn);
+        LiveOut[MBB] = std::move(NewOut);
+        Changed = true;
+      }
+    }
+  }
+}
+
+void MachineLoopInfo::compute(const MachineFunction& MF) {
+  Depth.clear();
+  Headers.clear();
+  if (MF.getBlocks().empty()) return;
+
+  // Reverse postorder from the entry block
+  std::vector<const MachineBasicBlock*> Order;
+  std::set<const MachineBasicBlock*> Visited;
+  std::vector<std::pair<const MachineBasicBlock*, size_t>> Stack;
+  Stack.push_back({MF.getBlocks().front().get(), 0});
+  Visited.insert(Stack.back().first);
+  while (!Stack.empty()) {
+    auto& [MBB, Next] = Stack.back();
+    if (Next < MBB->getSuccessors().size()) {
+      const MachineBasicBlock* Succ = MBB->getSuccessors()[Next++];
+      if (Visited.insert(Succ).second) Stack.push_back({Succ, 0});
+      continue;
+    }
+    Order.push_back(MBB);
+    Stack.pop_back();
+  }
+  std::reverse(Order.begin(), Order.end());
+  std::map<const MachineBasicBlock*, size_t> Number;
+  for (size_t i = 0; i < Order.size(); ++i) Number[Order[i]] = i;
+
+  // Immediate dominators (Cooper, Harvey and Kennedy)
+  std::vector<size_t> IDom(Order.size(), SIZE_MAX);
+  IDom[0] = 0;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (size_t i = 1; i < Order.size(); ++i) {
+      size_t NewIDom = SIZE_MAX;
+      for (const MachineBasicBlock* Pred : Order[i]->getPredecessors()) {
+        auto It = Number.find(Pred);
+        if (It == Number.end() || IDom[It->second] == SIZE_MAX) continue;
+        size_t P = It->second;
+        if (NewIDom == SIZE_MAX) {
+          NewIDom = P;
+          continue;
+        }
+        while (P != NewIDom) {
+          while (P > NewIDom) P = IDom[P];
+          while (NewIDom > P) NewIDom = IDom[NewIDom];
+        }
+      }
+      if (NewIDom != IDom[i]) {
+        IDom[i] = NewIDom;
+        Changed = true;
+      }
+    }
+  }
+  auto dominates = [&](size_t A, size_t B) {
+    while (B != A && B != 0) B = IDom[B];
+    return A == B;
+  };
+
+  // Gather each header's loop body from the sources of its back edges
+  std::map<size_t, std::set<const MachineBasicBlock*>> Loops;
+  for (size_t i = 0; i < Order.size(); ++i) {
+    for (const MachineBasicBlock* Succ : Order[i]->getSuccessors()) {
+      size_t H = Number[Succ];
+      if (!dominates(H, i)) continue;
+      auto& Body = Loops[H];
+      Body.insert(Succ);
+      std::vector<const MachineBasicBlock*> Work;
+      if (Body.insert(Order[i]).second) Work.push_back(Order[i]);
+      while (!Work.empty()) {
+        const MachineBasicBlock* MBB = Work.back();
+        Work.pop_back();
+        for (const MachineBasicBlock* Pred : MBB->getPredecessors()) {
+          if (Number.count(Pred) && Body.insert(Pred).second)
+            Work.push_back(Pred);
+        }
+      }
+    }
+  }
+  for (const auto& Loop : Loops) {
+    Headers.insert(Order[Loop.first]);
+    for (const MachineBasicBlock* MBB : Loop.second) Depth[MBB]++;
+  }
+}
+
+} // namespace yac
@@ -1,5 +1,6 @@
 #include "yac/CodeGen/Pass.h"
 #include "yac/CodeGen/IRVerifier.h"
+#include "yac/CodeGen/IRUtils.h"
 #include <chrono>
 #include <iomanip>
 #include <iostream>
@@ -13,10 +14,15 @@ namespace yac {
 // ===----------------------------------------------------------------------===
 
 bool PassManager::run(IRFunction* F) {
+  return runFunctionPasses(F, 0, Passes.size());
+}
+
+bool PassManager::runFunctionPasses(IRFunction* F, size_t Begin, size_t End) {
   AnalysisManager AM(F);
   bool Changed = false;
 
-  for (auto& P : Passes) {
+  for (size_t i = Begin; i < End; ++i) {
+    Pass* P = Passes[i].get();
     std::cout << "Running pass: " << P->getName() << "\n";
 
     // Count instructions before
@@ -64,10 +70,46 @@ bool PassManager::run(IRFunction* F) {
 
 bool PassManager::run(IRModule* M) {
   bool Changed = false;
+  size_t Begin = 0;
 
-  for (auto& F : M->getFunctions()) {
-    if (run(F.get())) {
-      Changed = true;
+  auto RunFunctionPasses = [&](size_t End) {
+    if (Begin == End) return;
+    for (auto& F : M->getFunctions()) {
+      if (runFunctionPasses(F.get(), Begin, End)) {
+        Changed = true;
+      }
+    }
+    Begin = End;
+  };
+
+  for (auto& Entry : ModulePasses) {
+    RunFunctionPasses(Entry.first);
+    Changed |= runModulePass(Entry.second.get(), M);
+  }
+  RunFunctionPasses(Passes.size());
+
+  return Changed;
+}
+
+bool PassManager::runModulePass(ModulePass* P, IRModule* M) {
+  std::cout << "Running pass: " << P->getName() << "\n";
+
+  size_t InstrsBefore = EnableTiming ? countInstructions(M) : 0;
+  auto Start = std::chrono::high_resolution_clock::now();
+  bool Changed = P->run(M);
+  auto End = std::chrono::high_resolution_clock::now();
+
+  if (EnableTiming) {
+    double TimeMs = std::chrono::duration<double, std::milli>(End - Start).count();
+    Stats.push_back({P->getName(), TimeMs, InstrsBefore, countInstructions(M)});
+  }
+
+  if (Changed && VerifyEach) {
+    IRVerifier V(false);
+    if (!V.verify(M)) {
+      std::cerr << "Verification failed after pass: " << P->getName() << "\n";
+      V.printErrors();
+      return false;
     }
   }
 
@@ -78,7 +120,7 @@ bool PassManager::run(IRModule* M) {
 // DominatorTree
 // ===----------------------------------------------------------------------===
 
-void DominatorTree::run(IRFunction* F) {
+void DominatorTreeBase::recalculate(IRFunction* F) {
   AllNodes.clear();
   Nodes.clear();
   Root = nullptr;
@@ -93,112 +135,143 @@ void DominatorTree::run(IRFunction* F) {
     AllNodes.push_back(std::move(N));
   }
 
-  // Entry block is the root and dominates itself
-  IRBasicBlock* Entry = F->getBlocks()[0].get();
-  Root = Nodes[Entry];
-  Root->IDom = nullptr;
+  // Edges of the graph being walked: the CFG, or the CFG reversed
+  auto Succs = [&](IRBasicBlock* BB) -> const std::vector<IRBasicBlock*>& {
+    return IsPostDom ? BB->getPredecessors() : BB->getSuccessors();
+  };
+  auto Preds = [&](IRBasicBlock* BB) -> const std::vector<IRBasicBlock*>& {
+    return IsPostDom ? BB->getSuccessors() : BB->getPredecessors();
+  };
 
-  // Compute dominators using iterative algorithm
-  // Initialize: all blocks except entry are dominated by all blocks
-  std::map<IRBasicBlock*, std::set<IRBasicBlock*>> Doms;
+  // Number the reachable nodes in postorder
+  std::vector<Node*> Order;
+  std::map<Node*, unsigned> PONum;
+  auto Walk = [&](IRBasicBlock* Start) {
+    std::vector<std::pair<IRBasicBlock*, size_t>> Stack;
+    PONum[Nodes[Start]] = 0;
+    Stack.push_back({Start, 0});
+    while (!Stack.empty()) {
+      IRBasicBlock* BB = Stack.back().first;
+      size_t& Next = Stack.back().second;
+      if (Next < Succs(BB).size()) {
+        IRBasicBlock* Succ = Succs(BB)[Next++];
+        if (PONum.emplace(Nodes[Succ], 0).second) {
+          Stack.push_back({Succ, 0});
+        }
+      } else {
+        PONum[Nodes[BB]] = Order.size();
+        Order.push_back(Nodes[BB]);
+        Stack.pop_back();
+      }
+    }
+  };
 
-  for (const auto& BB : F->getBlocks()) {
-    if (BB.get() == Entry) {
-      Doms[Entry].insert(Entry);
-    } else {
-      for (const auto& BB2 : F->getBlocks()) {
-        Doms[BB.get()].insert(BB2.get());
+  std::set<IRBasicBlock*> Roots;
+  if (!IsPostDom) {
+    IRBasicBlock* Entry = F->getBlocks()[0].get();
+    Walk(Entry);
+    Root = Nodes[Entry];
+  } else {
+    // Walk back from every return. A loop with no way out is never
+    // reached that way; its last block in layout order, usually the
+    // latch, becomes one more root.
+    for (const auto& BB : F->getBlocks()) {
+      if (BB->getNumSuccessors() == 0) {
+        Roots.insert(BB.get());
+        Walk(BB.get());
+      }
+    }
+    for (auto It = F->getBlocks().rbegin(); It != F->getBlocks().rend(); ++It) {
+      if (!PONum.count(Nodes[It->get()])) {
+        Roots.insert(It->get());
+        Walk(It->get());
       }
     }
+
+    auto Exit = std::make_unique<Node>();
+    Exit->Block = nullptr;
+    Root = Exit.get();
+    AllNodes.push_back(std::move(Exit));
+    PONum[Root] = Order.size();
+    Order.push_back(Root);
   }
 
-  // Iterate until fixpoint
+  // Cooper, Harvey and Kennedy: visit in reverse postorder, intersecting
+  // the dominators of the predecessors seen so far, until nothing changes
+  std::vector<Node*> IDoms(Order.size(), nullptr);
+  IDoms.back() = Root;
+
+  auto Intersect = [&](Node* A, Node* B) {
+    while (A != B) {
+      while (PONum[A] < PONum[B]) A = IDoms[PONum[A]];
+      while (PONum[B] < PONum[A]) B = IDoms[PONum[B]];
+    }
+    return A;
+  };
+
   bool Changed = true;
   while (Changed) {
     Changed = false;
-
-    for (const auto& BB : F->getBlocks()) {
-      if (BB.get() == Entry) continue;
-
-      std::set<IRBasicBlock*> NewDoms;
-      NewDoms.insert(BB.get());
-
-      // Intersect dominators of all predecessors
-      bool First = true;
-      for (IRBasicBlock* Pred : BB->getPredecessors()) {
-        if (First) {
-          NewDoms.insert(Doms[Pred].begin(), Doms[Pred].end());
-          First = false;
-        } else {
-          std::set<IRBasicBlock*> Intersection;
-          std::set_intersection(
-            NewDoms.begin(), NewDoms.end(),
-            Doms[Pred].begin(), Doms[Pred].end(),
-            std::inserter(Intersection, Intersection.begin())
-          );
-          NewDoms = std::move(Intersection);
-          NewDoms.insert(BB.get());
-        }
+    for (size_t i = Order.size() - 1; i-- > 0;) {
+      IRBasicBlock* BB = Order[i]->Block;
+      Node* NewIDom = Roots.count(BB) ? Root : nullptr;
+
+      for (IRBasicBlock* Pred : Preds(BB)) {
+        Node* P = Nodes[Pred];
+        auto It = PONum.find(P);
+        if (It == PONum.end() || !IDoms[It->second]) continue;
+        NewIDom = NewIDom ? Intersect(P, NewIDom) : P;
       }
 
-      if (NewDoms != Doms[BB.get()]) {
-        Doms[BB.get()] = NewDoms;
+      if (IDoms[i] != NewIDom) {
+        IDoms[i] = NewIDom;
         Changed = true;
       }
     }
   }
 
-  // Compute immediate dominators
+  // Link the tree, children in block order
   for (const auto& BB : F->getBlocks()) {
-    if (BB.get() == Entry) continue;
-
-    IRBasicBlock* IDom = nullptr;
-
-    // IDom is the unique dominator that is dominated by all other dominators
-    for (IRBasicBlock* D : Doms[BB.get()]) {
-      if (D == BB.get()) continue;
-
-      bool IsIDom = true;
-      for (IRBasicBlock* D2 : Doms[BB.get()]) {
-        if (D2 == BB.get() || D2 == D) continue;
-        if (Doms[D].count(D2) == 0) {
-          IsIDom = false;
-          break;
-        }
-      }
+    Node* N = Nodes[BB.get()];
+    auto It = PONum.find(N);
+    if (N == Root || It == PONum.end()) continue;
 
-      if (IsIDom) {
-        IDom = D;
-        break;
-      }
-    }
+    N->IDom = IDoms[It->second];
+    N->IDom->Children.push_back(N);
+  }
 
-    if (IDom) {
-      Node* N = Nodes[BB.get()];
-      N->IDom = Nodes[IDom];
-      Nodes[IDom]->Children.push_back(N);
+  // DFS numbers for O(1) dominance queries
+  unsigned Counter = 0;
+  std::vector<std::pair<Node*, size_t>> Stack;
+  Root->DFSIn = ++Counter;
+  Stack.push_back({Root, 0});
+  while (!Stack.empty()) {
+    Node* N = Stack.back().first;
+    size_t& Next = Stack.back().second;
+    if (Next < N->Children.size()) {
+      Node* Child = N->Children[Next++];
+      Child->DFSIn = ++Counter;
+      Stack.push_back({Child, 0});
+    } else {
+      N->DFSOut = ++Counter;
+      Stack.pop_back();
     }
   }
 }
 
-bool DominatorTree::dominates(IRBasicBlock* A, IRBasicBlock* B) const {
+bool DominatorTreeBase::dominates(IRBasicBlock* A, IRBasicBlock* B) const {
   if (A == B) return true;
 
   Node* NA = getNode(A);
   Node* NB = getNode(B);
-  if (!NA || !NB) return false;
-
-  // Walk up B's dominator tree
-  while (NB) {
-    if (NB == NA) return true;
-    NB = NB->IDom;
-  }
+  if (!NA || !NB || !NA->DFSIn || !NB->DFSIn) return false;
 
-  return false;
+  // A's subtree spans B's DFS interval
+  return NA->DFSIn <= NB->DFSIn && NB->DFSOut <= NA->DFSOut;
 }
 
-void DominatorTree::print() const {
-  std::cout << "Dominator Tree:\n";
+void DominatorTreeBase::print() const {
+  std::cout << (IsPostDom ? "Post-Dominator Tree:\n" : "Dominator Tree:\n");
   if (!Root) {
     std::cout << "  (empty)\n";
     return;
@@ -206,7 +279,7 @@ void DominatorTree::print() const {
 
   std::function<void(Node*, int)> PrintNode = [&](Node* N, int Depth) {
     for (int i = 0; i < Depth; ++i) std::cout << "  ";
-    std::cout << N->Block->getName() << "\n";
+    std::cout << (N->Block ? N->Block->getName() : "<exit>") << "\n";
     for (Node* Child : N->Children) {
       PrintNode(Child, Depth + 1);
     }
@@ -219,28 +292,40 @@ void DominatorTree::print() const {
 // Liveness
 // ===----------------------------------------------------------------------===
 
+/// Values that live in registers: constants, labels and globals (which are
+/// addressed by symbol) never do.
+static bool isTrackedValue(IRValue* V) {
+  return V && !V->isConstant() && !V->isLabel() && !V->isGlobal();
+}
+
 void Liveness::run(IRFunction* F) {
   BlockLiveness.clear();
 
-  // Initialize Use and Def sets for each block
+  // Phi results are defined on entry to their block, and each incoming
+  // value is used at the end of the matching predecessor rather than in
+  // the phi's own block
+  std::map<IRBasicBlock*, std::set<IRValue*>> PhiUses;
+
   for (const auto& BB : F->getBlocks()) {
     BlockInfo& Info = BlockLiveness[BB.get()];
 
     for (const auto& Inst : BB->getInstructions()) {
-      // Simplified: only handle binary instructions for now
-      if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
-        // If operand is used before being defined in this block, add to Use
-        if (!Info.Def.count(BinOp->getLHS()) && !BinOp->getLHS()->isConstant()) {
-          Info.Use.insert(BinOp->getLHS());
-        }
-        if (!Info.Def.count(BinOp->getRHS()) && !BinOp->getRHS()->isConstant()) {
-          Info.Use.insert(BinOp->getRHS());
+      if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
+        for (const auto& Entry : Phi->getIncomings()) {
+          if (isTrackedValue(Entry.Value))
+            PhiUses[Entry.Block].insert(Entry.Value);
         }
+        Info.Def.insert(Phi->getResult());
+        continue;
+      }
 
-        // Result is defined
-        Info.Def.insert(BinOp->getResult());
+      // An operand read before any def in this block is upward-exposed
+      for (IRValue* Op : getOperands(Inst.get())) {
+        if (isTrackedValue(Op) && !Info.Def.count(Op))
+          Info.Use.insert(Op);
       }
-      // TODO: Handle other instruction types
+      if (IRValue* Def = getDefinedValue(Inst.get()))
+        Info.Def.insert(Def);
     }
   }
 
@@ -249,11 +334,15 @@ void Liveness::run(IRFunction* F) {
   while (Changed) {
     Changed = false;
 
-    for (const auto& BB : F->getBlocks()) {
-      BlockInfo& Info = BlockLiveness[BB.get()];
+    // Reverse layout order converges faster for forward-laid-out code
+    const auto& Blocks = F->getBlocks();
+    for (auto It = Blocks.rbegin(); It != Blocks.rend(); ++It) {
+      IRBasicBlock* BB = It->get();
+      BlockInfo& Info = BlockLiveness[BB];
 
-      // LiveOut = Union of LiveIn of successors
-      std::set<IRValue*> NewLiveOut;
+      // LiveOut = Union of LiveIn of successors, plus phi operands
+      // flowing out along this block's edges
+      std::set<IRValue*> NewLiveOut = PhiUses[BB];
       for (IRBasicBlock* Succ : BB->getSuccessors()) {
         const BlockInfo& SuccInfo = BlockLiveness[Succ];
         NewLiveOut.insert(SuccInfo.LiveIn.begin(), SuccInfo.LiveIn.end());
@@ -281,6 +370,7 @@ void Liveness::run(IRFunction* F) {
 // ===----------------------------------------------------------------------===
 
 void LoopInfo::run(IRFunction* F) {
+  Loops.clear();
   TopLevelLoops.clear();
   BlockToLoop.clear();
 
@@ -289,6 +379,26 @@ void LoopInfo::run(IRFunction* F) {
   DT.run(F);
 
   identifyLoops(F, &DT);
+  buildLoopTree();
+}
+
+std::vector<Loop*> LoopInfo::getLoopsInnermostFirst() const {
+  std::vector<Loop*> Order;
+  std::vector<std::pair<Loop*, size_t>> Stack;
+  for (Loop* Top : TopLevelLoops) {
+    Stack.push_back({Top, 0});
+    while (!Stack.empty()) {
+      Loop* L = Stack.back().first;
+      size_t& Next = Stack.back().second;
+      if (Next < L->getSubLoops().size()) {
+        Stack.push_back({L->getSubLoops()[Next++], 0});
+      } else {
+        Order.push_back(L);
+        Stack.pop_back();
+      }
+    }
+  }
+  return Order;
 }
 
 void LoopInfo::identifyLoops(IRFunction* F, DominatorTree* DT) {
@@ -335,11 +445,46 @@ void LoopInfo::identifyLoops(IRFunction* F, DominatorTree* DT) {
   }
 }
 
+void LoopInfo::buildLoopTree() {
+  // Natural loops with different headers are either disjoint or nested,
+  // so the parent of a loop is the smallest other loop holding its header
+  for (const auto& L : Loops) {
+    Loop* Parent = nullptr;
+    for (const auto& Other : Loops) {
+      if (Other == L || !Other->contains(L->getHeader()) ||
+          Other->getBlocks().size() <= L->getBlocks().size()) {
+        continue;
+      }
+      if (!Parent || Other->getBlocks().size() < Parent->getBlocks().size()) {
+        Parent = Other.get();
+      }
+    }
+
+    L->setParentLoop(Parent);
+    if (Parent) {
+      Parent->addSubLoop(L.get());
+    } else {
+      TopLevelLoops.push_back(L.get());
+    }
+  }
+
+  // Map each block to the innermost loop containing it
+  BlockToLoop.clear();
+  for (const auto& L : Loops) {
+    for (IRBasicBlock* BB : L->getBlocks()) {
+      Loop*& Current = BlockToLoop[BB];
+      if (!Current || L->getBlocks().size() < Current->getBlocks().size()) {
+        Current = L.get();
+      }
+    }
+  }
+}
+
 Loop* LoopInfo::createLoop(IRBasicBlock* Header) {
   auto L = std::make_unique<Loop>(Header);
   Loop* LPtr = L.get();
 
-  TopLevelLoops.push_back(std::move(L));
+  Loops.push_back(std::move(L));
   BlockToLoop[Header] = LPtr;
 
   return LPtr;
@@ -377,6 +522,14 @@ size_t PassManager::countInstructions(IRFunction* F) const {
   return Count;
 }
 
+size_t PassManager::countInstructions(IRModule* M) const {
+  size_t Count = 0;
+  for (const auto& F : M->getFunctions()) {
+    Count += countInstructions(F.get());
+  }
+  return Count;
+}
+
 void PassManager::printTimingReport() const {
   if (Stats.empty()) {
     return;
@@ -0,0 +1,53 @@
+#include "yac/CodeGen/Pipeline.h"
+#include "yac/CodeGen/IPO.h"
+#include "yac/CodeGen/Transforms.h"
+
+namespace yac {
+
+void addOptimizationPasses(PassManager& PM, unsigned OptLevel) {
+  if (OptLevel == 0) return;
+
+  // -O1: Basic optimizations
+  PM.addPass(std::make_unique<SimplifyCFGPass>());
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<CopyPropagationPass>());
+  PM.addPass(std::make_unique<ConstantPropagationPass>());
+  PM.addPass(std::make_unique<DCEPass>());
+
+  if (OptLevel >= 2) {
+    // -O2: More aggressive optimizations with advanced passes
+    PM.addPass(std::make_unique<IPSCCPPass>());         // Constants across calls
+    PM.addPass(std::make_unique<FunctionAttrsPass>());  // Pure calls for DCE/GVN/LICM
+    if (OptLevel >= 3) {
+      // Before SimplifyCFG turns small invariant diamonds into selects
+      // that would run on every iteration
+      PM.addPass(std::make_unique<LoopUnswitchPass>()); // Clone loops on invariant branches
+    }
+    PM.addPass(std::make_unique<SimplifyCFGPass>());
+    PM.addPass(std::make_unique<ReassociatePass>());    // Rank-order associative expressions
+    PM.addPass(std::make_unique<SCCPPass>());           // Sparse conditional constant propagation
+    PM.addPass(std::make_unique<GVNPass>());            // Global value numbering (CSE)
+    PM.addPass(std::make_unique<CopyPropagationPass>());
+    PM.addPass(std::make_unique<ADCEPass>());           // Also drops dead loops and branches
+    PM.addPass(std::make_unique<LICMPass>());           // Loop invariant code motion
+    PM.addPass(std::make_unique<GCMPass>());            // Sink into the paths that use values
+    PM.addPass(std::make_unique<SimplifyCFGPass>());    // Cleanup after LICM
+  }
+
+  if (OptLevel >= 3) {
+    // -O3: Maximum optimizations (additional rounds)
+    PM.addPass(std::make_unique<FunctionSpecializationPass>());  // Clone for constant arguments
+    PM.addPass(std::make_unique<FunctionAttrsPass>());  // Re-stamp calls to the clones
+    PM.addPass(std::make_unique<SCCPPass>());
+    PM.addPass(std::make_unique<GVNPass>());
+    PM.addPass(std::make_unique<CopyPropagationPass>());
+    PM.addPass(std::make_unique<ADCEPass>());
+    PM.addPass(std::make_unique<LICMPass>());
+    PM.addPass(std::make_unique<SimplifyCFGPass>());
+  }
+
+  // Drop 'static' functions and globals nothing refers to any more
+  PM.addPass(std::make_unique<GlobalDCEPass>());
+}
+
+} // namespace yac
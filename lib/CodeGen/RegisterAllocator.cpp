@@ -1,200 +1,1278 @@
 #include "yac/CodeGen/RegisterAllocator.h"
+#include "yac/CodeGen/ParallelCopy.h"
 #include <algorithm>
-#include <iostream>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <cstdio>
 
 namespace yac {
 
-void RegisterAllocator::allocate(IRFunction* F) {
-  // Compute live intervals
-  auto Intervals = computeLiveIntervals(F);
+using MO = MachineOperand;
 
-  // Sort by start point (required for linear scan)
-  std::sort(Intervals.begin(), Intervals.end());
+static bool isInt32(int64_t V) { return V >= INT32_MIN && V <= INT32_MAX; }
 
-  // Active intervals (currently allocated)
-  std::vector<LiveInterval> Active;
+// How often code at a loop depth runs, relative to straight-line code
+static double getBlockFrequency(unsigned Depth) {
+  return std::pow(10.0, std::min(Depth, 6u));
+}
+
+// Position of a virtual register in the per-register tables
+static unsigned getVRegIndex(unsigned Reg) {
+  return Reg - X86::FirstVirtualRegister;
+}
+
+// Locations are registers, or stack slots encoded as -(FrameIndex + 1)
+static MO getLocationOperand(int64_t Loc, unsigned Flags) {
+  return Loc >= 0 ? MO::createReg(static_cast<unsigned>(Loc), Flags)
+                  : MO::createFrameIndex(static_cast<int>(-Loc - 1));
+}
+
+void RegisterAllocator::allocate(MachineFunction& MF) {
+  // Per-register tables are indexed from the first virtual register
+  unsigned NumVRegs = MF.getNumVirtRegs();
+  Intervals.clear();
+  Pieces.assign(NumVRegs, {});
+  FixedIntervals.clear();
+  Hints.assign(NumVRegs, X86::NoReg);
+  VRegToStackSlot.assign(NumVRegs, -1);
+  Order.clear();
+  OrderIndex.clear();
+  BlockStarts.clear();
+  LoopDepths.clear();
+  EntryDepths.clear();
+  ShallowestEntries.clear();
+  DefSlots.assign(NumVRegs, {});
+  StoredAtDef.assign(NumVRegs, false);
+  RematDefs.clear();
+  RematDefs.resize(NumVRegs);
+  Rematerialized.assign(NumVRegs, false);
+  LiveIns.clear();
+  SplitMoves.clear();
+  EdgeMoves.clear();
+  SplitRemats.clear();
+  EdgeRemats.clear();
+  NumSpilled = 0;
+  NumSplits = 0;
+  NumRemats = 0;
+
+  auto T0 = std::chrono::steady_clock::now();
+  auto lap = [&](const char* N) { auto T = std::chrono::steady_clock::now(); fprintf(stderr, "%s %.1f\n", N, std::chrono::duration<double, std::milli>(T - T0).count()); T0 = T; };
+  coalesceCopies(MF); lap("coalesce");
+  computeLiveIntervals(MF); lap("live");
+  runLinearScan(MF); lap("scan");
+  findRematerialized(); lap("remat");
+  placeSpillStores(); lap("stores");
+  resolveSplits(MF); lap("resolve");
+  rewriteVirtualRegisters(); lap("rewrite");
+  expandParallelCopies(MF); lap("pcopy");
+}
+
+unsigned RegisterAllocator::getRegister(unsigned VReg) const {
+  unsigned Index = getVRegIndex(VReg);
+  if (Index < Pieces.size() && !Pieces[Index].empty()) {
+    return Pieces[Index].front()->PhysReg;
+  }
+  return X86::NoReg;  // Never allocated
+}
+
+// ===----------------------------------------------------------------------===
+// Copy coalescing
+// ===----------------------------------------------------------------------===
+
+void RegisterAllocator::coalesceCopies(MachineFunction& MF) {
+  MachineLiveness LV;
+  LV.compute(MF);
+
+  // Chaitin-style interference: a def interferes with everything live
+  // after it, except the source of a copy into it, which may share its
+  // register. Each register's neighbours go in a flat list.
+  std::vector<std::vector<unsigned>> Adj(MF.getNumVirtRegs());
+  auto addEdge = [&](unsigned A, unsigned B) {
+    if (A == B) return;
+    Adj[getVRegIndex(A)].push_back(getVRegIndex(B));
+    Adj[getVRegIndex(B)].push_back(getVRegIndex(A));
+  };
+
+  std::vector<std::pair<unsigned, unsigned>> Copies;
+  for (const auto& MBB : MF.getBlocks()) {
+    std::set<unsigned> Live = LV.getLiveOut(MBB.get());
+    const auto& Instrs = MBB->instrs();
+    for (auto It = Instrs.rbegin(); It != Instrs.rend(); ++It) {
+      const MachineInstr& MI = **It;
+
+      // Copy source of each defined register, by destination
+      std::vector<std::pair<unsigned, unsigned>> CopySrc;
+      if (MI.getOpcode() == X86::PCOPY) {
+        for (size_t i = 0; i + 1 < MI.getNumOperands(); i += 2) {
+          const MO& Src = MI.getOperand(i + 1);
+          if (Src.isReg())
+            CopySrc.push_back({MI.getOperand(i).getReg(), Src.getReg()});
+        }
+        std::sort(CopySrc.begin(), CopySrc.end());
+      } else if (MI.isCopy()) {
+        CopySrc.push_back({MI.getOperand(0).getReg(),
+                           MI.getOperand(1).getReg()});
+      }
+      for (const auto& Entry : CopySrc) {
+        if (X86::isVirtualRegister(Entry.first) &&
+            X86::isVirtualRegister(Entry.second)) {
+          Copies.push_back(Entry);
+        }
+      }
+
+      std::vector<unsigned> Defs;
+      for (unsigned Reg : MI.getDefs()) {
+        if (X86::isVirtualRegister(Reg)) Defs.push_back(Reg);
+      }
+      for (unsigned D : Defs) {
+        auto Src = std::find_if(CopySrc.begin(), CopySrc.end(),
+                                [&](const auto& C) { return C.first == D; });
+        for (unsigned L : Live) {
+          if (Src == CopySrc.end() || Src->second != L) addEdge(D, L);
+        }
+        for (unsigned Other : Defs) addEdge(D, Other);
+      }
+      for (unsigned D : Defs) Live.erase(D);
+      for (unsigned Reg : MI.getUses()) {
+        if (X86::isVirtualRegister(Reg)) Live.insert(Reg);
+      }
+    }
+  }
+  for (auto& List : Adj) {
+    std::sort(List.begin(), List.end());
+    List.erase(std::unique(List.begin(), List.end()), List.end());
+  }
+
+  // Merge the two sides of each copy unless their classes interfere,
+  // that is, some member of one is a neighbour of some member of the
+  // other; the class with fewer edges to look through is the one checked.
+  // A merged class goes by the name of the copy destination's class.
+  std::vector<unsigned> Parent(Adj.size()), Name(Adj.size());
+  std::vector<std::vector<unsigned>> Members(Adj.size());
+  std::vector<size_t> Degree(Adj.size());
+  for (unsigned i = 0; i < Adj.size(); ++i) {
+    Parent[i] = i;
+    Name[i] = i + X86::FirstVirtualRegister;
+    Members[i] = {i};
+    Degree[i] = Adj[i].size();
+  }
+  auto find = [&](unsigned i) {
+    while (Parent[i] != i) i = Parent[i] = Parent[Parent[i]];
+    return i;
+  };
+  auto interferes = [&](unsigned A, unsigned B) {
+    if (Degree[A] > Degree[B]) std::swap(A, B);
+    for (unsigned M : Members[A]) {
+      for (unsigned N : Adj[M]) {
+        if (find(N) == B) return true;
+      }
+    }
+    return false;
+  };
+
+  // Copies were collected walking backwards; join in program order
+  std::reverse(Copies.begin(), Copies.end());
+  bool Merged = false;
+  for (const auto& Copy : Copies) {
+    unsigned A = find(getVRegIndex(Copy.first));
+    unsigned B = find(getVRegIndex(Copy.second));
+    if (A == B || interferes(A, B)) continue;
+
+    // The larger member list absorbs the smaller
+    unsigned Keep = Members[A].size() >= Members[B].size() ? A : B;
+    unsigned Drop = Keep == A ? B : A;
+    Members[Keep].insert(Members[Keep].end(), Members[Drop].begin(),
+                         Members[Drop].end());
+    Members[Drop].clear();
+    Degree[Keep] += Degree[Drop];
+    Parent[Drop] = Keep;
+    Name[Keep] = Name[A];
+    Merged = true;
+  }
+  if (!Merged) return;
+
+  // Rename every member to its leader; copies within a class vanish
+  for (const auto& MBB : MF.getBlocks()) {
+    auto Instrs = MBB->takeInstrs();
+    for (auto& MI : Instrs) {
+      for (MO& Op : MI->operands()) {
+        if (Op.isReg() && X86::isVirtualRegister(Op.getReg())) {
+          Op.setReg(Name[find(getVRegIndex(Op.getReg()))]);
+        } else if (Op.isMem()) {
+          if (X86::isVirtualRegister(Op.getBase()))
+            Op.setReg(Name[find(getVRegIndex(Op.getBase()))]);
+          if (X86::isVirtualRegister(Op.getIndex()))
+            Op.setIndex(Name[find(getVRegIndex(Op.getIndex()))]);
+        }
+      }
+      if (MI->isCopy() &&
+          MI->getOperand(0).getReg() == MI->getOperand(1).getReg()) {
+        continue;
+      }
+      MBB->push_back(std::move(MI));
+    }
+  }
+}
+
+// ===----------------------------------------------------------------------===
+// Live intervals
+// ===----------------------------------------------------------------------===
 
-  // Free registers
-  std::set<std::string> FreeRegs(AvailableRegs.begin(), AvailableRegs.end());
+bool LiveInterval::covers(int Pos) const {
+  auto It = std::upper_bound(Ranges.begin(), Ranges.end(), Pos,
+                             [](int P, const LiveRange& R) {
+                               return P < R.End;
+                             });
+  return It != Ranges.end() && It->Start <= Pos;
+}
 
-  // Linear scan allocation
-  for (auto& Interval : Intervals) {
-    // Expire old intervals
-    expireOldIntervals(Interval.Start, Active, FreeRegs);
+// First range of a sorted list that ends after Pos
+static std::vector<LiveRange>::const_iterator
+findRangeAfter(const std::vector<LiveRange>& Ranges,
+               std::vector<LiveRange>::const_iterator From, int Pos) {
+  return std::upper_bound(From, Ranges.end(), Pos,
+                          [](int P, const LiveRange& R) {
+                            return P < R.End;
+                          });
+}
 
-    // Try to allocate a register
-    if (!FreeRegs.empty()) {
-      // Allocate the first available register
-      std::string Reg = *FreeRegs.begin();
-      FreeRegs.erase(FreeRegs.begin());
-      ValueToReg[Interval.Value] = Reg;
-      Active.push_back(Interval);
+int LiveInterval::nextIntersection(const LiveInterval& Other) const {
+  // Ranges that end before the other interval's next one starts cannot
+  // meet it, so each side skips over them with a binary search
+  auto I = Ranges.begin(), J = Other.Ranges.begin();
+  while (I != Ranges.end() && J != Other.Ranges.end()) {
+    if (I->End <= J->Start) {
+      I = findRangeAfter(Ranges, I, J->Start);
+    } else if (J->End <= I->Start) {
+      J = findRangeAfter(Other.Ranges, J, I->Start);
     } else {
-      // No free registers, need to spill
-      spillAtInterval(Interval, Active);
-    }
-  }
-}
+      return std::max(I->Start, J->Start);
+    }
+  }
+  return INT_MAX;
+}
+
+size_t LiveInterval::findUse(int Pos) const {
+  return std::lower_bound(Uses.begin(), Uses.end(), Pos,
+                          [](const UsePosition& U, int P) {
+                            return U.Pos < P;
+                          }) - Uses.begin();
+}
+
+int LiveInterval::nextUseAfter(int Pos, bool NeedsRegOnly) const {
+  for (size_t i = findUse(Pos); i < Uses.size(); ++i) {
+    if (Uses[i].NeedsReg || !NeedsRegOnly) return Uses[i].Pos;
+  }
+  return INT_MAX;
+}
 
-std::string RegisterAllocator::getRegister(IRValue* V) const {
-  auto It = ValueToReg.find(V);
-  if (It != ValueToReg.end()) {
-    return It->second;
+void LiveInterval::addRange(int Start, int End) {
+  if (Start >= End) return;
+  if (!Ranges.empty() && End >= Ranges.back().Start) {
+    Ranges.back().Start = std::min(Start, Ranges.back().Start);
+    Ranges.back().End = std::max(End, Ranges.back().End);
+    return;
   }
-  return "";  // Not allocated or spilled
+  Ranges.push_back({Start, End});
+}
+
+void LiveInterval::setFrom(int Start) {
+  Ranges.back().Start = Start;
 }
 
-bool RegisterAllocator::isSpilled(IRValue* V) const {
-  return ValueToStackSlot.count(V) > 0;
+void LiveInterval::addUse(int Pos, bool NeedsReg) {
+  Uses.push_back({Pos, NeedsReg});
 }
 
-int RegisterAllocator::getStackOffset(IRValue* V) const {
-  auto It = ValueToStackSlot.find(V);
-  if (It != ValueToStackSlot.end()) {
-    return It->second;
+void LiveInterval::finish() {
+  std::reverse(Ranges.begin(), Ranges.end());
+  std::reverse(Uses.begin(), Uses.end());
+}
+
+void LiveInterval::insertUse(int Pos, bool NeedsReg) {
+  Uses.insert(Uses.begin() + findUse(Pos), {Pos, NeedsReg});
+}
+
+// Whether an operand must be a register, or may be turned into a stack slot
+static bool needsRegister(const MachineInstr& MI, const MO& Op) {
+  if (!Op.isReg() || Op.getSize() != 8) return true;
+  if (MI.getOpcode() == X86::PCOPY) return false;
+  return !(MI.getOpcode() == X86::MOV && MI.getNumOperands() == 2);
+}
+
+void RegisterAllocator::computeBlockOrder(const MachineFunction& MF,
+                                          const MachineLoopInfo& Loops) {
+  // Back edges are the ones a depth-first walk finds returning to a block
+  // still on its stack
+  const auto& Blocks = MF.getBlocks();
+  if (Blocks.empty()) return;
+  std::map<const MachineBasicBlock*, size_t> Layout;
+  for (size_t b = 0; b < Blocks.size(); ++b) Layout[Blocks[b].get()] = b;
+  std::set<std::pair<const MachineBasicBlock*, const MachineBasicBlock*>>
+    BackEdges;
+  std::set<const MachineBasicBlock*> Visited, OnStack;
+  std::vector<std::pair<const MachineBasicBlock*, size_t>> Stack;
+  Stack.push_back({Blocks.front().get(), 0});
+  Visited.insert(Blocks.front().get());
+  OnStack.insert(Blocks.front().get());
+  while (!Stack.empty()) {
+    auto& [MBB, Next] = Stack.back();
+    if (Next == MBB->getSuccessors().size()) {
+      OnStack.erase(MBB);
+      Stack.pop_back();
+      continue;
+    }
+    const MachineBasicBlock* Succ = MBB->getSuccessors()[Next++];
+    if (OnStack.count(Succ)) {
+      BackEdges.insert({MBB, Succ});
+    } else if (Visited.insert(Succ).second) {
+      OnStack.insert(Succ);
+      Stack.push_back({Succ, 0});
+    }
+  }
+
+  // A block is placed once all its forward predecessors are, the most
+  // deeply nested of the ready ones first, so that each loop's blocks are
+  // numbered together and split points can move out of them
+  std::map<const MachineBasicBlock*, unsigned> Pending;
+  for (const MachineBasicBlock* MBB : Visited) {
+    for (const MachineBasicBlock* Pred : MBB->getPredecessors()) {
+      if (Visited.count(Pred) && !BackEdges.count({Pred, MBB})) Pending[MBB]++;
+    }
+  }
+  std::vector<MachineBasicBlock*> Ready = {Blocks.front().get()};
+  while (!Ready.empty()) {
+    auto Best = Ready.begin();
+    for (auto It = Ready.begin(); It != Ready.end(); ++It) {
+      unsigned Depth = Loops.getLoopDepth(*It);
+      unsigned BestDepth = Loops.getLoopDepth(*Best);
+      if (Depth > BestDepth ||
+          (Depth == BestDepth && Layout[*It] < Layout[*Best])) {
+        Best = It;
+      }
+    }
+    MachineBasicBlock* MBB = *Best;
+    Ready.erase(Best);
+    Order.push_back(MBB);
+    for (MachineBasicBlock* Succ : MBB->getSuccessors()) {
+      if (!BackEdges.count({MBB, Succ}) && --Pending[Succ] == 0)
+        Ready.push_back(Succ);
+    }
+  }
+
+  // Unreachable blocks go last, as laid out
+  for (const auto& MBB : Blocks) {
+    if (!Visited.count(MBB.get())) Order.push_back(MBB.get());
   }
-  return -1;
+  for (size_t b = 0; b < Order.size(); ++b) OrderIndex[Order[b]] = b;
 }
 
-std::map<IRValue*, std::set<int>> RegisterAllocator::computeLiveness(IRFunction* F) {
-  std::map<IRValue*, std::set<int>> LiveRanges;
+void RegisterAllocator::computeLiveIntervals(const MachineFunction& MF) {
+  MachineLiveness LV;
+  LV.compute(MF);
+
+  MachineLoopInfo Loops;
+  Loops.compute(MF);
+  computeBlockOrder(MF, Loops);
+
+  int Index = 0;
+  for (const MachineBasicBlock* MBB : Order) {
+    BlockStarts.push_back(2 * Index);
+    Index += static_cast<int>(MBB->size());
+  }
+  BlockStarts.push_back(2 * Index);
+
+  // Moves at the top of a loop header run on the way into the loop; the
+  // back edges stay within the piece that starts there
+  for (const MachineBasicBlock* MBB : Order) {
+    unsigned Depth = Loops.getLoopDepth(MBB);
+    LoopDepths.push_back(Depth);
+    EntryDepths.push_back(Loops.isLoopHeader(MBB) ? Depth - 1 : Depth);
+  }
+
+  // The shallowest block entry, the latest among equals, in each run of
+  // 2^k blocks, so split points are found without walking the blocks
+  auto shallower = [&](size_t A, size_t B) {
+    return EntryDepths[A] < EntryDepths[B] ||
+           (EntryDepths[A] == EntryDepths[B] && A > B);
+  };
+  ShallowestEntries.emplace_back(Order.size());
+  for (size_t b = 0; b < Order.size(); ++b) ShallowestEntries[0][b] = b;
+  for (size_t Len = 2; Len <= Order.size(); Len *= 2) {
+    const std::vector<size_t>& Half = ShallowestEntries.back();
+    std::vector<size_t> Runs(Order.size() - Len + 1);
+    for (size_t b = 0; b < Runs.size(); ++b) {
+      size_t A = Half[b], B = Half[b + Len / 2];
+      Runs[b] = shallower(A, B) ? A : B;
+    }
+    ShallowestEntries.push_back(std::move(Runs));
+  }
+
+  // Physical registers are live from a def (or the block start) to each
+  // use; a def nobody reads still occupies its slot
+  std::set<unsigned> Allocatable(AvailableRegs.begin(), AvailableRegs.end());
+  std::map<unsigned, std::vector<LiveRange>> FixedRanges;
+  for (size_t b = 0; b < Order.size(); ++b) {
+    std::map<unsigned, int> LastDef;
+    int Slot = BlockStarts[b];
+    for (const auto& MI : Order[b]->instrs()) {
+      for (unsigned Reg : MI->getUses()) {
+        if (!Allocatable.count(Reg)) continue;
+        auto It = LastDef.find(Reg);
+        int From = It != LastDef.end() ? It->second : BlockStarts[b];
+        FixedRanges[Reg].push_back({From, Slot + 1});
+      }
+      for (unsigned Reg : MI->getDefs()) {
+        if (!Allocatable.count(Reg)) continue;
+        FixedRanges[Reg].push_back({Slot + 1, Slot + 2});
+        LastDef[Reg] = Slot + 1;
+      }
+
+      // A copy to or from a physical register suggests where the virtual
+      // register would like to live
+      if (MI->isCopy()) {
+        unsigned Dst = MI->getOperand(0).getReg();
+        unsigned Src = MI->getOperand(1).getReg();
+        if (X86::isVirtualRegister(Dst) && Allocatable.count(Src) &&
+            Hints[getVRegIndex(Dst)] == X86::NoReg) {
+          Hints[getVRegIndex(Dst)] = Src;
+        }
+        if (X86::isVirtualRegister(Src) && Allocatable.count(Dst) &&
+            Hints[getVRegIndex(Src)] == X86::NoReg) {
+          Hints[getVRegIndex(Src)] = Dst;
+        }
+      }
+      Slot += 2;
+    }
+  }
+  for (auto& [Reg, Ranges] : FixedRanges) {
+    std::sort(Ranges.begin(), Ranges.end(),
+              [](const LiveRange& A, const LiveRange& B) {
+                return A.Start < B.Start;
+              });
+    LiveInterval Fixed(Reg);
+    for (const LiveRange& R : Ranges) {
+      if (!Fixed.Ranges.empty() && R.Start <= Fixed.Ranges.back().End) {
+        Fixed.Ranges.back().End = std::max(Fixed.Ranges.back().End, R.End);
+      } else {
+        Fixed.Ranges.push_back(R);
+      }
+    }
+    FixedIntervals.emplace(Reg, std::move(Fixed));
+  }
+
+  // Virtual registers: walk each block backwards from its live-out set.
+  // A value is live from its def to its last use within a block, and over
+  // whole blocks it passes through; everywhere else is a hole.
+  std::vector<const MachineInstr*> DefInstrs(Pieces.size());
+  auto getInterval = [&](unsigned Reg) {
+    IntervalList& List = Pieces[getVRegIndex(Reg)];
+    if (List.empty()) {
+      Intervals.push_back(std::make_unique<LiveInterval>(Reg));
+      List.push_back(Intervals.back().get());
+    }
+    return List.front();
+  };
+
+  for (size_t b = Order.size(); b-- > 0;) {
+    const MachineBasicBlock* MBB = Order[b];
+    int From = BlockStarts[b];
+    std::set<unsigned> Live = LV.getLiveOut(MBB);
+    for (unsigned Reg : Live) getInterval(Reg)->addRange(From, BlockStarts[b + 1]);
 
-  int InstIndex = 0;
-  for (const auto& BB : F->getBlocks()) {
-    for (const auto& Inst : BB->getInstructions()) {
-      // Mark uses and defs based on instruction type
-      if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
-        if (BinOp->getLHS() && !BinOp->getLHS()->isConstant())
-          LiveRanges[BinOp->getLHS()].insert(InstIndex);
-        if (BinOp->getRHS() && !BinOp->getRHS()->isConstant())
-          LiveRanges[BinOp->getRHS()].insert(InstIndex);
-        if (BinOp->getResult() && !BinOp->getResult()->isConstant())
-          LiveRanges[BinOp->getResult()].insert(InstIndex);
-      } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(Inst.get())) {
-        if (UnOp->getOperand() && !UnOp->getOperand()->isConstant())
-          LiveRanges[UnOp->getOperand()].insert(InstIndex);
-        if (UnOp->getResult() && !UnOp->getResult()->isConstant())
-          LiveRanges[UnOp->getResult()].insert(InstIndex);
-      } else if (auto* Load = dynamic_cast<IRLoadInst*>(Inst.get())) {
-        if (Load->getPtr() && !Load->getPtr()->isConstant())
-          LiveRanges[Load->getPtr()].insert(InstIndex);
-        if (Load->getResult() && !Load->getResult()->isConstant())
-          LiveRanges[Load->getResult()].insert(InstIndex);
-      } else if (auto* Store = dynamic_cast<IRStoreInst*>(Inst.get())) {
-        if (Store->getValue() && !Store->getValue()->isConstant())
-          LiveRanges[Store->getValue()].insert(InstIndex);
-        if (Store->getPtr() && !Store->getPtr()->isConstant())
-          LiveRanges[Store->getPtr()].insert(InstIndex);
-      } else if (auto* Alloca = dynamic_cast<IRAllocaInst*>(Inst.get())) {
-        if (Alloca->getResult() && !Alloca->getResult()->isConstant())
-          LiveRanges[Alloca->getResult()].insert(InstIndex);
-      } else if (auto* Ret = dynamic_cast<IRRetInst*>(Inst.get())) {
-        if (Ret->hasRetValue() && !Ret->getRetValue()->isConstant())
-          LiveRanges[Ret->getRetValue()].insert(InstIndex);
-      } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(Inst.get())) {
-        if (CondBr->getCondition() && !CondBr->getCondition()->isConstant())
-          LiveRanges[CondBr->getCondition()].insert(InstIndex);
-      } else if (auto* Call = dynamic_cast<IRCallInst*>(Inst.get())) {
-        for (IRValue* Arg : Call->getArgs()) {
-          if (Arg && !Arg->isConstant())
-            LiveRanges[Arg].insert(InstIndex);
+    for (size_t i = MBB->size(); i-- > 0;) {
+      const MachineInstr& MI = *MBB->instrs()[i];
+      int Slot = From + 2 * static_cast<int>(i);
+      for (const MO& Op : MI.operands()) {
+        if (!Op.isReg() || !Op.isDef() || !X86::isVirtualRegister(Op.getReg()))
+          continue;
+        LiveInterval* LI = getInterval(Op.getReg());
+        if (Live.erase(Op.getReg())) {
+          LI->setFrom(Slot + 1);
+        } else {
+          LI->addRange(Slot + 1, Slot + 2);  // Dead def
         }
-        if (Call->getResult() && !Call->getResult()->isConstant())
-          LiveRanges[Call->getResult()].insert(InstIndex);
-      } else if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
-        for (const auto& Entry : Phi->getIncomings()) {
-          if (Entry.Value && !Entry.Value->isConstant())
-            LiveRanges[Entry.Value].insert(InstIndex);
+        LI->addUse(Slot + 1, needsRegister(MI, Op));
+        DefSlots[getVRegIndex(Op.getReg())].push_back(Slot + 1);
+        DefInstrs[getVRegIndex(Op.getReg())] = &MI;
+      }
+      auto addUse = [&](unsigned Reg, bool NeedsReg) {
+        if (!X86::isVirtualRegister(Reg)) return;
+        LiveInterval* LI = getInterval(Reg);
+        LI->addRange(From, Slot + 1);
+        LI->addUse(Slot, NeedsReg);
+        Live.insert(Reg);
+      };
+      for (const MO& Op : MI.operands()) {
+        if (Op.isReg() && Op.isUse()) {
+          addUse(Op.getReg(), needsRegister(MI, Op));
+        } else if (Op.isMem()) {
+          addUse(Op.getBase(), true);
+          addUse(Op.getIndex(), true);
         }
-        if (Phi->getResult() && !Phi->getResult()->isConstant())
-          LiveRanges[Phi->getResult()].insert(InstIndex);
-      } else if (auto* Move = dynamic_cast<IRMoveInst*>(Inst.get())) {
-        if (Move->getOperand() && !Move->getOperand()->isConstant())
-          LiveRanges[Move->getOperand()].insert(InstIndex);
-        if (Move->getResult() && !Move->getResult()->isConstant())
-          LiveRanges[Move->getResult()].insert(InstIndex);
       }
+    }
+  }
+  for (const auto& LI : Intervals) LI->finish();
+  for (auto& Slots : DefSlots) std::sort(Slots.begin(), Slots.end());
+  for (const MachineBasicBlock* MBB : Order) {
+    const std::set<unsigned>& Live = LV.getLiveIn(MBB);
+    LiveIns.emplace_back(Live.begin(), Live.end());
+  }
+
+  // Values a single cheap instruction defines can be recomputed instead
+  // of reloaded
+  for (size_t i = 0; i < DefInstrs.size(); ++i) {
+    if (DefSlots[i].size() == 1 && isRematerializable(*DefInstrs[i]))
+      RematDefs[i] = std::make_unique<MachineInstr>(*DefInstrs[i]);
+  }
+
+  // A value the loop uses and carries around is needed again at its top,
+  // which comes earlier in the numbering; a use at the bottom stands in
+  // for that one when weighing what to spill
+  for (size_t b = 0; b < Order.size(); ++b) {
+    if (Order[b]->empty()) continue;
+    for (const MachineBasicBlock* Succ : Order[b]->getSuccessors()) {
+      size_t Header = OrderIndex.at(Succ);
+      if (Header > b) continue;
+      for (unsigned Reg : LiveIns[Header]) {
+        LiveInterval* LI = Pieces[getVRegIndex(Reg)].front();
+        if (LI->nextUseAfter(BlockStarts[Header], false) < BlockStarts[b + 1])
+          LI->insertUse(BlockStarts[b + 1] - 2, false);
+      }
+    }
+  }
 
-      InstIndex++;
+  // Running totals of how often the uses run make the weight of those
+  // from any point on a subtraction; the sums are of powers of ten, so
+  // exact
+  for (const auto& LI : Intervals) {
+    double Total = 0;
+    for (UsePosition& U : LI->Uses) {
+      U.Freq = getBlockFrequency(LoopDepths[getBlockAt(U.Pos)]);
+      U.FreqBefore = Total;
+      Total += U.Freq;
     }
   }
+}
+
+LiveInterval* RegisterAllocator::getPieceAt(unsigned VReg, int Pos) const {
+  // Pieces split the lifetime in order, so only the last one starting at
+  // or before Pos can cover it
+  const IntervalList& List = Pieces[getVRegIndex(VReg)];
+  auto It = std::upper_bound(List.begin(), List.end(), Pos,
+                             [](int P, const LiveInterval* LI) {
+                               return P < LI->start();
+                             });
+  if (It == List.begin() || !(*--It)->covers(Pos)) return nullptr;
+  return *It;
+}
 
-  return LiveRanges;
+int64_t RegisterAllocator::getLocation(const LiveInterval* LI) const {
+  if (LI->PhysReg != X86::NoReg) return LI->PhysReg;
+  return -static_cast<int64_t>(VRegToStackSlot[getVRegIndex(LI->Reg)]) - 1;
 }
 
-std::vector<LiveInterval> RegisterAllocator::computeLiveIntervals(IRFunction* F) {
-  auto LiveRanges = computeLiveness(F);
-  std::vector<LiveInterval> Intervals;
+// ===----------------------------------------------------------------------===
+// Linear scan
+// ===----------------------------------------------------------------------===
 
-  for (const auto& Entry : LiveRanges) {
-    IRValue* V = Entry.first;
-    const auto& Ranges = Entry.second;
+void RegisterAllocator::runLinearScan(MachineFunction& MF) {
+  Unhandled.clear();
+  Active.clear();
+  Inactive.clear();
+  for (const auto& LI : Intervals) Unhandled.insert({LI->start(), LI.get()});
 
-    if (!Ranges.empty()) {
-      int Start = *Ranges.begin();
-      int End = *Ranges.rbegin();
-      Intervals.emplace_back(V, Start, End);
+  while (!Unhandled.empty()) {
+    LiveInterval* Current = Unhandled.begin()->second;
+    Unhandled.erase(Unhandled.begin());
+    int Pos = Current->start();
+
+    // Retire intervals that ended, and move the rest between active and
+    // inactive depending on whether Pos falls into one of their holes
+    IntervalList NextActive, NextInactive;
+    for (LiveInterval* LI : Active) {
+      if (LI->end() <= Pos) continue;
+      (LI->covers(Pos) ? NextActive : NextInactive).push_back(LI);
+    }
+    for (LiveInterval* LI : Inactive) {
+      if (LI->end() <= Pos) continue;
+      (LI->covers(Pos) ? NextActive : NextInactive).push_back(LI);
     }
+    Active = std::move(NextActive);
+    Inactive = std::move(NextInactive);
+
+    static long It=0, SA=0, SI=0, Bl=0; It++; SA+=Active.size(); SI+=Inactive.size();
+    if (!tryAllocateFreeReg(Current)) { Bl++; allocateBlockedReg(MF, Current);}
+    if (Unhandled.empty()) fprintf(stderr, "iters %ld active %ld inactive %ld blocked %ld ivs %zu\n", It, SA, SI, Bl, Intervals.size());
+    if (Current->PhysReg != X86::NoReg) Active.push_back(Current);
   }
-
-  return Intervals;
 }
 
-int RegisterAllocator::getInstructionIndex(IRFunction* F, IRInstruction* I) {
-  int Index = 0;
-  for (const auto& BB : F->getBlocks()) {
-    for (const auto& Inst : BB->getInstructions()) {
-      if (Inst.get() == I) {
-        return Index;
-      }
-      Index++;
+bool RegisterAllocator::tryAllocateFreeReg(LiveInterval* Current) {
+  // How long each register stays free from the start of Current
+  std::map<unsigned, int> FreeUntil;
+  for (unsigned Reg : AvailableRegs) FreeUntil[Reg] = INT_MAX;
+  for (LiveInterval* LI : Active) FreeUntil[LI->PhysReg] = 0;
+  for (LiveInterval* LI : Inactive) {
+    int& Free = FreeUntil[LI->PhysReg];
+    Free = std::min(Free, LI->nextIntersection(*Current));
+  }
+  for (const auto& [Reg, Fixed] : FixedIntervals) {
+    int& Free = FreeUntil[Reg];
+    Free = std::min(Free, Fixed.nextIntersection(*Current));
+  }
+
+  // Take the hinted register, or the first one free for the whole
+  // interval; failing that, the one free the longest
+  unsigned Reg = X86::NoReg;
+  unsigned Hint = Hints[getVRegIndex(Current->Reg)];
+  if (Hint != X86::NoReg && FreeUntil[Hint] >= Current->end()) Reg = Hint;
+  for (unsigned R : AvailableRegs) {
+    if (Reg == X86::NoReg && FreeUntil[R] >= Current->end()) Reg = R;
+  }
+  if (Reg == X86::NoReg) {
+    for (unsigned R : AvailableRegs) {
+      if (Reg == X86::NoReg || FreeUntil[R] > FreeUntil[Reg]) Reg = R;
     }
   }
-  return -1;
+
+  if (FreeUntil[Reg] >= Current->end()) {
+    Current->PhysReg = Reg;
+    return true;
+  }
+
+  // Free for a prefix only: keep the register up to a move point before
+  // it is taken, out of any loop it is taken in, and queue the rest
+  if ((FreeUntil[Reg] & ~1) <= Current->start()) return false;
+  int SplitPos = findSplitPos(Current->start(), FreeUntil[Reg] & ~1);
+  Current->PhysReg = Reg;
+  if (LiveInterval* Tail = splitInterval(Current, SplitPos)) {
+    Unhandled.insert({Tail->start(), Tail});
+  }
+  return true;
 }
 
-void RegisterAllocator::expireOldIntervals(int CurrentStart,
-                                           std::vector<LiveInterval>& Active,
-                                           std::set<std::string>& FreeRegs) {
-  // Remove intervals that have ended
-  auto It = Active.begin();
-  while (It != Active.end()) {
-    if (It->End < CurrentStart) {
-      // This interval has ended, free its register
-      std::string Reg = ValueToReg[It->Value];
-      FreeRegs.insert(Reg);
-      It = Active.erase(It);
-    } else {
-      ++It;
+void RegisterAllocator::allocateBlockedReg(MachineFunction& MF,
+                                           LiveInterval* Current) {
+  // When each register is next needed by the intervals holding it, and
+  // what spilling them from here would cost; fixed uses block a register
+  // outright from their position
+  int From = Current->start() & ~1;
+  std::map<unsigned, int> NextUse, BlockPos;
+  std::map<unsigned, double> Weight;
+  for (unsigned Reg : AvailableRegs) {
+    NextUse[Reg] = INT_MAX;
+    BlockPos[Reg] = INT_MAX;
+    Weight[Reg] = 0;
+  }
+  for (LiveInterval* LI : Active) {
+    int& Next = NextUse[LI->PhysReg];
+    Next = std::min(Next, LI->nextUseAfter(From, true));
+    Weight[LI->PhysReg] += getSpillWeight(LI, From);
+  }
+  for (LiveInterval* LI : Inactive) {
+    if (LI->nextIntersection(*Current) == INT_MAX) continue;
+    int& Next = NextUse[LI->PhysReg];
+    Next = std::min(Next, LI->nextUseAfter(From, true));
+    Weight[LI->PhysReg] += getSpillWeight(LI, From);
+  }
+  for (const auto& [Reg, Fixed] : FixedIntervals) {
+    int Block = Fixed.nextIntersection(*Current);
+    if (Block == INT_MAX) continue;
+    BlockPos[Reg] = Block;
+    NextUse[Reg] = (Block & ~1) > Current->start()
+                     ? std::min(NextUse[Reg], Block) : -1;
+  }
+
+  // The cheapest register among those not needed by this instruction,
+  // the one needed last among equals; with none such, the one needed last
+  unsigned Reg = X86::NoReg;
+  for (unsigned R : AvailableRegs) {
+    if (NextUse[R] <= From + 1) continue;
+    if (Reg == X86::NoReg || Weight[R] < Weight[Reg] ||
+        (Weight[R] == Weight[Reg] && NextUse[R] > NextUse[Reg])) {
+      Reg = R;
+    }
+  }
+  if (Reg == X86::NoReg) {
+    Reg = AvailableRegs.front();
+    for (unsigned R : AvailableRegs) {
+      if (NextUse[R] > NextUse[Reg]) Reg = R;
+    }
+  }
+
+  // Current goes to the stack, up to its first use that needs a register,
+  // if that register is wanted sooner or Current is the cheaper to spill
+  int FirstUse = Current->nextUseAfter(Current->start(), true);
+  int SpillUntil = FirstUse == INT_MAX ? INT_MAX : (FirstUse & ~1);
+  if (SpillUntil > Current->start() &&
+      (FirstUse > NextUse[Reg] ||
+       getSpillWeight(Current, Current->start()) < Weight[Reg])) {
+    spillInterval(MF, Current, Current->start());
+    return;
+  }
+
+  // Otherwise take the register from whoever holds it. They give it up
+  // after their last use before the current position, at the boundary
+  // where that costs least, and are spilled until they need it again.
+  Current->PhysReg = Reg;
+  IntervalList Victims;
+  for (LiveInterval* LI : Active) {
+    if (LI->PhysReg == Reg) Victims.push_back(LI);
+  }
+  for (LiveInterval* LI : Inactive) {
+    if (LI->PhysReg == Reg && LI->nextIntersection(*Current) != INT_MAX)
+      Victims.push_back(LI);
+  }
+  for (LiveInterval* LI : Victims) {
+    Active.erase(std::remove(Active.begin(), Active.end(), LI), Active.end());
+    Inactive.erase(std::remove(Inactive.begin(), Inactive.end(), LI),
+                   Inactive.end());
+    LiveInterval* Tail = LI;
+    if (From > LI->start()) {
+      int LastUse = LI->start();
+      size_t Next = LI->findUse(From);
+      if (Next > 0) LastUse = std::max(LastUse, LI->Uses[Next - 1].Pos);
+      Tail = splitInterval(LI, findSplitPos(LastUse, From));
+    }
+    if (Tail) spillInterval(MF, Tail, Current->start());
+  }
+
+  // A fixed use of the register ahead cuts Current short
+  if (BlockPos[Reg] < Current->end()) {
+    int SplitPos = findSplitPos(Current->start(), BlockPos[Reg] & ~1);
+    if (LiveInterval* Tail = splitInterval(Current, SplitPos)) {
+      Unhandled.insert({Tail->start(), Tail});
+    }
+  }
+}
+
+LiveInterval* RegisterAllocator::splitInterval(LiveInterval* LI, int Pos) {
+  // The tail starts with the range Pos falls into, cut at Pos, or the
+  // first one after it
+  auto Split = findRangeAfter(LI->Ranges, LI->Ranges.begin(), Pos);
+  if (Split == LI->Ranges.cend()) return nullptr;
+  auto Tail = std::make_unique<LiveInterval>(LI->Reg);
+  Tail->Ranges.assign(Split, LI->Ranges.cend());
+  LI->Ranges.erase(Split, LI->Ranges.cend());
+  if (Tail->Ranges.front().Start < Pos) {
+    LI->Ranges.push_back({Tail->Ranges.front().Start, Pos});
+    Tail->Ranges.front().Start = Pos;
+  }
+
+  auto FirstTailUse = LI->Uses.begin() + LI->findUse(Pos);
+  Tail->Uses.assign(FirstTailUse, LI->Uses.end());
+  LI->Uses.erase(FirstTailUse, LI->Uses.end());
+
+  IntervalList& List = Pieces[getVRegIndex(LI->Reg)];
+  List.insert(std::find(List.begin(), List.end(), LI) + 1, Tail.get());
+  Intervals.push_back(std::move(Tail));
+  NumSplits++;
+  return Intervals.back().get();
+}
+
+void RegisterAllocator::spillInterval(MachineFunction& MF, LiveInterval* LI,
+                                      int Pos) {
+  LI->PhysReg = X86::NoReg;
+  assignStackSlot(MF, LI->Reg);
+
+  // Second chance: the piece from the next use that needs a register
+  // competes for one again. The reload goes before that use, or at an
+  // earlier boundary outside the loops around it, but not behind Pos,
+  // which the scan has already passed.
+  int Use = LI->nextUseAfter(LI->start(), true);
+  if (Use == INT_MAX) return;
+  int Min = std::max(LI->start(), Pos);
+  int SplitPos = (Use & ~1) > Min ? findSplitPos(Min, Use & ~1) : (Use & ~1);
+  LiveInterval* Tail = SplitPos > LI->start() ? splitInterval(LI, SplitPos)
+                                              : LI;
+  if (Tail) Unhandled.insert({Tail->start(), Tail});
+}
+
+void RegisterAllocator::assignStackSlot(MachineFunction& MF, unsigned VReg) {
+  // Every piece of a register that leaves its register shares one slot
+  int& Slot = VRegToStackSlot[getVRegIndex(VReg)];
+  if (Slot >= 0) return;
+  Slot = MF.createStackObject(8, 8, /*IsSpillSlot=*/true);
+  NumSpilled++;
+}
+
+// ===----------------------------------------------------------------------===
+// Spill costs and placement
+// ===----------------------------------------------------------------------===
+
+size_t RegisterAllocator::getBlockAt(int Pos) const {
+  return std::upper_bound(BlockStarts.begin(), BlockStarts.end(), Pos) -
+         BlockStarts.begin() - 1;
+}
+
+double RegisterAllocator::getSpillWeight(const LiveInterval* LI,
+                                         int From) const {
+  // Uses from From on, each counted by how often its block runs, per
+  // instruction left to cover: long stretches with few uses outside
+  // loops are the cheap ones to keep on the stack
+  double Weight = 0;
+  size_t First = LI->findUse(From);
+  if (First < LI->Uses.size()) {
+    const UsePosition& Last = LI->Uses.back();
+    Weight = Last.FreqBefore + Last.Freq - LI->Uses[First].FreqBefore;
+  }
+
+  // A value that can be recomputed anywhere costs no store and a cheaper
+  // reload
+  if (const auto& Remat = RematDefs[getVRegIndex(LI->Reg)]) {
+    const MO& Src = Remat->getOperand(1);
+    if (!Src.isMem() || (Src.getBase() == X86::NoReg &&
+                         Src.getIndex() == X86::NoReg))
+      Weight /= 2;
+  }
+  return Weight / ((LI->end() - From) / 2 + 1);
+}
+
+int RegisterAllocator::findSplitPos(int Min, int Max) const {
+  // The block boundary in (Min, Max] whose moves run least often, the
+  // latest among equals; Max itself unless a boundary beats it
+  size_t Last = getBlockAt(Max);
+  unsigned MaxDepth =
+    Max == BlockStarts[Last] ? EntryDepths[Last] : LoopDepths[Last];
+  size_t First = std::upper_bound(BlockStarts.begin(), BlockStarts.end(), Min) -
+                 BlockStarts.begin();
+  if (First > Last) return Max;
+
+  // Two runs of a power-of-two length cover the blocks between
+  size_t k = 0;
+  while ((size_t{2} << k) <= Last - First + 1) ++k;
+  size_t A = ShallowestEntries[k][First];
+  size_t B = ShallowestEntries[k][Last + 1 - (size_t{1} << k)];
+  size_t Best = EntryDepths[B] <= EntryDepths[A] ? B : A;
+  return EntryDepths[Best] < MaxDepth ? BlockStarts[Best] : Max;
+}
+
+void RegisterAllocator::placeSpillStores() {
+  // What the stores on the way from a register to the stack cost, at
+  // split points inside blocks and along edges
+  std::map<unsigned, double> ExitCost;
+  for (size_t r = 0; r < Pieces.size(); ++r) {
+    if (VRegToStackSlot[r] < 0 || Rematerialized[r]) continue;
+    const IntervalList& List = Pieces[r];
+    for (size_t i = 1; i < List.size(); ++i) {
+      int Pos = List[i]->start();
+      size_t b = getBlockAt(Pos);
+      if (List[i - 1]->end() != Pos || BlockStarts[b] == Pos) continue;
+      if (List[i - 1]->PhysReg != X86::NoReg && List[i]->PhysReg == X86::NoReg)
+        ExitCost[List[i]->Reg] += getBlockFrequency(LoopDepths[b]);
+    }
+  }
+  for (size_t b = 0; b < Order.size(); ++b) {
+    const MachineBasicBlock* MBB = Order[b];
+    for (const MachineBasicBlock* Pred : MBB->getPredecessors()) {
+      size_t p = OrderIndex.at(Pred);
+      for (unsigned Reg : LiveIns[b]) {
+        unsigned r = getVRegIndex(Reg);
+        if (VRegToStackSlot[r] < 0 || Rematerialized[r]) continue;
+        LiveInterval* Out = getPieceAt(Reg, BlockStarts[p + 1] - 1);
+        LiveInterval* In = getPieceAt(Reg, BlockStarts[b]);
+        if (Out && In && Out->PhysReg != X86::NoReg &&
+            In->PhysReg == X86::NoReg) {
+          ExitCost[Reg] +=
+            getBlockFrequency(std::min(LoopDepths[p], LoopDepths[b]));
+        }
+      }
     }
   }
+
+  // A value whose slot is written at every def needs none of those
+  // stores. Defs on the stack write the slot anyway; the others store
+  // right after the def, unless a later def in the same block and piece
+  // overwrites the value before it could leave the register.
+  for (const auto& [Reg, Cost] : ExitCost) {
+    const std::vector<int>& Defs = DefSlots[getVRegIndex(Reg)];
+    std::vector<std::pair<InsertPoint, unsigned>> Stores;
+    double StoreCost = 0;
+    bool Placeable = true;
+    for (size_t i = 0; i < Defs.size() && Placeable; ++i) {
+      LiveInterval* LI = getPieceAt(Reg, Defs[i]);
+      if (LI->PhysReg == X86::NoReg) continue;
+      size_t b = getBlockAt(Defs[i]);
+      if (i + 1 < Defs.size() && Defs[i + 1] < BlockStarts[b + 1] &&
+          getPieceAt(Reg, Defs[i + 1]) == LI) {
+        continue;
+      }
+      size_t Index = static_cast<size_t>(Defs[i] - BlockStarts[b]) / 2 + 1;
+      Placeable = Index < Order[b]->size();
+      Stores.push_back({{Order[b], Index}, LI->PhysReg});
+      StoreCost += getBlockFrequency(LoopDepths[b]);
+    }
+    if (!Placeable || StoreCost >= Cost) continue;
+
+    StoredAtDef[getVRegIndex(Reg)] = true;
+    int64_t Slot = -static_cast<int64_t>(VRegToStackSlot[getVRegIndex(Reg)]) - 1;
+    for (const auto& [At, PhysReg] : Stores) {
+      SplitMoves[At].push_back({Slot, PhysReg});
+    }
+  }
+}
+
+// ===----------------------------------------------------------------------===
+// Rematerialization
+// ===----------------------------------------------------------------------===
+
+bool RegisterAllocator::isRematerializable(const MachineInstr& MI) const {
+  if (MI.getNumOperands() != 2 || !MI.getOperand(0).isReg()) return false;
+  unsigned Reg = MI.getOperand(0).getReg();
+  const MO& Src = MI.getOperand(1);
+  if (MI.getOpcode() == X86::MOV) return Src.isImm();
+  if (MI.getOpcode() != X86::LEA) return false;
+
+  // An address from the frame, a global, or values that never change
+  auto isStable = [&](unsigned Op) {
+    if (Op == X86::NoReg) return true;
+    if (Op == Reg || !X86::isVirtualRegister(Op)) return false;
+    return DefSlots[getVRegIndex(Op)].size() == 1;
+  };
+  return isStable(Src.getBase()) && isStable(Src.getIndex());
 }
 
-void RegisterAllocator::spillAtInterval(LiveInterval& Interval,
-                                        std::vector<LiveInterval>& Active) {
-  // Find the interval in Active that ends last
-  auto SpillCandidate = std::max_element(Active.begin(), Active.end(),
-    [](const LiveInterval& A, const LiveInterval& B) {
-      return A.End < B.End;
+bool RegisterAllocator::canRematerialize(unsigned VReg, int Pos) const {
+  const auto& Def = RematDefs[getVRegIndex(VReg)];
+  if (!Def) return false;
+
+  // Whatever the def reads has to be in a register at Pos
+  auto isAvailable = [&](unsigned Op) {
+    if (!X86::isVirtualRegister(Op)) return true;
+    LiveInterval* LI = getPieceAt(Op, Pos);
+    return LI && LI->PhysReg != X86::NoReg;
+  };
+  const MO& Src = Def->getOperand(1);
+  return !Src.isMem() ||
+         (isAvailable(Src.getBase()) && isAvailable(Src.getIndex()));
+}
+
+std::unique_ptr<MachineInstr>
+RegisterAllocator::rematerialize(unsigned VReg, unsigned PhysReg,
+                                 int Pos) const {
+  auto MI = std::make_unique<MachineInstr>(*RematDefs[getVRegIndex(VReg)]);
+  MI->getOperand(0).setReg(PhysReg);
+  MO& Src = MI->getOperand(1);
+  if (Src.isMem()) {
+    if (X86::isVirtualRegister(Src.getBase()))
+      Src.setReg(getPieceAt(Src.getBase(), Pos)->PhysReg);
+    if (X86::isVirtualRegister(Src.getIndex()))
+      Src.setIndex(getPieceAt(Src.getIndex(), Pos)->PhysReg);
+  }
+  return MI;
+}
+
+void RegisterAllocator::emitRemats(MachineBasicBlock* MBB,
+                                   InstrList Remats) {
+  // A recomputed address may read a register another one at the same
+  // point writes; that one goes first
+  while (!Remats.empty()) {
+    auto Next = std::find_if(Remats.begin(), Remats.end(), [&](const auto& MI) {
+      const MO& Src = MI->getOperand(1);
+      return std::none_of(Remats.begin(), Remats.end(), [&](const auto& Other) {
+        unsigned Reg = Other->getOperand(0).getReg();
+        return Other != MI && Src.isMem() &&
+               (Src.getBase() == Reg || Src.getIndex() == Reg);
+      });
     });
+    if (Next == Remats.end()) Next = Remats.begin();
+    MBB->push_back(std::move(*Next));
+    Remats.erase(Next);
+    ++NumRemats;
+  }
+}
+
+void RegisterAllocator::findRematerialized() {
+  // A spilled value needs its slot only if something reads it there, or
+  // some piece takes it back into a register where it cannot be recomputed
+  std::vector<bool> SlotRead(Pieces.size());
+  for (size_t b = 0; b < Order.size(); ++b) {
+    int Slot = BlockStarts[b];
+    for (const auto& MI : Order[b]->instrs()) {
+      for (const MO& Op : MI->operands()) {
+        if (!Op.isReg() || !Op.isUse() ||
+            !X86::isVirtualRegister(Op.getReg()) ||
+            !RematDefs[getVRegIndex(Op.getReg())]) {
+          continue;
+        }
+        if (getPieceAt(Op.getReg(), Slot)->PhysReg == X86::NoReg)
+          SlotRead[getVRegIndex(Op.getReg())] = true;
+      }
+      Slot += 2;
+    }
+  }
+
+  std::set<int> Boundaries(BlockStarts.begin(), BlockStarts.end());
+  for (size_t r = 0; r < Pieces.size(); ++r) {
+    if (VRegToStackSlot[r] < 0 || !RematDefs[r]) continue;
+    const IntervalList& List = Pieces[r];
+    for (size_t i = 1; i < List.size(); ++i) {
+      int Pos = List[i]->start();
+      if (List[i - 1]->end() != Pos || Boundaries.count(Pos)) continue;
+      if (List[i - 1]->PhysReg == X86::NoReg &&
+          List[i]->PhysReg != X86::NoReg && !canRematerialize(List[i]->Reg, Pos))
+        SlotRead[r] = true;
+    }
+  }
+  for (size_t b = 0; b < Order.size(); ++b) {
+    for (const MachineBasicBlock* Pred : Order[b]->getPredecessors()) {
+      int PredEnd = BlockStarts[OrderIndex.at(Pred) + 1] - 1;
+      for (unsigned Reg : LiveIns[b]) {
+        unsigned r = getVRegIndex(Reg);
+        if (!RematDefs[r] || VRegToStackSlot[r] < 0) continue;
+        LiveInterval* Out = getPieceAt(Reg, PredEnd);
+        LiveInterval* In = getPieceAt(Reg, BlockStarts[b]);
+        if (Out && In && Out->PhysReg == X86::NoReg &&
+            In->PhysReg != X86::NoReg && !canRematerialize(Reg, BlockStarts[b]))
+          SlotRead[r] = true;
+      }
+    }
+  }
 
-  if (SpillCandidate != Active.end() && SpillCandidate->End > Interval.End) {
-    // Spill the candidate instead of current interval
-    IRValue* SpillValue = SpillCandidate->Value;
-    std::string Reg = ValueToReg[SpillValue];
+  for (size_t r = 0; r < Pieces.size(); ++r) {
+    if (VRegToStackSlot[r] >= 0 && RematDefs[r] && !SlotRead[r])
+      Rematerialized[r] = true;
+  }
+}
 
-    // Assign spill slot
-    ValueToStackSlot[SpillValue] = SpillSlotCount++;
-    ValueToReg.erase(SpillValue);
+// ===----------------------------------------------------------------------===
+// Rewriting
+// ===----------------------------------------------------------------------===
 
-    // Give the register to current interval
-    ValueToReg[Interval.Value] = Reg;
+void RegisterAllocator::resolveSplits(MachineFunction& MF) {
+  std::set<std::string> Names;
+  for (const MachineBasicBlock* MBB : Order) Names.insert(MBB->getName());
 
-    // Replace spilled interval with current interval
-    *SpillCandidate = Interval;
-  } else {
-    // Spill the current interval
-    ValueToStackSlot[Interval.Value] = SpillSlotCount++;
+  // Pieces that meet inside a block are joined by a move at the split
+  // point; at block boundaries the edges below take care of it. Values
+  // stored at their defs, or never reloaded, have no slot to update, and
+  // a reload is a recomputation wherever the def's operands are at hand.
+  auto isSlotCurrent = [&](unsigned Reg) {
+    return StoredAtDef[getVRegIndex(Reg)] || Rematerialized[getVRegIndex(Reg)];
+  };
+  std::set<int> Boundaries(BlockStarts.begin(), BlockStarts.end());
+  for (const IntervalList& List : Pieces) {
+    for (size_t i = 1; i < List.size(); ++i) {
+      unsigned Reg = List[i]->Reg;
+      int Pos = List[i]->start();
+      if (List[i - 1]->end() != Pos || Boundaries.count(Pos)) continue;
+      int64_t Src = getLocation(List[i - 1]);
+      int64_t Dst = getLocation(List[i]);
+      if (Src == Dst || (Dst < 0 && isSlotCurrent(Reg))) continue;
+      size_t b = getBlockAt(Pos);
+      size_t Index = static_cast<size_t>(Pos - BlockStarts[b]) / 2;
+      if (Src < 0 && canRematerialize(Reg, Pos)) {
+        SplitRemats[{Order[b], Index}].push_back(
+          rematerialize(Reg, static_cast<unsigned>(Dst), Pos));
+        continue;
+      }
+      SplitMoves[{Order[b], Index}].push_back({Dst, Src});
+    }
+  }
+
+  // A value live into a block may sit elsewhere at the end of a
+  // predecessor. The copies go at the end of the predecessor if this is
+  // its only successor, else at the top of the block if this is its only
+  // predecessor, else on a new block in between.
+  for (size_t b = 0; b < Order.size(); ++b) {
+    MachineBasicBlock* MBB = Order[b];
+    std::vector<MachineBasicBlock*> Preds = MBB->getPredecessors();
+    for (MachineBasicBlock* Pred : Preds) {
+      int PredEnd = BlockStarts[OrderIndex.at(Pred) + 1] - 1;
+      CopyList Copies;
+      InstrList Remats;
+      for (unsigned Reg : LiveIns[b]) {
+        LiveInterval* Out = getPieceAt(Reg, PredEnd);
+        LiveInterval* In = getPieceAt(Reg, BlockStarts[b]);
+        if (!Out || !In || getLocation(Out) == getLocation(In)) continue;
+        if (getLocation(In) < 0 && isSlotCurrent(Reg)) continue;
+        if (getLocation(Out) < 0 && canRematerialize(Reg, BlockStarts[b])) {
+          Remats.push_back(rematerialize(Reg, In->PhysReg, BlockStarts[b]));
+          continue;
+        }
+        Copies.push_back({getLocation(In), getLocation(Out)});
+      }
+      if (Copies.empty() && Remats.empty()) continue;
+
+      auto addEdgeMoves = [&](InsertPoint At) {
+        CopyList& List = EdgeMoves[At];
+        List.insert(List.end(), Copies.begin(), Copies.end());
+        for (auto& MI : Remats) EdgeRemats[At].push_back(std::move(MI));
+      };
+      if (Pred->getSuccessors().size() == 1) {
+        addEdgeMoves({Pred, Pred->getFirstTerminator()});
+        continue;
+      }
+      if (Preds.size() == 1) {
+        addEdgeMoves({MBB, 0});
+        continue;
+      }
+
+      std::string Name = Pred->getName() + "_" + MBB->getName();
+      for (unsigned N = 1; Names.count(Name); ++N) {
+        Name = Pred->getName() + "_" + MBB->getName() + std::to_string(N);
+      }
+      Names.insert(Name);
+      MachineBasicBlock* Edge = MF.createBlock(Name);
+      Pred->replaceSuccessor(MBB, Edge);
+      Edge->addSuccessor(MBB);
+
+      if (!Copies.empty()) {
+        std::vector<MO> Ops;
+        for (const auto& Copy : Copies) {
+          Ops.push_back(getLocationOperand(Copy.first, MO::Def));
+          Ops.push_back(getLocationOperand(Copy.second, MO::Use));
+        }
+        Edge->push_back(std::make_unique<MachineInstr>(X86::PCOPY, Ops));
+      }
+      emitRemats(Edge, std::move(Remats));
+      Edge->push_back(std::make_unique<MachineInstr>(
+        X86::JMP, std::vector<MO>{MO::createBlock(MBB)}));
+    }
+  }
+}
+
+void RegisterAllocator::rewriteVirtualRegisters() {
+  auto emitCopies = [](MachineBasicBlock* MBB, const CopyList& Copies) {
+    std::vector<MO> Ops;
+    for (const auto& Copy : Copies) {
+      Ops.push_back(getLocationOperand(Copy.first, MO::Def));
+      Ops.push_back(getLocationOperand(Copy.second, MO::Use));
+    }
+    MBB->push_back(std::make_unique<MachineInstr>(X86::PCOPY, Ops));
+  };
+
+  // Blocks added while resolving edges already refer to locations
+  for (size_t b = 0; b < Order.size(); ++b) {
+    MachineBasicBlock* MBB = Order[b];
+    auto Instrs = MBB->takeInstrs();
+    for (size_t i = 0; i < Instrs.size(); ++i) {
+      auto Split = SplitMoves.find({MBB, i});
+      if (Split != SplitMoves.end()) emitCopies(MBB, Split->second);
+      auto SplitRemat = SplitRemats.find({MBB, i});
+      if (SplitRemat != SplitRemats.end())
+        emitRemats(MBB, std::move(SplitRemat->second));
+      auto Edge = EdgeMoves.find({MBB, i});
+      if (Edge != EdgeMoves.end()) emitCopies(MBB, Edge->second);
+      auto EdgeRemat = EdgeRemats.find({MBB, i});
+      if (EdgeRemat != EdgeRemats.end())
+        emitRemats(MBB, std::move(EdgeRemat->second));
+
+      // A constant whose slot nobody reads need not be written at all
+      auto& MI = Instrs[i];
+      int Slot = BlockStarts[b] + 2 * static_cast<int>(i);
+      if (MI->getNumOperands() > 0 && MI->getOperand(0).isReg() &&
+          MI->getOperand(0).isDef()) {
+        unsigned Def = MI->getOperand(0).getReg();
+        if (X86::isVirtualRegister(Def) && Rematerialized[getVRegIndex(Def)] &&
+            getPieceAt(Def, Slot + 1)->PhysReg == X86::NoReg) {
+          continue;
+        }
+      }
+
+      // Each operand refers to the piece live where the instruction reads
+      // or writes it
+      for (MO& Op : MI->operands()) {
+        if (Op.isReg() && X86::isVirtualRegister(Op.getReg())) {
+          unsigned Reg = Op.getReg();
+          LiveInterval* LI = getPieceAt(Reg, Op.isUse() ? Slot : Slot + 1);
+          if (LI->PhysReg != X86::NoReg) {
+            Op.setReg(LI->PhysReg);
+          } else {
+            Op = MO::createFrameIndex(VRegToStackSlot[getVRegIndex(Reg)]);
+          }
+        } else if (Op.isMem()) {
+          if (X86::isVirtualRegister(Op.getBase()))
+            Op.setReg(getPieceAt(Op.getBase(), Slot)->PhysReg);
+          if (X86::isVirtualRegister(Op.getIndex()))
+            Op.setIndex(getPieceAt(Op.getIndex(), Slot)->PhysReg);
+        }
+      }
+
+      if (MI->getOpcode() == X86::MOV && MI->getNumOperands() == 2) {
+        // Copies between values that ended up in the same place
+        MO& Dst = MI->getOperand(0);
+        MO& Src = MI->getOperand(1);
+        if (MI->isCopy() && Dst.getReg() == Src.getReg() &&
+            Dst.getSize() == Src.getSize()) {
+          continue;
+        }
+        if (Dst.isFrameIndex() && Src.isFrameIndex() &&
+            Dst.getFrameIndex() == Src.getFrameIndex()) {
+          continue;
+        }
+
+        // A mov whose register operands both went to the stack, or that
+        // stores a 64-bit constant, goes through a scratch register
+        if (Dst.isMem() &&
+            (Src.isMem() || (Src.isImm() && !isInt32(Src.getImm())))) {
+          MBB->push_back(std::make_unique<MachineInstr>(
+            X86::MOV, std::vector<MO>{MO::createReg(X86::R10, MO::Def), Src}));
+          Src = MO::createReg(X86::R10);
+        }
+      }
+      MBB->push_back(std::move(MI));
+    }
+  }
+}
+
+// ===----------------------------------------------------------------------===
+// Parallel copy expansion
+// ===----------------------------------------------------------------------===
+
+void expandParallelCopies(MachineFunction& MF) {
+  auto getLoc = [](const MO& Op) -> int64_t {
+    return Op.isReg() ? static_cast<int64_t>(Op.getReg())
+                      : -static_cast<int64_t>(Op.getFrameIndex()) - 1;
+  };
+
+  for (const auto& MBB : MF.getBlocks()) {
+    auto Instrs = MBB->takeInstrs();
+    for (auto& MI : Instrs) {
+      if (MI->getOpcode() != X86::PCOPY) {
+        MBB->push_back(std::move(MI));
+        continue;
+      }
+
+      auto emitMove = [&](MO Dst, MO Src) {
+        // x86 has no memory-to-memory mov, nor a 64-bit immediate store
+        if (Dst.isMem() && (Src.isMem() || (Src.isImm() &&
+                                            !isInt32(Src.getImm())))) {
+          MBB->push_back(std::make_unique<MachineInstr>(
+            X86::MOV, std::vector<MO>{MO::createReg(X86::R10, MO::Def), Src}));
+          Src = MO::createReg(X86::R10);
+        }
+        MBB->push_back(std::make_unique<MachineInstr>(
+          X86::MOV, std::vector<MO>{Dst, Src}));
+      };
+
+      // Register and stack copies first, then constants, which read nothing
+      std::vector<std::pair<int64_t, int64_t>> Copies;
+      std::vector<std::pair<int64_t, int64_t>> Constants;
+      for (size_t i = 0; i + 1 < MI->getNumOperands(); i += 2) {
+        const MO& Src = MI->getOperand(i + 1);
+        int64_t Dst = getLoc(MI->getOperand(i));
+        if (Src.isImm()) {
+          Constants.push_back({Dst, Src.getImm()});
+        } else {
+          Copies.push_back({Dst, getLoc(Src)});
+        }
+      }
+
+      sequentializeCopies<int64_t>(
+        Copies, static_cast<int64_t>(X86::R11),
+        [&](int64_t Dst, int64_t Src) {
+          emitMove(getLocationOperand(Dst, MO::Def),
+                 getLocationOperand(Src, MO::Use));
+        });
+      for (const auto& C : Constants) {
+        emitMove(getLocationOperand(C.first, MO::Def), MO::createImm(C.second));
+      }
+    }
   }
 }
 
@@ -0,0 +1,175 @@
+#include "yac/CodeGen/StackSlotColoring.h"
+#include <algorithm>
+#include <map>
+#include <set>
+
+namespace yac {
+
+using MO = MachineOperand;
+
+int64_t getFrameObjectsSize(const MachineFunction& MF) {
+  int64_t Offset = 0;
+  for (const FrameObject& Obj : MF.getFrameObjects()) {
+    Offset += Obj.Size;
+    Offset = (Offset + Obj.Align - 1) / Obj.Align * Obj.Align;
+  }
+  return Offset;
+}
+
+int64_t colorStackSlots(MachineFunction& MF) {
+  std::vector<FrameObject>& Objects = MF.getFrameObjects();
+  int64_t Before = getFrameObjectsSize(MF);
+
+  // A mov that writes all of an object kills it; every other reference
+  // reads it, and writes it too as the first operand. An object addressed
+  // with an offset or through lea may be reached in ways not seen here.
+  std::vector<bool> Referenced(Objects.size()), Pinned(Objects.size());
+  auto isKill = [&](const MachineInstr& MI, size_t OpNo) {
+    const MO& Op = MI.getOperand(OpNo);
+    return MI.getOpcode() == X86::MOV && OpNo == 0 &&
+           Op.getSize() >= Objects[Op.getFrameIndex()].Size;
+  };
+  for (const auto& MBB : MF.getBlocks()) {
+    for (const auto& MI : MBB->instrs()) {
+      for (const MO& Op : MI->operands()) {
+        if (!Op.isFrameIndex()) continue;
+        Referenced[Op.getFrameIndex()] = true;
+        if (Op.getDisp() != 0 || Op.getIndex() != X86::NoReg ||
+            MI->getOpcode() == X86::LEA) {
+          Pinned[Op.getFrameIndex()] = true;
+        }
+      }
+    }
+  }
+
+  // Objects read before being killed in each block, and those killed
+  std::map<const MachineBasicBlock*, std::set<int>> Use, Kill;
+  for (const auto& MBB : MF.getBlocks()) {
+    auto& BlockUse = Use[MBB.get()];
+    auto& BlockKill = Kill[MBB.get()];
+    for (const auto& MI : MBB->instrs()) {
+      for (size_t i = 0; i < MI->getNumOperands(); ++i) {
+        const MO& Op = MI->getOperand(i);
+        if (!Op.isFrameIndex()) continue;
+        if (isKill(*MI, i)) {
+          BlockKill.insert(Op.getFrameIndex());
+        } else if (!BlockKill.count(Op.getFrameIndex())) {
+          BlockUse.insert(Op.getFrameIndex());
+        }
+      }
+    }
+  }
+
+  std::map<const MachineBasicBlock*, std::set<int>> LiveIn, LiveOut;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    const auto& Blocks = MF.getBlocks();
+    for (auto It = Blocks.rbegin(); It != Blocks.rend(); ++It) {
+      const MachineBasicBlock* MBB = It->get();
+      std::set<int> NewOut;
+      for (const MachineBasicBlock* Succ : MBB->getSuccessors()) {
+        const auto& SuccIn = LiveIn[Succ];
+        NewOut.insert(SuccIn.begin(), SuccIn.end());
+      }
+      std::set<int> NewIn = Use[MBB];
+      for (int FI : NewOut) {
+        if (!Kill[MBB].count(FI)) NewIn.insert(FI);
+      }
+      if (NewIn != LiveIn[MBB] || NewOut != LiveOut[MBB]) {
+        LiveIn[MBB] = std::move(NewIn);
+        LiveOut[MBB] = std::move(NewOut);
+        Changed = true;
+      }
+    }
+  }
+
+  // An object written while another is live may not share its slot
+  std::vector<std::set<int>> Interferes(Objects.size());
+  for (const auto& MBB : MF.getBlocks()) {
+    std::set<int> Live = LiveOut[MBB.get()];
+    for (auto It = MBB->instrs().rbegin(); It != MBB->instrs().rend(); ++It) {
+      const MachineInstr& MI = **It;
+      bool Writes = MI.getNumOperands() > 0 && MI.getOperand(0).isFrameIndex();
+      if (Writes) {
+        int Written = MI.getOperand(0).getFrameIndex();
+        for (int FI : Live) {
+          if (FI == Written) continue;
+          Interferes[FI].insert(Written);
+          Interferes[Written].insert(FI);
+        }
+        if (isKill(MI, 0)) Live.erase(Written);
+      }
+      for (size_t i = Writes && isKill(MI, 0); i < MI.getNumOperands(); ++i) {
+        if (MI.getOperand(i).isFrameIndex())
+          Live.insert(MI.getOperand(i).getFrameIndex());
+      }
+    }
+  }
+
+  // Largest objects first, each into the first slot none of its
+  // occupants interferes with; the slot grows to fit
+  std::vector<int> Candidates;
+  for (size_t FI = 0; FI < Objects.size(); ++FI) {
+    if (Referenced[FI] && !Pinned[FI]) Candidates.push_back(FI);
+  }
+  std::stable_sort(Candidates.begin(), Candidates.end(), [&](int A, int B) {
+    if (Objects[A].Size != Objects[B].Size)
+      return Objects[A].Size > Objects[B].Size;
+    return Objects[A].Align > Objects[B].Align;
+  });
+  std::vector<std::vector<int>> Slots;
+  for (int FI : Candidates) {
+    auto Slot = std::find_if(Slots.begin(), Slots.end(), [&](const auto& S) {
+      return std::none_of(S.begin(), S.end(), [&](int Other) {
+        return Interferes[FI].count(Other);
+      });
+    });
+    if (Slot != Slots.end()) {
+      Slot->push_back(FI);
+    } else {
+      Slots.push_back({FI});
+    }
+  }
+  for (size_t FI = 0; FI < Objects.size(); ++FI) {
+    if (Pinned[FI]) Slots.push_back({static_cast<int>(FI)});
+  }
+
+  // Most aligned first, then largest, so no padding is needed between
+  // them
+  std::vector<FrameObject> NewObjects;
+  for (const auto& Slot : Slots) {
+    FrameObject Obj{0, 1, 0, true};
+    for (int FI : Slot) {
+      Obj.Size = std::max(Obj.Size, Objects[FI].Size);
+      Obj.Align = std::max(Obj.Align, Objects[FI].Align);
+      Obj.IsSpillSlot = Obj.IsSpillSlot && Objects[FI].IsSpillSlot;
+    }
+    NewObjects.push_back(Obj);
+  }
+  std::vector<size_t> Layout(Slots.size());
+  for (size_t i = 0; i < Layout.size(); ++i) Layout[i] = i;
+  std::stable_sort(Layout.begin(), Layout.end(), [&](size_t A, size_t B) {
+    if (NewObjects[A].Align != NewObjects[B].Align)
+      return NewObjects[A].Align > NewObjects[B].Align;
+    return NewObjects[A].Size > NewObjects[B].Size;
+  });
+
+  std::vector<int> NewIndex(Objects.size(), -1);
+  std::vector<FrameObject> Laid;
+  for (size_t i : Layout) {
+    for (int FI : Slots[i]) NewIndex[FI] = static_cast<int>(Laid.size());
+    Laid.push_back(NewObjects[i]);
+  }
+  for (const auto& MBB : MF.getBlocks()) {
+    for (const auto& MI : MBB->instrs()) {
+      for (MO& Op : MI->operands()) {
+        if (Op.isFrameIndex()) Op.setFrameIndex(NewIndex[Op.getFrameIndex()]);
+      }
+    }
+  }
+  Objects = std::move(Laid);
+  return Before - getFrameObjectsSize(MF);
+}
+
+} // namespace yac
@@ -0,0 +1,37 @@
+#include "yac/CodeGen/SwitchLowering.h"
+
+namespace yac {
+
+/// Bit tests replace a compare per case with one test per destination, so
+/// they only pay off when destinations are shared by enough cases.
+static bool isBitTestProfitable(size_t NumCases, size_t NumDests) {
+  return (NumDests == 1 && NumCases >= 3) ||
+         (NumDests == 2 && NumCases >= 5) ||
+         (NumDests == 3 && NumCases >= 6);
+}
+
+SwitchStrategy chooseSwitchStrategy(const std::vector<int64_t>& SortedValues,
+                                    size_t NumDests) {
+  if (SortedValues.empty()) {
+    return SwitchStrategy::CompareTree;
+  }
+
+  // Max - Min, computed without signed overflow
+  uint64_t Span = static_cast<uint64_t>(SortedValues.back()) -
+                  static_cast<uint64_t>(SortedValues.front());
+  size_t NumCases = SortedValues.size();
+
+  if (Span < 64 && NumDests <= MaxBitTestDests &&
+      isBitTestProfitable(NumCases, NumDests)) {
+    return SwitchStrategy::BitTest;
+  }
+
+  if (NumCases >= MinJumpTableCases && Span < MaxJumpTableSize &&
+      NumCases * 100 >= (Span + 1) * MinJumpTableDensity) {
+    return SwitchStrategy::JumpTable;
+  }
+
+  return SwitchStrategy::CompareTree;
+}
+
+} // namespace yac
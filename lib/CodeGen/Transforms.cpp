@@ -1,4 +1,5 @@
 #include "yac/CodeGen/Transforms.h"
+#include "yac/CodeGen/IRUtils.h"
 #include <iostream>
 #include <map>
 #include <queue>
@@ -128,13 +129,25 @@ std::set<IRBasicBlock*> Mem2RegPass::computeDominanceFrontier(
 
   std::set<IRBasicBlock*> Frontier;
 
-  // For each block in the set
-  for (IRBasicBlock* BB : Blocks) {
-    // For each successor
-    for (IRBasicBlock* Succ : BB->getSuccessors()) {
-      // If BB doesn't dominate Succ, Succ is in the dominance frontier
-      if (!DT->dominates(BB, Succ)) {
-        Frontier.insert(Succ);
+  // A join block Y is in DF(X) when X dominates a predecessor of Y but not
+  // Y itself. Walk up the dominator tree from each predecessor until the
+  // immediate dominator of Y; every block passed on the way has Y in its
+  // frontier. Looking only at direct successors misses loop headers
+  // reached through a back edge from deeper in the body.
+  for (const auto& Y : CurrentFunc->getBlocks()) {
+    if (Y->getNumPredecessors() < 2) continue;
+
+    auto* YNode = DT->getNode(Y.get());
+    if (!YNode) continue;
+    auto* IDom = YNode->IDom;
+
+    for (IRBasicBlock* Pred : Y->getPredecessors()) {
+      auto* Runner = DT->getNode(Pred);
+      while (Runner && Runner != IDom) {
+        if (Blocks.count(Runner->Block)) {
+          Frontier.insert(Y.get());
+        }
+        Runner = Runner->IDom;
       }
     }
   }
@@ -247,6 +260,11 @@ void Mem2RegPass::renameInBlock(
           // Propagate the value so children can inherit it
           CurrentDef[BB] = IncomingValue;
         }
+      } else {
+        // Entry block: the variable is uninitialized here. Give it a value
+        // anyway so every phi gets an entry for every predecessor.
+        IncomingValue = CurrentFunc->createConstant(0);
+        CurrentDef[BB] = IncomingValue;
       }
     }
   }
@@ -338,10 +356,28 @@ void Mem2RegPass::replaceValueInInstruction(IRInstruction* Inst,
       CondBr->setCondition(New);
     }
   }
+  else if (auto* Switch = dynamic_cast<IRSwitchInst*>(Inst)) {
+    if (Switch->getCondition() == Old) {
+      Switch->setCondition(New);
+    }
+  }
+  else if (auto* Sel = dynamic_cast<IRSelectInst*>(Inst)) {
+    if (Sel->getCondition() == Old) {
+      Sel->setCondition(New);
+    }
+    if (Sel->getTrueValue() == Old) {
+      Sel->setTrueValue(New);
+    }
+    if (Sel->getFalseValue() == Old) {
+      Sel->setFalseValue(New);
+    }
+  }
   else if (auto* Call = dynamic_cast<IRCallInst*>(Inst)) {
-    // Calls need more complex handling for args
-    // For now, skip - would need setArg(index, value) method
-    (void)Call;
+    for (size_t i = 0; i < Call->getArgs().size(); ++i) {
+      if (Call->getArgs()[i] == Old) {
+        Call->setArg(i, New);
+      }
+    }
   }
   else if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst)) {
     // Replace incoming values in phi nodes
@@ -353,9 +389,9 @@ void Mem2RegPass::replaceLoadsAndRemoveStores(AllocaInfo& Info) {
   // Replace uses of loaded values with SSA values
   for (auto& BB : CurrentFunc->getBlocks()) {
     for (const auto& Inst : BB->getInstructions()) {
-      // Don't replace in loads/stores/allocas themselves
+      // Don't replace in loads/allocas themselves. Stores are rewritten:
+      // a store to another alloca may still feed its phis later.
       if (dynamic_cast<IRLoadInst*>(Inst.get()) ||
-          dynamic_cast<IRStoreInst*>(Inst.get()) ||
           dynamic_cast<IRAllocaInst*>(Inst.get())) {
         continue;
       }
@@ -383,71 +419,23 @@ bool DCEPass::run(IRFunction* F, AnalysisManager& AM) {
   std::map<IRValue*, IRInstruction*> DefMap;
   for (const auto& BB : F->getBlocks()) {
     for (const auto& Inst : BB->getInstructions()) {
-      if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
-        DefMap[BinOp->getResult()] = Inst.get();
-      } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(Inst.get())) {
-        DefMap[UnOp->getResult()] = Inst.get();
-      } else if (auto* Load = dynamic_cast<IRLoadInst*>(Inst.get())) {
-        DefMap[Load->getResult()] = Inst.get();
-      } else if (auto* Alloca = dynamic_cast<IRAllocaInst*>(Inst.get())) {
-        DefMap[Alloca->getResult()] = Inst.get();
-      } else if (auto* Call = dynamic_cast<IRCallInst*>(Inst.get())) {
-        if (Call->getResult()) {
-          DefMap[Call->getResult()] = Inst.get();
-        }
-      } else if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
-        DefMap[Phi->getResult()] = Inst.get();
+      if (IRValue* Def = getDefinedValue(Inst.get())) {
+        DefMap[Def] = Inst.get();
       }
     }
   }
 
   // Mark transitively live instructions
-  bool Changed = true;
-  while (Changed) {
-    Changed = false;
-    for (const auto& BB : F->getBlocks()) {
-      for (const auto& Inst : BB->getInstructions()) {
-        if (Live.count(Inst.get())) {
-          // Extract operands and mark their defining instructions as live
-          std::vector<IRValue*> Operands;
-
-          if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
-            Operands.push_back(BinOp->getLHS());
-            Operands.push_back(BinOp->getRHS());
-          } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(Inst.get())) {
-            Operands.push_back(UnOp->getOperand());
-          } else if (auto* Load = dynamic_cast<IRLoadInst*>(Inst.get())) {
-            Operands.push_back(Load->getPtr());
-          } else if (auto* Store = dynamic_cast<IRStoreInst*>(Inst.get())) {
-            Operands.push_back(Store->getValue());
-            Operands.push_back(Store->getPtr());
-          } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(Inst.get())) {
-            Operands.push_back(CondBr->getCondition());
-          } else if (auto* Ret = dynamic_cast<IRRetInst*>(Inst.get())) {
-            if (Ret->hasRetValue()) {
-              Operands.push_back(Ret->getRetValue());
-            }
-          } else if (auto* Call = dynamic_cast<IRCallInst*>(Inst.get())) {
-            for (IRValue* Arg : Call->getArgs()) {
-              Operands.push_back(Arg);
-            }
-          } else if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
-            for (const auto& Entry : Phi->getIncomings()) {
-              Operands.push_back(Entry.Value);
-            }
-          }
-
-          // Mark defining instructions as live
-          for (IRValue* Op : Operands) {
-            if (Op && !Op->isConstant() && DefMap.count(Op)) {
-              IRInstruction* DefInst = DefMap[Op];
-              if (!Live.count(DefInst)) {
-                Live.insert(DefInst);
-                Changed = true;
-              }
-            }
-          }
-        }
+  std::vector<IRInstruction*> Worklist(Live.begin(), Live.end());
+  while (!Worklist.empty()) {
+    IRInstruction* I = Worklist.back();
+    Worklist.pop_back();
+
+    for (IRValue* Op : getOperands(I)) {
+      if (!Op || Op->isConstant()) continue;
+      auto It = DefMap.find(Op);
+      if (It != DefMap.end() && Live.insert(It->second).second) {
+        Worklist.push_back(It->second);
       }
     }
   }
@@ -460,7 +448,7 @@ bool DCEPass::run(IRFunction* F, AnalysisManager& AM) {
 
     auto it = Insts.begin();
     while (it != Insts.end()) {
-      if (!Live.count(it->get()) && !isInstructionDead(it->get())) {
+      if (!Live.count(it->get())) {
         it = Insts.erase(it);
         RemovedAny = true;
       } else {
@@ -473,10 +461,14 @@ bool DCEPass::run(IRFunction* F, AnalysisManager& AM) {
 }
 
 bool DCEPass::isInstructionDead(IRInstruction* I) {
-  // Instructions with side effects are never dead
+  // Instructions with side effects are never dead. A call is only
+  // removable once FunctionAttrs has proven it pure and terminating.
+  if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    return Call->isRemovable();
+  }
   return !I->isTerminator() &&
          I->getOpcode() != IRInstruction::Store &&
-         I->getOpcode() != IRInstruction::Call;
+         !dynamic_cast<IRLabelInst*>(I);
 }
 
 void DCEPass::collectLiveInstructions(
@@ -485,16 +477,215 @@ void DCEPass::collectLiveInstructions(
 
   for (const auto& BB : F->getBlocks()) {
     for (const auto& Inst : BB->getInstructions()) {
-      // Terminators, stores, and calls are always live
-      if (Inst->isTerminator() ||
-          Inst->getOpcode() == IRInstruction::Store ||
-          Inst->getOpcode() == IRInstruction::Call) {
+      // Terminators, labels, stores, and impure calls are always live
+      if (!isInstructionDead(Inst.get())) {
         Live.insert(Inst.get());
       }
     }
   }
 }
 
+// ===----------------------------------------------------------------------===
+// ADCE Pass
+// ===----------------------------------------------------------------------===
+
+// Label naming BB as a branch target
+static IRValue* getBlockLabel(IRFunction* F, IRBasicBlock* BB) {
+  for (const auto& Inst : BB->getInstructions()) {
+    if (auto* Label = dynamic_cast<IRLabelInst*>(Inst.get())) {
+      return Label->getLabel();
+    }
+  }
+  return F->createValue(IRValue::VK_Label, BB->getName(), nullptr);
+}
+
+void ADCEPass::computeControlDependence(IRFunction* F) {
+  ControlDeps.clear();
+
+  // Every block on the post-dominator chain from a successor of A up to
+  // (but not including) A's own post-dominator runs only if A goes that way
+  for (const auto& BB : F->getBlocks()) {
+    IRBasicBlock* A = BB.get();
+    if (A->getNumSuccessors() < 2) continue;
+
+    IRBasicBlock* Stop = PDT->getIPDom(A);
+    for (IRBasicBlock* Succ : A->getSuccessors()) {
+      for (IRBasicBlock* Runner = Succ; Runner && Runner != Stop;
+           Runner = PDT->getIPDom(Runner)) {
+        ControlDeps[Runner].insert(A);
+      }
+    }
+  }
+}
+
+void ADCEPass::markLive(IRInstruction* I) {
+  if (!LiveInsts.insert(I).second) return;
+  Worklist.push_back(I);
+  markLive(I->getParent());
+}
+
+void ADCEPass::markLive(IRBasicBlock* BB) {
+  if (!LiveBlocks.insert(BB).second) return;
+
+  // Unconditional branches out of live blocks stay
+  if (auto* Br = dynamic_cast<IRBrInst*>(BB->getTerminator())) {
+    markLive(Br);
+  }
+
+  // So do the branches deciding whether this block runs
+  for (IRBasicBlock* A : ControlDeps[BB]) {
+    markLive(A->getTerminator());
+  }
+}
+
+void ADCEPass::propagateLiveness() {
+  while (!Worklist.empty()) {
+    IRInstruction* I = Worklist.back();
+    Worklist.pop_back();
+
+    for (IRValue* Op : getOperands(I)) {
+      auto It = Defs.find(Op);
+      if (It != Defs.end()) markLive(It->second);
+    }
+
+    // A live phi needs to know which edge was taken
+    if (auto* Phi = dynamic_cast<IRPhiInst*>(I)) {
+      for (const auto& Entry : Phi->getIncomings()) {
+        markLive(Entry.Block);
+      }
+    }
+  }
+}
+
+IRBasicBlock* ADCEPass::findLivePostDominator(IRBasicBlock* BB) {
+  IRBasicBlock* Runner = PDT->getIPDom(BB);
+  while (Runner && !LiveBlocks.count(Runner)) {
+    Runner = PDT->getIPDom(Runner);
+  }
+  return Runner;
+}
+
+bool ADCEPass::run(IRFunction* F, AnalysisManager& AM) {
+  if (F->getBlocks().empty()) return false;
+
+  LiveInsts.clear();
+  LiveBlocks.clear();
+  Worklist.clear();
+  Defs.clear();
+
+  PDT = &AM.get<PostDominatorTree>();
+  computeControlDependence(F);
+
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      if (IRValue* Def = getDefinedValue(Inst.get())) {
+        Defs[Def] = Inst.get();
+      }
+    }
+  }
+
+  markLive(F->getBlocks()[0].get());
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      IRInstruction* I = Inst.get();
+      // A branch on a constant is left for SCCP; it may be a deliberate
+      // 'while (1)'
+      auto* Call = dynamic_cast<IRCallInst*>(I);
+      auto* CondBr = dynamic_cast<IRCondBrInst*>(I);
+      if (dynamic_cast<IRRetInst*>(I) || dynamic_cast<IRStoreInst*>(I) ||
+          (Call && !Call->isRemovable()) ||
+          (CondBr && CondBr->getCondition()->isConstant())) {
+        markLive(I);
+      }
+    }
+  }
+
+  // Each dead branch jumps to its nearest live post-dominator. If that is
+  // the virtual exit (the branch may enter a loop that never ends) or a
+  // block with phis that is not already a successor, keep the branch.
+  std::map<IRBasicBlock*, IRBasicBlock*> Redirect;
+  bool Retry = true;
+  while (Retry) {
+    propagateLiveness();
+    Retry = false;
+    Redirect.clear();
+
+    for (const auto& BB : F->getBlocks()) {
+      IRInstruction* Term = BB->getTerminator();
+      if (!Term || LiveInsts.count(Term)) continue;
+      if (!dynamic_cast<IRCondBrInst*>(Term) &&
+          !dynamic_cast<IRSwitchInst*>(Term)) {
+        continue;
+      }
+
+      IRBasicBlock* Target = findLivePostDominator(BB.get());
+      const auto& Succs = BB->getSuccessors();
+      bool IsSucc = std::find(Succs.begin(), Succs.end(), Target) != Succs.end();
+      bool HasPhis = false;
+      if (Target) {
+        for (const auto& Inst : Target->getInstructions()) {
+          if (dynamic_cast<IRPhiInst*>(Inst.get()) && LiveInsts.count(Inst.get())) {
+            HasPhis = true;
+          }
+        }
+      }
+
+      if (!Target || (HasPhis && !IsSucc)) {
+        markLive(Term);
+        Retry = true;
+      } else {
+        Redirect[BB.get()] = Target;
+      }
+    }
+  }
+
+  bool Changed = false;
+  for (const auto& Entry : Redirect) {
+    IRBasicBlock* BB = Entry.first;
+    IRBasicBlock* Target = Entry.second;
+
+    bool KeptEdge = false;
+    std::vector<IRBasicBlock*> Succs = BB->getSuccessors();
+    for (IRBasicBlock* Succ : Succs) {
+      if (Succ == Target && !KeptEdge) {
+        KeptEdge = true;
+      } else if (Succ == Target) {
+        BB->removeSuccessor(Succ);  // Duplicate edge; keep the phi entry
+      } else {
+        removeEdge(BB, Succ);
+      }
+    }
+    if (!KeptEdge) BB->addSuccessor(Target);
+
+    BB->removeInstruction(BB->getTerminator());
+    BB->addInstruction(std::make_unique<IRBrInst>(getBlockLabel(F, Target)));
+    Changed = true;
+  }
+
+  // Remove dead instructions; labels and the remaining branches stay
+  for (auto& BB : F->getBlocks()) {
+    auto& Insts = const_cast<std::vector<std::unique_ptr<IRInstruction>>&>(
+        BB->getInstructions());
+
+    auto it = Insts.begin();
+    while (it != Insts.end()) {
+      IRInstruction* I = it->get();
+      if (!LiveInsts.count(I) && !I->isTerminator() &&
+          !dynamic_cast<IRLabelInst*>(I)) {
+        it = Insts.erase(it);
+        Changed = true;
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // Loop bodies and arms nothing branches to any more
+  Changed |= removeUnreachableBlocks(F);
+
+  return Changed;
+}
+
 // ===----------------------------------------------------------------------===
 // SimplifyCFG Pass
 // ===----------------------------------------------------------------------===
@@ -505,6 +696,19 @@ bool SimplifyCFGPass::run(IRFunction* F, AnalysisManager& AM) {
   // Remove unreachable blocks
   Changed |= removeUnreachableBlocks(F);
 
+  // If-convert until no branch qualifies; folding an inner diamond can
+  // turn the enclosing one into a candidate
+  bool Folded = true;
+  while (Folded) {
+    Folded = false;
+    for (const auto& BB : F->getBlocks()) {
+      if (foldBranchToSelect(F, BB.get())) {
+        Folded = Changed = true;
+        break;
+      }
+    }
+  }
+
   // Merge blocks with single predecessor/successor
   // TODO: Implement block merging
 
@@ -512,44 +716,146 @@ bool SimplifyCFGPass::run(IRFunction* F, AnalysisManager& AM) {
 }
 
 bool SimplifyCFGPass::removeUnreachableBlocks(IRFunction* F) {
-  if (F->getBlocks().empty()) return false;
+  // Shared with the loop transforms, which also leave dead copies behind
+  return yac::removeUnreachableBlocks(F);
+}
 
-  // Find reachable blocks from entry
-  std::set<IRBasicBlock*> Reachable;
-  std::queue<IRBasicBlock*> Worklist;
+bool SimplifyCFGPass::isSpeculatableArm(IRBasicBlock* Arm, IRBasicBlock* Pred,
+                                        IRBasicBlock*& Join) {
+  if (Arm == Pred || Arm->getNumPredecessors() != 1 ||
+      Arm->getNumSuccessors() != 1) {
+    return false;
+  }
 
-  IRBasicBlock* Entry = F->getBlocks()[0].get();
-  Reachable.insert(Entry);
-  Worklist.push(Entry);
+  auto* Br = dynamic_cast<IRBrInst*>(Arm->getTerminator());
+  if (!Br) return false;
 
-  while (!Worklist.empty()) {
-    IRBasicBlock* BB = Worklist.front();
-    Worklist.pop();
+  size_t Count = 0;
+  for (const auto& Inst : Arm->getInstructions()) {
+    IRInstruction* I = Inst.get();
+    if (I == Br || dynamic_cast<IRLabelInst*>(I)) continue;
+
+    // Division may trap once it runs unconditionally; loads, stores and
+    // calls are never moved
+    bool Pure = dynamic_cast<IRUnaryInst*>(I) || dynamic_cast<IRMoveInst*>(I) ||
+                dynamic_cast<IRSelectInst*>(I);
+    if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+      Pure = BinOp->getOpcode() != IRInstruction::Div &&
+             BinOp->getOpcode() != IRInstruction::Mod;
+    }
+    if (!Pure || ++Count > SpeculationThreshold) return false;
+  }
 
-    for (IRBasicBlock* Succ : BB->getSuccessors()) {
-      if (!Reachable.count(Succ)) {
-        Reachable.insert(Succ);
-        Worklist.push(Succ);
+  Join = Arm->getSuccessors()[0];
+  return Join != Pred;
+}
+
+bool SimplifyCFGPass::foldBranchToSelect(IRFunction* F, IRBasicBlock* BB) {
+  auto* Br = dynamic_cast<IRCondBrInst*>(BB->getTerminator());
+  if (!Br) return false;
+
+  IRBasicBlock* TrueBB = getSuccessorForLabel(BB, Br->getTrueLabel());
+  IRBasicBlock* FalseBB = getSuccessorForLabel(BB, Br->getFalseLabel());
+  if (!TrueBB || !FalseBB || TrueBB == FalseBB) return false;
+
+  // Arms that get hoisted; a null arm means BB branches to Join directly
+  IRBasicBlock* TrueArm = nullptr;
+  IRBasicBlock* FalseArm = nullptr;
+  IRBasicBlock* Join = nullptr;
+  IRBasicBlock* TrueJoin = nullptr;
+  IRBasicBlock* FalseJoin = nullptr;
+  bool TrueOk = isSpeculatableArm(TrueBB, BB, TrueJoin);
+  bool FalseOk = isSpeculatableArm(FalseBB, BB, FalseJoin);
+
+  if (TrueOk && FalseOk && TrueJoin == FalseJoin) {
+    TrueArm = TrueBB;  // Diamond
+    FalseArm = FalseBB;
+    Join = TrueJoin;
+  } else if (TrueOk && TrueJoin == FalseBB) {
+    TrueArm = TrueBB;  // Triangle through the true side
+    Join = FalseBB;
+  } else if (FalseOk && FalseJoin == TrueBB) {
+    FalseArm = FalseBB;  // Triangle through the false side
+    Join = TrueBB;
+  } else {
+    return false;
+  }
+
+  IRValue* JoinLabel =
+      static_cast<IRBrInst*>((TrueArm ? TrueArm : FalseArm)->getTerminator())
+          ->getTarget();
+
+  // Hoist the arms, in order, ahead of the branch
+  for (IRBasicBlock* Arm : {TrueArm, FalseArm}) {
+    if (!Arm) continue;
+    std::vector<IRInstruction*> ToHoist;
+    for (const auto& Inst : Arm->getInstructions()) {
+      if (!Inst->isTerminator() && !dynamic_cast<IRLabelInst*>(Inst.get())) {
+        ToHoist.push_back(Inst.get());
       }
     }
+    for (IRInstruction* I : ToHoist) {
+      BB->insertBeforeTerminator(Arm->removeInstruction(I));
+    }
   }
 
-  // Remove unreachable blocks
-  auto& Blocks = const_cast<std::vector<std::unique_ptr<IRBasicBlock>>&>(
-      F->getBlocks());
+  // Each phi in Join picks its value with a select instead of an edge
+  IRBasicBlock* TrueFrom = TrueArm ? TrueArm : BB;
+  IRBasicBlock* FalseFrom = FalseArm ? FalseArm : BB;
+  for (const auto& Inst : Join->getInstructions()) {
+    auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get());
+    if (!Phi) continue;
+
+    IRValue* TrueVal = Phi->getIncomingValueForBlock(TrueFrom);
+    IRValue* FalseVal = Phi->getIncomingValueForBlock(FalseFrom);
+    if (!TrueVal || !FalseVal) continue;
+
+    IRValue* Merged = TrueVal;
+    if (TrueVal != FalseVal) {
+      IRValue* Result = Phi->getResult();
+      Merged = F->createValue(IRValue::VK_Temp, "sel_" + Result->getName(),
+                              Result->getType());
+      BB->insertBeforeTerminator(std::make_unique<IRSelectInst>(
+          Merged, Br->getCondition(), TrueVal, FalseVal));
+    }
 
-  auto it = Blocks.begin();
-  bool Changed = false;
-  while (it != Blocks.end()) {
-    if (!Reachable.count(it->get())) {
-      it = Blocks.erase(it);
-      Changed = true;
-    } else {
-      ++it;
+    Phi->removeIncomingBlock(TrueFrom);
+    Phi->removeIncomingBlock(FalseFrom);
+    Phi->addIncoming(Merged, BB);
+  }
+
+  // BB now falls straight into Join
+  for (IRBasicBlock* Arm : {TrueArm, FalseArm}) {
+    if (!Arm) continue;
+    BB->removeSuccessor(Arm);
+    Arm->removeSuccessor(Join);
+  }
+  if (TrueArm && FalseArm) {
+    BB->addSuccessor(Join);
+  }
+  BB->removeInstruction(Br);
+  BB->addInstruction(std::make_unique<IRBrInst>(JoinLabel));
+
+  for (IRBasicBlock* Arm : {TrueArm, FalseArm}) {
+    if (Arm) F->removeBlock(Arm);
+  }
+
+  // With BB as the only predecessor left, the phis are plain copies
+  if (Join->getNumPredecessors() == 1) {
+    std::vector<IRPhiInst*> Phis;
+    for (const auto& Inst : Join->getInstructions()) {
+      if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
+        Phis.push_back(Phi);
+      }
+    }
+    for (IRPhiInst* Phi : Phis) {
+      replaceAllUsesWith(F, Phi->getResult(),
+                         Phi->getIncomingValueForBlock(BB));
+      Join->removeInstruction(Phi);
     }
   }
 
-  return Changed;
+  return true;
 }
 
 // ===----------------------------------------------------------------------===
@@ -726,6 +1032,22 @@ void CopyPropagationPass::replaceValueInInstruction(IRInstruction* Inst,
       CondBr->setCondition(New);
     }
   }
+  else if (auto* Switch = dynamic_cast<IRSwitchInst*>(Inst)) {
+    if (Switch->getCondition() == Old) {
+      Switch->setCondition(New);
+    }
+  }
+  else if (auto* Sel = dynamic_cast<IRSelectInst*>(Inst)) {
+    if (Sel->getCondition() == Old) {
+      Sel->setCondition(New);
+    }
+    if (Sel->getTrueValue() == Old) {
+      Sel->setTrueValue(New);
+    }
+    if (Sel->getFalseValue() == Old) {
+      Sel->setFalseValue(New);
+    }
+  }
   else if (auto* Move = dynamic_cast<IRMoveInst*>(Inst)) {
     // Don't replace the result, but replace the operand if it's a copy
     (void)Move;
@@ -799,8 +1121,9 @@ void SCCPPass::markConstant(IRValue* V, int64_t Val) {
   if (MeetResult.State != Cell.State ||
       (MeetResult.State == Constant && MeetResult.ConstVal != Cell.ConstVal)) {
     Cell = MeetResult;
-    // Add users to worklist (instructions that use this value)
-    // For now, we'll process all instructions in executable blocks
+    for (IRInstruction* User : Users[V]) {
+      SSAWorkList.push_back(User);
+    }
   }
 }
 
@@ -810,6 +1133,9 @@ void SCCPPass::markOverdefined(IRValue* V) {
 
   Cell.State = Overdefined;
   Cell.ConstVal = 0;
+  for (IRInstruction* User : Users[V]) {
+    SSAWorkList.push_back(User);
+  }
 }
 
 void SCCPPass::markEdgeExecutable(IRBasicBlock* From, IRBasicBlock* To) {
@@ -837,22 +1163,35 @@ void SCCPPass::markBlockExecutable(IRBasicBlock* BB) {
 
 bool SCCPPass::tryEvaluateBinary(IRInstruction::Opcode Op, int64_t LHS, int64_t RHS, int64_t& Result) {
   switch (Op) {
-    case IRInstruction::Add: Result = LHS + RHS; return true;
-    case IRInstruction::Sub: Result = LHS - RHS; return true;
-    case IRInstruction::Mul: Result = LHS * RHS; return true;
+    // Wrap like the machine does instead of overflowing in the compiler
+    case IRInstruction::Add:
+      Result = static_cast<int64_t>(static_cast<uint64_t>(LHS) + static_cast<uint64_t>(RHS));
+      return true;
+    case IRInstruction::Sub:
+      Result = static_cast<int64_t>(static_cast<uint64_t>(LHS) - static_cast<uint64_t>(RHS));
+      return true;
+    case IRInstruction::Mul:
+      Result = static_cast<int64_t>(static_cast<uint64_t>(LHS) * static_cast<uint64_t>(RHS));
+      return true;
     case IRInstruction::Div:
-      if (RHS == 0) return false;
+      if (RHS == 0 || (LHS == INT64_MIN && RHS == -1)) return false;
       Result = LHS / RHS;
       return true;
     case IRInstruction::Mod:
-      if (RHS == 0) return false;
+      if (RHS == 0 || (LHS == INT64_MIN && RHS == -1)) return false;
       Result = LHS % RHS;
       return true;
     case IRInstruction::And: Result = LHS & RHS; return true;
     case IRInstruction::Or:  Result = LHS | RHS; return true;
     case IRInstruction::Xor: Result = LHS ^ RHS; return true;
-    case IRInstruction::Shl: Result = LHS << RHS; return true;
-    case IRInstruction::Shr: Result = LHS >> RHS; return true;
+    case IRInstruction::Shl:
+      if (RHS < 0 || RHS > 63) return false;
+      Result = static_cast<int64_t>(static_cast<uint64_t>(LHS) << RHS);
+      return true;
+    case IRInstruction::Shr:
+      if (RHS < 0 || RHS > 63) return false;
+      Result = LHS >> RHS;
+      return true;
     case IRInstruction::Lt:  Result = LHS < RHS ? 1 : 0; return true;
     case IRInstruction::Le:  Result = LHS <= RHS ? 1 : 0; return true;
     case IRInstruction::Gt:  Result = LHS > RHS ? 1 : 0; return true;
@@ -954,11 +1293,11 @@ void SCCPPass::visitPhi(IRPhiInst* Phi) {
     Result = meet(Result, IncomingCell);
   }
 
-  // Update phi result
-  LatticeCell& PhiCell = ValueState[Phi->getResult()];
-  if (Result.State != PhiCell.State ||
-      (Result.State == Constant && Result.ConstVal != PhiCell.ConstVal)) {
-    PhiCell = Result;
+  // Only ever move the phi down the lattice, so its users see every change
+  if (Result.State == Constant) {
+    markConstant(Phi->getResult(), Result.ConstVal);
+  } else if (Result.State == Overdefined) {
+    markOverdefined(Phi->getResult());
   }
 }
 
@@ -986,14 +1325,74 @@ void SCCPPass::visitCondBr(IRCondBrInst* Br) {
   }
 
   // Condition is constant - only one edge is executable
-  // For now, mark both edges (full implementation would only mark the taken edge)
-  // This requires mapping labels to blocks
-  for (IRBasicBlock* Succ : Parent->getSuccessors()) {
+  IRValue* Taken = CondCell.ConstVal ? Br->getTrueLabel() : Br->getFalseLabel();
+  if (IRBasicBlock* Succ = getSuccessorForLabel(Parent, Taken)) {
+    markEdgeExecutable(Parent, Succ);
+    markBlockExecutable(Succ);
+  }
+}
+
+void SCCPPass::visitSwitch(IRSwitchInst* Switch) {
+  IRValue* Cond = Switch->getCondition();
+
+  LatticeCell CondCell = Cond->isConstant() ?
+    LatticeCell{Constant, Cond->getConstant()} : ValueState[Cond];
+
+  if (CondCell.State == Undefined) {
+    return;
+  }
+
+  IRBasicBlock* Parent = Switch->getParent();
+
+  if (CondCell.State == Overdefined) {
+    for (IRBasicBlock* Succ : Parent->getSuccessors()) {
+      markEdgeExecutable(Parent, Succ);
+      markBlockExecutable(Succ);
+    }
+    return;
+  }
+
+  // Constant selector - only the matching case (or default) is taken
+  IRValue* Taken = Switch->getDefaultLabel();
+  for (const auto& Case : Switch->getCases()) {
+    if (Case.Value == CondCell.ConstVal) {
+      Taken = Case.Label;
+      break;
+    }
+  }
+  if (IRBasicBlock* Succ = getSuccessorForLabel(Parent, Taken)) {
     markEdgeExecutable(Parent, Succ);
     markBlockExecutable(Succ);
   }
 }
 
+void SCCPPass::visitSelect(IRSelectInst* Sel) {
+  auto GetCell = [&](IRValue* V) {
+    return V->isConstant() ? LatticeCell{Constant, V->getConstant()}
+                           : ValueState[V];
+  };
+
+  LatticeCell CondCell = GetCell(Sel->getCondition());
+  if (CondCell.State == Undefined) {
+    return;
+  }
+
+  // A known condition forwards one operand; otherwise both may flow out
+  LatticeCell Result;
+  if (CondCell.State == Constant) {
+    Result = GetCell(CondCell.ConstVal ? Sel->getTrueValue()
+                                       : Sel->getFalseValue());
+  } else {
+    Result = meet(GetCell(Sel->getTrueValue()), GetCell(Sel->getFalseValue()));
+  }
+
+  if (Result.State == Constant) {
+    markConstant(Sel->getResult(), Result.ConstVal);
+  } else if (Result.State == Overdefined) {
+    markOverdefined(Sel->getResult());
+  }
+}
+
 void SCCPPass::visitInst(IRInstruction* I) {
   if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
     visitBinaryInst(BinOp);
@@ -1003,6 +1402,10 @@ void SCCPPass::visitInst(IRInstruction* I) {
     visitPhi(Phi);
   } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(I)) {
     visitCondBr(CondBr);
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(I)) {
+    visitSwitch(Switch);
+  } else if (auto* Sel = dynamic_cast<IRSelectInst*>(I)) {
+    visitSelect(Sel);
   } else if (auto* Br = dynamic_cast<IRBrInst*>(I)) {
     // Unconditional branch - mark successor executable
     IRBasicBlock* Parent = Br->getParent();
@@ -1010,31 +1413,52 @@ void SCCPPass::visitInst(IRInstruction* I) {
       markEdgeExecutable(Parent, Succ);
       markBlockExecutable(Succ);
     }
-  } else if (auto* Ret = dynamic_cast<IRRetInst*>(I)) {
-    // Return - mark return value overdefined if present
-    if (Ret->hasRetValue() && !Ret->getRetValue()->isConstant()) {
-      markOverdefined(Ret->getRetValue());
+  } else if (auto* Move = dynamic_cast<IRMoveInst*>(I)) {
+    IRValue* Op = Move->getOperand();
+    LatticeCell OpCell = Op->isConstant() ?
+      LatticeCell{Constant, Op->getConstant()} : ValueState[Op];
+    if (OpCell.State == Constant) {
+      markConstant(Move->getResult(), OpCell.ConstVal);
+    } else if (OpCell.State == Overdefined) {
+      markOverdefined(Move->getResult());
     }
+  } else if (IRValue* Def = getDefinedValue(I)) {
+    // Loads, calls and allocas produce values we cannot track
+    markOverdefined(Def);
   }
-  // Other instructions don't affect propagation
 }
 
-void SCCPPass::rewriteFunction(IRFunction* F) {
-  // Replace all uses of constant values with actual constants
-  // This is a simplified version - full implementation would replace operands
+bool SCCPPass::rewriteFunction(IRFunction* F) {
+  bool Changed = false;
 
-  for (auto& BB : F->getBlocks()) {
-    for (auto& Inst : BB->getInstructions()) {
-      // Replace binary instruction operands if they're constant
-      if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
-        IRValue* LHS = BinOp->getLHS();
-        IRValue* RHS = BinOp->getRHS();
+  for (const auto& BB : F->getBlocks()) {
+    if (!ExecutableBlocks.count(BB.get())) continue;
 
-        // If result is constant, we could replace the entire instruction
-        // For now, just record the information
-      }
+    std::vector<IRInstruction*> Dead;
+    for (const auto& Inst : BB->getInstructions()) {
+      IRValue* Def = getDefinedValue(Inst.get());
+      if (!Def) continue;
+
+      auto It = ValueState.find(Def);
+      if (It == ValueState.end() || It->second.State != Constant) continue;
+
+      replaceAllUsesWith(F, Def, F->createConstant(It->second.ConstVal));
+      Dead.push_back(Inst.get());
+      Changed = true;
+    }
+    for (IRInstruction* I : Dead) {
+      BB->removeInstruction(I);
+    }
+  }
+
+  for (const auto& BB : F->getBlocks()) {
+    if (ExecutableBlocks.count(BB.get())) {
+      Changed |= foldConstantTerminator(BB.get());
     }
   }
+
+  Changed |= removeUnreachableBlocks(F);
+  return Changed;
 }
 
 bool SCCPPass::run(IRFunction* F, AnalysisManager& AM) {
@@ -1047,9 +1471,24 @@ bool SCCPPass::run(IRFunction* F, AnalysisManager& AM) {
   SSAWorkList.clear();
   CFGWorkList.clear();
 
+  Users.clear();
+
   // Mark entry block as executable
   if (F->getBlocks().empty()) return false;
 
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      for (IRValue* Op : getOperands(Inst.get())) {
+        Users[Op].push_back(Inst.get());
+      }
+    }
+  }
+
+  // Arguments can be anything
+  for (IRValue* Param : F->getParameters()) {
+    markOverdefined(Param);
+  }
+
   IRBasicBlock* Entry = F->getBlocks()[0].get();
   markBlockExecutable(Entry);
 
@@ -1085,12 +1524,7 @@ bool SCCPPass::run(IRFunction* F, AnalysisManager& AM) {
   }
 
   // Rewrite the function based on discovered constants
-  bool Changed = false;
-
-  // For now, just report what we found
-  // Full implementation would replace values and remove dead code
-
-  return Changed;
+  return rewriteFunction(F);
 }
 
 // ===----------------------------------------------------------------------===
@@ -1099,13 +1533,24 @@ bool SCCPPass::run(IRFunction* F, AnalysisManager& AM) {
 
 bool GVNPass::Expression::operator<(const Expression& Other) const {
   if (Op != Other.Op) return Op < Other.Op;
+  if (Callee != Other.Callee) return Callee < Other.Callee;
   if (Operands.size() != Other.Operands.size()) {
     return Operands.size() < Other.Operands.size();
   }
   for (size_t i = 0; i < Operands.size(); ++i) {
-    if (Operands[i] != Other.Operands[i]) {
-      return Operands[i] < Other.Operands[i];
+    IRValue* A = Operands[i];
+    IRValue* B = Other.Operands[i];
+    if (A == B) continue;
+
+    // Each use of a literal gets its own constant, so compare by value
+    if (A->isConstant() != B->isConstant()) return A->isConstant();
+    if (A->isConstant()) {
+      if (A->getConstant() != B->getConstant()) {
+        return A->getConstant() < B->getConstant();
+      }
+      continue;
     }
+    return A < B;
   }
   return false;
 }
@@ -1121,6 +1566,9 @@ GVNPass::Expression GVNPass::createExpression(IRInstruction* I) {
     Expr.Operands.push_back(UnOp->getOperand());
   } else if (auto* Load = dynamic_cast<IRLoadInst*>(I)) {
     Expr.Operands.push_back(Load->getPtr());
+  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    Expr.Callee = Call->getFuncName();
+    Expr.Operands = Call->getArgs();
   }
 
   return Expr;
@@ -1135,28 +1583,7 @@ IRValue* GVNPass::findExistingComputation(const Expression& Expr) {
 }
 
 void GVNPass::replaceAllUsesWith(IRFunction* F, IRValue* Old, IRValue* New) {
-  // Replace all uses of Old with New in the function
-  for (auto& BB : F->getBlocks()) {
-    for (auto& Inst : BB->getInstructions()) {
-      if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
-        if (BinOp->getLHS() == Old) BinOp->setLHS(New);
-        if (BinOp->getRHS() == Old) BinOp->setRHS(New);
-      } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(Inst.get())) {
-        if (UnOp->getOperand() == Old) UnOp->setOperand(New);
-      } else if (auto* Store = dynamic_cast<IRStoreInst*>(Inst.get())) {
-        if (Store->getValue() == Old) Store->setValue(New);
-        if (Store->getPtr() == Old) Store->setPtr(New);
-      } else if (auto* Ret = dynamic_cast<IRRetInst*>(Inst.get())) {
-        if (Ret->hasRetValue() && Ret->getRetValue() == Old) {
-          Ret->setRetValue(New);
-        }
-      } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(Inst.get())) {
-        if (CondBr->getCondition() == Old) CondBr->setCondition(New);
-      } else if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
-        Phi->replaceIncomingValue(Old, New);
-      }
-    }
-  }
+  yac::replaceAllUsesWith(F, Old, New);
 }
 
 bool GVNPass::run(IRFunction* F, AnalysisManager& AM) {
@@ -1169,10 +1596,21 @@ bool GVNPass::run(IRFunction* F, AnalysisManager& AM) {
   // Simple GVN: walk through all instructions and look for redundant computations
   // This is a basic local GVN (within basic blocks)
 
-  for (auto& BB : F->getBlocks()) {
-    // Clear expression map at start of each block (local GVN)
-    ExpressionMap.clear();
-
+  // Stack slots of this function, which no callee can read
+  std::set<IRValue*> Frame;
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      if (auto* Alloca = dynamic_cast<IRAllocaInst*>(Inst.get())) {
+        Frame.insert(Alloca->getResult());
+      }
+    }
+  }
+
+  for (auto& BB : F->getBlocks()) {
+    // Clear expression map at start of each block (local GVN)
+    ExpressionMap.clear();
+    ReadOnlyCalls.clear();
+
     for (auto& Inst : BB->getInstructions()) {
       // Only handle pure instructions (no side effects)
       if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
@@ -1197,6 +1635,26 @@ bool GVNPass::run(IRFunction* F, AnalysisManager& AM) {
         } else {
           ExpressionMap[Expr] = UnOp->getResult();
         }
+      } else if (auto* Store = dynamic_cast<IRStoreInst*>(Inst.get())) {
+        if (!Frame.count(Store->getPtr())) ReadOnlyCalls.clear();
+      } else if (auto* Call = dynamic_cast<IRCallInst*>(Inst.get())) {
+        if (!Call->onlyReadsMemory()) {
+          ReadOnlyCalls.clear();
+          continue;
+        }
+        if (!Call->getResult()) continue;
+
+        // Same callee, same arguments, same memory: same result
+        auto& Table = Call->hasAttr(FA_ReadNone) ? ExpressionMap
+                                                 : ReadOnlyCalls;
+        Expression Expr = createExpression(Inst.get());
+        auto It = Table.find(Expr);
+        if (It != Table.end()) {
+          Replacements[Call->getResult()] = It->second;
+          Changed = true;
+        } else {
+          Table[Expr] = Call->getResult();
+        }
       }
       // Loads are tricky - only safe to eliminate if no stores in between
       // Skip for now
@@ -1211,6 +1669,313 @@ bool GVNPass::run(IRFunction* F, AnalysisManager& AM) {
   return Changed;
 }
 
+// ===----------------------------------------------------------------------===
+// Reassociate Pass
+// ===----------------------------------------------------------------------===
+
+static bool isAssociativeOp(IRInstruction::Opcode Op) {
+  return Op == IRInstruction::Add || Op == IRInstruction::Mul ||
+         Op == IRInstruction::And || Op == IRInstruction::Or ||
+         Op == IRInstruction::Xor;
+}
+
+static bool isFloatValue(IRValue* V) {
+  return V->getType() && V->getType()->isFloatType();
+}
+
+static int64_t foldAssociative(IRInstruction::Opcode Op, int64_t A, int64_t B) {
+  // Wrap like the hardware does instead of relying on signed overflow
+  switch (Op) {
+    case IRInstruction::Add:
+      return static_cast<int64_t>(static_cast<uint64_t>(A) +
+                                  static_cast<uint64_t>(B));
+    case IRInstruction::Mul:
+      return static_cast<int64_t>(static_cast<uint64_t>(A) *
+                                  static_cast<uint64_t>(B));
+    case IRInstruction::And: return A & B;
+    case IRInstruction::Or:  return A | B;
+    case IRInstruction::Xor: return A ^ B;
+    default: return 0;
+  }
+}
+
+static bool isIdentityConstant(IRInstruction::Opcode Op, int64_t C) {
+  switch (Op) {
+    case IRInstruction::Add:
+    case IRInstruction::Or:
+    case IRInstruction::Xor: return C == 0;
+    case IRInstruction::Mul: return C == 1;
+    case IRInstruction::And: return C == -1;
+    default: return false;
+  }
+}
+
+unsigned ReassociatePass::getRank(IRValue* V, Loop* L) {
+  if (V->isConstant()) return RankConstant;
+  if (!V->isTemp()) return RankArgument;
+
+  auto It = DefMap.find(V);
+  if (It == DefMap.end()) return RankArgument;
+
+  IRInstruction* Def = It->second;
+  if (!L || !L->contains(Def->getParent())) return RankInvariant;
+
+  auto Key = std::make_pair(L, V);
+  auto Cached = RankCache.find(Key);
+  if (Cached != RankCache.end()) return Cached->second;
+
+  // Pure computations on invariant operands are invariant even before
+  // LICM has moved them out
+  unsigned R = RankVariant;
+  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Def)) {
+    if (BinOp->getOpcode() != IRInstruction::Div &&
+        BinOp->getOpcode() != IRInstruction::Mod &&
+        getRank(BinOp->getLHS(), L) <= RankInvariant &&
+        getRank(BinOp->getRHS(), L) <= RankInvariant) {
+      R = RankInvariant;
+    }
+  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(Def)) {
+    if (getRank(UnOp->getOperand(), L) <= RankInvariant) {
+      R = RankInvariant;
+    }
+  }
+
+  RankCache[Key] = R;
+  return R;
+}
+
+void ReassociatePass::addUses(IRInstruction* I) {
+  if (IRValue* V = getDefinedValue(I)) {
+    DefMap[V] = I;
+  }
+  for (IRValue* Op : getOperands(I)) {
+    ++UseCount[Op];
+  }
+}
+
+void ReassociatePass::dropUses(IRInstruction* I) {
+  if (IRValue* V = getDefinedValue(I)) {
+    DefMap.erase(V);
+  }
+  for (IRValue* Op : getOperands(I)) {
+    --UseCount[Op];
+  }
+}
+
+bool ReassociatePass::isTreeNode(IRValue* V, IRInstruction::Opcode Op,
+                                 IRBasicBlock* BB) {
+  if (!V->isTemp() || UseCount[V] != 1) return false;
+
+  auto It = DefMap.find(V);
+  if (It == DefMap.end()) return false;
+
+  auto* BinOp = dynamic_cast<IRBinaryInst*>(It->second);
+  return BinOp && BinOp->getOpcode() == Op && BinOp->getParent() == BB &&
+         !isFloatValue(V);
+}
+
+void ReassociatePass::linearize(IRBinaryInst* Root, IRInstruction::Opcode Op,
+                                std::vector<IRValue*>& Leaves,
+                                std::vector<IRInstruction*>& Nodes) {
+  for (IRValue* Operand : {Root->getLHS(), Root->getRHS()}) {
+    if (isTreeNode(Operand, Op, Root->getParent())) {
+      auto* Node = static_cast<IRBinaryInst*>(DefMap[Operand]);
+      Nodes.push_back(Node);
+      linearize(Node, Op, Leaves, Nodes);
+    } else {
+      Leaves.push_back(Operand);
+    }
+  }
+}
+
+IRValue* ReassociatePass::emitChain(IRInstruction::Opcode Op,
+                                    const std::vector<IRValue*>& Ops,
+                                    IRInstruction* Pos, Type* Ty) {
+  IRValue* Acc = Ops[0];
+  for (size_t i = 1; i < Ops.size(); ++i) {
+    IRValue* Result = CurrentFunc->createValue(
+        IRValue::VK_Temp, "ra" + std::to_string(NumCreated++), Ty);
+    auto Inst = std::make_unique<IRBinaryInst>(Op, Result, Acc, Ops[i]);
+    addUses(Inst.get());
+    Pos->getParent()->insertBefore(std::move(Inst), Pos);
+    Acc = Result;
+  }
+  return Acc;
+}
+
+bool ReassociatePass::factorMultiplies(IRBinaryInst* Root,
+                                       std::vector<IRValue*>& Leaves,
+                                       std::vector<IRInstruction*>& Dead,
+                                       Loop* L) {
+  // Group single-use "mul X, C" leaves by their constant
+  std::map<int64_t, std::vector<size_t>> Groups;
+  for (size_t i = 0; i < Leaves.size(); ++i) {
+    IRValue* Leaf = Leaves[i];
+    if (!Leaf->isTemp() || UseCount[Leaf] != 1) continue;
+
+    auto* Mul = dynamic_cast<IRBinaryInst*>(DefMap[Leaf]);
+    if (!Mul || Mul->getOpcode() != IRInstruction::Mul) continue;
+
+    if (Mul->getRHS()->isConstant()) {
+      Groups[Mul->getRHS()->getConstant()].push_back(i);
+    } else if (Mul->getLHS()->isConstant()) {
+      Groups[Mul->getLHS()->getConstant()].push_back(i);
+    }
+  }
+
+  std::set<size_t> Factored;
+  std::vector<IRValue*> Products;
+  Type* Ty = Root->getResult()->getType();
+
+  for (const auto& Group : Groups) {
+    if (Group.second.size() < 2) continue;
+
+    std::vector<IRValue*> Terms;
+    for (size_t Idx : Group.second) {
+      auto* Mul = static_cast<IRBinaryInst*>(DefMap[Leaves[Idx]]);
+      Terms.push_back(Mul->getRHS()->isConstant() ? Mul->getLHS()
+                                                  : Mul->getRHS());
+      Dead.push_back(Mul);
+      Factored.insert(Idx);
+    }
+
+    std::stable_sort(Terms.begin(), Terms.end(),
+                     [&](IRValue* A, IRValue* B) {
+                       return getRank(A, L) < getRank(B, L);
+                     });
+    IRValue* Sum = emitChain(IRInstruction::Add, Terms, Root, Ty);
+    Products.push_back(emitChain(
+        IRInstruction::Mul, {Sum, CurrentFunc->createConstant(Group.first)},
+        Root, Ty));
+  }
+
+  if (Factored.empty()) return false;
+
+  std::vector<IRValue*> Remaining;
+  for (size_t i = 0; i < Leaves.size(); ++i) {
+    if (!Factored.count(i)) Remaining.push_back(Leaves[i]);
+  }
+  Remaining.insert(Remaining.end(), Products.begin(), Products.end());
+  Leaves = Remaining;
+  return true;
+}
+
+bool ReassociatePass::rewriteTree(IRBinaryInst* Root) {
+  IRInstruction::Opcode Op = Root->getOpcode();
+  Loop* L = LI->getLoopFor(Root->getParent());
+
+  std::vector<IRValue*> Leaves;
+  std::vector<IRInstruction*> Nodes;
+  linearize(Root, Op, Leaves, Nodes);
+
+  std::vector<IRInstruction*> Dead = Nodes;
+  bool ConstantLast = Leaves.back()->isConstant();
+  bool Factored = Op == IRInstruction::Add &&
+                  factorMultiplies(Root, Leaves, Dead, L);
+  if (!Factored && Leaves.size() < 3) return false;
+
+  // Fold every constant leaf into one
+  std::vector<IRValue*> Vars;
+  int64_t C = 0;
+  unsigned NumConstants = 0;
+  for (IRValue* Leaf : Leaves) {
+    if (Leaf->isConstant()) {
+      C = NumConstants++ ? foldAssociative(Op, C, Leaf->getConstant())
+                         : Leaf->getConstant();
+    } else {
+      Vars.push_back(Leaf);
+    }
+  }
+
+  std::vector<IRValue*> Ops = Vars;
+  std::stable_sort(Ops.begin(), Ops.end(), [&](IRValue* A, IRValue* B) {
+    return getRank(A, L) < getRank(B, L);
+  });
+
+  // Already canonical
+  if (!Factored && Ops == Vars && NumConstants <= 1 &&
+      (NumConstants == 0 || ConstantLast)) {
+    return false;
+  }
+
+  // The constant goes last so it ends up as an immediate operand
+  if (NumConstants && (Ops.empty() || !isIdentityConstant(Op, C))) {
+    Ops.push_back(CurrentFunc->createConstant(C));
+  }
+
+  if (Ops.size() == 1) {
+    yac::replaceAllUsesWith(CurrentFunc, Root->getResult(), Ops[0]);
+    UseCount[Ops[0]] += UseCount[Root->getResult()];
+    UseCount[Root->getResult()] = 0;
+    Dead.push_back(Root);
+  } else {
+    std::vector<IRValue*> Prefix(Ops.begin(), Ops.end() - 1);
+    IRValue* LHS = emitChain(Op, Prefix, Root, Root->getResult()->getType());
+    dropUses(Root);
+    Root->setLHS(LHS);
+    Root->setRHS(Ops.back());
+    addUses(Root);
+  }
+
+  for (IRInstruction* I : Dead) {
+    dropUses(I);
+    Erased.insert(I);
+    I->getParent()->removeInstruction(I);
+  }
+
+  return true;
+}
+
+bool ReassociatePass::run(IRFunction* F, AnalysisManager& AM) {
+  CurrentFunc = F;
+  LI = &AM.get<LoopInfo>();
+  RankCache.clear();
+  NumCreated = 0;
+
+  // Last user seen of each value, only needed to pick the roots
+  std::map<IRValue*, IRInstruction*> UserOf;
+  DefMap.clear();
+  UseCount.clear();
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      addUses(Inst.get());
+      for (IRValue* Op : getOperands(Inst.get())) {
+        UserOf[Op] = Inst.get();
+      }
+    }
+  }
+
+  // Roots are associative instructions that are not folded into a larger
+  // tree of the same operation
+  std::vector<IRBinaryInst*> Roots;
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get());
+      if (!BinOp || !isAssociativeOp(BinOp->getOpcode()) ||
+          isFloatValue(BinOp->getResult())) {
+        continue;
+      }
+      auto* User = dynamic_cast<IRBinaryInst*>(UserOf[BinOp->getResult()]);
+      if (!User || User->getOpcode() != BinOp->getOpcode() ||
+          !isTreeNode(BinOp->getResult(), BinOp->getOpcode(), BB.get()) ||
+          User->getParent() != BB.get()) {
+        Roots.push_back(BinOp);
+      }
+    }
+  }
+
+  bool Changed = false;
+  Erased.clear();
+  for (IRBinaryInst* Root : Roots) {
+    // Factoring may have deleted a root that fed a later tree
+    if (Erased.count(Root)) continue;
+
+    if (rewriteTree(Root)) Changed = true;
+  }
+
+  return Changed;
+}
+
 // ===----------------------------------------------------------------------===
 // LICM (Loop Invariant Code Motion) Pass
 // ===----------------------------------------------------------------------===
@@ -1227,13 +1992,22 @@ bool LICMPass::isLoopInvariant(IRInstruction* I, Loop* L,
     IRValue* RHS = BinOp->getRHS();
 
     bool LHSInvariant = LHS->isConstant() || LoopInvariants.count(LHS) ||
-                        !L->contains(LHS->getType() ? nullptr : nullptr);  // Simplified check
-    bool RHSInvariant = RHS->isConstant() || LoopInvariants.count(RHS);
+                        !LoopDefs.count(LHS);
+    bool RHSInvariant = RHS->isConstant() || LoopInvariants.count(RHS) ||
+                        !LoopDefs.count(RHS);
 
     return LHSInvariant && RHSInvariant;
   } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(I)) {
     IRValue* Op = UnOp->getOperand();
-    return Op->isConstant() || LoopInvariants.count(Op);
+    return Op->isConstant() || LoopInvariants.count(Op) || !LoopDefs.count(Op);
+  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    for (IRValue* Arg : Call->getArgs()) {
+      if (!Arg->isConstant() && !LoopInvariants.count(Arg) &&
+          LoopDefs.count(Arg)) {
+        return false;
+      }
+    }
+    return true;
   }
 
   // Other instructions: assume not invariant for safety
@@ -1250,9 +2024,13 @@ bool LICMPass::isSafeToHoist(IRInstruction* I, Loop* L) {
     return true;
   }
 
+  // Calls only when FunctionAttrs proved they may run unconditionally
+  if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    return Call->hasAttr(FA_Speculatable);
+  }
+
   // Don't hoist loads (alias analysis needed)
   // Don't hoist stores (side effects)
-  // Don't hoist calls (side effects)
   return false;
 }
 
@@ -1275,8 +2053,8 @@ bool LICMPass::run(IRFunction* F, AnalysisManager& AM) {
 
   bool Changed = false;
 
-  // Process each loop
-  for (const auto& L : LI.getTopLevelLoops()) {
+  // Process inner loops first, so outer loops can hoist further
+  for (Loop* L : LI.getLoopsInnermostFirst()) {
     // Need a preheader to hoist to
     if (!L->getPreheader()) {
       continue;
@@ -1284,6 +2062,16 @@ bool LICMPass::run(IRFunction* F, AnalysisManager& AM) {
 
     IRBasicBlock* Preheader = L->getPreheader();
 
+    // Values computed inside the loop; everything else is invariant
+    LoopDefs.clear();
+    for (IRBasicBlock* BB : L->getBlocks()) {
+      for (const auto& Inst : BB->getInstructions()) {
+        if (IRValue* V = getDefinedValue(Inst.get())) {
+          LoopDefs.insert(V);
+        }
+      }
+    }
+
     // Track loop-invariant values and instructions to hoist
     std::set<IRValue*> LoopInvariants;
     std::vector<IRInstruction*> ToHoist;
@@ -1297,32 +2085,18 @@ bool LICMPass::run(IRFunction* F, AnalysisManager& AM) {
       for (IRBasicBlock* BB : L->getBlocks()) {
         for (const auto& Inst : BB->getInstructions()) {
           // Skip if already determined to be invariant
-          if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get())) {
-            if (LoopInvariants.count(BinOp->getResult())) {
-              continue;
-            }
-
-            // Check if invariant
-            if (isLoopInvariant(Inst.get(), L.get(), LoopInvariants)) {
-              if (isSafeToHoist(Inst.get(), L.get())) {
-                LoopInvariants.insert(BinOp->getResult());
-                ToHoist.push_back(Inst.get());
-                LocalChanged = true;
-                Changed = true;
-              }
-            }
-          } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(Inst.get())) {
-            if (LoopInvariants.count(UnOp->getResult())) {
-              continue;
-            }
+          IRValue* Result = getDefinedValue(Inst.get());
+          if (!Result || LoopInvariants.count(Result)) {
+            continue;
+          }
 
-            if (isLoopInvariant(Inst.get(), L.get(), LoopInvariants)) {
-              if (isSafeToHoist(Inst.get(), L.get())) {
-                LoopInvariants.insert(UnOp->getResult());
-                ToHoist.push_back(Inst.get());
-                LocalChanged = true;
-                Changed = true;
-              }
+          // Check if invariant
+          if (isLoopInvariant(Inst.get(), L, LoopInvariants)) {
+            if (isSafeToHoist(Inst.get(), L)) {
+              LoopInvariants.insert(Result);
+              ToHoist.push_back(Inst.get());
+              LocalChanged = true;
+              Changed = true;
             }
           }
         }
@@ -1338,6 +2112,177 @@ bool LICMPass::run(IRFunction* F, AnalysisManager& AM) {
   return Changed;
 }
 
+// ===----------------------------------------------------------------------===
+// GCM Pass
+// ===----------------------------------------------------------------------===
+
+bool GCMPass::isPinned(IRInstruction* I) const {
+  IRBasicBlock* BB = I->getParent();
+  if (!DT->getNode(BB) || !DT->getNode(BB)->DFSIn) return true;  // Unreachable
+
+  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+    // Moving a division onto a path that did not run it may add a trap
+    if (BinOp->getOpcode() == IRInstruction::Div ||
+        BinOp->getOpcode() == IRInstruction::Mod) {
+      IRValue* RHS = BinOp->getRHS();
+      return !RHS->isConstant() || RHS->getConstant() == 0 ||
+             RHS->getConstant() == -1;
+    }
+    return false;
+  }
+  if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    return !Call->getResult() || !Call->hasAttr(FA_Speculatable);
+  }
+  return !dynamic_cast<IRUnaryInst*>(I) && !dynamic_cast<IRSelectInst*>(I) &&
+         !dynamic_cast<IRMoveInst*>(I);
+}
+
+IRBasicBlock* GCMPass::findLCA(IRBasicBlock* A, IRBasicBlock* B) const {
+  while (DomDepth.at(A) > DomDepth.at(B)) A = DT->getIDom(A);
+  while (DomDepth.at(B) > DomDepth.at(A)) B = DT->getIDom(B);
+  while (A != B) {
+    A = DT->getIDom(A);
+    B = DT->getIDom(B);
+  }
+  return A;
+}
+
+IRBasicBlock* GCMPass::scheduleEarly(IRInstruction* I) {
+  if (isPinned(I)) return I->getParent();
+
+  auto It = Early.find(I);
+  if (It != Early.end()) return It->second;
+
+  // The deepest block holding an operand; arguments and constants are
+  // available from the entry
+  IRBasicBlock* Best = Entry;
+  for (IRValue* Op : getOperands(I)) {
+    auto DefIt = Defs.find(Op);
+    if (DefIt == Defs.end()) continue;
+    IRBasicBlock* OpBB = scheduleEarly(DefIt->second);
+    if (DomDepth[OpBB] > DomDepth[Best]) Best = OpBB;
+  }
+
+  Early[I] = Best;
+  return Best;
+}
+
+IRBasicBlock* GCMPass::scheduleLate(IRInstruction* I) {
+  if (isPinned(I)) return I->getParent();
+
+  auto It = Late.find(I);
+  if (It != Late.end()) return It->second;
+
+  // Every use must be dominated: a phi uses the value at the end of the
+  // incoming block, anything else wherever it ends up itself
+  IRValue* Result = getDefinedValue(I);
+  IRBasicBlock* LCA = nullptr;
+  auto AddUse = [&](IRBasicBlock* UseBB) {
+    if (!DT->getNode(UseBB) || !DT->getNode(UseBB)->DFSIn) return;
+    LCA = LCA ? findLCA(LCA, UseBB) : UseBB;
+  };
+
+  for (IRInstruction* User : Users[Result]) {
+    if (auto* Phi = dynamic_cast<IRPhiInst*>(User)) {
+      for (const auto& Entry : Phi->getIncomings()) {
+        if (Entry.Value == Result) AddUse(Entry.Block);
+      }
+    } else {
+      AddUse(scheduleLate(User));
+    }
+  }
+
+  // Unused values are left for DCE
+  IRBasicBlock* Best = I->getParent();
+  if (LCA) {
+    // Walk up to the earliest legal block, trading lateness only for a
+    // shallower loop
+    Best = LCA;
+    IRBasicBlock* EarlyBB = Early[I];
+    for (IRBasicBlock* BB = LCA; BB != EarlyBB;) {
+      BB = DT->getIDom(BB);
+      if (!BB) break;
+      if (LI->getLoopDepth(BB) < LI->getLoopDepth(Best)) Best = BB;
+    }
+  }
+
+  Late[I] = Best;
+  Order.push_back(I);
+  return Best;
+}
+
+bool GCMPass::run(IRFunction* F, AnalysisManager& AM) {
+  if (F->getBlocks().empty()) return false;
+
+  DT = &AM.get<DominatorTree>();
+  LI = &AM.get<LoopInfo>();
+  Entry = F->getBlocks()[0].get();
+
+  DomDepth.clear();
+  Defs.clear();
+  Users.clear();
+  Early.clear();
+  Late.clear();
+  Order.clear();
+
+  std::vector<DominatorTree::Node*> Stack = {DT->getRoot()};
+  DomDepth[Entry] = 0;
+  while (!Stack.empty()) {
+    DominatorTree::Node* N = Stack.back();
+    Stack.pop_back();
+    for (DominatorTree::Node* Child : N->Children) {
+      DomDepth[Child->Block] = DomDepth[N->Block] + 1;
+      Stack.push_back(Child);
+    }
+  }
+
+  std::vector<IRInstruction*> Floating;
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      if (IRValue* Def = getDefinedValue(Inst.get())) {
+        Defs[Def] = Inst.get();
+      }
+      for (IRValue* Op : getOperands(Inst.get())) {
+        Users[Op].push_back(Inst.get());
+      }
+      if (!isPinned(Inst.get())) Floating.push_back(Inst.get());
+    }
+  }
+
+  for (IRInstruction* I : Floating) scheduleEarly(I);
+  for (IRInstruction* I : Floating) scheduleLate(I);
+
+  // Users were scheduled first, so each moved instruction can go in front
+  // of its first user in the new block, or at the end if there is none
+  bool Changed = false;
+  for (IRInstruction* I : Order) {
+    IRBasicBlock* To = Late[I];
+    IRBasicBlock* From = I->getParent();
+    if (To == From) continue;
+
+    IRValue* Result = getDefinedValue(I);
+    IRInstruction* Pos = nullptr;
+    for (const auto& Inst : To->getInstructions()) {
+      if (dynamic_cast<IRPhiInst*>(Inst.get())) continue;
+      std::vector<IRValue*> Ops = getOperands(Inst.get());
+      if (std::find(Ops.begin(), Ops.end(), Result) != Ops.end()) {
+        Pos = Inst.get();
+        break;
+      }
+    }
+
+    auto Moved = From->removeInstruction(I);
+    if (Pos) {
+      To->insertBefore(std::move(Moved), Pos);
+    } else {
+      To->insertBeforeTerminator(std::move(Moved));
+    }
+    Changed = true;
+  }
+
+  return Changed;
+}
+
 // ===----------------------------------------------------------------------===
 // Inlining Pass
 // ===----------------------------------------------------------------------===
@@ -1443,20 +2388,20 @@ bool LoopUnrollPass::run(IRFunction* F, AnalysisManager& AM) {
   bool Changed = false;
 
   // Try to unroll each loop
-  for (const auto& L : LI.getTopLevelLoops()) {
-    if (canUnroll(L.get())) {
+  for (Loop* L : LI.getLoopsInnermostFirst()) {
+    if (canUnroll(L)) {
       // Check for constant trip count
       int64_t TripCount;
-      if (getTripCount(L.get(), TripCount)) {
+      if (getTripCount(L, TripCount)) {
         // Full unroll if small trip count
         if (TripCount > 0 && TripCount <= 8) {
-          if (unrollLoop(L.get(), static_cast<unsigned>(TripCount))) {
+          if (unrollLoop(L, static_cast<unsigned>(TripCount))) {
             Changed = true;
           }
         }
       } else {
         // Partial unroll
-        if (unrollLoop(L.get(), UnrollFactor)) {
+        if (unrollLoop(L, UnrollFactor)) {
           Changed = true;
         }
       }
@@ -1466,4 +2411,265 @@ bool LoopUnrollPass::run(IRFunction* F, AnalysisManager& AM) {
   return Changed;
 }
 
+// ===----------------------------------------------------------------------===
+// Loop Unswitching Pass
+// ===----------------------------------------------------------------------===
+
+static size_t getLoopSize(Loop* L) {
+  size_t Size = 0;
+  for (IRBasicBlock* BB : L->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      if (!dynamic_cast<IRLabelInst*>(Inst.get())) {
+        ++Size;
+      }
+    }
+  }
+  return Size;
+}
+
+bool LoopUnswitchPass::isInvariant(IRValue* V, Loop* L,
+                                   std::vector<IRInstruction*>& Chain) {
+  if (V->isConstant() || !V->isTemp()) {
+    return true;
+  }
+
+  auto It = DefMap.find(V);
+  if (It == DefMap.end() || !L->contains(It->second->getParent())) {
+    return true;
+  }
+
+  IRInstruction* Def = It->second;
+  if (std::find(Chain.begin(), Chain.end(), Def) != Chain.end()) {
+    return true;
+  }
+
+  // Only pure instructions can be moved to the preheader. Division is
+  // excluded because the loop may never have executed it.
+  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(Def)) {
+    if (BinOp->getOpcode() == IRInstruction::Div ||
+        BinOp->getOpcode() == IRInstruction::Mod) {
+      return false;
+    }
+    if (!isInvariant(BinOp->getLHS(), L, Chain) ||
+        !isInvariant(BinOp->getRHS(), L, Chain)) {
+      return false;
+    }
+  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(Def)) {
+    if (!isInvariant(UnOp->getOperand(), L, Chain)) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+
+  // Operands first, so the chain can be hoisted in order
+  Chain.push_back(Def);
+  return true;
+}
+
+IRCondBrInst* LoopUnswitchPass::findCandidate(
+    Loop* L, std::vector<IRInstruction*>& Chain) {
+  for (const auto& BB : L->getHeader()->getParent()->getBlocks()) {
+    if (!L->contains(BB.get())) continue;
+
+    auto* Br = dynamic_cast<IRCondBrInst*>(BB->getTerminator());
+    if (!Br || Br->getCondition()->isConstant()) continue;
+
+    // Exit tests are left alone; unswitching pays off when both sides
+    // stay in the loop
+    IRBasicBlock* TrueBB = getSuccessorForLabel(BB.get(), Br->getTrueLabel());
+    IRBasicBlock* FalseBB = getSuccessorForLabel(BB.get(), Br->getFalseLabel());
+    if (!TrueBB || !FalseBB || TrueBB == FalseBB ||
+        !L->contains(TrueBB) || !L->contains(FalseBB)) {
+      continue;
+    }
+
+    Chain.clear();
+    if (isInvariant(Br->getCondition(), L, Chain)) {
+      return Br;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<IRValue*> LoopUnswitchPass::getLiveOuts(Loop* L) {
+  std::vector<IRValue*> LiveOuts;
+  std::set<IRValue*> Seen;
+
+  for (const auto& BB : L->getHeader()->getParent()->getBlocks()) {
+    if (L->contains(BB.get())) continue;
+
+    for (const auto& Inst : BB->getInstructions()) {
+      std::vector<IRValue*> Ops;
+      if (auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get())) {
+        // Values flowing along exit edges are handled by the cloner
+        for (const auto& Entry : Phi->getIncomings()) {
+          if (!L->contains(Entry.Block)) {
+            Ops.push_back(Entry.Value);
+          }
+        }
+      } else {
+        Ops = getOperands(Inst.get());
+      }
+
+      for (IRValue* Op : Ops) {
+        auto It = DefMap.find(Op);
+        if (It != DefMap.end() && L->contains(It->second->getParent()) &&
+            Seen.insert(Op).second) {
+          LiveOuts.push_back(Op);
+        }
+      }
+    }
+  }
+
+  return LiveOuts;
+}
+
+void LoopUnswitchPass::foldBranch(IRCondBrInst* Br, bool Taken) {
+  IRBasicBlock* BB = Br->getParent();
+  IRValue* TakenLabel = Taken ? Br->getTrueLabel() : Br->getFalseLabel();
+  IRValue* DeadLabel = Taken ? Br->getFalseLabel() : Br->getTrueLabel();
+
+  removeEdge(BB, getSuccessorForLabel(BB, DeadLabel));
+  BB->removeInstruction(Br);
+  BB->addInstruction(std::make_unique<IRBrInst>(TakenLabel));
+}
+
+bool LoopUnswitchPass::unswitchLoop(IRFunction* F, Loop* L, IRCondBrInst* Br,
+                                    const std::vector<IRInstruction*>& Chain) {
+  IRBasicBlock* Header = L->getHeader();
+  IRBasicBlock* Preheader = L->getPreheader();
+  if (!Preheader || Preheader->getNumSuccessors() != 1) return false;
+
+  auto* PreheaderBr = dynamic_cast<IRBrInst*>(Preheader->getTerminator());
+  if (!PreheaderBr) return false;
+
+  // Values used after the loop need a merge phi once there are two copies
+  // of the loop. Keep that simple: one exit block, reached only from L.
+  std::vector<IRValue*> LiveOuts = getLiveOuts(L);
+  IRBasicBlock* Exit = nullptr;
+  if (!LiveOuts.empty()) {
+    std::set<IRBasicBlock*> Exits;
+    for (IRBasicBlock* BB : L->getBlocks()) {
+      for (IRBasicBlock* Succ : BB->getSuccessors()) {
+        if (!L->contains(Succ)) Exits.insert(Succ);
+      }
+    }
+    if (Exits.size() != 1) return false;
+    Exit = *Exits.begin();
+    for (IRBasicBlock* Pred : Exit->getPredecessors()) {
+      if (!L->contains(Pred)) return false;
+    }
+  }
+
+  // Compute the condition once, before the loop
+  for (IRInstruction* I : Chain) {
+    auto Inst = I->getParent()->removeInstruction(I);
+    Preheader->insertBeforeTerminator(std::move(Inst));
+  }
+
+  // Copy the loop in layout order so the output is deterministic
+  std::vector<IRBasicBlock*> LoopBlocks;
+  for (const auto& BB : F->getBlocks()) {
+    if (L->contains(BB.get())) LoopBlocks.push_back(BB.get());
+  }
+
+  std::string Suffix = "_us" + std::to_string(NumUnswitched++);
+  CloneMap VMap;
+  std::vector<IRBasicBlock*> NewBlocks =
+      cloneBlocks(F, LoopBlocks, Suffix, VMap);
+  std::set<IRBasicBlock*> NewBlockSet(NewBlocks.begin(), NewBlocks.end());
+
+  // Preheader picks a version: original when true, copy when false
+  IRBasicBlock* NewHeader = VMap.lookup(Header);
+  IRValue* HeaderLabel = PreheaderBr->getTarget();
+  Preheader->removeInstruction(PreheaderBr);
+  Preheader->addInstruction(std::make_unique<IRCondBrInst>(
+      Br->getCondition(), HeaderLabel, VMap.Labels[NewHeader]));
+  Preheader->addSuccessor(NewHeader);
+
+  // Merge live-out values in the exit block
+  for (IRValue* V : LiveOuts) {
+    IRValue* Merged = F->createValue(IRValue::VK_Temp,
+                                     V->getName() + Suffix + "_merge",
+                                     V->getType());
+    auto Phi = std::make_unique<IRPhiInst>(Merged);
+    for (IRBasicBlock* Pred : Exit->getPredecessors()) {
+      Phi->addIncoming(NewBlockSet.count(Pred) ? VMap.lookup(V) : V, Pred);
+    }
+
+    for (const auto& BB : F->getBlocks()) {
+      if (L->contains(BB.get()) || NewBlockSet.count(BB.get())) continue;
+      for (const auto& Inst : BB->getInstructions()) {
+        if (BB.get() == Exit && dynamic_cast<IRPhiInst*>(Inst.get())) {
+          continue;
+        }
+        replaceUsesInInstruction(Inst.get(), V, Merged);
+      }
+    }
+
+    auto& Insts = Exit->getInstructions();
+    auto Pos = Insts.begin();
+    while (Pos != Insts.end() && dynamic_cast<IRPhiInst*>(Pos->get())) {
+      ++Pos;
+    }
+    Phi->setParent(Exit);
+    Insts.insert(Pos, std::move(Phi));
+  }
+
+  // Each copy now knows the outcome of the branch
+  auto* NewBr = static_cast<IRCondBrInst*>(
+      VMap.lookup(Br->getParent())->getTerminator());
+  foldBranch(Br, true);
+  foldBranch(NewBr, false);
+
+  removeUnreachableBlocks(F);
+  return true;
+}
+
+bool LoopUnswitchPass::run(IRFunction* F, AnalysisManager& AM) {
+  bool Changed = false;
+  size_t Growth = 0;
+
+  // Unswitch one loop at a time; the loop structure changes after each
+  while (true) {
+    LoopInfo& LI = AM.get<LoopInfo>();
+
+    DefMap.clear();
+    for (const auto& BB : F->getBlocks()) {
+      for (const auto& Inst : BB->getInstructions()) {
+        if (IRValue* V = getDefinedValue(Inst.get())) {
+          DefMap[V] = Inst.get();
+        }
+      }
+    }
+
+    // Inner loops first: they run most often, and copying them is cheapest
+    bool Unswitched = false;
+    for (Loop* L : LI.getLoopsInnermostFirst()) {
+      size_t Size = getLoopSize(L);
+      if (Size > SizeThreshold || Growth + Size > GrowthBudget) {
+        continue;
+      }
+
+      std::vector<IRInstruction*> Chain;
+      IRCondBrInst* Br = findCandidate(L, Chain);
+      if (!Br || !unswitchLoop(F, L, Br, Chain)) {
+        continue;
+      }
+
+      Growth += Size;
+      Unswitched = true;
+      break;
+    }
+
+    if (!Unswitched) break;
+
+    Changed = true;
+    AM.invalidate(Analysis::All);
+  }
+
+  return Changed;
+}
+
 } // namespace yac
@@ -0,0 +1,107 @@
+#include "yac/CodeGen/X86AsmPrinter.h"
+
+namespace yac {
+
+void X86AsmPrinter::printFunction(const MachineFunction& MF) {
+  // Function label; 'static' functions stay local to this file
+  if (!MF.isInternal()) {
+    OS << "\t.globl _" << MF.getName() << "\n";
+  }
+  OS << "_" << MF.getName() << ":\n";
+
+  for (const auto& MBB : MF.getBlocks()) {
+    // The entry block starts at the function label
+    bool IsEntry = MBB.get() == MF.getBlocks().front().get();
+    if (!IsEntry || !MBB->getPredecessors().empty()) {
+      OS << MBB->getLabel() << ":\n";
+    }
+    for (const auto& MI : MBB->instrs()) {
+      printInstruction(*MI);
+    }
+  }
+
+  printJumpTables(MF);
+}
+
+void X86AsmPrinter::printInstruction(const MachineInstr& MI) {
+  OS << "\t" << MI.getDesc().Name << X86::getCondCodeName(MI.getCondCode());
+
+  bool First = true;
+  for (const MachineOperand& Op : MI.operands()) {
+    if (Op.isReg() && Op.isImplicit()) continue;
+    OS << (First ? " " : ", ");
+    printOperand(MI, Op);
+    First = false;
+  }
+  OS << "\n";
+}
+
+void X86AsmPrinter::printOperand(const MachineInstr& MI,
+                                 const MachineOperand& Op) {
+  switch (Op.getKind()) {
+  case MachineOperand::MO_Register:
+    OS << X86::getRegName(Op.getReg(), Op.getSize());
+    break;
+  case MachineOperand::MO_Immediate:
+    OS << Op.getImm();
+    break;
+  case MachineOperand::MO_Block:
+    OS << Op.getBlock()->getLabel();
+    break;
+  case MachineOperand::MO_Symbol:
+    OS << "_" << Op.getSymbol();
+    break;
+  case MachineOperand::MO_Memory: {
+    // lea computes an address and has no access width
+    if (MI.getOpcode() != X86::LEA) {
+      OS << (Op.getSize() == 4 ? "DWORD PTR " : "QWORD PTR ");
+    }
+    if (!Op.getSymbol().empty()) {
+      OS << "[rip + _" << Op.getSymbol() << "]";
+      break;
+    }
+    if (Op.getJumpTable() >= 0) {
+      OS << "[rip + "
+         << MI.getParent()->getParent()->getJumpTableLabel(Op.getJumpTable())
+         << "]";
+      break;
+    }
+    OS << "[";
+    bool HasTerm = false;
+    if (Op.getBase() != X86::NoReg) {
+      OS << X86::getRegName(Op.getBase());
+      HasTerm = true;
+    }
+    if (Op.getIndex() != X86::NoReg) {
+      OS << (HasTerm ? " + " : "") << X86::getRegName(Op.getIndex());
+      if (Op.getScale() != 1) OS << "*" << Op.getScale();
+      HasTerm = true;
+    }
+    if (!HasTerm) {
+      OS << Op.getDisp();
+    } else if (Op.getDisp() > 0) {
+      OS << " + " << Op.getDisp();
+    } else if (Op.getDisp() < 0) {
+      OS << " - " << -Op.getDisp();
+    }
+    OS << "]";
+    break;
+  }
+  }
+}
+
+void X86AsmPrinter::printJumpTables(const MachineFunction& MF) {
+  const auto& Tables = MF.getJumpTables();
+  for (size_t JTI = 0; JTI < Tables.size(); ++JTI) {
+    std::string Table = MF.getJumpTableLabel(static_cast<int>(JTI));
+    OS << "\t.section .rodata\n";
+    OS << "\t.p2align 2\n";
+    OS << Table << ":\n";
+    for (const MachineBasicBlock* Target : Tables[JTI]) {
+      OS << "\t.long " << Target->getLabel() << " - " << Table << "\n";
+    }
+    OS << "\t.text\n";
+  }
+}
+
+} // namespace yac
@@ -0,0 +1,1068 @@
+#include "yac/CodeGen/X86ISel.h"
+#include "yac/CodeGen/DivisionByConstant.h"
+#include "yac/CodeGen/IRUtils.h"
+#include "yac/CodeGen/SwitchLowering.h"
+#include <algorithm>
+#include <set>
+
+namespace yac {
+
+using MO = MachineOperand;
+
+static bool isInt32(int64_t V) { return V >= INT32_MIN && V <= INT32_MAX; }
+
+std::unique_ptr<MachineFunction> X86InstrSelector::select(IRFunction* F) {
+  auto Result = std::make_unique<MachineFunction>(F->getName(),
+                                                  F->isInternal());
+  MF = Result.get();
+  VRegs.clear();
+  FrameSlots.clear();
+  LabelToBlock.clear();
+  BlockMap.clear();
+  CompareDefs.clear();
+  Defs.clear();
+  UseCounts.clear();
+  Positions.clear();
+  Covered.clear();
+  Addresses.clear();
+  FoldedLoads.clear();
+  FusedCompares.clear();
+
+  for (const auto& BB : F->getBlocks()) {
+    LabelToBlock[BB->getName()] = BB.get();
+    BlockMap[BB.get()] = MF->createBlock(BB->getName());
+    for (const auto& Inst : BB->getInstructions()) {
+      if (IRValue* Def = getDefinedValue(Inst.get())) Defs[Def] = Inst.get();
+      for (IRValue* Op : getOperands(Inst.get())) UseCounts[Op]++;
+
+      auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get());
+      if (BinOp && BinOp->getOpcode() >= IRInstruction::Eq &&
+          BinOp->getOpcode() <= IRInstruction::Ge) {
+        CompareDefs[BinOp->getResult()] = BinOp;
+      }
+
+      // Allocas become frame slots; arrays get one slot per element
+      if (auto* Alloca = dynamic_cast<IRAllocaInst*>(Inst.get())) {
+        unsigned Size = 8;
+        auto* ArrTy = dynamic_cast<ArrayType*>(Alloca->getAllocType());
+        if (ArrTy && ArrTy->isSized()) {
+          Size = 8 * std::max(ArrTy->getSize(), 1);
+        }
+        FrameSlots[Alloca->getResult()] =
+          MF->createStackObject(Size, 8, /*IsSpillSlot=*/false);
+      }
+    }
+  }
+
+  // Parameters arrive in the argument registers, then above the return
+  // address and saved rbp
+  MBB = MF->getBlocks().front().get();
+  const auto& Params = F->getParameters();
+  for (size_t i = 0; i < Params.size(); ++i) {
+    if (i < X86::ArgRegs.size()) {
+      emitCopy(getVReg(Params[i]), MO::createReg(X86::ArgRegs[i]));
+    } else {
+      int64_t Offset = 16 + 8 * static_cast<int64_t>(i - X86::ArgRegs.size());
+      emit(X86::MOV, {MO::createReg(getVReg(Params[i]), MO::Def),
+                      MO::createMem(X86::RBP, Offset)});
+    }
+  }
+
+  for (const auto& BB : F->getBlocks()) {
+    MBB = BlockMap[BB.get()];
+
+    // Copies for an edge out of a conditional branch or switch run here,
+    // where only that edge arrives
+    const auto& Preds = BB->getPredecessors();
+    if (!Preds.empty() && !phiCopiesGoInPredecessor(Preds.front())) {
+      selectPhiCopies(Preds.front(), BB.get());
+    }
+
+    matchPatterns(BB.get());
+    for (const auto& Inst : BB->getInstructions()) {
+      selectInstruction(Inst.get());
+    }
+  }
+
+  MF = nullptr;
+  MBB = nullptr;
+  return Result;
+}
+
+// ===----------------------------------------------------------------------===
+// Operands
+// ===----------------------------------------------------------------------===
+
+unsigned X86InstrSelector::getVReg(IRValue* V) {
+  auto It = VRegs.find(V);
+  if (It != VRegs.end()) return It->second;
+  unsigned Reg = MF->createVirtualRegister();
+  VRegs[V] = Reg;
+  return Reg;
+}
+
+unsigned X86InstrSelector::getReg(IRValue* V) {
+  if (V->isConstant()) {
+    unsigned Reg = MF->createVirtualRegister();
+    emit(X86::MOV, {MO::createReg(Reg, MO::Def),
+                    MO::createImm(V->getConstant())});
+    return Reg;
+  }
+
+  // The address of a frame slot or global, used as a value
+  if (FrameSlots.count(V) || V->isGlobal()) {
+    unsigned Reg = MF->createVirtualRegister();
+    emit(X86::LEA, {MO::createReg(Reg, MO::Def), getAddress(V)});
+    return Reg;
+  }
+
+  return getVReg(V);
+}
+
+MachineOperand X86InstrSelector::getRegOrImm(IRValue* V) {
+  if (V->isConstant() && isInt32(V->getConstant())) {
+    return MO::createImm(V->getConstant());
+  }
+  return MO::createReg(getReg(V));
+}
+
+MachineOperand X86InstrSelector::getAddress(IRValue* Ptr) {
+  auto It = FrameSlots.find(Ptr);
+  if (It != FrameSlots.end()) return MO::createFrameIndex(It->second);
+  if (Ptr->isGlobal()) return MO::createGlobal(Ptr->getName());
+  return MO::createMem(getReg(Ptr));
+}
+
+MachineOperand X86InstrSelector::getAddress(IRInstruction* Access,
+                                            IRValue* Ptr) {
+  auto It = Addresses.find(Access);
+  if (It != Addresses.end()) return getAddressOperand(It->second);
+  return getAddress(Ptr);
+}
+
+MachineOperand X86InstrSelector::getAddressOperand(const AddressMode& AM) {
+  unsigned Base = AM.Base ? getReg(AM.Base) : X86::NoReg;
+  unsigned Index = AM.Index ? getReg(AM.Index) : X86::NoReg;
+  return MO::createMem(Base, AM.Disp, Index, AM.Scale);
+}
+
+MachineBasicBlock* X86InstrSelector::getBlock(IRValue* Label) {
+  return BlockMap[LabelToBlock[Label->getName()]];
+}
+
+MachineInstr* X86InstrSelector::emit(X86::Opcode Op,
+                                     std::vector<MachineOperand> Ops,
+                                     X86::CondCode CC) {
+  return MBB->push_back(std::make_unique<MachineInstr>(Op, std::move(Ops),
+                                                        CC));
+}
+
+void X86InstrSelector::emitCopy(unsigned Dst, const MachineOperand& Src) {
+  emit(X86::MOV, {MO::createReg(Dst, MO::Def), Src});
+}
+
+void X86InstrSelector::emitBranch(X86::CondCode CC,
+                                  MachineBasicBlock* Target) {
+  if (CC == X86::COND_NONE) {
+    emit(X86::JMP, {MO::createBlock(Target)});
+  } else {
+    emit(X86::JCC, {MO::createBlock(Target)}, CC);
+  }
+  MBB->addSuccessor(Target);
+}
+
+// ===----------------------------------------------------------------------===
+// Pattern matching
+// ===----------------------------------------------------------------------===
+
+static bool isCommutative(IRInstruction::Opcode Op) {
+  return Op == IRInstruction::Add || Op == IRInstruction::Mul ||
+         Op == IRInstruction::And || Op == IRInstruction::Or ||
+         Op == IRInstruction::Xor;
+}
+
+static bool isComparison(IRInstruction::Opcode Op) {
+  return Op >= IRInstruction::Eq && Op <= IRInstruction::Ge;
+}
+
+/// Opcodes with a reg, mem form that reads operand 1 from memory
+static bool acceptsMemoryOperand(IRInstruction::Opcode Op) {
+  return isCommutative(Op) || Op == IRInstruction::Sub || isComparison(Op);
+}
+
+void X86InstrSelector::matchPatterns(IRBasicBlock* BB) {
+  size_t Pos = 0;
+  for (const auto& Inst : BB->getInstructions()) Positions[Inst.get()] = Pos++;
+
+  // A load read once, by an instruction that takes a memory operand, is
+  // folded into that instruction
+  for (const auto& Inst : BB->getInstructions()) {
+    auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get());
+    if (!BinOp || !acceptsMemoryOperand(BinOp->getOpcode())) continue;
+    IRLoadInst* Load = getFoldableLoad(BinOp->getRHS(), BinOp);
+    if (!Load && isCommutative(BinOp->getOpcode()))
+      Load = getFoldableLoad(BinOp->getLHS(), BinOp);
+    if (Load) {
+      FoldedLoads[BinOp] = Load;
+      Covered.insert(Load);
+    }
+  }
+
+  const auto& Insts = BB->getInstructions();
+
+  // A comparison read only as the condition of branches and selects in
+  // this block is repeated at each of them, right before the jcc or cmov;
+  // its 0/1 value is never built
+  for (const auto& Inst : Insts) {
+    auto* Cmp = dynamic_cast<IRBinaryInst*>(Inst.get());
+    if (!Cmp || !isComparison(Cmp->getOpcode())) continue;
+    if (Cmp->getLHS()->isConstant() && Cmp->getRHS()->isConstant()) continue;
+
+    IRValue* Result = Cmp->getResult();
+    unsigned ConditionUses = 0;
+    IRInstruction* LastUser = Cmp;
+    for (size_t i = Positions[Cmp] + 1; i < Insts.size(); ++i) {
+      IRInstruction* User = Insts[i].get();
+      auto* CondBr = dynamic_cast<IRCondBrInst*>(User);
+      auto* Sel = dynamic_cast<IRSelectInst*>(User);
+      if ((CondBr && CondBr->getCondition() == Result) ||
+          (Sel && Sel->getCondition() == Result &&
+           Sel->getTrueValue() != Result && Sel->getFalseValue() != Result)) {
+        ConditionUses++;
+        LastUser = User;
+      }
+    }
+    if (ConditionUses == 0 || ConditionUses != UseCounts[Result]) continue;
+    if (FoldedLoads.count(Cmp) && writesMemoryBetween(Cmp, LastUser))
+      continue;
+
+    FusedCompares.insert(Cmp);
+    Covered.insert(Cmp);
+  }
+
+  // Address arithmetic, matched from the outermost tree down so a root
+  // claims as much of its tree as it can. An add, or a multiply by 3, 5 or
+  // 9, becomes one lea; a pointer computed for a single load or store
+  // becomes its memory operand.
+  for (auto It = Insts.rbegin(); It != Insts.rend(); ++It) {
+    IRInstruction* I = It->get();
+    if (Covered.count(I)) continue;
+
+    AddressMode AM;
+    std::vector<IRInstruction*> Matched;
+    IRValue* Ptr = nullptr;
+    if (auto* Load = dynamic_cast<IRLoadInst*>(I)) Ptr = Load->getPtr();
+    if (auto* Store = dynamic_cast<IRStoreInst*>(I)) Ptr = Store->getPtr();
+
+    bool Match = false;
+    if (Ptr) {
+      Match = isFoldable(Ptr, I) &&
+              matchAddressNode(Defs[Ptr], AM, Matched, 0) && AM.Base;
+    } else if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+      Match = !FoldedLoads.count(BinOp) &&
+              matchAddressNode(BinOp, AM, Matched, 0) && AM.Base;
+      // The root is selected as the lea itself
+      if (Match) Matched.pop_back();
+    }
+    if (!Match) continue;
+
+    Addresses[I] = AM;
+    Covered.insert(Matched.begin(), Matched.end());
+  }
+}
+
+bool X86InstrSelector::isFoldable(IRValue* V, IRInstruction* User) {
+  auto It = Defs.find(V);
+  if (It == Defs.end()) return false;
+  IRInstruction* Def = It->second;
+  return UseCounts[V] == 1 && Def->getParent() == User->getParent() &&
+         !Covered.count(Def) && !FoldedLoads.count(Def) &&
+         !dynamic_cast<IRPhiInst*>(Def);
+}
+
+IRLoadInst* X86InstrSelector::getFoldableLoad(IRValue* V,
+                                              IRInstruction* User) {
+  if (!isFoldable(V, User)) return nullptr;
+  auto* Load = dynamic_cast<IRLoadInst*>(Defs[V]);
+  if (!Load) return nullptr;
+
+  // The load moves down to its user; nothing in between may write memory
+  if (writesMemoryBetween(Load, User)) return nullptr;
+  return Load;
+}
+
+bool X86InstrSelector::writesMemoryBetween(IRInstruction* From,
+                                           IRInstruction* To) {
+  const auto& Insts = From->getParent()->getInstructions();
+  for (size_t i = Positions[From] + 1; i < Positions[To]; ++i) {
+    IRInstruction* Between = Insts[i].get();
+    if (dynamic_cast<IRStoreInst*>(Between) ||
+        dynamic_cast<IRCallInst*>(Between)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool X86InstrSelector::matchAddress(IRValue* V, IRInstruction* User,
+                                    AddressMode& AM,
+                                    std::vector<IRInstruction*>& Matched,
+                                    unsigned Depth) {
+  if (V->isConstant()) {
+    int64_t Disp;
+    if (!__builtin_add_overflow(AM.Disp, V->getConstant(), &Disp) &&
+        isInt32(Disp)) {
+      AM.Disp = Disp;
+      return true;
+    }
+  }
+
+  // Descend into single-use arithmetic; keep the trees small
+  if (Depth < 4 && isFoldable(V, User) &&
+      matchAddressNode(Defs[V], AM, Matched, Depth + 1)) {
+    return true;
+  }
+
+  // Anything else is a register
+  if (!AM.Base) {
+    AM.Base = V;
+    return true;
+  }
+  if (!AM.Index) {
+    AM.Index = V;
+    AM.Scale = 1;
+    return true;
+  }
+  return false;
+}
+
+bool X86InstrSelector::matchAddressNode(IRInstruction* I, AddressMode& AM,
+                                        std::vector<IRInstruction*>& Matched,
+                                        unsigned Depth) {
+  auto* BinOp = dynamic_cast<IRBinaryInst*>(I);
+  if (!BinOp) return false;
+  IRValue* LHS = BinOp->getLHS();
+  IRValue* RHS = BinOp->getRHS();
+
+  AddressMode Saved = AM;
+  size_t NumMatched = Matched.size();
+
+  switch (BinOp->getOpcode()) {
+  case IRInstruction::Add:
+    if (matchAddress(LHS, I, AM, Matched, Depth) &&
+        matchAddress(RHS, I, AM, Matched, Depth)) {
+      Matched.push_back(I);
+      return true;
+    }
+    break;
+  case IRInstruction::Sub: {
+    int64_t Disp;
+    if (RHS->isConstant() &&
+        !__builtin_sub_overflow(AM.Disp, RHS->getConstant(), &Disp) &&
+        isInt32(Disp)) {
+      AM.Disp = Disp;
+      if (matchAddress(LHS, I, AM, Matched, Depth)) {
+        Matched.push_back(I);
+        return true;
+      }
+    }
+    break;
+  }
+  case IRInstruction::Mul:
+  case IRInstruction::Shl: {
+    // x * k, with k a valid scale or one more than a scale
+    IRValue* X = LHS;
+    IRValue* K = RHS;
+    if (BinOp->getOpcode() == IRInstruction::Mul && LHS->isConstant())
+      std::swap(X, K);
+    if (!K->isConstant() || X->isConstant()) break;
+    int64_t Factor = K->getConstant();
+    if (BinOp->getOpcode() == IRInstruction::Shl) {
+      if (Factor < 0 || Factor > 3) break;
+      Factor = int64_t(1) << Factor;
+    }
+
+    if ((Factor == 1 || Factor == 2 || Factor == 4 || Factor == 8) &&
+        !AM.Index) {
+      AM.Index = X;
+      AM.Scale = static_cast<unsigned>(Factor);
+      Matched.push_back(I);
+      return true;
+    }
+    if ((Factor == 3 || Factor == 5 || Factor == 9) && !AM.Base &&
+        !AM.Index) {
+      AM.Base = X;
+      AM.Index = X;
+      AM.Scale = static_cast<unsigned>(Factor - 1);
+      Matched.push_back(I);
+      return true;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+
+  AM = Saved;
+  Matched.resize(NumMatched);
+  return false;
+}
+
+// ===----------------------------------------------------------------------===
+// Instructions
+// ===----------------------------------------------------------------------===
+
+void X86InstrSelector::selectInstruction(IRInstruction* I) {
+  // Selected as part of the instruction that uses it
+  if (Covered.count(I)) return;
+
+  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
+    selectBinary(BinOp);
+  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(I)) {
+    selectUnary(UnOp);
+  } else if (auto* Load = dynamic_cast<IRLoadInst*>(I)) {
+    selectLoad(Load);
+  } else if (auto* Store = dynamic_cast<IRStoreInst*>(I)) {
+    selectStore(Store);
+  } else if (auto* Ret = dynamic_cast<IRRetInst*>(I)) {
+    selectRet(Ret);
+  } else if (auto* Br = dynamic_cast<IRBrInst*>(I)) {
+    selectBr(Br);
+  } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(I)) {
+    selectCondBr(CondBr);
+  } else if (auto* Switch = dynamic_cast<IRSwitchInst*>(I)) {
+    selectSwitch(Switch);
+  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
+    selectCall(Call);
+  } else if (auto* Sel = dynamic_cast<IRSelectInst*>(I)) {
+    selectSelect(Sel);
+  } else if (auto* Move = dynamic_cast<IRMoveInst*>(I)) {
+    emitCopy(getVReg(Move->getResult()), getRegOrImm(Move->getOperand()));
+  }
+  // Allocas have their frame slots already; phis are copied on the edges
+}
+
+void X86InstrSelector::selectBinary(IRBinaryInst* I) {
+  switch (I->getOpcode()) {
+  case IRInstruction::Div:
+  case IRInstruction::Mod:
+    selectDivRem(I);
+    return;
+  case IRInstruction::Eq: case IRInstruction::Ne:
+  case IRInstruction::Lt: case IRInstruction::Le:
+  case IRInstruction::Gt: case IRInstruction::Ge:
+    selectCompare(I);
+    return;
+  default:
+    break;
+  }
+
+  unsigned Result = getVReg(I->getResult());
+  MachineOperand Dst = MO::createReg(Result, MO::Use | MO::Def);
+  IRValue* LHS = I->getLHS();
+  IRValue* RHS = I->getRHS();
+
+  // Three-operand add, scaled index or multiply by 3, 5 or 9
+  auto Addr = Addresses.find(I);
+  if (Addr != Addresses.end()) {
+    emit(X86::LEA, {MO::createReg(Result, MO::Def),
+                    getAddressOperand(Addr->second)});
+    return;
+  }
+
+  // op r, mem reads the folded load directly
+  auto Folded = FoldedLoads.find(I);
+  if (Folded != FoldedLoads.end()) {
+    IRLoadInst* Load = Folded->second;
+    emitCopy(Result, getRegOrImm(Load->getResult() == RHS ? LHS : RHS));
+    MachineOperand Mem = getAddress(Load, Load->getPtr());
+    X86::Opcode Op = X86::ADD;
+    switch (I->getOpcode()) {
+    case IRInstruction::Sub: Op = X86::SUB; break;
+    case IRInstruction::And: Op = X86::AND; break;
+    case IRInstruction::Or: Op = X86::OR; break;
+    case IRInstruction::Xor: Op = X86::XOR; break;
+    case IRInstruction::Mul: Op = X86::IMUL; break;
+    default: break;
+    }
+    emit(Op, {Dst, Mem});
+    return;
+  }
+
+  if (I->getOpcode() == IRInstruction::Mul &&
+      (LHS->isConstant() || RHS->isConstant())) {
+    if (LHS->isConstant()) std::swap(LHS, RHS);
+    selectMulByConstant(Result, LHS, RHS->getConstant());
+    return;
+  }
+
+  // 0 - x
+  if (I->getOpcode() == IRInstruction::Sub && LHS->isConstant() &&
+      LHS->getConstant() == 0) {
+    emitCopy(Result, getRegOrImm(RHS));
+    emit(X86::NEG, {Dst});
+    return;
+  }
+
+  // Commutative operations with a constant on the left use the immediate
+  // form
+  if (isCommutative(I->getOpcode()) && LHS->isConstant() &&
+      !RHS->isConstant()) {
+    std::swap(LHS, RHS);
+  }
+  emitCopy(Result, getRegOrImm(LHS));
+
+  switch (I->getOpcode()) {
+  case IRInstruction::Add:
+    emit(X86::ADD, {Dst, getRegOrImm(RHS)});
+    break;
+  case IRInstruction::Sub:
+    emit(X86::SUB, {Dst, getRegOrImm(RHS)});
+    break;
+  case IRInstruction::And:
+    emit(X86::AND, {Dst, getRegOrImm(RHS)});
+    break;
+  case IRInstruction::Or:
+    emit(X86::OR, {Dst, getRegOrImm(RHS)});
+    break;
+  case IRInstruction::Xor:
+    emit(X86::XOR, {Dst, getRegOrImm(RHS)});
+    break;
+  case IRInstruction::Mul:
+    emit(X86::IMUL, {Dst, MO::createReg(getReg(RHS))});
+    break;
+  case IRInstruction::Shl:
+  case IRInstruction::Shr: {
+    // Shr is arithmetic, matching the constant folder
+    X86::Opcode Op = I->getOpcode() == IRInstruction::Shl ? X86::SHL
+                                                          : X86::SAR;
+    if (RHS->isConstant()) {
+      emit(Op, {Dst, MO::createImm(RHS->getConstant() & 63)});
+    } else {
+      emitCopy(X86::RCX, getRegOrImm(RHS));
+      emit(Op, {Dst, MO::createReg(X86::RCX, MO::Use, 1)});
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+static X86::CondCode getCondCode(IRInstruction::Opcode Op) {
+  switch (Op) {
+  case IRInstruction::Eq: return X86::COND_E;
+  case IRInstruction::Ne: return X86::COND_NE;
+  case IRInstruction::Lt: return X86::COND_L;
+  case IRInstruction::Le: return X86::COND_LE;
+  case IRInstruction::Gt: return X86::COND_G;
+  case IRInstruction::Ge: return X86::COND_GE;
+  default: return X86::COND_NONE;
+  }
+}
+
+void X86InstrSelector::selectMulByConstant(unsigned Result, IRValue* X,
+                                           int64_t C) {
+  // Cheapest first: one lea, one shift, then imul with an immediate
+  MachineOperand Dst = MO::createReg(Result, MO::Use | MO::Def);
+  if (C == 3 || C == 5 || C == 9) {
+    unsigned Reg = getReg(X);
+    emit(X86::LEA, {MO::createReg(Result, MO::Def),
+                    MO::createMem(Reg, 0, Reg, static_cast<unsigned>(C - 1))});
+  } else if (C > 0 && (C & (C - 1)) == 0) {
+    unsigned Shift = 0;
+    while ((int64_t(1) << Shift) != C) ++Shift;
+    emitCopy(Result, getRegOrImm(X));
+    if (Shift) emit(X86::SHL, {Dst, MO::createImm(Shift)});
+  } else if (isInt32(C)) {
+    emit(X86::IMUL, {MO::createReg(Result, MO::Def), MO::createReg(getReg(X)),
+                     MO::createImm(C)});
+  } else {
+    unsigned Factor = MF->createVirtualRegister();
+    emitCopy(Factor, MO::createImm(C));
+    emitCopy(Result, getRegOrImm(X));
+    emit(X86::IMUL, {Dst, MO::createReg(Factor)});
+  }
+}
+
+X86::CondCode X86InstrSelector::emitCompare(IRBinaryInst* Cmp) {
+  IRValue* LHS = Cmp->getLHS();
+  IRValue* RHS = Cmp->getRHS();
+  X86::CondCode CC = getCondCode(Cmp->getOpcode());
+
+  auto Folded = FoldedLoads.find(Cmp);
+  if (Folded != FoldedLoads.end()) {
+    IRLoadInst* Load = Folded->second;
+    emit(X86::CMP, {MO::createReg(getReg(LHS)),
+                    getAddress(Load, Load->getPtr())});
+    return CC;
+  }
+
+  // cmp needs a register on the left
+  if (LHS->isConstant() && !RHS->isConstant()) {
+    std::swap(LHS, RHS);
+    CC = X86::getSwappedCondCode(CC);
+  }
+
+  MachineOperand L = MO::createReg(getReg(LHS));
+  if (RHS->isConstant() && RHS->getConstant() == 0) {
+    emit(X86::TEST, {L, L});
+  } else {
+    emit(X86::CMP, {L, getRegOrImm(RHS)});
+  }
+  return CC;
+}
+
+void X86InstrSelector::selectCompare(IRBinaryInst* I) {
+  X86::CondCode CC = emitCompare(I);
+  unsigned Result = getVReg(I->getResult());
+  emit(X86::SETCC, {MO::createReg(Result, MO::Def, 1)}, CC);
+  emit(X86::MOVZX, {MO::createReg(Result, MO::Def),
+                    MO::createReg(Result, MO::Use, 1)});
+}
+
+void X86InstrSelector::selectDivRem(IRBinaryInst* I) {
+  bool IsRem = I->getOpcode() == IRInstruction::Mod;
+  unsigned Result = getVReg(I->getResult());
+
+  if (I->getRHS()->isConstant()) {
+    // The dividend is kept in r11 for the whole sequence, since rax and rdx
+    // are overwritten by imul
+    emitCopy(X86::R11, getRegOrImm(I->getLHS()));
+    selectDivRemByConstant(IsRem, I->getRHS()->getConstant(), Result);
+    return;
+  }
+
+  // idiv needs the divisor in a register other than rax/rdx
+  emitCopy(X86::R11, MO::createReg(getReg(I->getRHS())));
+  emitCopy(X86::RAX, getRegOrImm(I->getLHS()));
+  emit(X86::CQO, {});
+  emit(X86::IDIV, {MO::createReg(X86::R11)});
+  emitCopy(Result, MO::createReg(IsRem ? X86::RDX : X86::RAX));
+}
+
+void X86InstrSelector::selectDivRemByConstant(bool IsRem, int64_t D,
+                                              unsigned Result) {
+  MachineOperand Dst = MO::createReg(Result, MO::Def);
+  MachineOperand RAX = MO::createReg(X86::RAX, MO::Use | MO::Def);
+  MachineOperand RDX = MO::createReg(X86::RDX, MO::Use | MO::Def);
+  MachineOperand R11 = MO::createReg(X86::R11);
+
+  // x / 1, x / -1 and x % ±1 need no division at all
+  if (D == 1 || D == -1) {
+    if (IsRem) {
+      emit(X86::MOV, {Dst, MO::createImm(0)});
+    } else {
+      emit(X86::MOV, {Dst, R11});
+      if (D == -1) emit(X86::NEG, {MO::createReg(Result, MO::Use | MO::Def)});
+    }
+    return;
+  }
+
+  if (D == 0) {
+    // Division by zero is undefined; trap like idiv would
+    emit(X86::UD2, {});
+    emit(X86::MOV, {Dst, MO::createImm(0)});
+    return;
+  }
+
+  unsigned K;
+  if (isPowerOf2Divisor(D, K)) {
+    // Round toward zero: add 2^k - 1 to negative dividends before shifting
+    emitCopy(X86::RDX, R11);
+    emit(X86::SAR, {RDX, MO::createImm(63)});
+    emit(X86::SHR, {RDX, MO::createImm(64 - K)});
+    emit(X86::ADD, {RDX, R11});
+    if (IsRem) {
+      // x - ((x + bias) & -2^k); the sign of D does not matter
+      if (K <= 31) {
+        emit(X86::AND, {RDX, MO::createImm(-(int64_t(1) << K))});
+      } else {
+        emit(X86::SAR, {RDX, MO::createImm(K)});
+        emit(X86::SHL, {RDX, MO::createImm(K)});
+      }
+      emitCopy(X86::RAX, R11);
+      emit(X86::SUB, {RAX, MO::createReg(X86::RDX)});
+      emit(X86::MOV, {Dst, MO::createReg(X86::RAX)});
+    } else {
+      emit(X86::SAR, {RDX, MO::createImm(K)});
+      if (D < 0) emit(X86::NEG, {RDX});
+      emit(X86::MOV, {Dst, MO::createReg(X86::RDX)});
+    }
+    return;
+  }
+
+  // q = mulhs(x, M), corrected, shifted, then rounded toward zero
+  SignedDivMagic Magic = computeSignedDivMagic(D);
+  emitCopy(X86::RAX, MO::createImm(Magic.Multiplier));
+  emit(X86::IMUL1, {R11});
+  if (D > 0 && Magic.Multiplier < 0) {
+    emit(X86::ADD, {RDX, R11});
+  } else if (D < 0 && Magic.Multiplier > 0) {
+    emit(X86::SUB, {RDX, R11});
+  }
+  if (Magic.Shift > 0) {
+    emit(X86::SAR, {RDX, MO::createImm(Magic.Shift)});
+  }
+  emitCopy(X86::RAX, MO::createReg(X86::RDX));
+  emit(X86::SHR, {RAX, MO::createImm(63)});
+  emit(X86::ADD, {RDX, MO::createReg(X86::RAX)});
+
+  if (IsRem) {
+    // x - q * D
+    if (isInt32(D)) {
+      emit(X86::IMUL, {MO::createReg(X86::RDX, MO::Def),
+                       MO::createReg(X86::RDX), MO::createImm(D)});
+    } else {
+      emitCopy(X86::RAX, MO::createImm(D));
+      emit(X86::IMUL, {RDX, MO::createReg(X86::RAX)});
+    }
+    emitCopy(X86::RAX, R11);
+    emit(X86::SUB, {RAX, MO::createReg(X86::RDX)});
+    emit(X86::MOV, {Dst, MO::createReg(X86::RAX)});
+  } else {
+    emit(X86::MOV, {Dst, MO::createReg(X86::RDX)});
+  }
+}
+
+void X86InstrSelector::selectUnary(IRUnaryInst* I) {
+  if (I->getOpcode() != IRInstruction::Not) return;
+
+  // Logical not: 1 for zero, 0 for anything else
+  unsigned Operand = getReg(I->getOperand());
+  unsigned Result = getVReg(I->getResult());
+  emit(X86::TEST, {MO::createReg(Operand), MO::createReg(Operand)});
+  emit(X86::SETCC, {MO::createReg(Result, MO::Def, 1)}, X86::COND_E);
+  emit(X86::MOVZX, {MO::createReg(Result, MO::Def),
+                    MO::createReg(Result, MO::Use, 1)});
+}
+
+void X86InstrSelector::selectLoad(IRLoadInst* I) {
+  MachineOperand Addr = getAddress(I, I->getPtr());
+  emit(X86::MOV, {MO::createReg(getVReg(I->getResult()), MO::Def), Addr});
+}
+
+void X86InstrSelector::selectStore(IRStoreInst* I) {
+  MachineOperand Value = getRegOrImm(I->getValue());
+  emit(X86::MOV, {getAddress(I, I->getPtr()), Value});
+}
+
+void X86InstrSelector::selectRet(IRRetInst* I) {
+  if (!I->hasRetValue()) {
+    emit(X86::RET, {});
+    return;
+  }
+  emitCopy(X86::RAX, getRegOrImm(I->getRetValue()));
+  emit(X86::RET, {MO::createReg(X86::RAX, MO::Use | MO::Implicit)});
+}
+
+void X86InstrSelector::selectPhiCopies(IRBasicBlock* From, IRBasicBlock* To) {
+  // The phis of To read all their incoming values at once
+  std::vector<MachineOperand> Ops;
+  for (const auto& Inst : To->getInstructions()) {
+    auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get());
+    if (!Phi) break;
+
+    for (const auto& Entry : Phi->getIncomings()) {
+      if (Entry.Block != From) continue;
+      MachineOperand Src = Entry.Value->isConstant()
+        ? MO::createImm(Entry.Value->getConstant())
+        : MO::createReg(getReg(Entry.Value));
+      Ops.push_back(MO::createReg(getVReg(Phi->getResult()), MO::Def));
+      Ops.push_back(Src);
+      break;
+    }
+  }
+  if (!Ops.empty()) emit(X86::PCOPY, std::move(Ops));
+}
+
+void X86InstrSelector::selectBr(IRBrInst* I) {
+  IRBasicBlock* To = LabelToBlock[I->getTarget()->getName()];
+  selectPhiCopies(I->getParent(), To);
+  emitBranch(X86::COND_NONE, BlockMap[To]);
+}
+
+void X86InstrSelector::selectCondBr(IRCondBrInst* I) {
+  MachineBasicBlock* TrueMBB = getBlock(I->getTrueLabel());
+  MachineBasicBlock* FalseMBB = getBlock(I->getFalseLabel());
+
+  IRValue* Cond = I->getCondition();
+  if (Cond->isConstant()) {
+    emitBranch(X86::COND_NONE, Cond->getConstant() ? TrueMBB : FalseMBB);
+    return;
+  }
+
+  // Branch on the comparison itself when there is one, otherwise on the
+  // 0/1 value. Phi copies for either edge run in the target block, so both
+  // paths can jump straight there.
+  X86::CondCode CC;
+  if (!selectFusedCompare(Cond, CC)) {
+    unsigned Reg = getReg(Cond);
+    emit(X86::TEST, {MO::createReg(Reg), MO::createReg(Reg)});
+    CC = X86::COND_NE;
+  }
+  emitBranch(CC, TrueMBB);
+  emitBranch(X86::COND_NONE, FalseMBB);
+}
+
+void X86InstrSelector::selectCall(IRCallInst* I) {
+  const auto& Args = I->getArgs();
+  size_t NumRegArgs = std::min(Args.size(), X86::ArgRegs.size());
+  size_t NumStackArgs = Args.size() - NumRegArgs;
+
+  // Arguments past the sixth are pushed right to left; keep rsp 16-byte
+  // aligned at the call
+  int64_t StackBytes = 8 * static_cast<int64_t>(NumStackArgs);
+  if (NumStackArgs % 2) {
+    emit(X86::SUB, {MO::createReg(X86::RSP, MO::Use | MO::Def),
+                    MO::createImm(8)});
+    StackBytes += 8;
+  }
+  for (size_t i = Args.size(); i > NumRegArgs; --i) {
+    emit(X86::PUSH, {getRegOrImm(Args[i - 1])});
+  }
+
+  std::vector<MachineOperand> CallOps = {MO::createSymbol(I->getFuncName())};
+  for (size_t i = 0; i < NumRegArgs; ++i) {
+    emitCopy(X86::ArgRegs[i], getRegOrImm(Args[i]));
+    CallOps.push_back(MO::createReg(X86::ArgRegs[i],
+                                    MO::Use | MO::Implicit));
+  }
+  emit(X86::CALL, std::move(CallOps));
+
+  if (StackBytes > 0) {
+    emit(X86::ADD, {MO::createReg(X86::RSP, MO::Use | MO::Def),
+                    MO::createImm(StackBytes)});
+  }
+
+  // Result in rax
+  if (I->getResult()) {
+    emitCopy(getVReg(I->getResult()), MO::createReg(X86::RAX));
+  }
+}
+
+void X86InstrSelector::selectSelect(IRSelectInst* I) {
+  unsigned Result = getVReg(I->getResult());
+  IRValue* Cond = I->getCondition();
+  if (Cond->isConstant()) {
+    IRValue* Val = Cond->getConstant() ? I->getTrueValue()
+                                       : I->getFalseValue();
+    emitCopy(Result, getRegOrImm(Val));
+    return;
+  }
+
+  // Materialize everything that needs a register before the flags are set
+  MachineOperand FalseVal = getRegOrImm(I->getFalseValue());
+  MachineOperand TrueVal = I->getTrueValue()->isConstant()
+    ? MO::createImm(I->getTrueValue()->getConstant())
+    : MO::createReg(getReg(I->getTrueValue()));
+
+  // Set the flags, either by repeating the comparison that produced the
+  // condition or by testing the 0/1 value itself
+  X86::CondCode CC;
+  if (!selectFusedCompare(Cond, CC)) {
+    unsigned Reg = getReg(Cond);
+    emit(X86::TEST, {MO::createReg(Reg), MO::createReg(Reg)});
+    CC = X86::COND_NE;
+  }
+
+  // Build the result in r11: the movs below leave the flags alone
+  emitCopy(X86::R11, FalseVal);
+  if (TrueVal.isImm()) {
+    // cmov has no immediate form
+    emitCopy(X86::R10, TrueVal);
+    TrueVal = MO::createReg(X86::R10);
+  }
+  emit(X86::CMOV, {MO::createReg(X86::R11, MO::Use | MO::Def), TrueVal}, CC);
+  emitCopy(Result, MO::createReg(X86::R11));
+}
+
+bool X86InstrSelector::selectFusedCompare(IRValue* Cond, X86::CondCode& CC) {
+  auto It = CompareDefs.find(Cond);
+  if (It == CompareDefs.end()) return false;
+
+  // Fused comparisons were checked when their block was matched. Repeating
+  // any other comparison here must read the same values: not a load that
+  // was folded into it, since memory may have changed since.
+  IRBinaryInst* Cmp = It->second;
+  if (!FusedCompares.count(Cmp)) {
+    if (FoldedLoads.count(Cmp)) return false;
+    if (Cmp->getLHS()->isConstant() && Cmp->getRHS()->isConstant())
+      return false;
+  }
+
+  CC = emitCompare(Cmp);
+  return true;
+}
+
+// ===----------------------------------------------------------------------===
+// Switch lowering
+// ===----------------------------------------------------------------------===
+
+void X86InstrSelector::selectSwitch(IRSwitchInst* I) {
+  std::string Prefix = "switch_" + I->getParent()->getName();
+
+  // Phi copies for each edge run in the target block, so every case jumps
+  // straight there
+  MachineBasicBlock* Default = getBlock(I->getDefaultLabel());
+
+  SwitchCaseList Cases;
+  for (const auto& Case : I->getCases()) {
+    Cases.push_back({Case.Value, getBlock(Case.Label)});
+  }
+  std::stable_sort(Cases.begin(), Cases.end(),
+                   [](const auto& A, const auto& B) { return A.first < B.first; });
+  Cases.erase(std::unique(Cases.begin(), Cases.end(),
+                          [](const auto& A, const auto& B) {
+                            return A.first == B.first;
+                          }),
+              Cases.end());
+
+  std::vector<int64_t> Values;
+  std::set<MachineBasicBlock*> Dests;
+  for (const auto& Case : Cases) {
+    Values.push_back(Case.first);
+    Dests.insert(Case.second);
+  }
+
+  emitCopy(X86::R11, getRegOrImm(I->getCondition()));
+
+  if (Cases.empty()) {
+    emitBranch(X86::COND_NONE, Default);
+    return;
+  }
+
+  switch (chooseSwitchStrategy(Values, Dests.size())) {
+  case SwitchStrategy::JumpTable:
+    emitSwitchJumpTable(Cases, Default);
+    break;
+  case SwitchStrategy::BitTest:
+    emitSwitchBitTests(Cases, Default);
+    break;
+  case SwitchStrategy::CompareTree: {
+    unsigned NextLabel = 0;
+    emitSwitchCompareTree(Cases, 0, Cases.size(), Default, Prefix, NextLabel);
+    break;
+  }
+  }
+}
+
+void X86InstrSelector::emitCompareImm(unsigned Reg, int64_t Value) {
+  if (isInt32(Value)) {
+    emit(X86::CMP, {MO::createReg(Reg), MO::createImm(Value)});
+  } else {
+    emitCopy(X86::R10, MO::createImm(Value));
+    emit(X86::CMP, {MO::createReg(Reg), MO::createReg(X86::R10)});
+  }
+}
+
+void X86InstrSelector::emitSwitchRangeCheck(int64_t Min, uint64_t Span,
+                                            MachineBasicBlock* Default) {
+  // Rebase the selector to 0; anything outside [Min, Max] wraps to a value
+  // above Span
+  MachineOperand R11 = MO::createReg(X86::R11, MO::Use | MO::Def);
+  if (Min != 0) {
+    if (isInt32(Min)) {
+      emit(X86::SUB, {R11, MO::createImm(Min)});
+    } else {
+      emitCopy(X86::R10, MO::createImm(Min));
+      emit(X86::SUB, {R11, MO::createReg(X86::R10)});
+    }
+  }
+  emit(X86::CMP, {MO::createReg(X86::R11),
+                  MO::createImm(static_cast<int64_t>(Span))});
+  emitBranch(X86::COND_A, Default);
+}
+
+void X86InstrSelector::emitSwitchJumpTable(const SwitchCaseList& Cases,
+                                           MachineBasicBlock* Default) {
+  int64_t Min = Cases.front().first;
+  uint64_t Span = static_cast<uint64_t>(Cases.back().first) -
+                  static_cast<uint64_t>(Min);
+
+  emitSwitchRangeCheck(Min, Span, Default);
+
+  std::vector<MachineBasicBlock*> Targets;
+  size_t Next = 0;
+  for (uint64_t Slot = 0; Slot <= Span; ++Slot) {
+    MachineBasicBlock* Target = Default;
+    if (Next < Cases.size() &&
+        static_cast<uint64_t>(Cases[Next].first) -
+                static_cast<uint64_t>(Min) == Slot) {
+      Target = Cases[Next++].second;
+    }
+    Targets.push_back(Target);
+    MBB->addSuccessor(Target);
+  }
+  int JTI = MF->createJumpTable(std::move(Targets));
+
+  // Entries are 32-bit offsets from the table, which keeps it position
+  // independent
+  emit(X86::LEA, {MO::createReg(X86::R10, MO::Def),
+                  MO::createJumpTable(JTI)});
+  emit(X86::MOVSXD, {MO::createReg(X86::R11, MO::Def),
+                     MO::createMem(X86::R10, 0, X86::R11, 4, /*Size=*/4)});
+  emit(X86::ADD, {MO::createReg(X86::R11, MO::Use | MO::Def),
+                  MO::createReg(X86::R10)});
+  emit(X86::JMP, {MO::createReg(X86::R11)});
+}
+
+void X86InstrSelector::emitSwitchBitTests(const SwitchCaseList& Cases,
+                                          MachineBasicBlock* Default) {
+  int64_t Min = Cases.front().first;
+  uint64_t Span = static_cast<uint64_t>(Cases.back().first) -
+                  static_cast<uint64_t>(Min);
+
+  // One mask per destination, tested in order of how many cases hit it
+  std::map<MachineBasicBlock*, uint64_t> Masks;
+  std::map<MachineBasicBlock*, unsigned> Counts;
+  std::vector<MachineBasicBlock*> Order;
+  for (const auto& Case : Cases) {
+    uint64_t Bit = static_cast<uint64_t>(Case.first) -
+                   static_cast<uint64_t>(Min);
+    if (!Masks.count(Case.second)) Order.push_back(Case.second);
+    Masks[Case.second] |= uint64_t(1) << Bit;
+    Counts[Case.second]++;
+  }
+  std::stable_sort(Order.begin(), Order.end(),
+                   [&](MachineBasicBlock* A, MachineBasicBlock* B) {
+                     return Counts[A] > Counts[B];
+                   });
+
+  emitSwitchRangeCheck(Min, Span, Default);
+  for (MachineBasicBlock* Dest : Order) {
+    emitCopy(X86::R10, MO::createImm(static_cast<int64_t>(Masks[Dest])));
+    emit(X86::BT, {MO::createReg(X86::R10), MO::createReg(X86::R11)});
+    emitBranch(X86::COND_B, Dest);
+  }
+  emitBranch(X86::COND_NONE, Default);
+}
+
+void X86InstrSelector::emitSwitchCompareTree(const SwitchCaseList& Cases,
+                                             size_t Lo, size_t Hi,
+                                             MachineBasicBlock* Default,
+                                             const std::string& Prefix,
+                                             unsigned& NextLabel) {
+  // Small ranges are cheaper as a run of compares
+  if (Hi - Lo <= 3) {
+    for (size_t i = Lo; i < Hi; ++i) {
+      emitCompareImm(X86::R11, Cases[i].first);
+      emitBranch(X86::COND_E, Cases[i].second);
+    }
+    emitBranch(X86::COND_NONE, Default);
+    return;
+  }
+
+  size_t Mid = Lo + (Hi - Lo) / 2;
+  MachineBasicBlock* Upper =
+    MF->createBlock(Prefix + "_" + std::to_string(NextLabel++), MBB);
+
+  emitCompareImm(X86::R11, Cases[Mid].first);
+  emitBranch(X86::COND_E, Cases[Mid].second);
+  emitBranch(X86::COND_G, Upper);
+  emitSwitchCompareTree(Cases, Lo, Mid, Default, Prefix, NextLabel);
+  MBB = Upper;
+  emitSwitchCompareTree(Cases, Mid + 1, Hi, Default, Prefix, NextLabel);
+}
+
+} // namespace yac
@@ -1,8 +1,17 @@
 #include "yac/CodeGen/X86_64Backend.h"
-#include <iomanip>
+#include "yac/CodeGen/GraphColoringAllocator.h"
+#include "yac/CodeGen/IRUtils.h"
+#include "yac/CodeGen/RegisterAllocator.h"
+#include "yac/CodeGen/StackSlotColoring.h"
+#include "yac/CodeGen/X86AsmPrinter.h"
+#include "yac/CodeGen/X86ISel.h"
+#include <algorithm>
+#include <set>
 
 namespace yac {
 
+using MO = MachineOperand;
+
 void X86_64Backend::generateAssembly(IRModule* M) {
   // Emit assembly header
   OS << "\t.text\n";
@@ -13,343 +22,165 @@ void X86_64Backend::generateAssembly(IRModule* M) {
     generateFunction(F.get());
     OS << "\n";
   }
-}
-
-void X86_64Backend::generateFunction(IRFunction* F) {
-  // Reset state for new function
-  LabelToBlock.clear();
-
-  // Build label to block mapping
-  for (const auto& BB : F->getBlocks()) {
-    LabelToBlock[BB->getName()] = BB.get();
-  }
-
-  // Run register allocation
-  RegisterAllocator Allocator;
-  Allocator.allocate(F);
-  RegAlloc = &Allocator;
-
-  // Function label (make main global)
-  if (F->getName() == "main") {
-    OS << "\t.globl _main\n";
-    OS << "_main:\n";
-  } else {
-    OS << "\t.globl _" << F->getName() << "\n";
-    OS << "_" << F->getName() << ":\n";
-  }
-
-  emitPrologue(F);
 
-  // Generate code for each basic block
-  for (const auto& BB : F->getBlocks()) {
-    // Skip entry block label (already at function start)
-    if (BB->getName() != "entry") {
-      OS << "." << BB->getName() << ":\n";
-    }
-
-    // Generate instructions
-    for (const auto& Inst : BB->getInstructions()) {
-      generateInstruction(Inst.get());
+  // Globals are 8-byte slots, arrays get one slot per element
+  if (!M->getGlobals().empty()) {
+    OS << "\t.data\n";
+    for (const auto& G : M->getGlobals()) {
+      if (!G->isInternal()) {
+        OS << "\t.globl _" << G->getName() << "\n";
+      }
+      OS << "\t.p2align 3\n";
+      OS << "_" << G->getName() << ":\n";
+      auto* ArrTy = dynamic_cast<ArrayType*>(G->getType());
+      if (ArrTy && ArrTy->isSized()) {
+        OS << "\t.zero " << 8 * std::max(ArrTy->getSize(), 1) << "\n";
+      } else {
+        OS << "\t.quad " << G->getInitializer() << "\n";
+      }
     }
   }
-
-  emitEpilogue(F);
-}
-
-void X86_64Backend::emitPrologue(IRFunction* F) {
-  OS << "\tpush rbp\n";
-  OS << "\tmov rbp, rsp\n";
-
-  // Reserve stack space for spilled values
-  int SpillSize = RegAlloc ? RegAlloc->getSpillSlotSize() : 0;
-  if (SpillSize > 0) {
-    // Align to 16 bytes for ABI compliance
-    SpillSize = (SpillSize + 15) & ~15;
-    OS << "\tsub rsp, " << SpillSize << "\n";
-  }
-}
-
-void X86_64Backend::emitEpilogue(IRFunction* F) {
-  // Note: epilogue is emitted in ret instruction
-}
-
-void X86_64Backend::generateInstruction(IRInstruction* I) {
-  if (auto* BinOp = dynamic_cast<IRBinaryInst*>(I)) {
-    generateBinaryInst(BinOp);
-  } else if (auto* UnOp = dynamic_cast<IRUnaryInst*>(I)) {
-    generateUnaryInst(UnOp);
-  } else if (auto* Load = dynamic_cast<IRLoadInst*>(I)) {
-    generateLoadInst(Load);
-  } else if (auto* Store = dynamic_cast<IRStoreInst*>(I)) {
-    generateStoreInst(Store);
-  } else if (auto* Alloca = dynamic_cast<IRAllocaInst*>(I)) {
-    generateAllocaInst(Alloca);
-  } else if (auto* Ret = dynamic_cast<IRRetInst*>(I)) {
-    generateRetInst(Ret);
-  } else if (auto* Br = dynamic_cast<IRBrInst*>(I)) {
-    generateBrInst(Br);
-  } else if (auto* CondBr = dynamic_cast<IRCondBrInst*>(I)) {
-    generateCondBrInst(CondBr);
-  } else if (auto* Call = dynamic_cast<IRCallInst*>(I)) {
-    generateCallInst(Call);
-  } else if (auto* Phi = dynamic_cast<IRPhiInst*>(I)) {
-    generatePhiInst(Phi);
-  }
-}
-
-void X86_64Backend::generateBinaryInst(IRBinaryInst* I) {
-  std::string lhs = getOperand(I->getLHS());
-  std::string rhs = getOperand(I->getRHS());
-  std::string result = allocResult(I->getResult());
-
-  switch (I->getOpcode()) {
-  case IRInstruction::Add:
-    OS << "\tmov " << result << ", " << lhs << "\n";
-    OS << "\tadd " << result << ", " << rhs << "\n";
-    break;
-  case IRInstruction::Sub:
-    OS << "\tmov " << result << ", " << lhs << "\n";
-    OS << "\tsub " << result << ", " << rhs << "\n";
-    break;
-  case IRInstruction::Mul:
-    OS << "\tmov rax, " << lhs << "\n";
-    OS << "\timul " << rhs << "\n";
-    OS << "\tmov " << result << ", rax\n";
-    break;
-  case IRInstruction::Div:
-    OS << "\tmov rax, " << lhs << "\n";
-    OS << "\tcqo\n";  // Sign extend
-    OS << "\tidiv " << rhs << "\n";
-    OS << "\tmov " << result << ", rax\n";
-    break;
-  case IRInstruction::Lt:
-    OS << "\txor " << result << ", " << result << "\n";
-    OS << "\tcmp " << lhs << ", " << rhs << "\n";
-    OS << "\tsetl " << getByteReg(result) << "\n";
-    break;
-  case IRInstruction::Le:
-    OS << "\txor " << result << ", " << result << "\n";
-    OS << "\tcmp " << lhs << ", " << rhs << "\n";
-    OS << "\tsetle " << getByteReg(result) << "\n";
-    break;
-  case IRInstruction::Gt:
-    OS << "\txor " << result << ", " << result << "\n";
-    OS << "\tcmp " << lhs << ", " << rhs << "\n";
-    OS << "\tsetg " << getByteReg(result) << "\n";
-    break;
-  case IRInstruction::Ge:
-    OS << "\txor " << result << ", " << result << "\n";
-    OS << "\tcmp " << lhs << ", " << rhs << "\n";
-    OS << "\tsetge " << getByteReg(result) << "\n";
-    break;
-  case IRInstruction::Eq:
-    OS << "\txor " << result << ", " << result << "\n";
-    OS << "\tcmp " << lhs << ", " << rhs << "\n";
-    OS << "\tsete " << getByteReg(result) << "\n";
-    break;
-  case IRInstruction::Ne:
-    OS << "\txor " << result << ", " << result << "\n";
-    OS << "\tcmp " << lhs << ", " << rhs << "\n";
-    OS << "\tsetne " << getByteReg(result) << "\n";
-    break;
-  default:
-    OS << "\t# TODO: " << IRInstruction::getOpcodeName(I->getOpcode()) << "\n";
-    break;
-  }
 }
 
-void X86_64Backend::generateUnaryInst(IRUnaryInst* I) {
-  std::string operand = getOperand(I->getOperand());
-  std::string result = allocResult(I->getResult());
-
-  switch (I->getOpcode()) {
-  case IRInstruction::Not:
-    OS << "\tmov " << result << ", " << operand << "\n";
-    OS << "\txor " << result << ", 1\n";  // Logical not: 0->1, non-zero->0
-    break;
-  default:
-    OS << "\t# TODO: Unary " << IRInstruction::getOpcodeName(I->getOpcode()) << "\n";
-    break;
-  }
-}
-
-void X86_64Backend::generateLoadInst(IRLoadInst* I) {
-  // Simplified: ignore for SSA form (loads eliminated by Mem2Reg)
-  OS << "\t# load eliminated by SSA\n";
-}
-
-void X86_64Backend::generateStoreInst(IRStoreInst* I) {
-  // Simplified: ignore for SSA form (stores eliminated by Mem2Reg)
-  OS << "\t# store eliminated by SSA\n";
-}
+void X86_64Backend::generateFunction(IRFunction* F) {
+  // Give every phi edge a block to hold its copies
+  splitCriticalEdges(F);
 
-void X86_64Backend::generateAllocaInst(IRAllocaInst* I) {
-  // Simplified: allocas handled by stack frame
-  OS << "\t# alloca handled in prologue\n";
-}
+  X86InstrSelector ISel;
+  std::unique_ptr<MachineFunction> MF = ISel.select(F);
 
-void X86_64Backend::generateRetInst(IRRetInst* I) {
-  if (I->hasRetValue()) {
-    std::string retVal = getOperand(I->getRetValue());
-    OS << "\tmov rax, " << retVal << "\n";
+  if (RegAlloc == RegAllocKind::GraphColoring) {
+    GraphColoringAllocator Allocator;
+    Allocator.allocate(*MF);
+  } else {
+    RegisterAllocator Allocator;
+    Allocator.allocate(*MF);
   }
 
-  // Epilogue
-  OS << "\tmov rsp, rbp\n";
-  OS << "\tpop rbp\n";
-  OS << "\tret\n";
-}
-
-void X86_64Backend::generateBrInst(IRBrInst* I) {
-  IRBasicBlock* FromBB = I->getParent();
-  std::string targetName = I->getTarget()->getName();
-  IRBasicBlock* ToBB = LabelToBlock[targetName];
+  optimizeBranches(*MF);
+  FrameBytesSaved[F->getName()] = colorStackSlots(*MF);
+  layoutFrame(*MF);
+  insertPrologueEpilogue(*MF);
 
-  // Emit phi moves before jumping
-  if (ToBB) {
-    emitPhiMoves(FromBB, ToBB);
-  }
-
-  OS << "\tjmp ." << targetName << "\n";
+  X86AsmPrinter Printer(OS);
+  Printer.printFunction(*MF);
 }
 
-void X86_64Backend::generateCondBrInst(IRCondBrInst* I) {
-  IRBasicBlock* FromBB = I->getParent();
-  std::string trueName = I->getTrueLabel()->getName();
-  std::string falseName = I->getFalseLabel()->getName();
-  IRBasicBlock* TrueBB = LabelToBlock[trueName];
-  IRBasicBlock* FalseBB = LabelToBlock[falseName];
+// ===----------------------------------------------------------------------===
+// Branch cleanup
+// ===----------------------------------------------------------------------===
 
-  std::string cond = getOperand(I->getCondition());
+void X86_64Backend::optimizeBranches(MachineFunction& MF) {
+  const auto& Blocks = MF.getBlocks();
+  for (size_t i = 0; i + 1 < Blocks.size(); ++i) {
+    MachineBasicBlock* MBB = Blocks[i].get();
+    MachineBasicBlock* Next = Blocks[i + 1].get();
+    if (MBB->empty()) continue;
 
-  OS << "\ttest " << cond << ", " << cond << "\n";
-
-  // Emit phi moves for true branch, then jump
-  OS << "\tjz .false_branch_" << FromBB->getName() << "\n";
-  if (TrueBB) {
-    emitPhiMoves(FromBB, TrueBB);
-  }
-  OS << "\tjmp ." << trueName << "\n";
+    // jmp to the next block
+    MachineInstr* Last = MBB->instrs().back().get();
+    if (Last->getOpcode() != X86::JMP || !Last->getOperand(0).isBlock())
+      continue;
+    if (Last->getOperand(0).getBlock() == Next) {
+      MBB->erase(MBB->size() - 1);
+      continue;
+    }
 
-  // False branch
-  OS << ".false_branch_" << FromBB->getName() << ":\n";
-  if (FalseBB) {
-    emitPhiMoves(FromBB, FalseBB);
+    // jcc Next; jmp Other  ->  jn<cc> Other
+    if (MBB->size() < 2) continue;
+    MachineInstr* Cond = MBB->instrs()[MBB->size() - 2].get();
+    if (Cond->getOpcode() != X86::JCC ||
+        Cond->getOperand(0).getBlock() != Next) {
+      continue;
+    }
+    Cond->setCondCode(X86::getInverseCondCode(Cond->getCondCode()));
+    Cond->getOperand(0).setBlock(Last->getOperand(0).getBlock());
+    MBB->erase(MBB->size() - 1);
   }
-  OS << "\tjmp ." << falseName << "\n";
 }
 
-void X86_64Backend::generateCallInst(IRCallInst* I) {
-  // Simplified calling convention (System V AMD64 ABI)
-  const auto& Args = I->getArgs();
-  const char* ArgRegs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
-
-  // Move arguments to registers
-  for (size_t i = 0; i < Args.size() && i < 6; ++i) {
-    std::string arg = getOperand(Args[i]);
-    OS << "\tmov " << ArgRegs[i] << ", " << arg << "\n";
-  }
-
-  // Call function (add underscore for macOS)
-  OS << "\tcall _" << I->getFuncName() << "\n";
+// ===----------------------------------------------------------------------===
+// Frame lowering
+// ===----------------------------------------------------------------------===
 
-  // Result in rax
-  if (I->getResult()) {
-    std::string result = allocResult(I->getResult());
-    OS << "\tmov " << result << ", rax\n";
+void X86_64Backend::layoutFrame(MachineFunction& MF) {
+  // Callee-saved registers the function writes are pushed right below the
+  // saved rbp
+  std::set<unsigned> Written;
+  for (const auto& MBB : MF.getBlocks()) {
+    for (const auto& MI : MBB->instrs()) {
+      for (unsigned Reg : MI->getDefs()) Written.insert(Reg);
+    }
   }
-}
-
-void X86_64Backend::generatePhiInst(IRPhiInst* I) {
-  // Phi nodes handled by phi resolution in branches
-  OS << "\t# phi node (handled by branch phi moves)\n";
-}
-
-std::string X86_64Backend::allocResult(IRValue* V) {
-  if (!RegAlloc) return "rax";  // Fallback
-
-  std::string Reg = RegAlloc->getRegister(V);
-  if (!Reg.empty()) {
-    return Reg;
+  std::vector<unsigned> Saved;
+  for (unsigned Reg : X86::CalleeSavedRegs) {
+    if (Written.count(Reg)) Saved.push_back(Reg);
   }
+  MF.setSavedRegs(Saved);
+  int64_t SaveSize = 8 * static_cast<int64_t>(Saved.size());
 
-  // Value is spilled, use rax as temp (caller should handle spill)
-  return "rax";
-}
-
-std::string X86_64Backend::getOperand(IRValue* V) {
-  if (V->isConstant()) {
-    return std::to_string(V->getConstant());
+  // Stack objects sit below those
+  int64_t Offset = SaveSize;
+  for (FrameObject& Obj : MF.getFrameObjects()) {
+    Offset += Obj.Size;
+    Offset = (Offset + Obj.Align - 1) / Obj.Align * Obj.Align;
+    Obj.Offset = -Offset;
   }
 
-  if (!RegAlloc) return "rax";  // Fallback
+  // Align to 16 bytes for ABI compliance, pushes included
+  MF.setStackSize(((Offset + 15) & ~int64_t(15)) - SaveSize);
 
-  std::string Reg = RegAlloc->getRegister(V);
-  if (!Reg.empty()) {
-    return Reg;
+  for (const auto& MBB : MF.getBlocks()) {
+    for (const auto& MI : MBB->instrs()) {
+      for (MO& Op : MI->operands()) {
+        if (Op.isFrameIndex()) {
+          Op.resolveFrameIndex(X86::RBP,
+                               MF.getFrameObjects()[Op.getFrameIndex()].Offset);
+        }
+      }
+    }
   }
-
-  // Value is spilled, load it into rax
-  // TODO: Better temp register management for spills
-  loadSpilledValue(V, "rax");
-  return "rax";
-}
-
-void X86_64Backend::loadSpilledValue(IRValue* V, const std::string& TempReg) {
-  if (!RegAlloc || !RegAlloc->isSpilled(V)) return;
-
-  int Offset = RegAlloc->getStackOffset(V);
-  int ByteOffset = -((Offset + 1) * 8);  // Negative offset from rbp
-  OS << "\tmov " << TempReg << ", [rbp" << ByteOffset << "]\n";
 }
 
-void X86_64Backend::storeSpilledValue(IRValue* V, const std::string& TempReg) {
-  if (!RegAlloc || !RegAlloc->isSpilled(V)) return;
-
-  int Offset = RegAlloc->getStackOffset(V);
-  int ByteOffset = -((Offset + 1) * 8);  // Negative offset from rbp
-  OS << "\tmov [rbp" << ByteOffset << "], " << TempReg << "\n";
-}
-
-std::string X86_64Backend::getByteReg(const std::string& Reg) {
-  // Convert 64-bit register to 8-bit register for setcc instructions
-  if (Reg == "rax") return "al";
-  if (Reg == "rbx") return "bl";
-  if (Reg == "rcx") return "cl";
-  if (Reg == "rdx") return "dl";
-  if (Reg == "rsi") return "sil";
-  if (Reg == "rdi") return "dil";
-  if (Reg == "r8")  return "r8b";
-  if (Reg == "r9")  return "r9b";
-  if (Reg == "r10") return "r10b";
-  if (Reg == "r11") return "r11b";
-  if (Reg == "r12") return "r12b";
-  if (Reg == "r13") return "r13b";
-  if (Reg == "r14") return "r14b";
-  if (Reg == "r15") return "r15b";
-  return "al";  // Default
-}
-
-void X86_64Backend::emitPhiMoves(IRBasicBlock* FromBB, IRBasicBlock* ToBB) {
-  // Emit moves for phi nodes in the target block
-  // For each phi in ToBB, find the incoming value from FromBB and emit a mov
-
-  for (const auto& Inst : ToBB->getInstructions()) {
-    auto* Phi = dynamic_cast<IRPhiInst*>(Inst.get());
-    if (!Phi) {
-      // Phi nodes are at the beginning of blocks
-      break;
-    }
-
-    // Find the incoming value from FromBB
-    for (const auto& Entry : Phi->getIncomings()) {
-      if (Entry.Block == FromBB) {
-        // Found the incoming value for this predecessor
-        std::string phiReg = allocResult(Phi->getResult());
-        std::string valueOp = getOperand(Entry.Value);
-        OS << "\tmov " << phiReg << ", " << valueOp << "\n";
-        break;
+void X86_64Backend::insertPrologueEpilogue(MachineFunction& MF) {
+  auto makeInstr = [](X86::Opcode Op, std::vector<MO> Ops) {
+    return std::make_unique<MachineInstr>(Op, std::move(Ops));
+  };
+
+  MachineBasicBlock* Entry = MF.getBlocks().front().get();
+  const std::vector<unsigned>& Saved = MF.getSavedRegs();
+  size_t Pos = 0;
+  Entry->insert(Pos++, makeInstr(X86::PUSH, {MO::createReg(X86::RBP)}));
+  Entry->insert(Pos++, makeInstr(X86::MOV, {MO::createReg(X86::RBP, MO::Def),
+                                            MO::createReg(X86::RSP)}));
+  for (unsigned Reg : Saved) {
+    Entry->insert(Pos++, makeInstr(X86::PUSH, {MO::createReg(Reg)}));
+  }
+  if (MF.getStackSize() > 0) {
+    Entry->insert(Pos++, makeInstr(X86::SUB,
+                                   {MO::createReg(X86::RSP, MO::Use | MO::Def),
+                                    MO::createImm(MF.getStackSize())}));
+  }
+
+  // Tear the frame down before every return. With registers to restore,
+  // rsp goes back to just below them rather than to rbp.
+  for (const auto& MBB : MF.getBlocks()) {
+    for (size_t i = 0; i < MBB->size(); ++i) {
+      if (!MBB->instrs()[i]->isReturn()) continue;
+      if (Saved.empty()) {
+        MBB->insert(i++, makeInstr(X86::MOV, {MO::createReg(X86::RSP, MO::Def),
+                                              MO::createReg(X86::RBP)}));
+      } else {
+        int64_t SaveSize = 8 * static_cast<int64_t>(Saved.size());
+        MBB->insert(i++, makeInstr(X86::LEA,
+                                   {MO::createReg(X86::RSP, MO::Def),
+                                    MO::createMem(X86::RBP, -SaveSize)}));
+        for (auto It = Saved.rbegin(); It != Saved.rend(); ++It) {
+          MBB->insert(i++, makeInstr(X86::POP, {MO::createReg(*It, MO::Def)}));
+        }
       }
+      MBB->insert(i++, makeInstr(X86::POP, {MO::createReg(X86::RBP,
+                                                          MO::Def)}));
     }
   }
 }
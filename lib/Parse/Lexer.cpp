@@ -344,6 +344,7 @@ Token Lexer::lexOperator() {
   case ']': Kind = TokenKind::RBracket; break;
   case ',': Kind = TokenKind::Comma; break;
   case ';': Kind = TokenKind::Semicolon; break;
+  case ':': Kind = TokenKind::Colon; break;
   default: return Token(); // Unknown
   }
 
@@ -376,6 +377,10 @@ TokenKind Lexer::identifyKeyword(const std::string& Text) {
   if (Text == "return") return TokenKind::KW_return;
   if (Text == "break") return TokenKind::KW_break;
   if (Text == "continue") return TokenKind::KW_continue;
+  if (Text == "switch") return TokenKind::KW_switch;
+  if (Text == "case") return TokenKind::KW_case;
+  if (Text == "default") return TokenKind::KW_default;
+  if (Text == "static") return TokenKind::KW_static;
   return TokenKind::Identifier;
 }
 
@@ -104,6 +104,8 @@ Type* Parser::parseTypeSpecifier() {
 // ===----------------------------------------------------------------------===
 
 Decl* Parser::parseDeclaration() {
+  bool IsStatic = consume(TokenKind::KW_static);
+
   // Parse type specifier
   Type* DeclType = parseTypeSpecifier();
   if (!DeclType) return nullptr;
@@ -121,10 +123,14 @@ Decl* Parser::parseDeclaration() {
   // Check if it's a function or variable
   if (currentToken().is(TokenKind::LParen)) {
     // Function declaration/definition
-    return parseFunctionDeclaration(DeclType, Name);
+    FunctionDecl* FD = parseFunctionDeclaration(DeclType, Name);
+    if (FD) FD->setStatic(IsStatic);
+    return FD;
   } else {
     // Variable declaration
-    return parseVariableDeclaration(DeclType, Name);
+    VarDecl* VD = parseVariableDeclaration(DeclType, Name);
+    if (VD) VD->setStatic(IsStatic);
+    return VD;
   }
 }
 
@@ -227,6 +233,12 @@ Stmt* Parser::parseStatement() {
     return parseForStatement();
   case TokenKind::KW_do:
     return parseDoStatement();
+  case TokenKind::KW_switch:
+    return parseSwitchStatement();
+  case TokenKind::KW_case:
+    return parseCaseStatement();
+  case TokenKind::KW_default:
+    return parseDefaultStatement();
   case TokenKind::KW_return:
     return parseReturnStatement();
   case TokenKind::KW_break: {
@@ -247,7 +259,8 @@ Stmt* Parser::parseStatement() {
   case TokenKind::KW_int:
   case TokenKind::KW_float:
   case TokenKind::KW_char:
-  case TokenKind::KW_void: {
+  case TokenKind::KW_void:
+  case TokenKind::KW_static: {
     Decl* D = parseDeclaration();
     if (D) {
       return create<DeclStmt>(D->getSourceRange(), D);
@@ -384,6 +397,51 @@ Stmt* Parser::parseDoStatement() {
                         std::unique_ptr<Expr>(Cond));
 }
 
+Stmt* Parser::parseSwitchStatement() {
+  SourceLocation Loc = currentToken().getLocation();
+  advance(); // consume 'switch'
+
+  expect(TokenKind::LParen);
+  advance();
+
+  Expr* Cond = parseExpression();
+
+  expect(TokenKind::RParen);
+  advance();
+
+  Stmt* Body = parseStatement();
+
+  return create<SwitchStmt>(SourceRange(Loc), std::unique_ptr<Expr>(Cond),
+                            std::unique_ptr<Stmt>(Body));
+}
+
+Stmt* Parser::parseCaseStatement() {
+  SourceLocation Loc = currentToken().getLocation();
+  advance(); // consume 'case'
+
+  Expr* Value = parseExpression();
+
+  expect(TokenKind::Colon);
+  advance();
+
+  Stmt* Sub = parseStatement();
+
+  return create<CaseStmt>(SourceRange(Loc), std::unique_ptr<Expr>(Value),
+                          std::unique_ptr<Stmt>(Sub));
+}
+
+Stmt* Parser::parseDefaultStatement() {
+  SourceLocation Loc = currentToken().getLocation();
+  advance(); // consume 'default'
+
+  expect(TokenKind::Colon);
+  advance();
+
+  Stmt* Sub = parseStatement();
+
+  return create<DefaultStmt>(SourceRange(Loc), std::unique_ptr<Stmt>(Sub));
+}
+
 Stmt* Parser::parseReturnStatement() {
   SourceLocation Loc = currentToken().getLocation();
   advance(); // consume 'return'
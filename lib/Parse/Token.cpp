@@ -22,6 +22,10 @@ const char* Token::getTokenKindName(TokenKind K) {
   case TokenKind::KW_return: return "return";
   case TokenKind::KW_break: return "break";
   case TokenKind::KW_continue: return "continue";
+  case TokenKind::KW_switch: return "switch";
+  case TokenKind::KW_case: return "case";
+  case TokenKind::KW_default: return "default";
+  case TokenKind::KW_static: return "static";
   case TokenKind::Plus: return "+";
   case TokenKind::Minus: return "-";
   case TokenKind::Star: return "*";
@@ -57,6 +61,7 @@ const char* Token::getTokenKindName(TokenKind K) {
   case TokenKind::RBracket: return "]";
   case TokenKind::Comma: return ",";
   case TokenKind::Semicolon: return ";";
+  case TokenKind::Colon: return ":";
   case TokenKind::Unknown: return "Unknown";
   }
   return "Unknown";
@@ -55,6 +55,72 @@ bool Sema::isScalarType(Type* Ty) {
   return Ty->isScalarType();
 }
 
+bool Sema::evaluateIntegerConstant(Expr* E, int64_t& Result) {
+  if (auto* IL = dynamic_cast<IntegerLiteral*>(E)) {
+    Result = IL->getValue();
+    return true;
+  }
+  if (auto* CL = dynamic_cast<CharLiteral*>(E)) {
+    Result = CL->getValue();
+    return true;
+  }
+  if (auto* Cast = dynamic_cast<ImplicitCastExpr*>(E)) {
+    return evaluateIntegerConstant(Cast->getSubExpr(), Result);
+  }
+  if (auto* UO = dynamic_cast<UnaryOperator*>(E)) {
+    int64_t V;
+    if (!evaluateIntegerConstant(UO->getSubExpr(), V)) return false;
+    switch (UO->getOp()) {
+    case UnaryOperatorKind::Plus: Result = V; return true;
+    case UnaryOperatorKind::Minus:
+      Result = static_cast<int64_t>(0 - static_cast<uint64_t>(V));
+      return true;
+    case UnaryOperatorKind::Not: Result = !V; return true;
+    case UnaryOperatorKind::BitwiseNot: Result = ~V; return true;
+    default: return false;
+    }
+  }
+  if (auto* BO = dynamic_cast<BinaryOperator*>(E)) {
+    int64_t L, R;
+    if (!evaluateIntegerConstant(BO->getLHS(), L) ||
+        !evaluateIntegerConstant(BO->getRHS(), R)) {
+      return false;
+    }
+    uint64_t UL = static_cast<uint64_t>(L), UR = static_cast<uint64_t>(R);
+    switch (BO->getOp()) {
+    case BinaryOperatorKind::Add: Result = static_cast<int64_t>(UL + UR); return true;
+    case BinaryOperatorKind::Sub: Result = static_cast<int64_t>(UL - UR); return true;
+    case BinaryOperatorKind::Mul: Result = static_cast<int64_t>(UL * UR); return true;
+    case BinaryOperatorKind::Div:
+    case BinaryOperatorKind::Mod:
+      if (R == 0 || (R == -1 && L == INT64_MIN)) return false;
+      Result = BO->getOp() == BinaryOperatorKind::Div ? L / R : L % R;
+      return true;
+    case BinaryOperatorKind::LT: Result = L < R; return true;
+    case BinaryOperatorKind::GT: Result = L > R; return true;
+    case BinaryOperatorKind::LE: Result = L <= R; return true;
+    case BinaryOperatorKind::GE: Result = L >= R; return true;
+    case BinaryOperatorKind::EQ: Result = L == R; return true;
+    case BinaryOperatorKind::NE: Result = L != R; return true;
+    case BinaryOperatorKind::LAnd: Result = L && R; return true;
+    case BinaryOperatorKind::LOr: Result = L || R; return true;
+    case BinaryOperatorKind::And: Result = L & R; return true;
+    case BinaryOperatorKind::Or: Result = L | R; return true;
+    case BinaryOperatorKind::Xor: Result = L ^ R; return true;
+    case BinaryOperatorKind::Shl:
+    case BinaryOperatorKind::Shr:
+      if (R < 0 || R > 63) return false;
+      Result = BO->getOp() == BinaryOperatorKind::Shl
+                   ? static_cast<int64_t>(UL << R)
+                   : L >> R;
+      return true;
+    default:
+      return false;
+    }
+  }
+  return false;
+}
+
 bool Sema::checkAssignmentTypes(Type* LHS, Type* RHS, SourceLocation Loc) {
   if (LHS->isCompatibleWith(RHS)) {
     return true;
@@ -86,6 +152,20 @@ void Sema::visitVarDecl(VarDecl* D) {
       checkAssignmentTypes(D->getType(), InitType, Init->getLocation());
     }
   }
+
+  if (!CurrentFunction) {
+    // Globals are laid out in the data section, so their initial value
+    // must be known now
+    int64_t Value = 0;
+    if (D->getInit() && !evaluateIntegerConstant(D->getInit(), Value)) {
+      Diag.error(D->getInit()->getLocation(),
+                 "Initializer of global variable '" + D->getName() +
+                     "' is not an integer constant expression");
+    }
+    D->setInitValue(Value);
+  } else if (D->isStatic()) {
+    Diag.error(D->getLocation(), "'static' local variables are not supported");
+  }
 }
 
 void Sema::visitParmVarDecl(ParmVarDecl* D) {
@@ -258,9 +338,9 @@ void Sema::visitDoStmt(DoStmt* S) {
 }
 
 void Sema::visitBreakStmt(BreakStmt* S) {
-  if (LoopDepth == 0) {
+  if (LoopDepth == 0 && SwitchStack.empty()) {
     Diag.error(S->getLocation(),
-               "Break statement not in loop");
+               "Break statement not in loop or switch");
   }
 }
 
@@ -271,6 +351,56 @@ void Sema::visitContinueStmt(ContinueStmt* S) {
   }
 }
 
+void Sema::visitSwitchStmt(SwitchStmt* S) {
+  Type* CondType = getExprType(S->getCondition());
+  if (CondType && !isIntegerType(CondType)) {
+    Diag.error(S->getCondition()->getLocation(),
+               "Switch condition must have integer type");
+  }
+
+  SwitchStack.emplace_back();
+  visit(S->getBody());
+  SwitchStack.pop_back();
+}
+
+void Sema::visitCaseStmt(CaseStmt* S) {
+  if (SwitchStack.empty()) {
+    Diag.error(S->getLocation(), "Case label not in switch statement");
+  }
+
+  Type* ValueType = getExprType(S->getValueExpr());
+  int64_t Value;
+  if (ValueType && !isIntegerType(ValueType)) {
+    Diag.error(S->getValueExpr()->getLocation(),
+               "Case label must have integer type");
+  } else if (!evaluateIntegerConstant(S->getValueExpr(), Value)) {
+    Diag.error(S->getValueExpr()->getLocation(),
+               "Case label is not an integer constant expression");
+  } else {
+    S->setValue(Value);
+    if (!SwitchStack.empty() &&
+        !SwitchStack.back().CaseValues.insert(Value).second) {
+      Diag.error(S->getLocation(),
+                 "Duplicate case value '" + std::to_string(Value) + "'");
+    }
+  }
+
+  visit(S->getSubStmt());
+}
+
+void Sema::visitDefaultStmt(DefaultStmt* S) {
+  if (SwitchStack.empty()) {
+    Diag.error(S->getLocation(), "Default label not in switch statement");
+  } else if (SwitchStack.back().HasDefault) {
+    Diag.error(S->getLocation(),
+               "Multiple default labels in one switch");
+  } else {
+    SwitchStack.back().HasDefault = true;
+  }
+
+  visit(S->getSubStmt());
+}
+
 // ===----------------------------------------------------------------------===
 // Expression visitors - Literals
 // ===----------------------------------------------------------------------===
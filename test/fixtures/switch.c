@@ -0,0 +1,30 @@
+int classify(int x) {
+  int r = 0;
+  switch (x) {
+  case 0:
+    r = 10;
+    break;
+  case 1:
+  case 2:
+    r = 20;
+    break;
+  case 3:
+    r = 30;
+  case 4:
+    r = r + 1;
+    break;
+  default:
+    r = -1;
+  }
+  return r;
+}
+
+int main() {
+  int sum = 0;
+  int i;
+  for (i = 0; i < 8; i = i + 1) {
+    if (i == 6) continue;
+    sum = sum + classify(i);
+  }
+  return sum;
+}
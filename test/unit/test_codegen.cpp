@@ -0,0 +1,611 @@
+#include "yac/CodeGen/DivisionByConstant.h"
+#include "yac/CodeGen/GraphColoringAllocator.h"
+#include "yac/CodeGen/IRBuilder.h"
+#include "yac/CodeGen/IRUtils.h"
+#include "yac/CodeGen/ParallelCopy.h"
+#include "yac/CodeGen/RegisterAllocator.h"
+#include "yac/CodeGen/StackSlotColoring.h"
+#include "yac/CodeGen/SwitchLowering.h"
+#include "yac/CodeGen/Transforms.h"
+#include "yac/CodeGen/X86ISel.h"
+#include "yac/CodeGen/X86_64Backend.h"
+#include "yac/Parse/Lexer.h"
+#include "yac/Parse/Parser.h"
+#include "yac/Sema/Sema.h"
+#include <gtest/gtest.h>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+
+using namespace yac;
+
+namespace {
+
+__extension__ typedef __int128 Int128;
+
+// Evaluate the sequences emitted by X86_64Backend for a constant divisor,
+// using a 128-bit product for the high half of imul.
+int64_t mulhs(int64_t A, int64_t B) {
+  return static_cast<int64_t>((static_cast<Int128>(A) * B) >> 64);
+}
+
+int64_t lowerDiv(int64_t X, int64_t D) {
+  unsigned K;
+  if (isPowerOf2Divisor(D, K)) {
+    uint64_t Bias = static_cast<uint64_t>(X >> 63) >> (64 - K);
+    int64_t Q = static_cast<int64_t>(static_cast<uint64_t>(X) + Bias) >> K;
+    return D < 0 ? static_cast<int64_t>(0 - static_cast<uint64_t>(Q)) : Q;
+  }
+
+  SignedDivMagic Magic = computeSignedDivMagic(D);
+  uint64_t Q = static_cast<uint64_t>(mulhs(X, Magic.Multiplier));
+  if (D > 0 && Magic.Multiplier < 0) Q += static_cast<uint64_t>(X);
+  if (D < 0 && Magic.Multiplier > 0) Q -= static_cast<uint64_t>(X);
+  int64_t S = static_cast<int64_t>(Q) >> Magic.Shift;
+  return S + static_cast<int64_t>(static_cast<uint64_t>(S) >> 63);
+}
+
+int64_t lowerRem(int64_t X, int64_t D) {
+  unsigned K;
+  if (isPowerOf2Divisor(D, K)) {
+    uint64_t Bias = static_cast<uint64_t>(X >> 63) >> (64 - K);
+    uint64_t Rounded = (static_cast<uint64_t>(X) + Bias) & ~((1ULL << K) - 1);
+    return static_cast<int64_t>(static_cast<uint64_t>(X) - Rounded);
+  }
+
+  uint64_t Q = static_cast<uint64_t>(lowerDiv(X, D));
+  return static_cast<int64_t>(static_cast<uint64_t>(X) -
+                              Q * static_cast<uint64_t>(D));
+}
+
+/// Compile Source to IR with types owned by TyCtx. OptLevel 2 runs the SSA
+/// cleanup passes the backend relies on for selects.
+std::unique_ptr<IRModule> buildModule(const std::string& Source,
+                                      TypeContext& TyCtx,
+                                      unsigned OptLevel = 0) {
+  DiagnosticEngine Diag;
+  Lexer Lex(Source, "test.c", Diag);
+  Parser P(Lex.tokenize(), Diag, TyCtx);
+  auto TU = P.parseTranslationUnit();
+  Sema S(Diag, TyCtx);
+  S.analyze(TU.get());
+  EXPECT_FALSE(Diag.hasErrors());
+
+  IRBuilder Builder(TyCtx);
+  auto M = Builder.generateIR(TU.get());
+
+  if (OptLevel >= 2) {
+    PassManager PM;
+    PM.addPass(std::make_unique<Mem2RegPass>());
+    PM.addPass(std::make_unique<SimplifyCFGPass>());
+    PM.run(M.get());
+  }
+  return M;
+}
+
+/// Compile Source and return the assembly for each function
+std::map<std::string, std::string>
+emitAssembly(const std::string& Source, unsigned OptLevel = 0,
+             RegAllocKind RegAlloc = RegAllocKind::LinearScan) {
+  TypeContext TyCtx;
+  auto M = buildModule(Source, TyCtx, OptLevel);
+
+  std::map<std::string, std::string> Asm;
+  for (const auto& F : M->getFunctions()) {
+    std::ostringstream OS;
+    X86_64Backend Backend(OS, RegAlloc);
+    Backend.generateFunction(F.get());
+    Asm[F->getName()] = OS.str();
+  }
+
+  // The whole module, for checks on data and symbol directives
+  std::ostringstream OS;
+  X86_64Backend Backend(OS, RegAlloc);
+  Backend.generateAssembly(M.get());
+  Asm[""] = OS.str();
+  return Asm;
+}
+
+} // namespace
+
+TEST(DivisionByConstantTest, MatchesSignedDivision) {
+  const int64_t Min = std::numeric_limits<int64_t>::min();
+  const int64_t Max = std::numeric_limits<int64_t>::max();
+
+  std::vector<int64_t> Divisors = {2,  3,   5,    6,    7,         10,
+                                   12, 25,  125,  641,  1000,      1024,
+                                   -2, -3,  -5,   -7,   -10,       -1024,
+                                   Max, Min, Min + 1, int64_t(1) << 62,
+                                   1000000007, -(int64_t(1) << 40)};
+  std::vector<int64_t> Dividends = {0,   1,   -1,  2,       -2,      7,
+                                    -7,  9,   -9,  10,      -10,     11,
+                                    -11, 1023, -1023, 1024, -1024,   1025,
+                                    Max, Min, Max - 1, Min + 1};
+
+  std::mt19937_64 Rng(42);
+  for (int i = 0; i < 2000; ++i) {
+    Dividends.push_back(static_cast<int64_t>(Rng()));
+    Dividends.push_back(static_cast<int64_t>(Rng() >> (Rng() % 63)));
+  }
+
+  for (int64_t D : Divisors) {
+    for (int64_t X : Dividends) {
+      ASSERT_EQ(lowerDiv(X, D), X / D) << X << " / " << D;
+      ASSERT_EQ(lowerRem(X, D), X % D) << X << " % " << D;
+    }
+  }
+}
+
+TEST(DivisionByConstantTest, PowerOf2Divisors) {
+  unsigned K = 0;
+  EXPECT_TRUE(isPowerOf2Divisor(1024, K));
+  EXPECT_EQ(K, 10u);
+  EXPECT_TRUE(isPowerOf2Divisor(-8, K));
+  EXPECT_EQ(K, 3u);
+  EXPECT_TRUE(isPowerOf2Divisor(std::numeric_limits<int64_t>::min(), K));
+  EXPECT_EQ(K, 63u);
+  EXPECT_FALSE(isPowerOf2Divisor(1, K));
+  EXPECT_FALSE(isPowerOf2Divisor(-1, K));
+  EXPECT_FALSE(isPowerOf2Divisor(12, K));
+}
+
+TEST(DivisionByConstantTest, BackendAvoidsIdivForConstants) {
+  auto Asm = emitAssembly("int f(int x) { return x / 10 + x % 1024; }\n"
+                          "int g(int x, int y) { return x % y; }\n");
+
+  EXPECT_EQ(Asm["f"].find("idiv"), std::string::npos);
+  EXPECT_NE(Asm["f"].find("imul r11"), std::string::npos);
+  EXPECT_NE(Asm["f"].find("and rdx, -1024"), std::string::npos);
+  EXPECT_NE(Asm["g"].find("idiv r11"), std::string::npos);
+}
+
+TEST(SwitchLoweringTest, ChoosesStrategyByDensity) {
+  // Dense values, one destination each
+  EXPECT_EQ(chooseSwitchStrategy({1, 2, 3, 5, 6}, 5), SwitchStrategy::JumpTable);
+  // Few destinations over a small range
+  EXPECT_EQ(chooseSwitchStrategy({97, 101, 105, 111, 117}, 1),
+            SwitchStrategy::BitTest);
+  // Too few cases sharing a destination to beat compares
+  EXPECT_EQ(chooseSwitchStrategy({1, 2}, 1), SwitchStrategy::CompareTree);
+  // Sparse values
+  EXPECT_EQ(chooseSwitchStrategy({-7, 1, 100, 1000, 10000, 100000}, 6),
+            SwitchStrategy::CompareTree);
+  // Extreme values must not overflow the range computation
+  EXPECT_EQ(chooseSwitchStrategy({INT64_MIN, 0, 1, INT64_MAX}, 4),
+            SwitchStrategy::CompareTree);
+  EXPECT_EQ(chooseSwitchStrategy({}, 0), SwitchStrategy::CompareTree);
+}
+
+TEST(SwitchLoweringTest, BackendEmitsEachStrategy) {
+  auto Asm = emitAssembly(
+      "int dense(int x) {\n"
+      "  switch (x) { case 1: return 5; case 2: return 7; case 3: return 9;\n"
+      "               case 5: return 11; case 6: return 13; }\n"
+      "  return 1;\n"
+      "}\n"
+      "int vowel(int c) {\n"
+      "  switch (c) { case 97: case 101: case 105: case 111: case 117:\n"
+      "    return 1; }\n"
+      "  return 0;\n"
+      "}\n"
+      "int sparse(int x) {\n"
+      "  switch (x) { case 1: return 1; case 100: return 2;\n"
+      "               case 1000: return 3; case 10000: return 4;\n"
+      "               case 100000: return 5; case -7: return 6; }\n"
+      "  return 0;\n"
+      "}\n");
+
+  EXPECT_NE(Asm["dense"].find(".section .rodata"), std::string::npos);
+  EXPECT_NE(Asm["dense"].find("jmp r11"), std::string::npos);
+  // Slot for the missing value 4 goes to the default
+  EXPECT_NE(Asm["dense"].find(".long .Ldense_switch_end0 - .Ldense_jt0"),
+            std::string::npos);
+
+  // 'a', 'e', 'i', 'o', 'u' rebased to 'a' form a single mask
+  EXPECT_NE(Asm["vowel"].find("mov r10, 1065233\n\tbt r10, r11"),
+            std::string::npos);
+
+  EXPECT_EQ(Asm["sparse"].find(".rodata"), std::string::npos);
+  EXPECT_NE(Asm["sparse"].find("cmp r11, 1000\n\tje .Lsparse_case3\n\tjg"),
+            std::string::npos);
+}
+
+TEST(SelectLoweringTest, BackendEmitsCmov) {
+  auto Asm = emitAssembly(
+      "int mx(int a, int b) { int m = b; if (a > b) m = a; return m; }\n"
+      "int pick(int c, int a) { int r = 5; if (c) r = a; return r; }\n",
+      /*OptLevel=*/2);
+
+  // The comparison is repeated right before the cmov
+  EXPECT_NE(Asm["mx"].find("cmovg r11"), std::string::npos);
+  EXPECT_EQ(Asm["mx"].find("jz"), std::string::npos);
+
+  // A plain 0/1 condition is tested; the constant goes through r11
+  EXPECT_NE(Asm["pick"].find("mov r11, 5\n\tcmovne r11"), std::string::npos);
+  EXPECT_EQ(Asm["pick"].find("jz"), std::string::npos);
+}
+
+TEST(LinkageTest, StaticSymbolsAreNotExported) {
+  auto Asm = emitAssembly("int total = 40;\n"
+                          "static int bias = -3;\n"
+                          "static int add(int x) { return x + bias; }\n"
+                          "int get() { total = total + 2; return add(total); }\n");
+
+  EXPECT_EQ(Asm["add"].find(".globl"), std::string::npos);
+  EXPECT_NE(Asm["get"].find(".globl _get"), std::string::npos);
+  EXPECT_NE(Asm["add"].find("add rax, QWORD PTR [rip + _bias]"),
+            std::string::npos);
+  EXPECT_NE(Asm["get"].find("QWORD PTR [rip + _total], "), std::string::npos);
+
+  const std::string& Module = Asm[""];
+  EXPECT_NE(Module.find(".globl _total\n\t.p2align 3\n_total:\n\t.quad 40"),
+            std::string::npos);
+  EXPECT_NE(Module.find("_bias:\n\t.quad -3"), std::string::npos);
+  EXPECT_EQ(Module.find(".globl _bias"), std::string::npos);
+}
+
+TEST(ParallelCopyTest, MatchesParallelSemantics) {
+  // A swap needs the temporary exactly once
+  std::vector<std::pair<std::string, std::string>> Moves;
+  auto Record = [&](const std::string& D, const std::string& S) {
+    Moves.push_back({D, S});
+  };
+  sequentializeCopies<std::string>({{"a", "b"}, {"b", "a"}}, "t", Record);
+  ASSERT_EQ(Moves.size(), 3u);
+  EXPECT_EQ(Moves[0], std::make_pair(std::string("t"), std::string("a")));
+
+  // Random copies over 6 locations, with fan-out, chains, cycles and
+  // self-copies; location 6 is the temporary
+  std::mt19937 Rng(38);
+  for (int Round = 0; Round < 500; ++Round) {
+    std::vector<int> Dests = {0, 1, 2, 3, 4, 5};
+    std::shuffle(Dests.begin(), Dests.end(), Rng);
+    Dests.resize(Rng() % 7);
+
+    std::vector<std::pair<int, int>> Copies;
+    for (int D : Dests) Copies.push_back({D, static_cast<int>(Rng() % 6)});
+
+    int Regs[7] = {10, 11, 12, 13, 14, 15, -1};
+    int Expected[7];
+    std::copy(Regs, Regs + 7, Expected);
+    for (const auto& C : Copies) Expected[C.first] = Regs[C.second];
+
+    sequentializeCopies(Copies, 6,
+                        [&](int D, int S) { Regs[D] = Regs[S]; });
+    for (int R = 0; R < 6; ++R) EXPECT_EQ(Regs[R], Expected[R]);
+  }
+}
+
+TEST(OutOfSSATest, SwapLoopUsesParallelCopies) {
+  auto Asm = emitAssembly(
+      "int f(int n) {\n"
+      "  int a = 1; int b = 2; int i = 0;\n"
+      "  while (i < n) { int t = a; a = b; b = t; i = i + 1; }\n"
+      "  return a - b;\n"
+      "}\n",
+      /*OptLevel=*/2);
+  const std::string& F = Asm["f"];
+
+  // The swap on the back edge goes through the cycle-breaking temporary,
+  // and neither edge out of the loop test needs a stub of its own
+  EXPECT_NE(F.find("\tmov r11, "), std::string::npos);
+  EXPECT_NE(F.find(", r11\n\tjmp .Lf_while_cond0"), std::string::npos);
+  EXPECT_EQ(F.find("false_branch"), std::string::npos);
+}
+
+TEST(MachineIRTest, AllocationLeavesOnlyPhysicalRegisters) {
+  TypeContext TyCtx;
+  auto M = buildModule(
+      "int g(int a, int b) { return a * b; }\n"
+      "int f(int n) {\n"
+      "  int s = 0; int i = 0;\n"
+      "  while (i < n) { s = s + g(s, i) / 3; i = i + 1; }\n"
+      "  return s;\n"
+      "}\n",
+      TyCtx, /*OptLevel=*/2);
+  IRFunction* F = nullptr;
+  for (const auto& Fn : M->getFunctions())
+    if (Fn->getName() == "f") F = Fn.get();
+  ASSERT_NE(F, nullptr);
+  splitCriticalEdges(F);
+
+  X86InstrSelector ISel;
+  auto MF = ISel.select(F);
+  EXPECT_GT(MF->getNumVirtRegs(), 0u);
+
+  RegisterAllocator Allocator;
+  Allocator.allocate(*MF);
+
+  for (const auto& MBB : MF->getBlocks()) {
+    for (const auto& MI : MBB->instrs()) {
+      EXPECT_NE(MI->getOpcode(), X86::PCOPY);
+      for (unsigned Reg : MI->getUses())
+        EXPECT_TRUE(X86::isPhysicalRegister(Reg));
+      for (unsigned Reg : MI->getDefs())
+        EXPECT_TRUE(X86::isPhysicalRegister(Reg));
+    }
+  }
+
+  // n, s and i are live across the call, which clobbers every caller-saved
+  // register; they stay in callee-saved ones instead of stack slots
+  EXPECT_EQ(Allocator.getNumSpilled(), 0u);
+}
+
+TEST(MachineIRTest, SplitsValuesAroundCalls) {
+  const char* Source =
+      "int g(int x);\n"
+      "int f(int a, int b) {\n"
+      "  int v0 = a * b; int v1 = a - b; int v2 = a ^ b; int v3 = a | b;\n"
+      "  int v4 = a & b; int v5 = a * 3 - b; int v6 = b * 5 - a;\n"
+      "  int v7 = a * a; int v8 = b * b; int v9 = a * b * b;\n"
+      "  g(v0 + v9);\n"
+      "  return v0 + v1 * 2 + v2 * 3 + v3 * 4 + v4 * 5 + v5 * 6 + v6 * 7 +\n"
+      "         v7 * 8 + v8 * 9 + v9 * 10;\n"
+      "}\n";
+  TypeContext TyCtx;
+  auto M = buildModule(Source, TyCtx, /*OptLevel=*/2);
+  IRFunction* F = M->getFunctions().back().get();
+  ASSERT_EQ(F->getName(), "f");
+
+  X86InstrSelector ISel;
+  auto MF = ISel.select(F);
+  RegisterAllocator Allocator;
+  Allocator.allocate(*MF);
+
+  // Ten values live across the call and five callee-saved registers: the
+  // other five are split, and only the pieces spanning the call live on
+  // the stack
+  EXPECT_EQ(Allocator.getNumSpilled(), 5u);
+  EXPECT_GE(Allocator.getNumSplits(), 5u);
+
+  auto Asm = emitAssembly(Source, /*OptLevel=*/2);
+  const std::string& Fn = Asm["f"];
+  EXPECT_NE(Fn.find("\tpush rbx\n\tpush r12\n\tpush r13\n\tpush r14\n"
+                    "\tpush r15\n\tsub rsp, 40\n"),
+            std::string::npos);
+  EXPECT_NE(Fn.find("\tlea rsp, [rbp - 40]\n\tpop r15\n\tpop r14\n"
+                    "\tpop r13\n\tpop r12\n\tpop rbx\n\tpop rbp\n"),
+            std::string::npos);
+}
+
+TEST(MachineIRTest, KeepsSpillCodeOutOfLoops) {
+  TypeContext TyCtx;
+  auto M = buildModule(
+      "int f(int n, int z) {\n"
+      "  int a = z * 2; int b = z * 3 + 1; int c = z * 4 + 2;\n"
+      "  int d = z * 5 + 3; int e = z * 6 + 4; int g = z * 7 + 5;\n"
+      "  int p = z * 8 + 6; int q = z * 9 + 7; int r = z * 10 + 8;\n"
+      "  int s = z * 11 + 9; int t = z * 12 + 10; int u = z * 13 + 11;\n"
+      "  int acc = 0;\n"
+      "  for (int i = 0; i < n; i = i + 1) {\n"
+      "    for (int j = 0; j < 100; j = j + 1) {\n"
+      "      acc = acc + (i ^ j) * a - (acc & b) + c;\n"
+      "      a = a + (j & 3); b = b ^ acc; c = c + i - j;\n"
+      "    }\n"
+      "    d = d + acc; e = e ^ d; g = g + e;\n"
+      "  }\n"
+      "  return acc + a + b + c + d + e + g + p + q + r + s + t + u;\n"
+      "}\n",
+      TyCtx, /*OptLevel=*/2);
+  IRFunction* F = M->getFunctions().back().get();
+  splitCriticalEdges(F);
+
+  X86InstrSelector ISel;
+  auto MF = ISel.select(F);
+  RegisterAllocator Allocator;
+  Allocator.allocate(*MF);
+
+  // More values are live than there are registers, but the ones sitting
+  // out the loops are cheapest to spill, and their stores and reloads
+  // happen outside them
+  EXPECT_GT(Allocator.getNumSpilled(), 0u);
+  MachineLoopInfo Loops;
+  Loops.compute(*MF);
+  for (const auto& MBB : MF->getBlocks()) {
+    if (Loops.getLoopDepth(MBB.get()) == 0) continue;
+    for (const auto& MI : MBB->instrs()) {
+      for (const MachineOperand& Op : MI->operands())
+        EXPECT_FALSE(Op.isFrameIndex()) << MBB->getName();
+    }
+  }
+}
+
+TEST(MachineIRTest, RematerializesCheapValues) {
+  TypeContext TyCtx;
+  auto M = buildModule(
+      "int h(int a, int b) { return a * 3 - b; }\n"
+      "int f(int n, int z) {\n"
+      "  int s = 0; int a = z - 31; int b = z + 5; int c = z + 9;\n"
+      "  for (int i = 0; i < n; i = i + 1) {\n"
+      "    s = s + h(s, a);\n"
+      "    s = s ^ h(i, b);\n"
+      "    s = s - h(s + i, c) + z;\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n",
+      TyCtx, /*OptLevel=*/2);
+  IRFunction* F = M->getFunctions().back().get();
+  ASSERT_EQ(F->getName(), "f");
+  splitCriticalEdges(F);
+
+  X86InstrSelector ISel;
+  auto MF = ISel.select(F);
+  RegisterAllocator Allocator;
+  Allocator.allocate(*MF);
+
+  // Not all of a, b and c keep a register across the calls, but z does,
+  // so they are recomputed with an lea and their slots never written
+  EXPECT_GT(Allocator.getNumRemats(), 0u);
+  std::set<int> Written;
+  for (const auto& MBB : MF->getBlocks()) {
+    for (const auto& MI : MBB->instrs()) {
+      if (MI->getNumOperands() > 0 && MI->getOperand(0).isFrameIndex())
+        Written.insert(MI->getOperand(0).getFrameIndex());
+    }
+  }
+  EXPECT_LT(Written.size(), Allocator.getNumSpilled());
+}
+
+TEST(MachineIRTest, ColorsStackSlots) {
+  TypeContext TyCtx;
+  auto M = buildModule(
+      "int f(int x) {\n"
+      "  int a = x + 1; int r = a * 2; int b = r + 3;\n"
+      "  int s = 0;\n"
+      "  for (int i = 0; i < b; i = i + 1) s = s + x;\n"
+      "  return s;\n"
+      "}\n",
+      TyCtx);
+  IRFunction* F = M->getFunctions().back().get();
+  X86InstrSelector ISel;
+  auto MF = ISel.select(F);
+  RegisterAllocator Allocator;
+  Allocator.allocate(*MF);
+
+  // At -O0 every local has a slot; a, r and b live one after another and
+  // can share one, while x, s and i are live together in the loop
+  size_t Before = MF->getFrameObjects().size();
+  int64_t Saved = colorStackSlots(*MF);
+  size_t After = MF->getFrameObjects().size();
+  EXPECT_LT(After, Before);
+  EXPECT_GE(After, 3u);
+  EXPECT_EQ(Saved, 8 * static_cast<int64_t>(Before - After));
+  for (const auto& MBB : MF->getBlocks()) {
+    for (const auto& MI : MBB->instrs()) {
+      for (const MachineOperand& Op : MI->operands()) {
+        if (Op.isFrameIndex())
+          EXPECT_LT(Op.getFrameIndex(),
+                    static_cast<int>(MF->getFrameObjects().size()));
+      }
+    }
+  }
+}
+
+TEST(GraphColoringTest, CoalescesCopiesAndColorsAcrossCalls) {
+  TypeContext TyCtx;
+  auto M = buildModule(
+      "int g(int a, int b) { return a * b; }\n"
+      "int f(int n) {\n"
+      "  int s = 0; int i = 0;\n"
+      "  while (i < n) { s = s + g(s, i) / 3; i = i + 1; }\n"
+      "  return s;\n"
+      "}\n",
+      TyCtx, /*OptLevel=*/2);
+  IRFunction* F = M->getFunctions().back().get();
+  ASSERT_EQ(F->getName(), "f");
+  splitCriticalEdges(F);
+
+  X86InstrSelector ISel;
+  auto MF = ISel.select(F);
+  GraphColoringAllocator Allocator;
+  Allocator.allocate(*MF);
+
+  for (const auto& MBB : MF->getBlocks()) {
+    for (const auto& MI : MBB->instrs()) {
+      EXPECT_NE(MI->getOpcode(), X86::PCOPY);
+      for (unsigned Reg : MI->getUses())
+        EXPECT_TRUE(X86::isPhysicalRegister(Reg));
+      for (unsigned Reg : MI->getDefs())
+        EXPECT_TRUE(X86::isPhysicalRegister(Reg));
+    }
+  }
+
+  // The call interferes with every caller-saved register, so n, s and i
+  // are colored with callee-saved ones; phi and argument copies merge
+  EXPECT_EQ(Allocator.getNumSpilled(), 0u);
+  EXPECT_GT(Allocator.getNumCoalesced(), 0u);
+}
+
+TEST(GraphColoringTest, RotatesWithoutATemporary) {
+  auto Asm = emitAssembly(
+      "int fib(int n) { int a = 0; int b = 1; int i = 0;\n"
+      "  while (i < n) { int t = a + b; a = b; b = t; i = i + 1; }\n"
+      "  return a; }\n",
+      /*OptLevel=*/2, RegAllocKind::GraphColoring);
+
+  // The sum gets its own register, so the phi copies form a chain rather
+  // than a cycle through r11
+  const std::string& F = Asm["fib"];
+  EXPECT_EQ(F.find("r11"), std::string::npos);
+  EXPECT_NE(F.find("\tmov rax, rcx\n\tmov rcx, "), std::string::npos);
+}
+
+TEST(MachineIRTest, CallsFollowTheCallingConvention) {
+  auto Asm = emitAssembly(
+      "int h(int a, int b, int c, int d, int e, int f, int g, int k);\n"
+      "int call(int x) { return h(x, 2, 3, 4, 5, 6, 7, 8) + x; }\n",
+      /*OptLevel=*/2);
+  const std::string& F = Asm["call"];
+
+  // Two stack arguments keep rsp aligned without padding
+  EXPECT_NE(F.find("\tpush 8\n\tpush 7\n"), std::string::npos);
+  EXPECT_NE(F.find("\tmov rsi, 2\n"), std::string::npos);
+  EXPECT_NE(F.find("\tcall _h\n\tadd rsp, 16\n"), std::string::npos);
+  // x is needed after the call, so it moves to a callee-saved register,
+  // which the prologue saves and each return restores
+  EXPECT_NE(F.find("\tpush rbx\n\tsub rsp, 8\n\tmov rbx, rdi\n"),
+            std::string::npos);
+  EXPECT_NE(F.find("\tlea rsp, [rbp - 8]\n\tpop rbx\n\tpop rbp\n\tret\n"),
+            std::string::npos);
+}
+
+TEST(PatternISelTest, FoldsAddressArithmeticAndConstants) {
+  auto Asm = emitAssembly(
+      "int idx(int a, int b) { return a + b * 4 + 7; }\n"
+      "int mul(int x) { return x * 9 + x * 12; }\n"
+      "int sign(int x) { return x < 0; }\n",
+      /*OptLevel=*/2);
+
+  // The whole tree is one lea
+  EXPECT_NE(Asm["idx"].find("*4 + 7]"), std::string::npos);
+  EXPECT_EQ(Asm["idx"].find("imul"), std::string::npos);
+  EXPECT_EQ(Asm["idx"].find("\tadd "), std::string::npos);
+
+  // x * 9 is x + x*8; other constants use the immediate form of imul
+  EXPECT_NE(Asm["mul"].find("*8]"), std::string::npos);
+  EXPECT_NE(Asm["mul"].find(", 12\n"), std::string::npos);
+
+  // Comparisons with zero test the register against itself
+  EXPECT_NE(Asm["sign"].find("\ttest "), std::string::npos);
+  EXPECT_EQ(Asm["sign"].find("\tcmp "), std::string::npos);
+}
+
+TEST(PatternISelTest, FoldsLoadsIntoMemoryOperands) {
+  auto Asm = emitAssembly("int a;\n"
+                          "int b;\n"
+                          "int sum() { return a + b; }\n"
+                          "int order() { int t = a; b = 5; return b + t; }\n",
+                          /*OptLevel=*/2);
+
+  // One load becomes the memory operand of the add
+  EXPECT_NE(Asm["sum"].find("add rax, QWORD PTR [rip + _b]"),
+            std::string::npos);
+
+  // A load may not move past a store to memory
+  const std::string& Order = Asm["order"];
+  size_t LoadA = Order.find("QWORD PTR [rip + _a]");
+  ASSERT_NE(LoadA, std::string::npos);
+  EXPECT_LT(LoadA, Order.find("QWORD PTR [rip + _b], 5"));
+  EXPECT_NE(Order.find("add rax, QWORD PTR [rip + _b]"), std::string::npos);
+}
+
+TEST(BranchFusionTest, ComparisonsFeedJumpsDirectly) {
+  auto Asm = emitAssembly(
+      "int loop(int n) { int s = 0; int i = 0;\n"
+      "  while (i < 10) { s = s + i; i = i + 1; } return s; }\n"
+      "int flag(int a, int b) { int c = a < b; if (c) return c + 1;\n"
+      "  return c; }\n",
+      /*OptLevel=*/2);
+
+  // The loop test is a compare and a jump out of the loop; the body is
+  // the fallthrough
+  const std::string& Loop = Asm["loop"];
+  EXPECT_NE(Loop.find("cmp "), std::string::npos);
+  EXPECT_NE(Loop.find(", 10\n\tjge .Lloop_while_end2\n"), std::string::npos);
+  EXPECT_EQ(Loop.find("\tset"), std::string::npos);
+  EXPECT_EQ(Loop.find("jmp .Lloop_while_body1"), std::string::npos);
+
+  // A comparison that is also used as a value is still materialized
+  EXPECT_NE(Asm["flag"].find("\tsetl "), std::string::npos);
+}
@@ -0,0 +1,1007 @@
+#include "yac/CodeGen/IPO.h"
+#include "yac/CodeGen/IRBuilder.h"
+#include "yac/CodeGen/IRUtils.h"
+#include "yac/CodeGen/IRVerifier.h"
+#include "yac/CodeGen/Pipeline.h"
+#include "yac/CodeGen/Transforms.h"
+#include "yac/Parse/Lexer.h"
+#include "yac/Parse/Parser.h"
+#include "yac/Sema/Sema.h"
+#include <gtest/gtest.h>
+
+using namespace yac;
+
+class TransformTest : public ::testing::Test {
+protected:
+  DiagnosticEngine Diag;
+  TypeContext TyCtx;
+  std::unique_ptr<TranslationUnit> TU;
+
+  std::unique_ptr<IRModule> compile(const std::string& Source) {
+    Lexer Lex(Source, "test.c", Diag);
+    Parser P(Lex.tokenize(), Diag, TyCtx);
+    TU = P.parseTranslationUnit();
+    Sema S(Diag, TyCtx);
+    S.analyze(TU.get());
+    EXPECT_FALSE(Diag.hasErrors());
+
+    IRBuilder Builder(TyCtx);
+    return Builder.generateIR(TU.get());
+  }
+
+  IRFunction* getFunction(IRModule* M, const std::string& Name) {
+    for (const auto& F : M->getFunctions()) {
+      if (F->getName() == Name) return F.get();
+    }
+    return nullptr;
+  }
+
+  bool verify(IRModule* M) {
+    IRVerifier V(/*FailFast=*/false);
+    bool OK = V.verify(M);
+    if (!OK) V.printErrors();
+    return OK;
+  }
+
+  size_t countCondBrsOn(IRFunction* F, IRValue* Cond) {
+    size_t Count = 0;
+    for (const auto& BB : F->getBlocks()) {
+      auto* Br = dynamic_cast<IRCondBrInst*>(BB->getTerminator());
+      if (Br && Br->getCondition() == Cond) ++Count;
+    }
+    return Count;
+  }
+};
+
+static const char* UnswitchSource =
+    "int f(int n, int mode) {\n"
+    "  int s = 0;\n"
+    "  int i = 0;\n"
+    "  while (i < n) {\n"
+    "    if (mode == 1) { s = s + i; } else { s = s - i; }\n"
+    "    i = i + 1;\n"
+    "  }\n"
+    "  return s;\n"
+    "}\n";
+
+TEST_F(TransformTest, UnswitchHoistsInvariantBranch) {
+  auto M = compile(UnswitchSource);
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<LoopUnswitchPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  IRFunction* F = getFunction(M.get(), "f");
+  ASSERT_NE(F, nullptr);
+
+  // The entry block now selects a loop version on the invariant test
+  IRBasicBlock* Entry = F->getBlocks()[0].get();
+  auto* Br = dynamic_cast<IRCondBrInst*>(Entry->getTerminator());
+  ASSERT_NE(Br, nullptr);
+  EXPECT_EQ(Entry->getNumSuccessors(), 2u);
+  EXPECT_EQ(countCondBrsOn(F, Br->getCondition()), 1u);
+
+  // Two loop headers, each with one arm of the original if
+  AnalysisManager AM(F);
+  EXPECT_EQ(AM.get<LoopInfo>().getTopLevelLoops().size(), 2u);
+  EXPECT_NE(findBlock(F, "then3"), nullptr);
+  EXPECT_EQ(findBlock(F, "else4"), nullptr);
+  EXPECT_NE(findBlock(F, "else4_us0"), nullptr);
+  EXPECT_EQ(findBlock(F, "then3_us0"), nullptr);
+}
+
+TEST_F(TransformTest, UnswitchRespectsGrowthBudget) {
+  auto M = compile(UnswitchSource);
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<LoopUnswitchPass>(/*SizeThreshold=*/60,
+                                                /*GrowthBudget=*/4));
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  IRFunction* F = getFunction(M.get(), "f");
+  AnalysisManager AM(F);
+  EXPECT_EQ(AM.get<LoopInfo>().getTopLevelLoops().size(), 1u);
+  EXPECT_NE(findBlock(F, "else4"), nullptr);
+}
+
+TEST_F(TransformTest, UnswitchInnerLoopOnOuterVariantBranch) {
+  auto M = compile(
+      "int f(int n) {\n"
+      "  int s = 0;\n"
+      "  int j = 0;\n"
+      "  while (j < n) {\n"
+      "    int odd = j % 2;\n"
+      "    int i = 0;\n"
+      "    while (i < n) {\n"
+      "      if (odd == 1) { s = s + i; } else { s = s - i; }\n"
+      "      i = i + 1;\n"
+      "    }\n"
+      "    j = j + 1;\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n");
+  IRFunction* F = getFunction(M.get(), "f");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.run(M.get());
+
+  {
+    AnalysisManager AM(F);
+    LoopInfo& LI = AM.get<LoopInfo>();
+    ASSERT_EQ(LI.getTopLevelLoops().size(), 1u);
+    Loop* Outer = LI.getTopLevelLoops()[0];
+    ASSERT_EQ(Outer->getSubLoops().size(), 1u);
+    Loop* Inner = Outer->getSubLoops()[0];
+    EXPECT_EQ(Inner->getParentLoop(), Outer);
+    EXPECT_EQ(Inner->getLoopDepth(), 2u);
+    EXPECT_EQ(LI.getLoopFor(findBlock(F, "then6")), Inner);
+    EXPECT_EQ(LI.getLoopsInnermostFirst(), (std::vector<Loop*>{Inner, Outer}));
+  }
+
+  PassManager Unswitch;
+  Unswitch.addPass(std::make_unique<LoopUnswitchPass>());
+  EXPECT_TRUE(Unswitch.run(M.get()));
+  ASSERT_TRUE(verify(M.get()));
+
+  // The test varies with j, so only the inner loop is split, inside the
+  // one outer loop
+  AnalysisManager AM(F);
+  LoopInfo& LI = AM.get<LoopInfo>();
+  ASSERT_EQ(LI.getTopLevelLoops().size(), 1u);
+  EXPECT_EQ(LI.getTopLevelLoops()[0]->getSubLoops().size(), 2u);
+  EXPECT_NE(findBlock(F, "then6"), nullptr);
+  EXPECT_EQ(findBlock(F, "else7"), nullptr);
+  EXPECT_NE(findBlock(F, "else7_us0"), nullptr);
+  EXPECT_EQ(findBlock(F, "then6_us0"), nullptr);
+}
+
+TEST_F(TransformTest, UnswitchLeavesVariantBranch) {
+  auto M = compile(
+      "int f(int n) {\n"
+      "  int s = 0;\n"
+      "  int i = 0;\n"
+      "  while (i < n) {\n"
+      "    if (i == 3) { s = s + 1; } else { s = s + 2; }\n"
+      "    i = i + 1;\n"
+      "  }\n"
+      "  return s;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<LoopUnswitchPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  IRFunction* F = getFunction(M.get(), "f");
+  EXPECT_EQ(findBlock(F, "while_cond0_us0"), nullptr);
+}
+
+TEST_F(TransformTest, LICMKeepsLoopVariantInstructions) {
+  auto M = compile(
+      "int main() {\n"
+      "  int i = 0;\n"
+      "  while (i < 10) { i = i + 1; }\n"
+      "  return i;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<LICMPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // Nothing in this loop is invariant, so the entry block only branches
+  IRFunction* F = getFunction(M.get(), "main");
+  EXPECT_EQ(F->getBlocks()[0]->getInstructions().size(), 1u);
+}
+
+TEST_F(TransformTest, CloneBlocksRemapsValuesAndEdges) {
+  auto M = compile(UnswitchSource);
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.run(M.get());
+
+  IRFunction* F = getFunction(M.get(), "f");
+  IRBasicBlock* Then = findBlock(F, "then3");
+  IRBasicBlock* EndIf = findBlock(F, "endif5");
+  ASSERT_NE(Then, nullptr);
+  ASSERT_NE(EndIf, nullptr);
+
+  CloneMap VMap;
+  auto NewBlocks = cloneBlocks(F, {Then}, ".copy", VMap);
+  ASSERT_EQ(NewBlocks.size(), 1u);
+  EXPECT_EQ(NewBlocks[0]->getName(), "then3.copy");
+
+  // The copy defines its own value and feeds the same join block
+  auto* Add = dynamic_cast<IRBinaryInst*>(
+      NewBlocks[0]->getInstructions()[0].get());
+  ASSERT_NE(Add, nullptr);
+  auto* OrigAdd = dynamic_cast<IRBinaryInst*>(
+      Then->getInstructions()[0].get());
+  EXPECT_EQ(VMap.lookup(OrigAdd->getResult()), Add->getResult());
+  EXPECT_NE(Add->getResult(), OrigAdd->getResult());
+
+  ASSERT_EQ(NewBlocks[0]->getNumSuccessors(), 1u);
+  EXPECT_EQ(NewBlocks[0]->getSuccessors()[0], EndIf);
+  auto* Phi = dynamic_cast<IRPhiInst*>(EndIf->getInstructions()[0].get());
+  ASSERT_NE(Phi, nullptr);
+  EXPECT_EQ(Phi->getIncomingValueForBlock(NewBlocks[0]), Add->getResult());
+}
+
+TEST_F(TransformTest, ReassociateGroupsConstants) {
+  auto M = compile("int f(int a, int b) { return (a + 3) + (b + 5); }\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<ReassociatePass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // (a + b) + 8
+  IRFunction* F = getFunction(M.get(), "f");
+  auto* Ret = dynamic_cast<IRRetInst*>(F->getBlocks()[0]->getTerminator());
+  ASSERT_NE(Ret, nullptr);
+  size_t NumConstants = 0;
+  IRBinaryInst* Root = nullptr;
+  for (const auto& Inst : F->getBlocks()[0]->getInstructions()) {
+    auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get());
+    if (!BinOp) continue;
+    if (BinOp->getLHS()->isConstant()) ++NumConstants;
+    if (BinOp->getRHS()->isConstant()) ++NumConstants;
+    if (BinOp->getResult() == Ret->getRetValue()) Root = BinOp;
+  }
+  EXPECT_EQ(NumConstants, 1u);
+  ASSERT_NE(Root, nullptr);
+  ASSERT_TRUE(Root->getRHS()->isConstant());
+  EXPECT_EQ(Root->getRHS()->getConstant(), 8);
+}
+
+TEST_F(TransformTest, ReassociateRewritesManyTrees) {
+  // Each statement's sum is used twice, so every statement is its own tree
+  // and later trees read the results of earlier rewrites
+  std::string Source = "int f(int a, int b) {\n  int s = 0;\n  int t = 0;\n";
+  for (int i = 0; i < 300; ++i) {
+    Source += "  s = (s + 1) + (a + 2);\n  t = t + s;\n";
+  }
+  Source += "  return s + t;\n}\n";
+
+  auto M = compile(Source);
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<ReassociatePass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // (s + a) + 3 in every statement
+  IRFunction* F = getFunction(M.get(), "f");
+  size_t NumThrees = 0;
+  for (const auto& Inst : F->getBlocks()[0]->getInstructions()) {
+    auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get());
+    if (!BinOp) continue;
+    EXPECT_FALSE(BinOp->getLHS()->isConstant());
+    if (BinOp->getRHS()->isConstant()) {
+      EXPECT_EQ(BinOp->getRHS()->getConstant(), 3);
+      ++NumThrees;
+    }
+  }
+  EXPECT_EQ(NumThrees, 300u);
+}
+
+TEST_F(TransformTest, ReassociateFactorsMultiplies) {
+  auto M = compile("int f(int x, int y) { return x * 4 + y * 4; }\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<ReassociatePass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  size_t NumMuls = 0;
+  IRFunction* F = getFunction(M.get(), "f");
+  for (const auto& Inst : F->getBlocks()[0]->getInstructions()) {
+    if (Inst->getOpcode() == IRInstruction::Mul) ++NumMuls;
+  }
+  EXPECT_EQ(NumMuls, 1u);
+}
+
+TEST_F(TransformTest, ReassociateExposesInvariantsToLICM) {
+  auto M = compile(
+      "int f(int n, int a, int b) {\n"
+      "  int s = 0;\n"
+      "  int i = 0;\n"
+      "  while (i < n) { s = s + (i + a) + b; i = i + 1; }\n"
+      "  return s;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<ReassociatePass>());
+  PM.addPass(std::make_unique<LICMPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // a + b is computed once in the preheader
+  IRFunction* F = getFunction(M.get(), "f");
+  IRBasicBlock* Entry = F->getBlocks()[0].get();
+  ASSERT_EQ(Entry->getInstructions().size(), 2u);
+  auto* Hoisted = dynamic_cast<IRBinaryInst*>(Entry->getInstructions()[0].get());
+  ASSERT_NE(Hoisted, nullptr);
+  EXPECT_EQ(Hoisted->getOpcode(), IRInstruction::Add);
+  EXPECT_EQ(Hoisted->getLHS()->getName(), "a");
+  EXPECT_EQ(Hoisted->getRHS()->getName(), "b");
+}
+
+static size_t countOpcode(IRFunction* F, IRInstruction::Opcode Op) {
+  size_t Count = 0;
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      if (Inst->getOpcode() == Op) ++Count;
+    }
+  }
+  return Count;
+}
+
+TEST_F(TransformTest, SimplifyCFGConvertsDiamondsAndTriangles) {
+  auto M = compile(
+      "int mn(int a, int b) {\n"
+      "  int m;\n"
+      "  if (a < b) m = a; else m = b;\n"
+      "  return m;\n"
+      "}\n"
+      "int ab(int x) {\n"
+      "  if (x < 0) x = 0 - x;\n"
+      "  return x;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<SimplifyCFGPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  for (const char* Name : {"mn", "ab"}) {
+    IRFunction* F = getFunction(M.get(), Name);
+    EXPECT_EQ(countOpcode(F, IRInstruction::CondBr), 0u) << Name;
+    EXPECT_EQ(countOpcode(F, IRInstruction::Phi), 0u) << Name;
+    EXPECT_EQ(countOpcode(F, IRInstruction::Select), 1u) << Name;
+  }
+
+  // min picks between the parameters themselves
+  IRFunction* F = getFunction(M.get(), "mn");
+  IRSelectInst* Sel = nullptr;
+  for (const auto& Inst : F->getBlocks()[0]->getInstructions()) {
+    if (auto* S = dynamic_cast<IRSelectInst*>(Inst.get())) Sel = S;
+  }
+  ASSERT_NE(Sel, nullptr);
+  EXPECT_EQ(Sel->getTrueValue()->getName(), "a");
+  EXPECT_EQ(Sel->getFalseValue()->getName(), "b");
+}
+
+TEST_F(TransformTest, SimplifyCFGKeepsUnsafeOrCostlyArms) {
+  auto M = compile(
+      "int g(int x) { return x; }\n"
+      "int calls(int x) {\n"
+      "  if (x < 0) x = g(x);\n"
+      "  return x;\n"
+      "}\n"
+      "int divides(int x, int y) {\n"
+      "  if (y != 0) x = x / y;\n"
+      "  return x;\n"
+      "}\n"
+      "int costly(int x) {\n"
+      "  if (x < 0) x = x + 1 + x + 2 + x;\n"
+      "  return x;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<SimplifyCFGPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  for (const char* Name : {"calls", "divides", "costly"}) {
+    IRFunction* F = getFunction(M.get(), Name);
+    EXPECT_EQ(countOpcode(F, IRInstruction::CondBr), 1u) << Name;
+    EXPECT_EQ(countOpcode(F, IRInstruction::Select), 0u) << Name;
+  }
+}
+
+static const char* SmallDiamondLoopSource =
+    "int f(int n, int mode, int a, int b) {\n"
+    "  int s = 0;\n"
+    "  int i = 0;\n"
+    "  while (i < n) {\n"
+    "    int r = 0;\n"
+    "    if (mode == 1) r = a; else r = b;\n"
+    "    s = s + r + i;\n"
+    "    i = i + 1;\n"
+    "  }\n"
+    "  return s;\n"
+    "}\n";
+
+TEST_F(TransformTest, PipelineUnswitchesBeforeIfConversion) {
+  // -O3 unswitches the invariant diamond before SimplifyCFG can turn it
+  // into a select evaluated on every iteration
+  auto M = compile(SmallDiamondLoopSource);
+  PassManager PM;
+  addOptimizationPasses(PM, 3);
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  IRFunction* F = getFunction(M.get(), "f");
+  AnalysisManager AM(F);
+  EXPECT_EQ(AM.get<LoopInfo>().getTopLevelLoops().size(), 2u);
+  EXPECT_EQ(countOpcode(F, IRInstruction::Select), 0u);
+
+  // -O2 does not unswitch, so the diamond becomes a select
+  auto M2 = compile(SmallDiamondLoopSource);
+  PassManager PM2;
+  addOptimizationPasses(PM2, 2);
+  PM2.run(M2.get());
+  ASSERT_TRUE(verify(M2.get()));
+
+  IRFunction* F2 = getFunction(M2.get(), "f");
+  AnalysisManager AM2(F2);
+  EXPECT_EQ(AM2.get<LoopInfo>().getTopLevelLoops().size(), 1u);
+  EXPECT_EQ(countOpcode(F2, IRInstruction::Select), 1u);
+}
+
+TEST_F(TransformTest, Mem2RegPlacesPhisForNestedLoopStores) {
+  // m is only stored inside the if, so its loop header phi comes from the
+  // iterated dominance frontier rather than a direct successor
+  auto M = compile(
+      "int f(int n) {\n"
+      "  int m = 0;\n"
+      "  int i = 0;\n"
+      "  while (i < n) {\n"
+      "    int d = i - 5;\n"
+      "    if (d > m) m = d;\n"
+      "    i = i + 1;\n"
+      "  }\n"
+      "  return m;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<SimplifyCFGPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  IRFunction* F = getFunction(M.get(), "f");
+  EXPECT_EQ(countOpcode(F, IRInstruction::Alloca), 0u);
+  EXPECT_EQ(countOpcode(F, IRInstruction::Load), 0u);
+  EXPECT_EQ(countOpcode(F, IRInstruction::Select), 1u);
+}
+
+TEST_F(TransformTest, IPSCCPPropagatesArgumentsAndReturns) {
+  auto M = compile(
+      "static int scale(int x, int mode) {\n"
+      "  if (mode == 1) return x * 2;\n"
+      "  return x + 100;\n"
+      "}\n"
+      "int seven() { return 7; }\n"
+      "int main() {\n"
+      "  int a = scale(3, 1);\n"
+      "  int b = scale(4, 1);\n"
+      "  if (seven() == 7) return a + b;\n"
+      "  return 0;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<IPSCCPPass>());
+  EXPECT_TRUE(PM.run(M.get()));
+  ASSERT_TRUE(verify(M.get()));
+
+  // mode is 1 at every call, so the x + 100 path is gone
+  IRFunction* Scale = getFunction(M.get(), "scale");
+  EXPECT_EQ(countOpcode(Scale, IRInstruction::CondBr), 0u);
+  EXPECT_EQ(countOpcode(Scale, IRInstruction::Add), 0u);
+  EXPECT_EQ(countOpcode(Scale, IRInstruction::Mul), 1u);
+
+  // seven() is folded into the caller's branch; the call itself stays
+  IRFunction* Main = getFunction(M.get(), "main");
+  EXPECT_EQ(countOpcode(Main, IRInstruction::CondBr), 0u);
+  EXPECT_EQ(countOpcode(Main, IRInstruction::Call), 3u);
+}
+
+TEST_F(TransformTest, IPSCCPKeepsVaryingAndExternalArguments) {
+  auto M = compile(
+      "static int pick(int c) { if (c) return 1; return 2; }\n"
+      "int api(int c) { if (c) return 3; return 4; }\n"
+      "int main(int argc) {\n"
+      "  int r = pick(0) + pick(1);\n"
+      "  if (argc) r = r + 1;\n"
+      "  return r;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<IPSCCPPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // Different constants meet to overdefined
+  EXPECT_EQ(countOpcode(getFunction(M.get(), "pick"), IRInstruction::CondBr),
+            1u);
+  // Never called here, and main's arguments come from outside
+  EXPECT_EQ(countOpcode(getFunction(M.get(), "api"), IRInstruction::CondBr),
+            1u);
+  EXPECT_EQ(countOpcode(getFunction(M.get(), "main"), IRInstruction::CondBr),
+            1u);
+}
+
+TEST_F(TransformTest, IPSCCPAssumesNothingWithoutMain) {
+  auto M = compile(
+      "int helper(int c) { if (c) return 1; return 2; }\n"
+      "int lib() { return helper(1); }\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<IPSCCPPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // Other translation units may call helper with anything
+  EXPECT_EQ(countOpcode(getFunction(M.get(), "helper"), IRInstruction::CondBr),
+            1u);
+}
+
+TEST_F(TransformTest, IPSCCPKeepsParametersOfExternalFunctions) {
+  // Another file may call helper(2), even though main only passes 1
+  auto M = compile(
+      "int helper(int m) { if (m == 1) return 10; return 20; }\n"
+      "int main() { return helper(1); }\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<IPSCCPPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  EXPECT_EQ(countOpcode(getFunction(M.get(), "helper"), IRInstruction::CondBr),
+            1u);
+}
+
+TEST_F(TransformTest, SCCPFoldsConstantBranches) {
+  auto M = compile(
+      "int f(int n) {\n"
+      "  int k = 4;\n"
+      "  int i = 0;\n"
+      "  while (i < n) {\n"
+      "    if (k * 2 == 8) i = i + 1; else i = i + 2;\n"
+      "  }\n"
+      "  return i + k;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<SCCPPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // Only the loop test is left; k * 2 == 8 and the else arm are gone
+  IRFunction* F = getFunction(M.get(), "f");
+  EXPECT_EQ(countOpcode(F, IRInstruction::CondBr), 1u);
+  EXPECT_EQ(countOpcode(F, IRInstruction::Mul), 0u);
+  EXPECT_EQ(countOpcode(F, IRInstruction::Eq), 0u);
+}
+
+static const char* SpecializeSource =
+    "int step(int x, int mode) {\n"
+    "  if (mode == 0) return x + 1;\n"
+    "  if (mode == 1) return x * 3;\n"
+    "  return x - mode;\n"
+    "}\n"
+    "int main(int argc) {\n"
+    "  int s = 0;\n"
+    "  int i = 0;\n"
+    "  while (i < 10) {\n"
+    "    s = step(s, 1);\n"
+    "    i = i + 1;\n"
+    "  }\n"
+    "  s = step(s, 0);\n"
+    "  return step(s, argc);\n"
+    "}\n";
+
+TEST_F(TransformTest, SpecializationClonesForConstantArguments) {
+  auto M = compile(SpecializeSource);
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<FunctionSpecializationPass>(
+      3, 400, 100, /*MinWeight=*/1));
+  EXPECT_TRUE(PM.run(M.get()));
+  ASSERT_TRUE(verify(M.get()));
+
+  // The call in the loop weighs most, so it gets the first clone
+  IRFunction* InLoop = getFunction(M.get(), "step.spec0");
+  IRFunction* Once = getFunction(M.get(), "step.spec1");
+  ASSERT_NE(InLoop, nullptr);
+  ASSERT_NE(Once, nullptr);
+  EXPECT_EQ(countOpcode(InLoop, IRInstruction::CondBr), 0u);
+  EXPECT_EQ(countOpcode(InLoop, IRInstruction::Mul), 1u);
+  EXPECT_EQ(countOpcode(InLoop, IRInstruction::Add), 0u);
+  EXPECT_EQ(countOpcode(Once, IRInstruction::CondBr), 0u);
+  EXPECT_EQ(countOpcode(Once, IRInstruction::Add), 1u);
+  EXPECT_TRUE(InLoop->isInternal());
+  EXPECT_FALSE(getFunction(M.get(), "step")->isInternal());
+
+  // The call with a variable mode keeps the original
+  std::map<std::string, size_t> Calls;
+  for (const auto& BB : getFunction(M.get(), "main")->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      if (auto* Call = dynamic_cast<IRCallInst*>(Inst.get())) {
+        ++Calls[Call->getFuncName()];
+      }
+    }
+  }
+  EXPECT_EQ(Calls["step"], 1u);
+  EXPECT_EQ(Calls["step.spec0"], 1u);
+  EXPECT_EQ(Calls["step.spec1"], 1u);
+}
+
+TEST_F(TransformTest, SpecializationRespectsBudget) {
+  auto M = compile(SpecializeSource);
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<FunctionSpecializationPass>(
+      /*MaxClones=*/1, 400, 100, /*MinWeight=*/1));
+  PM.run(M.get());
+  EXPECT_NE(getFunction(M.get(), "step.spec0"), nullptr);
+  EXPECT_EQ(getFunction(M.get(), "step.spec1"), nullptr);
+
+  auto M2 = compile(SpecializeSource);
+  PassManager PM2;
+  PM2.addPass(std::make_unique<Mem2RegPass>());
+  PM2.addPass(std::make_unique<FunctionSpecializationPass>(3, /*SizeBudget=*/5));
+  PM2.run(M2.get());
+  EXPECT_EQ(M2->getFunctions().size(), 2u);
+}
+
+TEST_F(TransformTest, SpecializationSkipsColdCalls) {
+  auto M = compile(SpecializeSource);
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<FunctionSpecializationPass>());
+  EXPECT_TRUE(PM.run(M.get()));
+  ASSERT_TRUE(verify(M.get()));
+
+  // Only the call in the loop is hot enough; step(s, 0) runs once
+  EXPECT_NE(getFunction(M.get(), "step.spec0"), nullptr);
+  EXPECT_EQ(getFunction(M.get(), "step.spec1"), nullptr);
+}
+
+TEST_F(TransformTest, GlobalDCERemovesUnreferencedInternals) {
+  auto M = compile(
+      "int counter = 5;\n"
+      "static int used = 7;\n"
+      "static int unused = 3;\n"
+      "static int helper(int x) { return x + used; }\n"
+      "static int dead(int x) { return x * 2; }\n"
+      "static int deadCaller(int x) { return dead(x); }\n"
+      "int api(int x) { counter = counter + 1; return helper(x); }\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<GlobalDCEPass>());
+  EXPECT_TRUE(PM.run(M.get()));
+  ASSERT_TRUE(verify(M.get()));
+
+  // Functions only reachable from dead functions go too
+  EXPECT_NE(getFunction(M.get(), "api"), nullptr);
+  EXPECT_NE(getFunction(M.get(), "helper"), nullptr);
+  EXPECT_EQ(getFunction(M.get(), "dead"), nullptr);
+  EXPECT_EQ(getFunction(M.get(), "deadCaller"), nullptr);
+
+  std::set<std::string> Globals;
+  for (const auto& G : M->getGlobals()) Globals.insert(G->getName());
+  EXPECT_EQ(Globals, (std::set<std::string>{"counter", "used"}));
+}
+
+TEST_F(TransformTest, GlobalDCEKeepsExternalSymbols) {
+  auto M = compile(
+      "int exported = 1;\n"
+      "int unusedApi(int x) { return x; }\n"
+      "static int local(int x) { return x + exported; }\n"
+      "int main() { return local(2); }\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<GlobalDCEPass>());
+  EXPECT_FALSE(PM.run(M.get()));
+  EXPECT_EQ(M->getFunctions().size(), 3u);
+  EXPECT_EQ(M->getGlobals().size(), 1u);
+  EXPECT_TRUE(getFunction(M.get(), "local")->isInternal());
+}
+
+TEST_F(TransformTest, SwitchDropsCodeBeforeFirstLabel) {
+  auto M = compile(
+      "int f(int x, int n) {\n"
+      "  int r = 0;\n"
+      "  switch (x) {\n"
+      "    r = 5;\n"
+      "    while (n > 0) { r = r + 7; n = n - 1; }\n"
+      "  case 1: r = r + 1; break;\n"
+      "  case 2: r = 2;\n"
+      "  }\n"
+      "  return r;\n"
+      "}\n");
+  ASSERT_TRUE(verify(M.get()));
+
+  // Neither the store of 5 nor the loop survives; case 1 and the default
+  // still reach the end
+  IRFunction* F = getFunction(M.get(), "f");
+  EXPECT_EQ(countOpcode(F, IRInstruction::CondBr), 0u);
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      auto* Store = dynamic_cast<IRStoreInst*>(Inst.get());
+      if (Store && Store->getValue()->isConstant()) {
+        EXPECT_NE(Store->getValue()->getConstant(), 5);
+      }
+    }
+  }
+  auto* Switch = dynamic_cast<IRSwitchInst*>(F->getBlocks()[0]->getTerminator());
+  ASSERT_NE(Switch, nullptr);
+  EXPECT_EQ(Switch->getCases().size(), 2u);
+}
+
+TEST_F(TransformTest, FunctionAttrsInfersMemoryEffects) {
+  auto M = compile(
+      "int g;\n"
+      "int ext(int x);\n"
+      "int sq(int x) { int t = x; return t * t; }\n"
+      "int rd(int x) { return sq(x) + g; }\n"
+      "int wr(int x) { g = x; return x; }\n"
+      "int callsExt(int x) { return ext(x); }\n"
+      "int div(int x, int y) { return x / y; }\n"
+      "int spin(int n) { while (n > 0) n = n - 1; return n; }\n"
+      "int fact(int n) { if (n < 2) return 1; return n * fact(n - 1); }\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<FunctionAttrsPass>());
+  EXPECT_TRUE(PM.run(M.get()));
+
+  const unsigned Pure = FA_ReadNone | FA_NoUnwind | FA_WillReturn;
+  // Its own stack slot does not count as memory
+  EXPECT_EQ(getFunction(M.get(), "sq")->getAttrs(), Pure | FA_Speculatable);
+  EXPECT_EQ(getFunction(M.get(), "rd")->getAttrs(),
+            FA_ReadOnly | FA_NoUnwind | FA_WillReturn);
+  EXPECT_EQ(getFunction(M.get(), "wr")->getAttrs(),
+            FA_NoUnwind | FA_WillReturn);
+  EXPECT_EQ(getFunction(M.get(), "callsExt")->getAttrs(), 0u);
+  // Division by an unknown value may trap
+  EXPECT_EQ(getFunction(M.get(), "div")->getAttrs(), Pure);
+  // Loops and recursion may not terminate
+  EXPECT_EQ(getFunction(M.get(), "spin")->getAttrs(),
+            FA_ReadNone | FA_NoUnwind);
+  EXPECT_EQ(getFunction(M.get(), "fact")->getAttrs(),
+            FA_ReadNone | FA_NoUnwind);
+
+  // Call sites carry their callee's attributes
+  for (const auto& BB : getFunction(M.get(), "rd")->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      if (auto* Call = dynamic_cast<IRCallInst*>(Inst.get())) {
+        EXPECT_TRUE(Call->isRemovable());
+      }
+    }
+  }
+}
+
+TEST_F(TransformTest, FunctionAttrsEnablesCallOptimizations) {
+  auto M = compile(
+      "int g;\n"
+      "int sq(int x) { return x * x; }\n"
+      "int rd(int x) { return x + g; }\n"
+      "int wr(int x) { g = x; return x; }\n"
+      "int f(int k, int n) {\n"
+      "  int s = 0;\n"
+      "  sq(k);\n"
+      "  wr(k);\n"
+      "  s = rd(1) + rd(1);\n"
+      "  wr(2);\n"
+      "  s = s + rd(1);\n"
+      "  while (n > 0) { s = s + sq(k); n = n - 1; }\n"
+      "  return s;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<FunctionAttrsPass>());
+  PM.addPass(std::make_unique<GVNPass>());
+  PM.addPass(std::make_unique<DCEPass>());
+  PM.addPass(std::make_unique<LICMPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // The unused sq(k) is gone, the second rd(1) reuses the first, and the
+  // store in wr(2) forces the third to stay
+  IRFunction* F = getFunction(M.get(), "f");
+  std::map<std::string, size_t> Calls;
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      if (auto* Call = dynamic_cast<IRCallInst*>(Inst.get())) {
+        ++Calls[Call->getFuncName()];
+      }
+    }
+  }
+  EXPECT_EQ(Calls["sq"], 1u);
+  EXPECT_EQ(Calls["rd"], 2u);
+  EXPECT_EQ(Calls["wr"], 2u);
+
+  // The sq(k) in the loop moved out of it
+  LoopInfo LI;
+  LI.run(F);
+  ASSERT_EQ(LI.getTopLevelLoops().size(), 1u);
+  for (IRBasicBlock* BB : LI.getTopLevelLoops()[0]->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      EXPECT_EQ(dynamic_cast<IRCallInst*>(Inst.get()), nullptr);
+    }
+  }
+}
+
+TEST_F(TransformTest, ADCEDeletesDeadLoopsAndBranches) {
+  auto M = compile(
+      "int g;\n"
+      "int f(int n, int x) {\n"
+      "  int i; int s = 0; int t = 0;\n"
+      "  for (i = 0; i < n; i = i + 1) { s = s + i * x; }\n"
+      "  if (x > 3) { t = x / 2; } else { t = x + 1; }\n"
+      "  if (n > 2) { g = 1; }\n"
+      "  return x;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<ADCEPass>());
+  EXPECT_TRUE(PM.run(M.get()));
+  ASSERT_TRUE(verify(M.get()));
+
+  // Only the branch guarding the store survives
+  IRFunction* F = getFunction(M.get(), "f");
+  EXPECT_EQ(countOpcode(F, IRInstruction::CondBr), 1u);
+  EXPECT_EQ(countOpcode(F, IRInstruction::Phi), 0u);
+  EXPECT_EQ(countOpcode(F, IRInstruction::Div), 0u);
+  EXPECT_EQ(countOpcode(F, IRInstruction::Store), 1u);
+
+  LoopInfo LI;
+  LI.run(F);
+  EXPECT_TRUE(LI.getTopLevelLoops().empty());
+}
+
+TEST_F(TransformTest, ADCEKeepsLoopsWithEffects) {
+  auto M = compile(
+      "int g;\n"
+      "int f(int n) {\n"
+      "  int s = 0;\n"
+      "  while (n > 0) { s = s + n; n = n - 1; }\n"
+      "  while (n < 10) { g = n; n = n + 1; }\n"
+      "  return s;\n"
+      "}\n"
+      "int spin(int n) {\n"
+      "  int s = 0; int i;\n"
+      "  for (i = 0; i < n; i = i + 1) { s = s + i; }\n"
+      "  while (1) { g = n; }\n"
+      "  return s;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<SCCPPass>());
+  PM.addPass(std::make_unique<ADCEPass>());
+  PM.run(M.get());
+  ASSERT_TRUE(verify(M.get()));
+
+  // The first loop computes the result, the second stores
+  LoopInfo LI;
+  LI.run(getFunction(M.get(), "f"));
+  EXPECT_EQ(LI.getTopLevelLoops().size(), 2u);
+
+  // The loop that never exits stays; the one in front of it, whose result
+  // is never returned, does not
+  LI.run(getFunction(M.get(), "spin"));
+  EXPECT_EQ(LI.getTopLevelLoops().size(), 1u);
+  EXPECT_EQ(countOpcode(getFunction(M.get(), "spin"), IRInstruction::Store),
+            1u);
+}
+
+TEST_F(TransformTest, PostDominatorTreeHasVirtualExit) {
+  auto M = compile(
+      "int g;\n"
+      "int f(int x) {\n"
+      "  int r = 0;\n"
+      "  if (x > 0) { r = 1; } else { r = 2; }\n"
+      "  if (r > 1) return r;\n"
+      "  return 0;\n"
+      "}\n"
+      "int spin(int n) {\n"
+      "  if (n > 0) { while (1) { g = n; } }\n"
+      "  return n;\n"
+      "}\n");
+
+  // Two returns meet only at the virtual exit
+  IRFunction* F = getFunction(M.get(), "f");
+  PostDominatorTree PDT;
+  PDT.run(F);
+  IRBasicBlock* Entry = F->getBlocks()[0].get();
+  IRBasicBlock* Join = findBlock(F, "endif2");
+  EXPECT_EQ(PDT.getRoot()->Block, nullptr);
+  EXPECT_EQ(PDT.getIPDom(Entry), Join);
+  EXPECT_EQ(PDT.getIPDom(findBlock(F, "then0")), Join);
+  EXPECT_EQ(PDT.getIPDom(Join), nullptr);
+  EXPECT_TRUE(PDT.postDominates(Join, findBlock(F, "else1")));
+  EXPECT_FALSE(PDT.postDominates(findBlock(F, "then3"), Join));
+  EXPECT_FALSE(PDT.postDominates(findBlock(F, "then0"), Entry));
+
+  // Once the loop cannot exit it hangs off the virtual exit too
+  F = getFunction(M.get(), "spin");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<SCCPPass>());
+  PM.run(F);
+  PDT.run(F);
+  IRBasicBlock* Cond = findBlock(F, "while_cond3");
+  IRBasicBlock* Body = findBlock(F, "while_body4");
+  ASSERT_NE(Cond, nullptr);
+  ASSERT_NE(Body, nullptr);
+  EXPECT_NE(PDT.getNode(Cond)->DFSIn, 0u);
+  EXPECT_TRUE(PDT.postDominates(Body, Cond));
+  EXPECT_FALSE(PDT.postDominates(Body, F->getBlocks()[0].get()));
+  EXPECT_EQ(PDT.getIPDom(F->getBlocks()[0].get()), nullptr);
+}
+
+TEST_F(TransformTest, GCMSinksAndHoists) {
+  auto M = compile(
+      "int g;\n"
+      "int f(int a, int b, int n) {\n"
+      "  int i; int s = 0;\n"
+      "  int t = a * b + 7;\n"
+      "  int q = a / b;\n"
+      "  for (i = 0; i < n; i = i + 1) { s = s + (a * 3 - b); }\n"
+      "  if (n > 100) { g = t; }\n"
+      "  if (n > 200) { g = q; }\n"
+      "  return s;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.addPass(std::make_unique<GCMPass>());
+  EXPECT_TRUE(PM.run(M.get()));
+  ASSERT_TRUE(verify(M.get()));
+
+  IRFunction* F = getFunction(M.get(), "f");
+  LoopInfo LI;
+  LI.run(F);
+  for (const auto& BB : F->getBlocks()) {
+    for (const auto& Inst : BB->getInstructions()) {
+      auto* BinOp = dynamic_cast<IRBinaryInst*>(Inst.get());
+      if (!BinOp) continue;
+      switch (BinOp->getOpcode()) {
+        case IRInstruction::Mul:
+          // a * 3 leaves the loop, a * b moves to the only arm using it
+          if (BinOp->getRHS()->isConstant()) {
+            EXPECT_EQ(LI.getLoopDepth(BB.get()), 0u);
+          } else {
+            EXPECT_EQ(BB->getName(), "then4");
+          }
+          break;
+        case IRInstruction::Div:
+          // A division that may trap stays where it was written
+          EXPECT_EQ(BB.get(), F->getBlocks()[0].get());
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+TEST_F(TransformTest, SplitCriticalEdgesGivesPhiCopiesAHome) {
+  auto M = compile(
+      "int f(int n) {\n"
+      "  int s = 0; int i = 0;\n"
+      "  while (i < n) { if (i == 3) { s = 100; break; } s = s + i; i = i + 1; }\n"
+      "  return s;\n"
+      "}\n");
+  PassManager PM;
+  PM.addPass(std::make_unique<Mem2RegPass>());
+  PM.run(M.get());
+
+  IRFunction* F = getFunction(M.get(), "f");
+  size_t NumBlocks = F->getBlocks().size();
+  EXPECT_TRUE(splitCriticalEdges(F));
+  EXPECT_GT(F->getBlocks().size(), NumBlocks);
+  EXPECT_FALSE(splitCriticalEdges(F));
+  ASSERT_TRUE(verify(M.get()));
+
+  // Every phi edge now has a block of its own to hold the copies
+  for (const auto& BB : F->getBlocks()) {
+    auto* Phi = dynamic_cast<IRPhiInst*>(BB->getInstructions().front().get());
+    if (!Phi) continue;
+    for (const auto& Entry : Phi->getIncomings()) {
+      EXPECT_TRUE(phiCopiesGoInPredecessor(Entry.Block) ||
+                  BB->getNumPredecessors() == 1)
+          << Entry.Block->getName() << " -> " << BB->getName();
+    }
+  }
+}
@@ -5,6 +5,7 @@
 #include "yac/CodeGen/IRBuilder.h"
 #include "yac/CodeGen/IRVerifier.h"
 #include "yac/CodeGen/Pass.h"
+#include "yac/CodeGen/Pipeline.h"
 #include "yac/CodeGen/Transforms.h"
 #include "yac/CodeGen/X86_64Backend.h"
 #include "yac/Parse/Lexer.h"
@@ -34,7 +35,10 @@ void printUsage(const char* progName) {
             << "  --verify-each        Verify IR after each pass\n"
             << "  -fsyntax-only        Check syntax only\n"
             << "  -ftime-report        Report per-pass timing statistics\n"
-            << "  -O<level>            Optimization level (0-3, default: 0)\n";
+            << "  -stats               Report backend statistics\n"
+            << "  -O<level>            Optimization level (0-3, default: 0)\n"
+            << "  -regalloc=<kind>     Register allocator: linear or color\n"
+            << "                       (default: color at -O3, linear below)\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -53,9 +57,11 @@ int main(int argc, char* argv[]) {
   bool verifyIR = false;
   bool verifyEach = false;
   bool timeReport = false;
+  bool printStats = false;
   bool emitIR = false;
   bool emitAsm = false;
   int optLevel = 0;
+  std::string regAlloc;
   (void)dumpAST;                  // Suppress unused warning for now
   (void)syntaxOnly;               // Suppress unused warning for now
 
@@ -80,6 +86,8 @@ int main(int argc, char* argv[]) {
       syntaxOnly = true;
     } else if (arg == "-ftime-report") {
       timeReport = true;
+    } else if (arg == "-stats") {
+      printStats = true;
     } else if (arg == "-emit-ir") {
       emitIR = true;
     } else if (arg == "-S" || arg == "-emit-asm") {
@@ -92,6 +100,12 @@ int main(int argc, char* argv[]) {
         std::cerr << "Invalid optimization level: " << arg << "\n";
         return 1;
       }
+    } else if (arg.substr(0, 10) == "-regalloc=") {
+      regAlloc = arg.substr(10);
+      if (regAlloc != "linear" && regAlloc != "color") {
+        std::cerr << "Invalid register allocator: " << regAlloc << "\n";
+        return 1;
+      }
     } else if (arg[0] != '-') {
       inputFile = arg;
     }
@@ -198,35 +212,7 @@ int main(int argc, char* argv[]) {
     PM.setEnableTiming(timeReport);
 
     // Configure passes based on optimization level
-    if (optLevel >= 1) {
-      // -O1: Basic optimizations
-      PM.addPass(std::make_unique<SimplifyCFGPass>());
-      PM.addPass(std::make_unique<Mem2RegPass>());
-      PM.addPass(std::make_unique<CopyPropagationPass>());
-      PM.addPass(std::make_unique<ConstantPropagationPass>());
-      PM.addPass(std::make_unique<DCEPass>());
-    }
-
-    if (optLevel >= 2) {
-      // -O2: More aggressive optimizations with advanced passes
-      PM.addPass(std::make_unique<SimplifyCFGPass>());
-      PM.addPass(std::make_unique<SCCPPass>());           // Sparse conditional constant propagation
-      PM.addPass(std::make_unique<GVNPass>());            // Global value numbering (CSE)
-      PM.addPass(std::make_unique<CopyPropagationPass>());
-      PM.addPass(std::make_unique<DCEPass>());
-      PM.addPass(std::make_unique<LICMPass>());           // Loop invariant code motion
-      PM.addPass(std::make_unique<SimplifyCFGPass>());    // Cleanup after LICM
-    }
-
-    if (optLevel >= 3) {
-      // -O3: Maximum optimizations (additional rounds)
-      PM.addPass(std::make_unique<SCCPPass>());
-      PM.addPass(std::make_unique<GVNPass>());
-      PM.addPass(std::make_unique<CopyPropagationPass>());
-      PM.addPass(std::make_unique<DCEPass>());
-      PM.addPass(std::make_unique<LICMPass>());
-      PM.addPass(std::make_unique<SimplifyCFGPass>());
-    }
+    addOptimizationPasses(PM, optLevel);
 
     // Run passes
     bool Changed = PM.run(IR.get());
@@ -333,11 +319,23 @@ int main(int argc, char* argv[]) {
     asmOut << "# Generated by YAC Compiler v0.5.0\n";
     asmOut << "# Optimization level: -O" << optLevel << "\n\n";
 
-    X86_64Backend Backend(asmOut);
+    // Graph coloring costs more compile time; it pays off at -O3
+    if (regAlloc.empty()) regAlloc = optLevel >= 3 ? "color" : "linear";
+    X86_64Backend Backend(asmOut, regAlloc == "color"
+                                    ? RegAllocKind::GraphColoring
+                                    : RegAllocKind::LinearScan);
     Backend.generateAssembly(IR.get());
 
     asmOut.close();
 
+    if (printStats) {
+      std::cout << "\n--- Backend Statistics ---\n";
+      for (const auto& [Name, Bytes] : Backend.getFrameBytesSaved()) {
+        std::cout << "  " << Name << ": " << Bytes
+                  << " frame bytes saved by stack slot coloring\n";
+      }
+    }
+
     std::cout << "✓ Assembly written to: " << asmFile << "\n";
   }
 